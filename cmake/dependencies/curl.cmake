@@ -11,6 +11,7 @@ if (NOT TARGET CURL::libcurl)
     )
     set(BUILD_TESTING OFF CACHE BOOL "Turn off testing" FORCE)
     set(BUILD_CURL_EXE OFF CACHE BOOL "Turn off curl executable" FORCE)
+    set(ENABLE_WEBSOCKETS ON CACHE BOOL "Turn on WebSocket support (required by WebSocketTransferHandle)" FORCE)
 
     if (WIN32)
         set(CURL_USE_SCHANNEL ON CACHE BOOL "Use schannel to build libcurl" FORCE)
@@ -5,6 +5,9 @@
     #pkg_check_modules(Mosquitto IMPORTED_TARGET libmosquittopp REQUIRED)
 #endif()
 
+# libmosquitto uses OpenSSL for TLS, MqttClient queries the SSL objects of its connections
+find_package(OpenSSL REQUIRED)
+
 file (DOWNLOAD
    https://test.mosquitto.org/ssl/mosquitto.org.crt
    ${CMAKE_BINARY_DIR}/mosquitto.org.crt
@@ -2,6 +2,7 @@
 #ifdef CURL_AVAILABLE
 #include "ftp_transfer_handle.h"
 #include "http_transfer_handle.h"
+#include "transfer_handle_pool.h"
 #endif
 #include <spdlog/spdlog.h>
 
@@ -22,7 +23,7 @@ ApplicationEngine::ApplicationEngine(const slint::ComponentHandle<AppWindow> &ap
 	InitCounterDemo(appWindow->global<CounterSingleton>());
 
 #ifdef CURL_AVAILABLE
-	const auto &networkAccessManager = NetworkAccessManager::instance();
+	auto &networkAccessManager = NetworkAccessManager::instance();
 	InitHttpDemo(appWindow->global<HttpSingleton>(), networkAccessManager);
 	InitFtpDemo(appWindow->global<FtpSingleton>(), networkAccessManager);
 #else
@@ -56,23 +57,26 @@ void ApplicationEngine::InitCounterDemo(const CounterSingleton &uiPageCounter)
 }
 
 #ifdef CURL_AVAILABLE
-void ApplicationEngine::InitHttpDemo(const HttpSingleton &httpSingleton, const INetworkAccessManager &networkAccessManager)
+void ApplicationEngine::InitHttpDemo(const HttpSingleton &httpSingleton, NetworkAccessManager &networkAccessManager)
 {
 	httpSingleton.set_url("https://example.com");
-	auto startHttpQuery = [&]() {
-		const auto url = Url(httpSingleton.get_url().data());
-		auto *httpTransfer = new HttpTransferHandle(url, true);
-
-		httpTransfer->finished.connect([=, &httpSingleton](int result) {
-			const auto fetchedContent =
-				(result == CURLcode::CURLE_OK)
-					? slint::SharedString(httpTransfer->dataRead())
-					: slint::SharedString("Download failed");
-			httpSingleton.set_fetched_content(fetchedContent);
-			httpTransfer->deleteLater();
-		});
 
-		networkAccessManager.registerTransfer(*httpTransfer);
+	// the coroutine frame owns the transfer, no handle needs to be deleted manually.
+	// reassigning httpQuery destroys a still running query and thereby cancels its transfer.
+	static TransferTask httpQuery;
+
+	auto fetchContent = [](const HttpSingleton &httpSingleton, NetworkAccessManager &networkAccessManager, Url url) -> TransferTask {
+		const auto response = co_await networkAccessManager.get(url, true);
+		const auto fetchedContent =
+			response.isOk()
+				? slint::SharedString(response.data)
+				: slint::SharedString("Download failed");
+		httpSingleton.set_fetched_content(fetchedContent);
+	};
+
+	auto startHttpQuery = [&, fetchContent]() {
+		const auto url = Url(httpSingleton.get_url().data());
+		httpQuery = fetchContent(httpSingleton, networkAccessManager, url);
 	};
 	httpSingleton.on_request_http_query(startHttpQuery);
 }
@@ -85,40 +89,48 @@ void ApplicationEngine::InitFtpDemo(const FtpSingleton &ftpSingleton, const INet
 	ftpSingleton.set_url_download("ftp://ftp-stud.hs-esslingen.de/debian/ls-lR.gz");
 	ftpSingleton.set_url_upload("ftp://ftp.cs.brown.edu/incoming/ls-lR.gz");
 
+	// transfer handles return to their pool after finished was emitted, no handle needs to be deleted manually
+	static TransferHandlePool<FtpDownloadTransferHandle> ftpDownloadPool(networkAccessManager);
+	static TransferHandlePool<FtpUploadTransferHandle> ftpUploadPool(networkAccessManager);
+
 	auto startFtpDownload = [&]() {
 		const auto &url = Url(ftpSingleton.get_url_download().data());
-		auto ftpDownloadTransfer = new FtpDownloadTransferHandle(ftpFile, url, false);
+		auto ftpDownloadTransfer = ftpDownloadPool.start(ftpFile, url, false);
+		if (!ftpDownloadTransfer) {
+			return;
+		}
 
-		ftpDownloadTransfer->finished.connect([=, &ftpSingleton]() {
-			spdlog::info("FtpDownloadTransferHandle::finished() - downloaded {} bytes", ftpDownloadTransfer->numberOfBytesTransferred.get());
-			ftpSingleton.set_is_downloading(false);
-			ftpDownloadTransfer->deleteLater();
+		auto progressConnection = ftpDownloadTransfer->progressPercent.valueChanged().connect([&ftpSingleton](const int &progressPercent) {
+			ftpSingleton.set_progress_percent_download(progressPercent);
 		});
 
-		ftpDownloadTransfer->progressPercent.valueChanged().connect([&ftpSingleton](const int &progressPercent) {
-			ftpSingleton.set_progress_percent_download(progressPercent);
+		ftpDownloadTransfer->finished.connect([=, &ftpSingleton]() mutable {
+			spdlog::info("FtpDownloadTransferHandle::finished() - downloaded {} bytes", ftpDownloadTransfer->numberOfBytesTransferred.get());
+			ftpSingleton.set_is_downloading(false);
+			progressConnection.disconnect();
 		});
 
-		networkAccessManager.registerTransfer(*ftpDownloadTransfer);
 		ftpSingleton.set_is_downloading(true);
 	};
 	ftpSingleton.on_request_ftp_download(startFtpDownload);
 
 	auto startFtpUpload = [&]() {
 		const auto &url = Url(ftpSingleton.get_url_upload().data());
-		auto ftpUploadTransfer = new FtpUploadTransferHandle(ftpFile, url, true);
+		auto ftpUploadTransfer = ftpUploadPool.start(ftpFile, url, true);
+		if (!ftpUploadTransfer) {
+			return;
+		}
 
-		ftpUploadTransfer->finished.connect([=, &ftpSingleton]() {
-			spdlog::info("FtpUploadTransferHandle::finished() - uploaded {} bytes", ftpUploadTransfer->numberOfBytesTransferred.get());
-			ftpSingleton.set_is_uploading(false);
-			ftpUploadTransfer->deleteLater();
+		auto progressConnection = ftpUploadTransfer->progressPercent.valueChanged().connect([&ftpSingleton](const int &progressPercent) {
+			ftpSingleton.set_progress_percent_upload(progressPercent);
 		});
 
-		ftpUploadTransfer->progressPercent.valueChanged().connect([&ftpSingleton](const int &progressPercent) {
-			ftpSingleton.set_progress_percent_upload(progressPercent);
+		ftpUploadTransfer->finished.connect([=, &ftpSingleton]() mutable {
+			spdlog::info("FtpUploadTransferHandle::finished() - uploaded {} bytes", ftpUploadTransfer->numberOfBytesTransferred.get());
+			ftpSingleton.set_is_uploading(false);
+			progressConnection.disconnect();
 		});
 
-		networkAccessManager.registerTransfer(*ftpUploadTransfer);
 		ftpSingleton.set_is_uploading(true);
 	};
 	ftpSingleton.on_request_ftp_upload(startFtpUpload);
@@ -196,11 +208,11 @@ void ApplicationEngine::InitMqttDemo(const MqttSingleton &mqttSingleton, IMqttCl
 	};
 	mqttClient.subscriptions.valueChanged().connect(onMqttSubscriptionsChanged);
 
-	auto onMqttMessageReceived = [&](const mosquitto_message *message) {
+	auto onMqttMessageReceived = [&](const MqttMessageView &message) {
 		const auto timestamp = std::time(nullptr);
 		const auto timestring = std::string(std::asctime(std::localtime(&timestamp)));
-		const auto topic = std::string(message->topic);
-		const auto payload = std::string(static_cast<char*>(message->payload));
+		const auto topic = std::string(message.topic);
+		const auto payload = std::string(message.payloadAsString());
 		mqttSingleton.set_message(slint::SharedString(timestring.substr(0, timestring.size()-1) + " - " + topic + " - " + payload));
 	};
 	mqttClient.msgReceived.connect(onMqttMessageReceived);
@@ -26,7 +26,7 @@ class ApplicationEngine
   private:
 	static void InitCounterDemo(const CounterSingleton &uiPageCounter);
 #ifdef CURL_AVAILABLE
-	static void InitHttpDemo(const HttpSingleton &httpSingleton, const INetworkAccessManager &networkAccessManager);
+	static void InitHttpDemo(const HttpSingleton &httpSingleton, NetworkAccessManager &networkAccessManager);
 	static void InitFtpDemo(const FtpSingleton &ftpSingleton, const INetworkAccessManager &networkAccessManager);
 #endif
 #ifdef MOSQUITTO_AVAILABLE
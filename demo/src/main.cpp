@@ -1,5 +1,6 @@
 #include "application_engine/application_engine.h"
 #include "kdgui_slint_integration.h"
+#include "metrics_exporter.h"
 
 int main()
 {
@@ -25,6 +26,13 @@ int main()
 
 	ApplicationEngine::init(slintApp);
 
+#if defined(__linux__)
+	// step 4: serve metrics of all integrations on demand, e.g. via
+	// curl --abstract-unix-socket mecaps_demo_metrics http://localhost/metrics
+	MetricsExporter metricsExporter;
+	metricsExporter.listen("@mecaps_demo_metrics");
+#endif
+
 	slintApp->run();
 
 	return 0;
@@ -1,5 +1,7 @@
+#include "metrics_registry.h"
 #include "window_adapter.h"
 #include <KDGui/gui_application.h>
+#include <chrono>
 #include <slint-platform.h>
 #include <thread>
 
@@ -38,7 +40,9 @@ class KDSlintPlatform : public slint_platform::Platform
 					// can submit to it without causing deadlock
 					lock.unlock();
 					while (true) {
+						const auto updateStart = std::chrono::steady_clock::now();
 						slint_platform::update_timers_and_animations();
+						m_updateDuration.observe(secondsSince(updateStart));
 
 						auto maxAcceptableTimeout =
 							slint_platform::duration_until_next_timer_update();
@@ -61,11 +65,14 @@ class KDSlintPlatform : public slint_platform::Platform
 
 				event = std::move(m_events.front());
 				m_events.pop_front();
+				m_pendingTasks.set(static_cast<std::int64_t>(m_events.size()));
 			}
 
 			if (event) {
+				const auto taskStart = std::chrono::steady_clock::now();
 				std::move(*event).run();
 				event.reset();
+				m_taskDuration.observe(secondsSince(taskStart));
 			}
 		}
 
@@ -83,6 +90,7 @@ class KDSlintPlatform : public slint_platform::Platform
 	{
 		const std::unique_lock lock(the_mutex);
 		m_events.push_back(std::move(event));
+		m_pendingTasks.set(static_cast<std::int64_t>(m_events.size()));
 		m_slintStateChanged = true;
 		KDFoundation::CoreApplication::instance()->eventLoop()->wakeUp();
 	}
@@ -95,6 +103,11 @@ class KDSlintPlatform : public slint_platform::Platform
 	}
 
   private:
+	static double secondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
 	std::mutex the_mutex; // owns m_needsToQuit and m_events
 	bool m_needsToQuit = false;
 	std::deque<slint_platform::Platform::Task> m_events;
@@ -102,5 +115,16 @@ class KDSlintPlatform : public slint_platform::Platform
 	std::atomic<bool> m_slintStateChanged;
 
 	std::unique_ptr<KDWindowAdapter> m_windowAdapter;
+
+	// exported via MetricsRegistry::instance(), long durations mean dropped frames
+	Histogram &m_updateDuration = MetricsRegistry::instance().histogram(
+		"slint_timers_and_animations_update_duration_seconds", "Duration of slint::platform::update_timers_and_animations()",
+		Histogram::exponentialBounds(0.0001, 2.0, 12));
+	Histogram &m_taskDuration = MetricsRegistry::instance().histogram(
+		"slint_event_loop_task_duration_seconds", "Duration of tasks run via slint::invoke_from_event_loop()",
+		Histogram::exponentialBounds(0.0001, 2.0, 12));
+	// updated from any thread calling run_in_event_loop()
+	Gauge &m_pendingTasks = MetricsRegistry::instance().gauge(
+		"slint_event_loop_pending_tasks", "Tasks waiting to be run by the event loop");
 };
 } // namespace mecaps
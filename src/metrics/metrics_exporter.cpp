@@ -0,0 +1,305 @@
+#include "metrics_exporter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <system_error>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr std::size_t c_maxNumberOfConnections = 8;
+constexpr std::size_t c_maxRequestSize = 8192;
+constexpr std::chrono::seconds c_requestTimeout { 5 };
+
+constexpr auto c_contentType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+std::string httpResponse(std::string_view status, std::string_view contentType, std::string_view body)
+{
+	std::string response = "HTTP/1.1 ";
+	response += status;
+	response += "\r\nContent-Type: ";
+	response += contentType;
+	response += "\r\nContent-Length: ";
+	response += std::to_string(body.size());
+	response += "\r\nConnection: close\r\n\r\n";
+	response += body;
+	return response;
+}
+
+}
+
+MetricsExporter::MetricsExporter(const MetricsRegistry &registry)
+	: m_registry{registry}
+{
+	m_cleanupTimer.interval.set(std::chrono::microseconds(1));
+	m_cleanupTimer.timeout.connect([this]() {
+		m_cleanupTimer.running.set(false);
+		removeClosedConnections();
+	});
+
+	m_requestTimeoutTimer.interval.set(std::chrono::seconds(1));
+	m_requestTimeoutTimer.timeout.connect([this]() { closeTimedOutConnections(); });
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	close();
+}
+
+#ifndef _WIN32
+
+bool MetricsExporter::listen(const std::string &socketPath)
+{
+	spdlog::debug("MetricsExporter::listen() - {}", socketPath);
+
+	close();
+
+	sockaddr_un address {};
+	address.sun_family = AF_UNIX;
+	if (socketPath.empty() || (socketPath.size() >= sizeof(address.sun_path))) {
+		spdlog::error("MetricsExporter::listen() - invalid socket path {}", socketPath);
+		return true;
+	}
+	const auto isAbstract = (socketPath.front() == '@');
+	std::memcpy(address.sun_path, socketPath.data(), socketPath.size());
+	if (isAbstract) {
+		address.sun_path[0] = '\0';
+	}
+	// the name of an abstract socket has no terminating null
+	const auto addressSize = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + socketPath.size() + (isAbstract ? 0 : 1));
+
+	if (!isAbstract && std::filesystem::is_socket(socketPath)) {
+		::unlink(socketPath.c_str());
+	}
+
+	m_listeningSocket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (m_listeningSocket < 0) {
+		spdlog::error("MetricsExporter::listen() - socket() failed: {}", std::strerror(errno));
+		return true;
+	}
+	if ((::bind(m_listeningSocket, reinterpret_cast<const sockaddr*>(&address), addressSize) != 0)
+		|| (::listen(m_listeningSocket, static_cast<int>(c_maxNumberOfConnections)) != 0)) {
+		spdlog::error("MetricsExporter::listen() - cannot listen on {}: {}", socketPath, std::strerror(errno));
+		::close(m_listeningSocket);
+		m_listeningSocket = -1;
+		return true;
+	}
+
+	m_socketPath = socketPath;
+	m_listeningNotifier = std::make_unique<FileDescriptorNotifier>(m_listeningSocket, FileDescriptorNotifier::NotificationType::Read);
+	m_listeningNotifier->triggered.connect([this]() { onConnectionRequested(); });
+	return false;
+}
+
+void MetricsExporter::close()
+{
+	if (m_listeningSocket < 0) {
+		return;
+	}
+	spdlog::debug("MetricsExporter::close() - {}", m_socketPath);
+
+	for (auto &connection : m_connections) {
+		closeConnection(*connection);
+	}
+	removeClosedConnections();
+
+	m_listeningNotifier.reset();
+	::close(m_listeningSocket);
+	m_listeningSocket = -1;
+	if (!m_socketPath.starts_with('@')) {
+		::unlink(m_socketPath.c_str());
+	}
+	m_socketPath.clear();
+}
+
+void MetricsExporter::onConnectionRequested()
+{
+	while (true) {
+		const auto socket = ::accept4(m_listeningSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (socket < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+				spdlog::warn("MetricsExporter::onConnectionRequested() - accept() failed: {}", std::strerror(errno));
+			}
+			return;
+		}
+
+		const auto numberOfOpenConnections = std::ranges::count(m_connections, false, [](const auto &connection) { return connection->isClosed; });
+		if (static_cast<std::size_t>(numberOfOpenConnections) >= c_maxNumberOfConnections) {
+			spdlog::warn("MetricsExporter::onConnectionRequested() - too many connections, rejecting one");
+			::close(socket);
+			continue;
+		}
+
+		auto connection = std::make_unique<Connection>();
+		connection->socket = socket;
+		connection->acceptTime = std::chrono::steady_clock::now();
+		connection->readNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Read);
+		connection->readNotifier->triggered.connect([this, connection = connection.get()]() { onReadable(*connection); });
+		m_connections.push_back(std::move(connection));
+		m_requestTimeoutTimer.running = true;
+	}
+}
+
+void MetricsExporter::onReadable(Connection &connection)
+{
+	if (connection.isClosed) {
+		return;
+	}
+
+	char buffer[1024];
+	const auto numberOfBytes = ::recv(connection.socket, buffer, sizeof(buffer), 0);
+	if (numberOfBytes < 0) {
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+			closeConnection(connection);
+		}
+		return;
+	}
+	if (numberOfBytes == 0) {
+		closeConnection(connection);
+		return;
+	}
+	if (!connection.response.empty()) {
+		return; // request already answered, discard whatever follows
+	}
+
+	connection.request.append(buffer, static_cast<std::size_t>(numberOfBytes));
+	const auto isComplete = (connection.request.find("\r\n\r\n") != std::string::npos) || (connection.request.find("\n\n") != std::string::npos);
+	if (!isComplete) {
+		if (connection.request.size() > c_maxRequestSize) {
+			spdlog::warn("MetricsExporter::onReadable() - request too large");
+			closeConnection(connection);
+		}
+		return;
+	}
+
+	const auto isGetRequest = connection.request.starts_with("GET ");
+	connection.response = isGetRequest ? httpResponse("200 OK", c_contentType, m_registry.exposition())
+									   : httpResponse("405 Method Not Allowed", "text/plain; charset=utf-8", "Only GET is supported\n");
+	connection.request.clear();
+	onWritable(connection);
+}
+
+void MetricsExporter::onWritable(Connection &connection)
+{
+	if (connection.isClosed) {
+		return;
+	}
+
+	while (connection.numberOfBytesWritten < connection.response.size()) {
+		const auto numberOfBytes = ::send(connection.socket, connection.response.data() + connection.numberOfBytesWritten,
+										  connection.response.size() - connection.numberOfBytesWritten, MSG_NOSIGNAL);
+		if (numberOfBytes < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+				// continue once the client read some of the response
+				if (!connection.writeNotifier) {
+					connection.writeNotifier = std::make_unique<FileDescriptorNotifier>(connection.socket, FileDescriptorNotifier::NotificationType::Write);
+					connection.writeNotifier->triggered.connect([this, &connection]() { onWritable(connection); });
+				}
+				return;
+			}
+			closeConnection(connection);
+			return;
+		}
+		connection.numberOfBytesWritten += static_cast<std::size_t>(numberOfBytes);
+	}
+	closeConnection(connection);
+}
+
+void MetricsExporter::removeClosedConnections()
+{
+	std::erase_if(m_connections, [](const auto &connection) {
+		if (!connection->isClosed) {
+			return false;
+		}
+		// the notifiers have to be gone before their file descriptor is closed
+		connection->readNotifier.reset();
+		connection->writeNotifier.reset();
+		::close(connection->socket);
+		return true;
+	});
+	if (m_connections.empty()) {
+		m_requestTimeoutTimer.running = false;
+	}
+}
+
+#else
+
+bool MetricsExporter::listen(const std::string &socketPath)
+{
+	spdlog::error("MetricsExporter::listen() - Unix domain sockets are not supported on this platform");
+	return true;
+}
+
+void MetricsExporter::close()
+{
+}
+
+void MetricsExporter::onConnectionRequested()
+{
+}
+
+void MetricsExporter::onReadable(Connection &connection)
+{
+}
+
+void MetricsExporter::onWritable(Connection &connection)
+{
+}
+
+void MetricsExporter::removeClosedConnections()
+{
+}
+
+#endif
+
+bool MetricsExporter::isListening() const
+{
+	return m_listeningSocket >= 0;
+}
+
+bool MetricsExporter::writeFile(const std::string &filePath) const
+{
+	const auto temporaryFilePath = filePath + ".tmp";
+	{
+		const auto exposition = m_registry.exposition();
+		std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+		file.write(exposition.data(), static_cast<std::streamsize>(exposition.size()));
+		if (!file.flush()) {
+			spdlog::error("MetricsExporter::writeFile() - cannot write {}", temporaryFilePath);
+			return true;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temporaryFilePath, filePath, ec);
+	if (ec) {
+		spdlog::error("MetricsExporter::writeFile() - cannot replace {}: {}", filePath, ec.message());
+		return true;
+	}
+	return false;
+}
+
+void MetricsExporter::closeConnection(Connection &connection)
+{
+	connection.isClosed = true;
+	m_cleanupTimer.running = true;
+}
+
+void MetricsExporter::closeTimedOutConnections()
+{
+	const auto now = std::chrono::steady_clock::now();
+	for (auto &connection : m_connections) {
+		if (!connection->isClosed && (now - connection->acceptTime > c_requestTimeout)) {
+			spdlog::debug("MetricsExporter::closeTimedOutConnections() - closing idle connection");
+			closeConnection(*connection);
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <KDFoundation/file_descriptor_notifier.h>
+#include <KDFoundation/timer.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "metrics_registry.h"
+
+using namespace KDFoundation;
+
+/*
+ * Class: MetricsExporter
+ *
+ * Exports the snapshot of a MetricsRegistry on demand, either
+ * - as HTTP response to every request on a local Unix domain socket (see listen()),
+ *   e.g. "curl --unix-socket /run/app/metrics.sock http://localhost/metrics", or
+ * - into a file (see writeFile()), e.g. for the textfile collector of a node exporter.
+ * Connections are served by the event loop, the snapshot is taken when a request arrives.
+ */
+class MetricsExporter
+{
+  public:
+	explicit MetricsExporter(const MetricsRegistry &registry = MetricsRegistry::instance());
+	~MetricsExporter();
+
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter &operator=(const MetricsExporter&) = delete;
+
+	// a path starting with '@' names a socket in the abstract namespace (Linux), a stale socket
+	// file at socketPath is replaced; returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool listen(const std::string &socketPath);
+	// closes the socket and all of its connections
+	void close();
+	[[nodiscard]] bool isListening() const;
+
+	// replaces the file at once, a scraper never reads a partial snapshot; returns true in case of error
+	bool writeFile(const std::string &filePath) const;
+
+  private:
+	struct Connection
+	{
+		int socket;
+		std::chrono::steady_clock::time_point acceptTime;
+		std::string request;
+		std::string response;
+		std::size_t numberOfBytesWritten { 0 };
+		std::unique_ptr<FileDescriptorNotifier> readNotifier;
+		std::unique_ptr<FileDescriptorNotifier> writeNotifier;
+		bool isClosed { false };
+	};
+
+	void onConnectionRequested();
+	void onReadable(Connection &connection);
+	void onWritable(Connection &connection);
+	void closeConnection(Connection &connection);
+	void removeClosedConnections();
+	void closeTimedOutConnections();
+
+	const MetricsRegistry &m_registry;
+	std::string m_socketPath;
+	int m_listeningSocket { -1 };
+	std::unique_ptr<FileDescriptorNotifier> m_listeningNotifier;
+	std::vector<std::unique_ptr<Connection>> m_connections;
+
+	// connections are closed from within the slots of their notifiers -> deleted afterwards
+	Timer m_cleanupTimer;
+	Timer m_requestTimeoutTimer;
+};
@@ -0,0 +1,250 @@
+#include "metrics_registry.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+bool isValidMetricName(std::string_view name)
+{
+	const auto isValidCharacter = [](char c, bool isFirst) {
+		return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_') || (c == ':') || (!isFirst && (c >= '0') && (c <= '9'));
+	};
+	if (name.empty() || !isValidCharacter(name.front(), true)) {
+		return false;
+	}
+	return std::ranges::all_of(name.substr(1), [&](char c) { return isValidCharacter(c, false); });
+}
+
+bool isValidLabelName(std::string_view name)
+{
+	// "le" is added to the samples of histograms
+	return isValidMetricName(name) && (name.find(':') == std::string_view::npos) && (name != "le");
+}
+
+// escapes backslashes, double quotes (in label values only) and line feeds
+void appendEscaped(std::string &text, std::string_view value, bool escapeDoubleQuotes)
+{
+	for (const auto c : value) {
+		if (c == '\\') {
+			text += "\\\\";
+		}
+		else if (c == '\n') {
+			text += "\\n";
+		}
+		else if ((c == '"') && escapeDoubleQuotes) {
+			text += "\\\"";
+		}
+		else {
+			text.push_back(c);
+		}
+	}
+}
+
+void appendNumber(std::string &text, double value)
+{
+	if (std::isinf(value)) {
+		text += (value > 0) ? "+Inf" : "-Inf";
+		return;
+	}
+	if (std::isnan(value)) {
+		text += "NaN";
+		return;
+	}
+	std::array<char, 32> buffer;
+	const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+	text.append(buffer.data(), result.ptr);
+}
+
+void appendSample(std::string &text, std::string_view name, std::string_view suffix, std::string_view labels, std::string_view extraLabel, std::string_view value)
+{
+	text += name;
+	text += suffix;
+	if (!labels.empty() || !extraLabel.empty()) {
+		text.push_back('{');
+		text += labels;
+		if (!labels.empty() && !extraLabel.empty()) {
+			text.push_back(',');
+		}
+		text += extraLabel;
+		text.push_back('}');
+	}
+	text.push_back(' ');
+	text += value;
+	text.push_back('\n');
+}
+
+}
+
+Histogram::Histogram(std::vector<double> upperBounds)
+	: m_upperBounds{std::move(upperBounds)}
+{
+	std::ranges::sort(m_upperBounds);
+	const auto duplicates = std::ranges::unique(m_upperBounds);
+	m_upperBounds.erase(duplicates.begin(), duplicates.end());
+	// the +Inf bucket is implicit
+	std::erase_if(m_upperBounds, [](double bound) { return std::isinf(bound) || std::isnan(bound); });
+
+	m_bucketCounts = std::make_unique<std::atomic<std::uint64_t>[]>(m_upperBounds.size() + 1);
+}
+
+void Histogram::observe(double value)
+{
+	// buckets are "less than or equal" -> the first bound not less than value
+	const auto bucket = std::ranges::lower_bound(m_upperBounds, value) - m_upperBounds.begin();
+	m_bucketCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+const std::vector<double> &Histogram::upperBounds() const
+{
+	return m_upperBounds;
+}
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+	Snapshot snapshot;
+	snapshot.cumulativeCounts.reserve(m_upperBounds.size() + 1);
+	for (std::size_t i = 0; i <= m_upperBounds.size(); ++i) {
+		snapshot.count += m_bucketCounts[i].load(std::memory_order_relaxed);
+		snapshot.cumulativeCounts.push_back(snapshot.count);
+	}
+	// may already include values observed after the buckets were read
+	snapshot.sum = m_sum.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+std::vector<double> Histogram::exponentialBounds(double start, double factor, std::size_t count)
+{
+	std::vector<double> bounds;
+	bounds.reserve(count);
+	for (auto bound = start; bounds.size() < count; bound *= factor) {
+		bounds.push_back(bound);
+	}
+	return bounds;
+}
+
+MetricsRegistry &MetricsRegistry::instance()
+{
+	static MetricsRegistry s_instance;
+	return s_instance;
+}
+
+Counter &MetricsRegistry::counter(std::string_view name, std::string_view help, const MetricLabels &labels)
+{
+	return metric<Counter>(Type::COUNTER, name, help, labels);
+}
+
+Gauge &MetricsRegistry::gauge(std::string_view name, std::string_view help, const MetricLabels &labels)
+{
+	return metric<Gauge>(Type::GAUGE, name, help, labels);
+}
+
+Histogram &MetricsRegistry::histogram(std::string_view name, std::string_view help, std::vector<double> upperBounds, const MetricLabels &labels)
+{
+	return metric<Histogram>(Type::HISTOGRAM, name, help, labels, std::move(upperBounds));
+}
+
+template<typename Metric, typename... Args>
+Metric &MetricsRegistry::metric(Type type, std::string_view name, std::string_view help, const MetricLabels &labels, Args&&... args)
+{
+	std::string formattedLabels;
+	auto hasValidLabels = true;
+	for (const auto &[labelName, labelValue] : labels) {
+		hasValidLabels = hasValidLabels && isValidLabelName(labelName);
+		if (!formattedLabels.empty()) {
+			formattedLabels.push_back(',');
+		}
+		formattedLabels += labelName;
+		formattedLabels += "=\"";
+		appendEscaped(formattedLabels, labelValue, true);
+		formattedLabels.push_back('"');
+	}
+
+	const std::lock_guard lock(m_mutex);
+
+	auto unexportedMetric = [&]() -> Metric& {
+		m_unexportedSeries.push_back({ std::move(formattedLabels), std::make_unique<Metric>(std::forward<Args>(args)...) });
+		return *std::get<std::unique_ptr<Metric>>(m_unexportedSeries.back().metric);
+	};
+
+	if (!isValidMetricName(name) || !hasValidLabels) {
+		spdlog::error("MetricsRegistry::metric() - invalid name or labels of metric {}", name);
+		return unexportedMetric();
+	}
+
+	auto family = std::ranges::find(m_families, name, &Family::name);
+	if (family == m_families.end()) {
+		m_families.push_back({ std::string(name), std::string(help), type, {} });
+		family = std::prev(m_families.end());
+	}
+	else if (family->type != type) {
+		spdlog::error("MetricsRegistry::metric() - metric {} is already registered with another type", name);
+		return unexportedMetric();
+	}
+
+	auto series = std::ranges::find(family->series, formattedLabels, &Series::labels);
+	if (series == family->series.end()) {
+		family->series.push_back({ std::move(formattedLabels), std::make_unique<Metric>(std::forward<Args>(args)...) });
+		series = std::prev(family->series.end());
+	}
+	return *std::get<std::unique_ptr<Metric>>(series->metric);
+}
+
+std::string MetricsRegistry::exposition() const
+{
+	std::string text;
+	std::string value;
+
+	const std::lock_guard lock(m_mutex);
+	for (const auto &family : m_families) {
+		text += "# TYPE ";
+		text += family.name;
+		switch (family.type) {
+		case Type::COUNTER:
+			text += " counter\n";
+			break;
+		case Type::GAUGE:
+			text += " gauge\n";
+			break;
+		case Type::HISTOGRAM:
+			text += " histogram\n";
+			break;
+		}
+		if (!family.help.empty()) {
+			text += "# HELP ";
+			text += family.name;
+			text.push_back(' ');
+			appendEscaped(text, family.help, false);
+			text.push_back('\n');
+		}
+
+		for (const auto &series : family.series) {
+			if (const auto *counter = std::get_if<std::unique_ptr<Counter>>(&series.metric)) {
+				appendSample(text, family.name, "_total", series.labels, {}, std::to_string((*counter)->value()));
+			}
+			else if (const auto *gauge = std::get_if<std::unique_ptr<Gauge>>(&series.metric)) {
+				appendSample(text, family.name, {}, series.labels, {}, std::to_string((*gauge)->value()));
+			}
+			else {
+				const auto &histogram = *std::get<std::unique_ptr<Histogram>>(series.metric);
+				const auto snapshot = histogram.snapshot();
+				const auto &upperBounds = histogram.upperBounds();
+				for (std::size_t i = 0; i < snapshot.cumulativeCounts.size(); ++i) {
+					std::string boundLabel = "le=\"";
+					appendNumber(boundLabel, (i < upperBounds.size()) ? upperBounds[i] : INFINITY);
+					boundLabel.push_back('"');
+					appendSample(text, family.name, "_bucket", series.labels, boundLabel, std::to_string(snapshot.cumulativeCounts[i]));
+				}
+				value.clear();
+				appendNumber(value, snapshot.sum);
+				appendSample(text, family.name, "_sum", series.labels, {}, value);
+				appendSample(text, family.name, "_count", series.labels, {}, std::to_string(snapshot.count));
+			}
+		}
+	}
+	text += "# EOF\n";
+	return text;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+/*
+ * Class: Counter
+ *
+ * Monotonically increasing value, e.g. the number of finished transfers.
+ * Safe to update from any thread.
+ */
+class Counter
+{
+  public:
+	void increment(std::uint64_t value = 1) { m_value.fetch_add(value, std::memory_order_relaxed); }
+	[[nodiscard]] std::uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+  private:
+	std::atomic<std::uint64_t> m_value { 0 };
+};
+
+/*
+ * Class: Gauge
+ *
+ * Value going up and down, e.g. the number of running transfers.
+ * Safe to update from any thread.
+ */
+class Gauge
+{
+  public:
+	void set(std::int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+	void increment(std::int64_t value = 1) { m_value.fetch_add(value, std::memory_order_relaxed); }
+	void decrement(std::int64_t value = 1) { m_value.fetch_sub(value, std::memory_order_relaxed); }
+	[[nodiscard]] std::int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+  private:
+	std::atomic<std::int64_t> m_value { 0 };
+};
+
+/*
+ * Class: Histogram
+ *
+ * Distribution of observed values (e.g. durations in seconds) over buckets with fixed upper
+ * bounds, plus their count and sum. Safe to update from any thread.
+ */
+class Histogram
+{
+  public:
+	struct Snapshot
+	{
+		// per upper bound and one for +Inf, each including all smaller buckets
+		std::vector<std::uint64_t> cumulativeCounts;
+		std::uint64_t count { 0 };
+		double sum { 0.0 };
+	};
+
+	// upperBounds get sorted, the +Inf bucket is implicit
+	explicit Histogram(std::vector<double> upperBounds);
+
+	void observe(double value);
+
+	[[nodiscard]] const std::vector<double> &upperBounds() const;
+	[[nodiscard]] Snapshot snapshot() const;
+
+	// start, start * factor, start * factor^2, ... (count bounds)
+	static std::vector<double> exponentialBounds(double start, double factor, std::size_t count);
+
+  private:
+	std::vector<double> m_upperBounds;
+	std::unique_ptr<std::atomic<std::uint64_t>[]> m_bucketCounts;
+	std::atomic<double> m_sum { 0.0 };
+};
+
+/*
+ * Class: MetricsRegistry
+ *
+ * Process wide collection of counters, gauges and histograms, exported as OpenMetrics text
+ * (see exposition() and MetricsExporter), so that devices can be scraped instead of their logs
+ * being searched for timing lines.
+ * Looking up a metric takes a lock, so look it up once and keep the returned reference, which
+ * stays valid as long as the registry. Updating a metric is a single relaxed atomic operation
+ * and does not lock, exporting only reads the atomics.
+ * Names follow the OpenMetrics conventions: counters are registered without their "_total"
+ * suffix, units are part of the name (e.g. "nam_transfer_duration_seconds").
+ */
+class MetricsRegistry
+{
+  public:
+	MetricsRegistry() = default;
+
+	MetricsRegistry(const MetricsRegistry&) = delete;
+	MetricsRegistry &operator=(const MetricsRegistry&) = delete;
+
+	static MetricsRegistry &instance();
+
+	// returns the metric registered with the same name and labels before, if any;
+	// a name which is invalid or registered with another type yields a metric not being exported
+	Counter &counter(std::string_view name, std::string_view help, const MetricLabels &labels = {});
+	Gauge &gauge(std::string_view name, std::string_view help, const MetricLabels &labels = {});
+	// upperBounds only apply if the histogram is not registered yet
+	Histogram &histogram(std::string_view name, std::string_view help, std::vector<double> upperBounds, const MetricLabels &labels = {});
+
+	// snapshot of all metrics in the OpenMetrics text format, terminated by "# EOF"
+	[[nodiscard]] std::string exposition() const;
+
+  private:
+	enum class Type {
+		COUNTER,
+		GAUGE,
+		HISTOGRAM
+	};
+
+	struct Series
+	{
+		// formatted as in the exposition, without braces
+		std::string labels;
+		std::variant<std::unique_ptr<Counter>, std::unique_ptr<Gauge>, std::unique_ptr<Histogram>> metric;
+	};
+
+	struct Family
+	{
+		std::string name;
+		std::string help;
+		Type type;
+		std::vector<Series> series;
+	};
+
+	template<typename Metric, typename... Args>
+	Metric &metric(Type type, std::string_view name, std::string_view help, const MetricLabels &labels, Args&&... args);
+
+	mutable std::mutex m_mutex;
+	std::vector<Family> m_families;
+	// metrics handed out for invalid registrations, see counter()
+	std::vector<Series> m_unexportedSeries;
+};
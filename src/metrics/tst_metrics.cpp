@@ -0,0 +1,235 @@
+#include <KDFoundation/core_application.h>
+#include "metrics_exporter.h"
+#include "metrics_registry.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+auto app = CoreApplication();
+
+TEST_SUITE("Metrics")
+{
+	TEST_CASE("MetricsRegistry")
+	{
+		MetricsRegistry registry;
+
+		SUBCASE("Counters, gauges and histograms are exported in OpenMetrics text format")
+		{
+			// GIVEN
+			auto &counter = registry.counter("requests", "Number of requests", { { "method", "get" } });
+			auto &gauge = registry.gauge("connections", "Open connections");
+			auto &histogram = registry.histogram("latency_seconds", "Latency", { 0.5, 0.125 });
+
+			// WHEN
+			counter.increment();
+			counter.increment(2);
+			gauge.set(5);
+			gauge.decrement();
+			histogram.observe(0.0625);
+			histogram.observe(0.125);
+			histogram.observe(0.25);
+			histogram.observe(2.0);
+
+			// THEN
+			REQUIRE(registry.exposition() ==
+					"# TYPE requests counter\n"
+					"# HELP requests Number of requests\n"
+					"requests_total{method=\"get\"} 3\n"
+					"# TYPE connections gauge\n"
+					"# HELP connections Open connections\n"
+					"connections 4\n"
+					"# TYPE latency_seconds histogram\n"
+					"# HELP latency_seconds Latency\n"
+					"latency_seconds_bucket{le=\"0.125\"} 2\n"
+					"latency_seconds_bucket{le=\"0.5\"} 3\n"
+					"latency_seconds_bucket{le=\"+Inf\"} 4\n"
+					"latency_seconds_sum 2.4375\n"
+					"latency_seconds_count 4\n"
+					"# EOF\n");
+		}
+
+		SUBCASE("Registering a metric again returns the same metric, other labels another one of the same family")
+		{
+			// GIVEN
+			auto &ok = registry.counter("transfers", "Transfers", { { "result", "ok" } });
+			auto &error = registry.counter("transfers", "Transfers", { { "result", "error" } });
+
+			// WHEN
+			registry.counter("transfers", "Transfers", { { "result", "ok" } }).increment();
+			error.increment(7);
+
+			// THEN
+			REQUIRE(&ok != &error);
+			REQUIRE(ok.value() == 1);
+			REQUIRE(registry.exposition() ==
+					"# TYPE transfers counter\n"
+					"# HELP transfers Transfers\n"
+					"transfers_total{result=\"ok\"} 1\n"
+					"transfers_total{result=\"error\"} 7\n"
+					"# EOF\n");
+		}
+
+		SUBCASE("Label values and help texts are escaped")
+		{
+			// WHEN
+			registry.gauge("state", "Line 1\nLine \\2", { { "path", "C:\\\"x\"" } }).set(-1);
+
+			// THEN
+			REQUIRE(registry.exposition() ==
+					"# TYPE state gauge\n"
+					"# HELP state Line 1\\nLine \\\\2\n"
+					"state{path=\"C:\\\\\\\"x\\\"\"} -1\n"
+					"# EOF\n");
+		}
+
+		SUBCASE("Invalid names and type conflicts yield metrics which are not exported")
+		{
+			// GIVEN
+			registry.counter("events", "Events").increment();
+
+			// WHEN
+			auto &conflictingGauge = registry.gauge("events", "Events");
+			auto &invalidCounter = registry.counter("1events", "Events");
+			auto &invalidLabelCounter = registry.counter("other_events", "Events", { { "le", "1" } });
+			conflictingGauge.set(3);
+			invalidCounter.increment();
+			invalidLabelCounter.increment();
+
+			// THEN
+			REQUIRE(conflictingGauge.value() == 3);
+			REQUIRE(registry.exposition() ==
+					"# TYPE events counter\n"
+					"# HELP events Events\n"
+					"events_total 1\n"
+					"# EOF\n");
+		}
+
+		SUBCASE("Metrics can be updated from several threads at once")
+		{
+			// GIVEN
+			auto &counter = registry.counter("increments", "Increments");
+			auto &histogram = registry.histogram("values", "Values", Histogram::exponentialBounds(1.0, 2.0, 4));
+			REQUIRE(histogram.upperBounds() == std::vector<double>{ 1.0, 2.0, 4.0, 8.0 });
+
+			// WHEN
+			std::vector<std::thread> threads;
+			for (int i = 0; i < 4; ++i) {
+				threads.emplace_back([&]() {
+					for (int j = 0; j < 10000; ++j) {
+						counter.increment();
+						histogram.observe(j % 10);
+					}
+				});
+			}
+			for (auto &thread : threads) {
+				thread.join();
+			}
+
+			// THEN
+			const auto snapshot = histogram.snapshot();
+			REQUIRE(counter.value() == 40000);
+			REQUIRE(snapshot.count == 40000);
+			REQUIRE(snapshot.cumulativeCounts == std::vector<std::uint64_t>{ 8000, 12000, 20000, 36000, 40000 });
+			REQUIRE(snapshot.sum == 4 * 1000 * 45);
+		}
+	}
+
+	TEST_CASE("MetricsExporter")
+	{
+		MetricsRegistry registry;
+		registry.counter("scrapes", "Scrapes").increment(42);
+		const auto expectedBody = registry.exposition();
+		MetricsExporter exporter(registry);
+
+		const auto directoryPath = std::filesystem::temp_directory_path() / "mecaps_tst_metrics";
+		std::filesystem::create_directories(directoryPath);
+
+		SUBCASE("writeFile() writes the snapshot")
+		{
+			// GIVEN
+			const auto filePath = (directoryPath / "metrics.prom").string();
+
+			// WHEN
+			const auto hasError = exporter.writeFile(filePath);
+
+			// THEN
+			REQUIRE_FALSE(hasError);
+			std::ifstream file(filePath);
+			const auto content = std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			REQUIRE(content == expectedBody);
+			REQUIRE_FALSE(std::filesystem::exists(filePath + ".tmp"));
+		}
+
+#ifndef _WIN32
+		SUBCASE("listen() answers HTTP requests on a Unix domain socket")
+		{
+			// GIVEN
+			const auto socketPath = (directoryPath / "metrics.sock").string();
+			REQUIRE_FALSE(exporter.listen(socketPath));
+			REQUIRE(exporter.isListening());
+
+			auto request = [&](const std::string &text) {
+				const auto client = ::socket(AF_UNIX, SOCK_STREAM, 0);
+				sockaddr_un address {};
+				address.sun_family = AF_UNIX;
+				socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+				REQUIRE(::connect(client, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+				REQUIRE(::send(client, text.data(), text.size(), 0) == static_cast<ssize_t>(text.size()));
+
+				std::string response;
+				for (int i = 0; i < 100; ++i) {
+					app.processEvents(10);
+					char buffer[4096];
+					const auto numberOfBytes = ::recv(client, buffer, sizeof(buffer), MSG_DONTWAIT);
+					if (numberOfBytes == 0) {
+						break;
+					}
+					if (numberOfBytes > 0) {
+						response.append(buffer, static_cast<std::size_t>(numberOfBytes));
+					}
+				}
+				::close(client);
+				return response;
+			};
+
+			// WHEN
+			const auto getResponse = request("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+			const auto postResponse = request("POST /metrics HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n\r\n");
+
+			// THEN
+			REQUIRE(getResponse.starts_with("HTTP/1.1 200 OK\r\n"));
+			REQUIRE(getResponse.find("Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n") != std::string::npos);
+			REQUIRE(getResponse.ends_with("\r\n\r\n" + expectedBody));
+			REQUIRE(postResponse.starts_with("HTTP/1.1 405 Method Not Allowed\r\n"));
+
+			// WHEN
+			exporter.close();
+
+			// THEN
+			REQUIRE_FALSE(exporter.isListening());
+			REQUIRE_FALSE(std::filesystem::exists(socketPath));
+		}
+
+		SUBCASE("listen() fails for paths exceeding the size of a socket address")
+		{
+			// THEN
+			REQUIRE(exporter.listen(std::string(200, 'x')));
+			REQUIRE_FALSE(exporter.isListening());
+		}
+#endif
+
+		std::filesystem::remove_all(directoryPath);
+	}
+}
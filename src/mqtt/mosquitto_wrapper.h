@@ -20,6 +20,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 /*
  * This is a C++ class wrapping library specific functions
@@ -89,7 +90,7 @@ class MosquittoClient
 		mosquitto_log_callback_set(m_clientInstance, onLog);
 	}
 
-	~MosquittoClient() {
+	virtual ~MosquittoClient() {
 		mosquitto_destroy(m_clientInstance);
 	}
 
@@ -109,10 +110,30 @@ class MosquittoClient
 		return mosquitto_subscribe(m_clientInstance, msg_id, sub.c_str(), qos);
 	}
 
+	// one SUBSCRIBE packet for all subs, which are granted their QoS individually (see subscribed)
+	virtual int subscribeMultiple(int *msg_id, const std::vector<std::string> &subs, int qos = 0) {
+		std::vector<char*> topics;
+		topics.reserve(subs.size());
+		for (const auto &sub : subs) {
+			topics.push_back(const_cast<char*>(sub.c_str()));
+		}
+		return mosquitto_subscribe_multiple(m_clientInstance, msg_id, static_cast<int>(topics.size()), topics.data(), qos, 0, nullptr);
+	}
+
 	virtual int unsubscribe(int *msg_id, const std::string &sub) {
 		return mosquitto_unsubscribe(m_clientInstance, msg_id, sub.c_str());
 	}
 
+	// one UNSUBSCRIBE packet for all subs
+	virtual int unsubscribeMultiple(int *msg_id, const std::vector<std::string> &subs) {
+		std::vector<char*> topics;
+		topics.reserve(subs.size());
+		for (const auto &sub : subs) {
+			topics.push_back(const_cast<char*>(sub.c_str()));
+		}
+		return mosquitto_unsubscribe_multiple(m_clientInstance, msg_id, static_cast<int>(topics.size()), topics.data(), nullptr);
+	}
+
 	virtual int loopMisc() {
 		return mosquitto_loop_misc(m_clientInstance);
 	}
@@ -133,6 +154,19 @@ class MosquittoClient
 		return mosquitto_want_write(m_clientInstance);
 	}
 
+	virtual int intOptionSet(enum mosq_opt_t option, int value) {
+		return mosquitto_int_option(m_clientInstance, option, value);
+	}
+
+	virtual int threadedSet(bool threaded) {
+		return mosquitto_threaded_set(m_clientInstance, threaded);
+	}
+
+	// libmosquitto serializes this with logging -> may be called while another thread runs connect()
+	virtual void logCallbackUnset() {
+		mosquitto_log_callback_set(m_clientInstance, nullptr);
+	}
+
 	virtual void *sslGet() {
 		return mosquitto_ssl_get(m_clientInstance);
 	}
@@ -1,8 +1,95 @@
 #include "mqtt.h"
+#include "metrics_registry.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+#include <spdlog/fmt/ranges.h>
 #include <spdlog/spdlog.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
 
 constexpr std::chrono::milliseconds c_miscTaskInterval = std::chrono::milliseconds(1000);
 
+namespace {
+
+// shared by all MqttClient instances, exported via MetricsRegistry::instance()
+struct MqttMetrics
+{
+	Histogram &connectDuration;
+	Counter &failedConnects;
+	Gauge &connectedClients;
+	Counter &publishedMessages;
+	Counter &receivedMessages;
+	Counter &errors;
+	Counter &exhaustedReadBudgets;
+	Gauge &outboundQueueMessages;
+	Gauge &outboundQueueBytes;
+	Counter &rejectedPublishes;
+	Counter &storedMessages;
+	Counter &unstorableMessages;
+	Counter &forwardedMessages;
+	Counter &reconnectAttempts;
+	Histogram &recoveryDuration;
+};
+
+MqttMetrics &metrics()
+{
+	auto &registry = MetricsRegistry::instance();
+	static MqttMetrics s_metrics {
+		registry.histogram("mqtt_connect_duration_seconds", "Duration of MosquittoClient::connect() on the connecting thread",
+						   Histogram::exponentialBounds(0.001, 2.0, 14)),
+		registry.counter("mqtt_connects_failed", "Connects failing before or on CONNACK"),
+		registry.gauge("mqtt_clients_connected", "MqttClients connected to a broker"),
+		registry.counter("mqtt_messages_published", "Messages acknowledged as published by mosquitto"),
+		registry.counter("mqtt_messages_received", "Messages received on subscribed topics"),
+		registry.counter("mqtt_errors", "Errors reported by mosquitto clients"),
+		registry.counter("mqtt_read_budgets_exhausted", "Socket wakeups ending with data left to read, see MqttClient::setReadBudget()"),
+		registry.gauge("mqtt_outbound_queue_messages", "Messages published but not acknowledged or sent yet"),
+		registry.gauge("mqtt_outbound_queue_bytes", "Topic and payload bytes of messages published but not acknowledged or sent yet"),
+		registry.counter("mqtt_publishes_rejected", "Publishes rejected as the outbound queue is full, see MqttClient::setOutboundQueueLimits()"),
+		registry.counter("mqtt_messages_stored", "Messages stored to be forwarded once connected, see MqttClient::setStoreAndForward()"),
+		registry.counter("mqtt_messages_not_stored", "Messages neither published nor stored as the store is full"),
+		registry.counter("mqtt_messages_forwarded", "Stored messages published after connecting"),
+		registry.counter("mqtt_reconnect_attempts", "Connects started to reconnect, see MqttClient::setAutoReconnect()"),
+		registry.histogram("mqtt_connection_recovery_duration_seconds", "Time from losing the connection until reconnected and subscribed to all topics again",
+						   Histogram::exponentialBounds(0.1, 2.0, 14)),
+	};
+	return s_metrics;
+}
+
+bool hasDataToRead(int socket)
+{
+	if (socket < 0) {
+		return false;
+	}
+	pollfd pollFd { socket, POLLIN, 0 };
+	return (::poll(&pollFd, 1, 0) > 0) && (pollFd.revents & POLLIN);
+}
+
+// ssl is the SSL object of a TLS connection (see IMosquittoClient::sslGet()), nullptr otherwise:
+// OpenSSL decrypts whole records, so packets may wait in its buffer while the socket has nothing to read
+bool hasPendingTlsData(void *ssl)
+{
+	return ssl && (SSL_pending(static_cast<SSL*>(ssl)) > 0);
+}
+
+// fails for sockets other than TCP ones, e.g. Unix domain sockets, which is fine;
+// TCP_CORK is Linux specific, other platforms send without corking
+void setTcpCork([[maybe_unused]] int socket, [[maybe_unused]] bool isCorked)
+{
+#ifdef TCP_CORK
+	const int value = isCorked ? 1 : 0;
+	::setsockopt(socket, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#endif
+}
+
+}
+
 using namespace KDFoundation;
 
 MqttLib::MqttLib()
@@ -96,6 +183,20 @@ MqttClient::MqttClient(const std::string &clientId, bool cleanSession, bool verb
 	m_mosquitto.init(client, this);
 
 	m_eventLoopHook.init(c_miscTaskInterval, this);
+
+	m_replayTimer.interval.set(c_defaultReplayInterval);
+	m_replayTimer.running.set(false);
+	m_replayTimer.timeout.connect(&MqttClient::onReplayRequested, this);
+
+	m_reconnectTimer.running.set(false);
+	m_reconnectTimer.timeout.connect(&MqttClient::onReconnectRequested, this);
+}
+
+MqttClient::~MqttClient()
+{
+	if (m_asyncConnector.isRunning()) {
+		m_asyncConnector.abandon(m_mosquitto.release());
+	}
 }
 
 int MqttClient::setTls(const File &cafile)
@@ -161,23 +262,20 @@ int MqttClient::connect(const Url &host, int port, int keepalive)
 		return MOSQ_ERR_UNKNOWN;
 	}
 
-	connectionState.set(ConnectionState::CONNECTING);
-	// TODO -> TLS only works with connect(), it does not work with connect_async()
-	// I'm uncertain if there is a setup that allows for connect_async() with TLS (I didn't manage to find one)
-	// (the use of non-blocking connect_async() would be preferred from our POV)
-	// other people seem to have encountered similiar behaviour before, though this issue should have been fixed a while ago
-	// -> https://github.com/eclipse/mosquitto/issues/990
-	const auto start = clock();
-	const auto result = m_mosquitto.client()->connect(host.url().c_str(), port, keepalive);
-	const auto end = clock();
-	const auto elapsedTimeMs = std::round((double(end-start) / double(CLOCKS_PER_SEC)) * 1000000.0);
-	spdlog::info("MqttClient::connect() - blocking call of MosquittoClient::connect() took {} µs", elapsedTimeMs);
-
-	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::connect()");
-	if (!hasError) {
-		m_eventLoopHook.engage(m_mosquitto.client()->socket());
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::connect() - Previous connect is still running.");
+		return MOSQ_ERR_UNKNOWN;
 	}
-	return result;
+
+	// connecting right away instead of waiting for a scheduled reconnect
+	m_reconnectTimer.running.set(false);
+	m_reconnectAttempt = 0;
+
+	m_host = host.url();
+	m_port = port;
+	m_keepalive = keepalive;
+	m_isReconnectWanted = true;
+	return startConnecting();
 }
 
 int MqttClient::disconnect()
@@ -190,13 +288,26 @@ int MqttClient::disconnect()
 	}
 
 	if (connectionState.get() == ConnectionState::DISCONNECTED) {
+		if (m_reconnectTimer.running.get()) {
+			spdlog::debug("MqttClient::disconnect() - Stop waiting to reconnect.");
+			stopReconnecting();
+			return MOSQ_ERR_SUCCESS;
+		}
 		spdlog::error("MqttClient::disconnect() - Not connected to any host.");
 		return MOSQ_ERR_UNKNOWN;
 	}
 
+	stopReconnecting();
 	connectionState.set(ConnectionState::DISCONNECTING);
+	if (m_asyncConnector.isRunning()) {
+		// see onConnectFinished()
+		m_isDisconnectRequestedWhileConnecting = true;
+		return MOSQ_ERR_SUCCESS;
+	}
+
 	const auto result = m_mosquitto.client()->disconnect();
 	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::disconnect()");
+	updateWriteOpInterest();
 	return result;
 }
 
@@ -204,13 +315,42 @@ int MqttClient::publish(int *msgId, const char *topic, int payloadlen, const voi
 {
 	spdlog::debug("MqttClient::publish() - topic:{}, qos:{}, retain:{}", topic, qos, retain);
 
+	if (m_publishStore && ((connectionState.get() != ConnectionState::CONNECTED) || m_publishStore->hasPendingRecords())) {
+		return storeMessage(msgId, topic, payloadlen, payload, qos, retain);
+	}
+
 	if (connectionState.get() == ConnectionState::DISCONNECTED) {
 		spdlog::error("MqttClient::publish() - Not connected to any host.");
 		return MOSQ_ERR_UNKNOWN;
 	}
 
-	const auto result = m_mosquitto.client()->publish(msgId, topic, payloadlen, payload, qos, retain);
-	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::publish()");
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::publish() - Still connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	const auto size = std::strlen(topic) + static_cast<std::size_t>(std::max(payloadlen, 0));
+	if ((m_outboundQueueMaxBytes > 0) && (m_outboundQueue.numberOfBytes() + size > m_outboundQueueMaxBytes)) {
+		spdlog::error("MqttClient::publish() - Outbound queue is full.");
+		metrics().rejectedPublishes.increment();
+		return MOSQ_ERR_NOMEM;
+	}
+
+	// the msgId is needed to track the message in the outbound queue
+	int queuedMsgId;
+	bool isSent;
+	const auto result = publishAndCheckIfSent(&queuedMsgId, topic, payloadlen, payload, qos, retain, isSent);
+	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::publish()");
+	if (!hasError) {
+		if (msgId != nullptr) {
+			*msgId = queuedMsgId;
+		}
+		if (!isSent) {
+			m_outboundQueue.add(queuedMsgId, size, qos);
+			updateOutboundQueueWritability();
+		}
+	}
+	updateWriteOpInterest();
 	return result;
 }
 
@@ -223,14 +363,63 @@ int MqttClient::subscribe(const char *pattern, int qos)
 		return MOSQ_ERR_UNKNOWN;
 	}
 
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::subscribe() - Still connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
 	int msgId;
 	const auto result = m_mosquitto.client()->subscribe(&msgId, pattern, qos);
 	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::subscribe()");
 	if (!hasError) {
-		const auto topic = std::string(pattern);
-		m_subscriptionsRegistry.registerPendingRegistryOperation(topic, msgId);
+		m_subscriptionsRegistry.registerPendingRegistryOperation(SubscriptionsRegistry::Operation::SUBSCRIBE, { pattern }, msgId, qos);
 		subscriptionState.set(SubscriptionState::SUBSCRIBING);
 	}
+	updateWriteOpInterest();
+	return result;
+}
+
+int MqttClient::subscribe(const char *pattern, MessageHandler handler, int qos)
+{
+	if (!TopicRouter::isValidFilter(pattern) || !handler) {
+		spdlog::error("MqttClient::subscribe() - Invalid pattern or handler.");
+		return MOSQ_ERR_INVAL;
+	}
+
+	const auto result = subscribe(pattern, qos);
+	if (result == MOSQ_ERR_SUCCESS) {
+		m_topicRouter.addHandler(pattern, std::move(handler));
+	}
+	return result;
+}
+
+int MqttClient::subscribe(const std::vector<std::string> &patterns, int qos)
+{
+	spdlog::debug("MqttClient::subscribe() - subscribe patterns:{}, qos:{}", patterns, qos);
+
+	if (patterns.empty()) {
+		spdlog::error("MqttClient::subscribe() - No patterns.");
+		return MOSQ_ERR_INVAL;
+	}
+
+	if (connectionState.get() == ConnectionState::DISCONNECTED) {
+		spdlog::error("MqttClient::subscribe() - Not connected to any host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::subscribe() - Still connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	int msgId;
+	const auto result = m_mosquitto.client()->subscribeMultiple(&msgId, patterns, qos);
+	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::subscribe()");
+	if (!hasError) {
+		m_subscriptionsRegistry.registerPendingRegistryOperation(SubscriptionsRegistry::Operation::SUBSCRIBE, patterns, msgId, qos);
+		subscriptionState.set(SubscriptionState::SUBSCRIBING);
+	}
+	updateWriteOpInterest();
 	return result;
 }
 
@@ -243,17 +432,161 @@ int MqttClient::unsubscribe(const char *pattern)
 		return MOSQ_ERR_UNKNOWN;
 	}
 
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::unsubscribe() - Still connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
 	int msgId;
 	const auto result = m_mosquitto.client()->unsubscribe(&msgId, pattern);
 	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::unsubscribe()");
 	if (!hasError) {
-		const auto topic = std::string(pattern);
-		m_subscriptionsRegistry.registerPendingRegistryOperation(topic, msgId);
+		m_subscriptionsRegistry.registerPendingRegistryOperation(SubscriptionsRegistry::Operation::UNSUBSCRIBE, { pattern }, msgId);
+		m_topicRouter.removeHandlers(pattern);
+		subscriptionState.set(SubscriptionState::UNSUBSCRIBING);
+	}
+	updateWriteOpInterest();
+	return result;
+}
+
+int MqttClient::unsubscribe(const std::vector<std::string> &patterns)
+{
+	spdlog::debug("MqttClient::unsubscribe() - unsubscribe patterns:{}", patterns);
+
+	if (patterns.empty()) {
+		spdlog::error("MqttClient::unsubscribe() - No patterns.");
+		return MOSQ_ERR_INVAL;
+	}
+
+	if (connectionState.get() == ConnectionState::DISCONNECTED) {
+		spdlog::error("MqttClient::unsubscribe() - Not connected to any host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::unsubscribe() - Still connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	int msgId;
+	const auto result = m_mosquitto.client()->unsubscribeMultiple(&msgId, patterns);
+	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::unsubscribe()");
+	if (!hasError) {
+		m_subscriptionsRegistry.registerPendingRegistryOperation(SubscriptionsRegistry::Operation::UNSUBSCRIBE, patterns, msgId);
+		for (const auto &pattern : patterns) {
+			m_topicRouter.removeHandlers(pattern);
+		}
 		subscriptionState.set(SubscriptionState::UNSUBSCRIBING);
 	}
+	updateWriteOpInterest();
+	return result;
+}
+
+void MqttClient::setReadBudget(int maxPackets, std::chrono::microseconds maxDuration)
+{
+	spdlog::debug("MqttClient::setReadBudget() - maxPackets:{}, maxDuration:{} µs", maxPackets, maxDuration.count());
+
+	if (maxPackets < 1) {
+		spdlog::warn("MqttClient::setReadBudget() - At least one packet is read per wakeup.");
+	}
+	m_readBudgetPackets = std::max(maxPackets, 1);
+	m_readBudgetDuration = maxDuration;
+}
+
+int MqttClient::setPublishBatching(bool isEnabled, bool corkSocket)
+{
+	spdlog::debug("MqttClient::setPublishBatching() - isEnabled:{}, corkSocket:{}", isEnabled, corkSocket);
+
+	if (m_asyncConnector.isRunning()) {
+		spdlog::error("MqttClient::setPublishBatching() - Not allowed while connecting to host.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	// mosquitto sends packets right away unless it assumes another thread to run its network loop
+	const auto result = m_mosquitto.client()->threadedSet(isEnabled);
+	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::setPublishBatching()");
+	if (!hasError) {
+		m_corksSocketWhenFlushing = isEnabled && corkSocket;
+	}
+	return result;
+}
+
+int MqttClient::setMaxInflightMessages(int maxInflightMessages)
+{
+	spdlog::debug("MqttClient::setMaxInflightMessages() - maxInflightMessages:{}", maxInflightMessages);
+
+	if (connectionState.get() != ConnectionState::DISCONNECTED) {
+		spdlog::error("MqttClient::setMaxInflightMessages() - Setting the in-flight window is only allowed when disconnected.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	const auto result = m_mosquitto.client()->intOptionSet(MOSQ_OPT_SEND_MAXIMUM, maxInflightMessages);
+	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::setMaxInflightMessages()");
 	return result;
 }
 
+void MqttClient::setOutboundQueueLimits(std::size_t highWaterBytes, std::size_t maxBytes)
+{
+	spdlog::debug("MqttClient::setOutboundQueueLimits() - highWaterBytes:{}, maxBytes:{}", highWaterBytes, maxBytes);
+
+	m_outboundQueueHighWaterBytes = highWaterBytes;
+	m_outboundQueueMaxBytes = maxBytes;
+	updateOutboundQueueWritability();
+}
+
+std::size_t MqttClient::outboundQueueMessages() const
+{
+	return m_outboundQueue.numberOfMessages();
+}
+
+std::size_t MqttClient::outboundQueueBytes() const
+{
+	return m_outboundQueue.numberOfBytes();
+}
+
+int MqttClient::setStoreAndForward(const std::string &directoryPath, const PublishStore::Options &options, int replayBatchSize, std::chrono::milliseconds replayInterval)
+{
+	spdlog::debug("MqttClient::setStoreAndForward() - directoryPath:{}, replayBatchSize:{}, replayInterval:{} ms", directoryPath, replayBatchSize, replayInterval.count());
+
+	if (connectionState.get() != ConnectionState::DISCONNECTED) {
+		spdlog::error("MqttClient::setStoreAndForward() - Setting store and forward is only allowed when disconnected.");
+		return MOSQ_ERR_UNKNOWN;
+	}
+
+	m_replayedRecordByMsgId.clear();
+	m_publishStore.reset();
+	if (directoryPath.empty()) {
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	auto publishStore = std::make_unique<PublishStore>();
+	const auto hasError = publishStore->open(directoryPath, options);
+	if (hasError) {
+		spdlog::error("MqttClient::setStoreAndForward() - Cannot open store in {}.", directoryPath);
+		return MOSQ_ERR_ERRNO;
+	}
+	m_publishStore = std::move(publishStore);
+	m_replayBatchSize = std::max(replayBatchSize, 1);
+	m_replayTimer.interval.set(replayInterval);
+	return MOSQ_ERR_SUCCESS;
+}
+
+void MqttClient::setAutoReconnect(bool isEnabled, std::chrono::milliseconds initialDelay, std::chrono::milliseconds maxDelay)
+{
+	spdlog::debug("MqttClient::setAutoReconnect() - isEnabled:{}, initialDelay:{} ms, maxDelay:{} ms", isEnabled, initialDelay.count(), maxDelay.count());
+
+	if (maxDelay < initialDelay) {
+		spdlog::warn("MqttClient::setAutoReconnect() - maxDelay is less than initialDelay, using initialDelay.");
+	}
+	m_isAutoReconnectEnabled = isEnabled;
+	m_reconnectInitialDelay = std::max(initialDelay, std::chrono::milliseconds(0));
+	m_reconnectMaxDelay = std::max(maxDelay, m_reconnectInitialDelay);
+
+	if (!isEnabled) {
+		m_reconnectTimer.running.set(false);
+	}
+}
+
 void MqttClient::onConnected(int connackCode)
 {
 	spdlog::debug("MqttClient::onConnected() - connackCode({}): {}", connackCode, MqttLib::instance().connackString(connackCode));
@@ -273,8 +606,29 @@ void MqttClient::onConnected(int connackCode)
 		spdlog::info("MqttClient::onConnected() - This connection {} TLS encrypted", tlsIsEnabled ? "is" : "is not");
 	}
 
+	if (hasError) {
+		metrics().failedConnects.increment();
+	}
+	else if (!m_isCountedAsConnected) {
+		metrics().connectedClients.increment();
+		m_isCountedAsConnected = true;
+	}
+
 	const auto state = hasError ? ConnectionState::DISCONNECTED : ConnectionState::CONNECTED;
 	connectionState.set(state);
+
+	if (hasError) {
+		// usually followed by onDisconnected(), which does not schedule another reconnect then
+		scheduleReconnect();
+		return;
+	}
+
+	m_reconnectAttempt = 0;
+	resubscribe();
+
+	if (m_publishStore && m_publishStore->hasPendingRecords()) {
+		m_replayTimer.running.set(true);
+	}
 }
 
 void MqttClient::onDisconnected(int reasonCode)
@@ -283,40 +637,93 @@ void MqttClient::onDisconnected(int reasonCode)
 
 	m_eventLoopHook.disengage();
 
+	m_outboundQueue.removeQos0Messages();
+	updateOutboundQueueWritability();
+
+	// mosquitto drops QoS 0 messages not sent yet, the others are sent again after reconnecting
+	m_replayTimer.running.set(false);
+	std::erase_if(m_replayedRecordByMsgId, [this](const auto &pair) {
+		if (pair.second.qos > 0) {
+			return false;
+		}
+		m_publishStore->requeue(pair.second.recordId);
+		return true;
+	});
+
+	// subscribed to again once reconnected, see resubscribe()
+	m_subscriptionsRegistry.resolvePendingOperationsLostOnDisconnect();
+	m_pendingResubscriptionMsgIds.clear();
+	const auto subscriptionsState = m_subscriptionsRegistry.subscribedTopics().empty() ? SubscriptionState::UNSUBSCRIBED : SubscriptionState::SUBSCRIBED;
+	subscriptionState.set(subscriptionsState);
+	subscriptions.set(m_subscriptionsRegistry.subscribedTopics());
+
+	if (m_isCountedAsConnected) {
+		metrics().connectedClients.decrement();
+		m_isCountedAsConnected = false;
+
+		// not set by disconnect(), see reportRecovery()
+		if (m_isReconnectWanted && !m_connectionLostTime) {
+			m_connectionLostTime = std::chrono::steady_clock::now();
+		}
+	}
+
 	connectionState.set(ConnectionState::DISCONNECTED);
+	scheduleReconnect();
 }
 
 void MqttClient::onPublished(int msgId)
 {
 	spdlog::debug("MqttClient::onPublished() - msgId:{}", msgId);
+	if (m_isPublishing) {
+		m_msgIdsSentWhilePublishing.push_back(msgId);
+	}
+	metrics().publishedMessages.increment();
+	m_outboundQueue.remove(msgId);
+	updateOutboundQueueWritability();
+
+	const auto replayedRecord = m_replayedRecordByMsgId.find(msgId);
+	if (replayedRecord != m_replayedRecordByMsgId.end()) {
+		m_publishStore->acknowledge(replayedRecord->second.recordId);
+		m_replayedRecordByMsgId.erase(replayedRecord);
+	}
+
 	msgPublished.emit(msgId);
 }
 
 void MqttClient::onMessage(const mosquitto_message *message)
 {
 	spdlog::debug("MqttClient::onMessage() - message.id:{}, message.topic:{}", message->mid, message->topic);
-	msgReceived.emit(message);
+	metrics().receivedMessages.increment();
+
+	// no copies, mosquitto frees the message after the callback
+	const auto messageView = MqttMessageView::fromMosquittoMessage(*message);
+	msgReceived.emit(messageView);
+	m_topicRouter.route(messageView);
 }
 
 void MqttClient::onSubscribed(int msgId, int qosCount, const int *grantedQos)
 {
-	// we only handle subscriptions to one single topic with one single QOS value for now.
-	// in case mosquitto_subscribe_multiple is added to MosquittoClient some time in the future,
-	// add handling of multiple topic/QOS pairs here.
-	assert(qos_count == 1);
-
-	const auto topic = m_subscriptionsRegistry.registerTopicSubscriptionAndReturnTopicName(msgId, grantedQos[0]);
-	spdlog::debug("MqttClient::onSubscribed() - msgId:{}, topic:{}, qosCount:{}, grantedQos:{}", msgId, topic, qosCount, grantedQos[0]);
+	// one SUBACK grants the QoS of all topics of a SUBSCRIBE packet, see resubscribe()
+	const auto topics = m_subscriptionsRegistry.registerTopicSubscriptionsAndReturnTopicNames(msgId, qosCount, grantedQos);
+	spdlog::debug("MqttClient::onSubscribed() - msgId:{}, topics:{}, qosCount:{}", msgId, topics, qosCount);
 
 	const auto state = m_subscriptionsRegistry.subscribedTopics().empty() ? SubscriptionState::UNSUBSCRIBED : SubscriptionState::SUBSCRIBED;
 	subscriptionState.set(state);
 	subscriptions.set(m_subscriptionsRegistry.subscribedTopics());
+
+	const auto resubscription = std::ranges::find(m_pendingResubscriptionMsgIds, msgId);
+	if (resubscription != m_pendingResubscriptionMsgIds.end()) {
+		m_pendingResubscriptionMsgIds.erase(resubscription);
+		if (m_pendingResubscriptionMsgIds.empty()) {
+			reportRecovery();
+		}
+	}
 }
 
 void MqttClient::onUnsubscribed(int msgId)
 {
-	const auto topic = m_subscriptionsRegistry.unregisterTopicSubscriptionAndReturnTopicName(msgId);
-	spdlog::debug("MqttClient::onUnsubscribed() - msgId:{}, topic:{}", msgId, topic);
+	const auto topics = m_subscriptionsRegistry.unregisterTopicSubscriptionsAndReturnTopicNames(msgId);
+	spdlog::debug("MqttClient::onUnsubscribed() - msgId:{}, topics:{}", msgId, topics);
 
 	const auto state = m_subscriptionsRegistry.subscribedTopics().empty() ? SubscriptionState::UNSUBSCRIBED : SubscriptionState::SUBSCRIBED;
 	subscriptionState.set(state);
@@ -333,30 +740,296 @@ void MqttClient::onLog(int level, const char *str) const
 void MqttClient::onError()
 {
 	spdlog::error("MqttClient::onError()");
+	metrics().errors.increment();
 	error.emit();
 }
 
+void MqttClient::onConnectFinished(int result, std::chrono::steady_clock::duration elapsedTime)
+{
+	const auto elapsedSeconds = std::chrono::duration<double>(elapsedTime).count();
+	metrics().connectDuration.observe(elapsedSeconds);
+	spdlog::debug("MqttClient::onConnectFinished() - MosquittoClient::connect() took {} µs", std::round(elapsedSeconds * 1000000.0));
+
+	const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::connect()");
+	if (hasError) {
+		m_isDisconnectRequestedWhileConnecting = false;
+		metrics().failedConnects.increment();
+		connectionState.set(ConnectionState::DISCONNECTED);
+		onError();
+		scheduleReconnect();
+		return;
+	}
+
+	m_eventLoopHook.engage(m_mosquitto.client()->socket());
+	updateWriteOpInterest();
+
+	if (m_isDisconnectRequestedWhileConnecting) {
+		m_isDisconnectRequestedWhileConnecting = false;
+		const auto disconnectResult = m_mosquitto.client()->disconnect();
+		MqttLib::instance().checkMosquittoResultAndDoDebugPrints(disconnectResult, "MqttClient::disconnect()");
+		updateWriteOpInterest();
+	}
+}
+
 void MqttClient::onReadOpRequested()
 {
-	auto result = m_mosquitto.client()->loopRead();
-	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "loopRead()");
+	// loopRead() reads a single packet (libmosquitto ignores max_packets) -> drain the socket
+	// until it would block or the read budget is exhausted, instead of one wakeup per packet
+	const auto deadline = std::chrono::steady_clock::now() + m_readBudgetDuration;
+	for (int numberOfPackets = 1; ; ++numberOfPackets) {
+		const auto result = m_mosquitto.client()->loopRead();
+		const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "loopRead()");
+
+		// a packet might have disconnected the client, see onDisconnected()
+		if (hasError || !m_eventLoopHook.isEngaged()) {
+			break;
+		}
+		const auto hasTlsDataPending = hasPendingTlsData(m_mosquitto.client()->sslGet());
+		if (!hasTlsDataPending && !hasDataToRead(m_mosquitto.client()->socket())) {
+			break;
+		}
+
+		if ((numberOfPackets >= m_readBudgetPackets) || (std::chrono::steady_clock::now() >= deadline)) {
+			// the read notifier triggers again after other events got processed,
+			// but does not know about data OpenSSL already took from the socket
+			if (hasTlsDataPending) {
+				m_eventLoopHook.readLater();
+			}
+			metrics().exhaustedReadBudgets.increment();
+			break;
+		}
+	}
+
+	// incoming packets may have queued acknowledgements
+	updateWriteOpInterest();
 }
 
 void MqttClient::onWriteOpRequested()
 {
 	const auto writeOpIsPending = m_mosquitto.client()->wantWrite();
-	if (!writeOpIsPending) {
-		return;
+	if (writeOpIsPending) {
+		// loopWrite() writes all queued packets until the socket would block
+		const auto socket = m_mosquitto.client()->socket();
+		if (m_corksSocketWhenFlushing) {
+			setTcpCork(socket, true);
+		}
+
+		auto result = m_mosquitto.client()->loopWrite();
+		MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "loopWrite()");
+
+		// uncorking sends what is left right away
+		if (m_corksSocketWhenFlushing && (socket == m_mosquitto.client()->socket())) {
+			setTcpCork(socket, false);
+		}
 	}
 
-	auto result = m_mosquitto.client()->loopWrite();
-	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "loopWrite()");
+	updateWriteOpInterest();
 }
 
 void MqttClient::onMiscTaskRequested()
 {
 	auto result = m_mosquitto.client()->loopMisc();
 	MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "loopMisc()");
+
+	// e.g. PINGREQ or retried messages
+	updateWriteOpInterest();
+}
+
+void MqttClient::updateWriteOpInterest()
+{
+	// mosquitto writes directly to the socket, only data which did not fit is pending
+	// (or all of it, see setPublishBatching())
+	if (m_eventLoopHook.isEngaged()) {
+		m_eventLoopHook.setWriteOpInterest(m_mosquitto.client()->wantWrite());
+	}
+}
+
+void MqttClient::updateOutboundQueueWritability()
+{
+	// hysteresis, so that producers do not toggle with every message
+	const auto bytes = m_outboundQueue.numberOfBytes();
+	if (isOutboundQueueWritable.get() && (bytes >= m_outboundQueueHighWaterBytes)) {
+		spdlog::debug("MqttClient::updateOutboundQueueWritability() - high water mark reached, {} bytes queued", bytes);
+		isOutboundQueueWritable.set(false);
+	} else if (!isOutboundQueueWritable.get() && (bytes < m_outboundQueueHighWaterBytes / 2)) {
+		spdlog::debug("MqttClient::updateOutboundQueueWritability() - writable again, {} bytes queued", bytes);
+		isOutboundQueueWritable.set(true);
+	}
+}
+
+int MqttClient::publishAndCheckIfSent(int *msgId, const std::string &topic, int payloadlen, const void *payload, int qos, bool retain, bool &isSent)
+{
+	// mosquitto sends QoS 0 messages right away if it can, and calls onPublished() from within publish() then
+	m_msgIdsSentWhilePublishing.clear();
+	m_isPublishing = true;
+	const auto result = m_mosquitto.client()->publish(msgId, topic, payloadlen, payload, qos, retain);
+	m_isPublishing = false;
+
+	isSent = (result == MOSQ_ERR_SUCCESS) && (std::ranges::find(m_msgIdsSentWhilePublishing, *msgId) != m_msgIdsSentWhilePublishing.end());
+	return result;
+}
+
+int MqttClient::storeMessage(int *msgId, const char *topic, int payloadlen, const void *payload, int qos, bool retain)
+{
+	const auto payloadSize = static_cast<std::size_t>(std::max(payloadlen, 0));
+	const auto hasError = m_publishStore->append(topic, std::span(static_cast<const std::byte*>(payload), payloadSize), qos, retain);
+	if (hasError) {
+		spdlog::error("MqttClient::publish() - Cannot store message.");
+		metrics().unstorableMessages.increment();
+		return MOSQ_ERR_NOMEM;
+	}
+	metrics().storedMessages.increment();
+
+	// the message gets its msgId once forwarded
+	if (msgId != nullptr) {
+		*msgId = 0;
+	}
+	if (connectionState.get() == ConnectionState::CONNECTED) {
+		m_replayTimer.running.set(true);
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+void MqttClient::onReplayRequested()
+{
+	if (!m_publishStore || (connectionState.get() != ConnectionState::CONNECTED)) {
+		m_replayTimer.running.set(false);
+		return;
+	}
+
+	// forwarding pauses while the outbound queue is above its high water mark
+	for (int i = 0; (i < m_replayBatchSize) && isOutboundQueueWritable.get(); ++i) {
+		const auto record = m_publishStore->next();
+		if (!record) {
+			break;
+		}
+
+		const auto &message = record->message;
+		const auto size = message.topic.size() + message.payload.size();
+		const auto qos = message.qos;
+		int msgId;
+		bool isSent;
+		const auto result = publishAndCheckIfSent(&msgId, std::string(message.topic), static_cast<int>(message.payload.size()),
+												  message.payload.data(), message.qos, message.retain, isSent);
+		const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::onReplayRequested()");
+		if (hasError) {
+			m_publishStore->requeue(record->id);
+			break;
+		}
+		metrics().forwardedMessages.increment();
+
+		if (isSent) {
+			m_publishStore->acknowledge(record->id);
+		} else {
+			m_replayedRecordByMsgId[msgId] = { record->id, qos };
+			m_outboundQueue.add(msgId, size, qos);
+		}
+	}
+
+	updateOutboundQueueWritability();
+	updateWriteOpInterest();
+
+	if (!m_publishStore->hasPendingRecords()) {
+		m_replayTimer.running.set(false);
+	}
+}
+
+int MqttClient::startConnecting()
+{
+	// left engaged if the broker refused the connection without disconnecting, see onConnected()
+	if (m_eventLoopHook.isEngaged()) {
+		m_eventLoopHook.disengage();
+	}
+
+	connectionState.set(ConnectionState::CONNECTING);
+	const auto hasError = m_asyncConnector.start(m_mosquitto.client(), m_host, m_port, m_keepalive, this);
+	if (hasError) {
+		metrics().failedConnects.increment();
+		connectionState.set(ConnectionState::DISCONNECTED);
+		scheduleReconnect();
+		return MOSQ_ERR_ERRNO;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+void MqttClient::stopReconnecting()
+{
+	m_isReconnectWanted = false;
+	m_reconnectTimer.running.set(false);
+	m_reconnectAttempt = 0;
+	m_connectionLostTime.reset();
+}
+
+void MqttClient::scheduleReconnect()
+{
+	if (!m_isAutoReconnectEnabled || !m_isReconnectWanted || m_reconnectTimer.running.get()
+		|| (connectionState.get() != ConnectionState::DISCONNECTED)) {
+		return;
+	}
+
+	// exponential backoff with jitter: a random delay between half of and the full backoff
+	const auto exponent = std::min(m_reconnectAttempt, 20);
+	const auto backoff = std::min(m_reconnectInitialDelay * (std::int64_t { 1 } << exponent), m_reconnectMaxDelay);
+	std::uniform_int_distribution<std::chrono::milliseconds::rep> distribution(backoff.count() / 2, backoff.count());
+	const auto delay = std::chrono::milliseconds(distribution(m_reconnectDelayRandomEngine));
+	++m_reconnectAttempt;
+
+	spdlog::info("MqttClient::scheduleReconnect() - Reconnecting in {} ms (attempt {}).", delay.count(), m_reconnectAttempt);
+	m_reconnectTimer.interval.set(delay);
+	m_reconnectTimer.running.set(true);
+}
+
+void MqttClient::onReconnectRequested()
+{
+	// single shot
+	m_reconnectTimer.running.set(false);
+
+	if (!m_isReconnectWanted || (connectionState.get() != ConnectionState::DISCONNECTED)) {
+		return;
+	}
+
+	spdlog::info("MqttClient::onReconnectRequested() - Reconnecting to {}:{}.", m_host, m_port);
+	metrics().reconnectAttempts.increment();
+	startConnecting();
+}
+
+void MqttClient::resubscribe()
+{
+	m_pendingResubscriptionMsgIds.clear();
+
+	// all topics of a SUBSCRIBE packet are requested with the same QoS -> one packet per QoS
+	for (const auto &[qos, topics] : m_subscriptionsRegistry.subscribedTopicsByGrantedQos()) {
+		spdlog::debug("MqttClient::resubscribe() - topics:{}, qos:{}", topics.size(), qos);
+
+		int msgId;
+		const auto result = m_mosquitto.client()->subscribeMultiple(&msgId, topics, qos);
+		const auto hasError = MqttLib::instance().checkMosquittoResultAndDoDebugPrints(result, "MqttClient::resubscribe()");
+		if (!hasError) {
+			m_subscriptionsRegistry.registerPendingRegistryOperation(SubscriptionsRegistry::Operation::SUBSCRIBE, topics, msgId, qos);
+			m_pendingResubscriptionMsgIds.push_back(msgId);
+		}
+	}
+
+	if (m_pendingResubscriptionMsgIds.empty()) {
+		reportRecovery();
+		return;
+	}
+	subscriptionState.set(SubscriptionState::SUBSCRIBING);
+	updateWriteOpInterest();
+}
+
+void MqttClient::reportRecovery()
+{
+	if (!m_connectionLostTime) {
+		return;
+	}
+
+	const auto timeToRecover = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - *m_connectionLostTime);
+	m_connectionLostTime.reset();
+
+	metrics().recoveryDuration.observe(std::chrono::duration<double>(timeToRecover).count());
+	spdlog::info("MqttClient::reportRecovery() - Recovered from connection loss after {} ms.", timeToRecover.count());
+	connectionRecovered.emit(timeToRecover);
 }
 
 void MqttClient::EventLoopHook::init(const std::chrono::milliseconds miscTaskInterval, MqttClient *parent)
@@ -370,6 +1043,26 @@ void MqttClient::EventLoopHook::init(const std::chrono::milliseconds miscTaskInt
 	miscTaskTimer->interval.set(miscTaskInterval);
 	miscTaskTimer->running.set(false);
 	miscTaskTimer->timeout.connect(&MqttClient::onMiscTaskRequested, parent);
+
+	cleanupTimer = std::make_unique<Timer>();
+	cleanupTimer->interval.set(std::chrono::microseconds(1));
+	cleanupTimer->running.set(false);
+	cleanupTimer->timeout.connect([this]() {
+		cleanupTimer->running.set(false);
+		if (!isInterestedInWriteOps) {
+			writeOpNotifier = {};
+		}
+	});
+
+	readTimer = std::make_unique<Timer>();
+	readTimer->interval.set(std::chrono::microseconds(1));
+	readTimer->running.set(false);
+	readTimer->timeout.connect([this]() {
+		readTimer->running.set(false);
+		if (isEngaged()) {
+			this->parent->onReadOpRequested();
+		}
+	});
 }
 
 void MqttClient::EventLoopHook::engage(const int socket)
@@ -391,11 +1084,13 @@ void MqttClient::EventLoopHook::engage(const int socket)
 		return;
 	}
 
-	readOpNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Read);
-	writeOpNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Write);
+	// a write notifier left by the last connection watches a closed socket
+	cleanupTimer->running.set(false);
+	writeOpNotifier = {};
 
+	this->socket = socket;
+	readOpNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Read);
 	readOpNotifier->triggered.connect(&MqttClient::onReadOpRequested, parent);
-	writeOpNotifier->triggered.connect(&MqttClient::onWriteOpRequested, parent);
 
 	miscTaskTimer->running.set(true);
 }
@@ -410,12 +1105,42 @@ void MqttClient::EventLoopHook::disengage()
 	}
 
 	miscTaskTimer->running.set(false);
+	readTimer->running.set(false);
 
 	readOpNotifier->triggered.disconnectAll();
-	writeOpNotifier->triggered.disconnectAll();
-
 	readOpNotifier = {};
-	writeOpNotifier = {};
+	setWriteOpInterest(false);
+	socket = -1;
+}
+
+void MqttClient::EventLoopHook::setWriteOpInterest(bool isInterested)
+{
+	if (isInterested == isInterestedInWriteOps) {
+		return;
+	}
+
+	isInterestedInWriteOps = isInterested;
+	if (isInterested) {
+		cleanupTimer->running.set(false);
+		if (!writeOpNotifier) {
+			writeOpNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Write);
+			writeOpNotifier->triggered.connect([this]() {
+				// the socket stays writable until the notifier is deleted
+				if (isInterestedInWriteOps) {
+					parent->onWriteOpRequested();
+				}
+			});
+		}
+	} else {
+		cleanupTimer->running.set(true);
+	}
+}
+
+void MqttClient::EventLoopHook::readLater()
+{
+	if (isEngaged()) {
+		readTimer->running.set(true);
+	}
 }
 
 bool MqttClient::EventLoopHook::isSetup() const
@@ -425,7 +1150,181 @@ bool MqttClient::EventLoopHook::isSetup() const
 
 bool MqttClient::EventLoopHook::isEngaged() const
 {
-	return (readOpNotifier && writeOpNotifier);
+	return (readOpNotifier != nullptr);
+}
+
+MqttClient::AsyncConnector::AsyncConnector()
+{
+	cleanupTimer.interval.set(std::chrono::microseconds(1));
+	cleanupTimer.timeout.connect([this]() {
+		cleanupTimer.running.set(false);
+		resultNotifier = {};
+		closePipe();
+	});
+}
+
+MqttClient::AsyncConnector::~AsyncConnector()
+{
+	// ~MqttClient() abandons a running connect -> this joins a finished one only
+	if (thread.joinable()) {
+		thread.join();
+	}
+	resultNotifier = {};
+	closePipe();
+}
+
+bool MqttClient::AsyncConnector::start(MosquittoClient *client, const std::string &host, int port, int keepalive, MqttClient *parent)
+{
+	spdlog::debug("MqttClient::AsyncConnector::start()");
+	assert(parent != nullptr);
+
+	if (isRunning()) {
+		spdlog::error("MqttClient::AsyncConnector::start() - Already running.");
+		return true;
+	}
+
+	cleanupTimer.running.set(false);
+	if (!resultNotifier) {
+		// pipe2() is not portable
+		if (::pipe(resultPipe) != 0) {
+			spdlog::error("MqttClient::AsyncConnector::start() - Cannot create pipe.");
+			resultPipe[0] = resultPipe[1] = -1;
+			return true;
+		}
+		for (const auto fd : resultPipe) {
+			::fcntl(fd, F_SETFD, FD_CLOEXEC);
+		}
+
+		resultNotifier = std::make_unique<FileDescriptorNotifier>(resultPipe[0], FileDescriptorNotifier::NotificationType::Read);
+		resultNotifier->triggered.connect([this]() { onFinished(); });
+	}
+
+	this->parent = parent;
+
+	startTime = std::chrono::steady_clock::now();
+	threadState = std::make_shared<ThreadState>();
+	thread = std::thread([client, host, port, keepalive, resultFd = resultPipe[1], threadState = threadState]() {
+		const int result = client->connect(host, port, keepalive);
+
+		std::lock_guard lock(threadState->mutex);
+		if (threadState->isAbandoned) {
+			// the pipe is closed already, nobody is interested in the result
+			delete threadState->client;
+			return;
+		}
+		// writes to a pipe up to PIPE_BUF bytes are atomic
+		[[maybe_unused]] const auto numberOfBytes = ::write(resultFd, &result, sizeof(result));
+		threadState->isFinished = true;
+	});
+	return false;
+}
+
+bool MqttClient::AsyncConnector::isRunning() const
+{
+	return thread.joinable();
+}
+
+void MqttClient::AsyncConnector::abandon(MosquittoClient *client)
+{
+	spdlog::debug("MqttClient::AsyncConnector::abandon()");
+
+	{
+		std::lock_guard lock(threadState->mutex);
+		if (!threadState->isFinished) {
+			// log messages of the connect must not reach the MqttClient anymore
+			client->logCallbackUnset();
+			threadState->isAbandoned = true;
+			threadState->client = client;
+			thread.detach();
+			return;
+		}
+	}
+
+	// the result has not been handled yet
+	thread.join();
+	delete client;
+}
+
+void MqttClient::AsyncConnector::onFinished()
+{
+	int result = MOSQ_ERR_UNKNOWN;
+	if (::read(resultPipe[0], &result, sizeof(result)) != sizeof(result)) {
+		spdlog::error("MqttClient::AsyncConnector::onFinished() - Cannot read result.");
+	}
+	thread.join();
+	const auto elapsedTime = std::chrono::steady_clock::now() - startTime;
+
+	cleanupTimer.running.set(true);
+
+	parent->onConnectFinished(result, elapsedTime);
+}
+
+void MqttClient::AsyncConnector::closePipe()
+{
+	for (auto &fd : resultPipe) {
+		if (fd >= 0) {
+			::close(fd);
+			fd = -1;
+		}
+	}
+}
+
+MqttClient::OutboundQueue::~OutboundQueue()
+{
+	metrics().outboundQueueMessages.decrement(static_cast<std::int64_t>(messageByMsgId.size()));
+	metrics().outboundQueueBytes.decrement(static_cast<std::int64_t>(bytes));
+}
+
+void MqttClient::OutboundQueue::add(int msgId, std::size_t size, int qos)
+{
+	const auto [it, isInserted] = messageByMsgId.try_emplace(msgId, Message { size, qos });
+	if (!isInserted) {
+		spdlog::warn("MqttClient::OutboundQueue::add() - msgId {} is already queued.", msgId);
+		return;
+	}
+	bytes += size;
+	metrics().outboundQueueMessages.increment();
+	metrics().outboundQueueBytes.increment(static_cast<std::int64_t>(size));
+}
+
+void MqttClient::OutboundQueue::remove(int msgId)
+{
+	const auto it = messageByMsgId.find(msgId);
+	if (it == messageByMsgId.end()) {
+		return;
+	}
+	bytes -= it->second.size;
+	metrics().outboundQueueMessages.decrement();
+	metrics().outboundQueueBytes.decrement(static_cast<std::int64_t>(it->second.size));
+	messageByMsgId.erase(it);
+}
+
+void MqttClient::OutboundQueue::removeQos0Messages()
+{
+	std::erase_if(messageByMsgId, [this](const auto &pair) {
+		if (pair.second.qos > 0) {
+			return false;
+		}
+		bytes -= pair.second.size;
+		metrics().outboundQueueMessages.decrement();
+		metrics().outboundQueueBytes.decrement(static_cast<std::int64_t>(pair.second.size));
+		return true;
+	});
+}
+
+std::size_t MqttClient::OutboundQueue::numberOfMessages() const
+{
+	return messageByMsgId.size();
+}
+
+std::size_t MqttClient::OutboundQueue::numberOfBytes() const
+{
+	return bytes;
+}
+
+MqttClient::MosquittoClientDependency::~MosquittoClientDependency()
+{
+	delete mosquittoClient;
 }
 
 void MqttClient::MosquittoClientDependency::init(MosquittoClient *client, MqttClient *parent)
@@ -451,46 +1350,94 @@ MosquittoClient *MqttClient::MosquittoClientDependency::client()
 	return mosquittoClient;
 }
 
-void MqttClient::SubscriptionsRegistry::registerPendingRegistryOperation(std::string_view topic, int msgId)
+MosquittoClient *MqttClient::MosquittoClientDependency::release()
+{
+	return std::exchange(mosquittoClient, nullptr);
+}
+
+void MqttClient::SubscriptionsRegistry::registerPendingRegistryOperation(Operation operation, std::vector<std::string> topics, int msgId, int requestedQos)
 {
-	spdlog::debug("MqttClient::SubscriptionsRegistry::registerPendingRegistryOperation() - topic:{}, msgId:{}", topic, msgId);
-	topicByMsgIdOfPendingOperations[msgId] = topic;
+	spdlog::debug("MqttClient::SubscriptionsRegistry::registerPendingRegistryOperation() - topics:{}, msgId:{}", topics, msgId);
+	pendingOperationByMsgId[msgId] = { operation, std::move(topics), requestedQos };
 }
 
-std::string MqttClient::SubscriptionsRegistry::registerTopicSubscriptionAndReturnTopicName(int msgId, int grantedQos)
+std::vector<std::string> MqttClient::SubscriptionsRegistry::registerTopicSubscriptionsAndReturnTopicNames(int msgId, int qosCount, const int *grantedQos)
 {
-	spdlog::debug("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionAndReturnTopicName() - msgId:{}, grantedQos:{}", msgId, grantedQos);
+	spdlog::debug("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionsAndReturnTopicNames() - msgId:{}, qosCount:{}", msgId, qosCount);
 
-	auto it = topicByMsgIdOfPendingOperations.find(msgId);
-	if (it == topicByMsgIdOfPendingOperations.end()) {
-		spdlog::error("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionAndReturnTopicName() - No pending operation with msgId: {}.", msgId);
+	auto it = pendingOperationByMsgId.find(msgId);
+	if (it == pendingOperationByMsgId.end()) {
+		spdlog::error("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionsAndReturnTopicNames() - No pending operation with msgId: {}.", msgId);
 		return {};
 	}
 
-	auto topic = it->second;
-	topicByMsgIdOfPendingOperations.erase(it);
+	auto pendingTopics = std::move(it->second.topics);
+	pendingOperationByMsgId.erase(it);
 
-	qosByTopicOfActiveSubscriptions[topic] = grantedQos;
+	const auto numberOfGrantedQos = static_cast<std::size_t>(std::max(qosCount, 0));
+	if (numberOfGrantedQos != pendingTopics.size()) {
+		spdlog::warn("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionsAndReturnTopicNames() - {} topics, but {} granted QoS.", pendingTopics.size(), numberOfGrantedQos);
+	}
 
-	return topic;
+	std::vector<std::string> topics;
+	topics.reserve(pendingTopics.size());
+	for (std::size_t i = 0; i < pendingTopics.size(); ++i) {
+		auto &topic = pendingTopics[i];
+		// 0x80 (MQTT 3.1.1) or a reason code >= 0x80 (MQTT 5) if the broker refused the topic
+		const auto isGranted = (i < numberOfGrantedQos) && (grantedQos[i] >= 0) && (grantedQos[i] <= 2);
+		if (!isGranted) {
+			spdlog::error("MqttClient::SubscriptionsRegistry::registerTopicSubscriptionsAndReturnTopicNames() - Subscription to {} refused.", topic);
+			qosByTopicOfActiveSubscriptions.erase(topic);
+			continue;
+		}
+		qosByTopicOfActiveSubscriptions[topic] = grantedQos[i];
+		topics.push_back(std::move(topic));
+	}
+	return topics;
 }
 
-std::string MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionAndReturnTopicName(int msgId)
+std::vector<std::string> MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionsAndReturnTopicNames(int msgId)
 {
-	spdlog::debug("MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionAndReturnTopicName() - msgId:{}", msgId);
-	
-	auto it = topicByMsgIdOfPendingOperations.find(msgId);
-	if (it == topicByMsgIdOfPendingOperations.end()) {
-		spdlog::error("MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionAndReturnTopicName() - No pending operation with msgId: {}.", msgId);
+	spdlog::debug("MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionsAndReturnTopicNames() - msgId:{}", msgId);
+
+	auto it = pendingOperationByMsgId.find(msgId);
+	if (it == pendingOperationByMsgId.end()) {
+		spdlog::error("MqttClient::SubscriptionsRegistry::unregisterTopicSubscriptionsAndReturnTopicNames() - No pending operation with msgId: {}.", msgId);
 		return {};
 	}
 
-	const auto &topic = it->second;
-	topicByMsgIdOfPendingOperations.erase(it);
+	auto topics = std::move(it->second.topics);
+	pendingOperationByMsgId.erase(it);
 
-	qosByTopicOfActiveSubscriptions.erase(topic);
+	for (const auto &topic : topics) {
+		qosByTopicOfActiveSubscriptions.erase(topic);
+	}
+	return topics;
+}
+
+void MqttClient::SubscriptionsRegistry::resolvePendingOperationsLostOnDisconnect()
+{
+	spdlog::debug("MqttClient::SubscriptionsRegistry::resolvePendingOperationsLostOnDisconnect() - operations:{}", pendingOperationByMsgId.size());
 
-	return topic;
+	// in order of sending, as a topic might have been subscribed to and unsubscribed from again
+	std::vector<int> msgIds;
+	msgIds.reserve(pendingOperationByMsgId.size());
+	for (const auto &pair : pendingOperationByMsgId) {
+		msgIds.push_back(pair.first);
+	}
+	std::sort(msgIds.begin(), msgIds.end());
+
+	for (const auto msgId : msgIds) {
+		const auto &operation = pendingOperationByMsgId.at(msgId);
+		for (const auto &topic : operation.topics) {
+			if (operation.operation == Operation::SUBSCRIBE) {
+				qosByTopicOfActiveSubscriptions[topic] = operation.requestedQos;
+			} else {
+				qosByTopicOfActiveSubscriptions.erase(topic);
+			}
+		}
+	}
+	pendingOperationByMsgId.clear();
 }
 
 std::vector<std::string> MqttClient::SubscriptionsRegistry::subscribedTopics() const
@@ -504,6 +1451,18 @@ std::vector<std::string> MqttClient::SubscriptionsRegistry::subscribedTopics() c
 	return keys;
 }
 
+std::map<int, std::vector<std::string>> MqttClient::SubscriptionsRegistry::subscribedTopicsByGrantedQos() const
+{
+	std::map<int, std::vector<std::string>> topicsByQos;
+	for (const auto &[topic, qos] : qosByTopicOfActiveSubscriptions) {
+		topicsByQos[qos].push_back(topic);
+	}
+	for (auto &[qos, topics] : topicsByQos) {
+		std::sort(topics.begin(), topics.end());
+	}
+	return topicsByQos;
+}
+
 int MqttClient::SubscriptionsRegistry::grantedQosForTopic(const std::string &topic) const
 {
 	return qosByTopicOfActiveSubscriptions.at(topic);
@@ -4,13 +4,29 @@
 #include <KDFoundation/timer.h>
 #include <KDUtils/file.h>
 #include <KDUtils/url.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
 #include "mosquitto_wrapper.h"
+#include "publish_store.h"
+#include "topic_router.h"
 
 using namespace KDFoundation;
 using namespace KDUtils;
 
 constexpr int c_defaultPort = 1883;
 constexpr int c_defaultKeepAliveSeconds = 60;
+constexpr int c_defaultReadBudgetPackets = 100;
+constexpr std::chrono::microseconds c_defaultReadBudgetDuration = std::chrono::milliseconds(5);
+constexpr std::size_t c_defaultOutboundQueueHighWaterBytes = 1024 * 1024;
+constexpr int c_defaultReplayBatchSize = 50;
+constexpr std::chrono::milliseconds c_defaultReplayInterval = std::chrono::milliseconds(10);
+constexpr std::chrono::milliseconds c_defaultReconnectInitialDelay = std::chrono::seconds(1);
+constexpr std::chrono::milliseconds c_defaultReconnectMaxDelay = std::chrono::seconds(60);
 
 /*
  * Class: IMqttLib
@@ -103,8 +119,12 @@ class IMqttClient
 
 	KDBindings::Property<std::vector<std::string>> subscriptions { };
 
+	using MessageHandler = TopicRouter::MessageHandler;
+
 	KDBindings::Signal<int /*msgId*/> msgPublished;
-	KDBindings::Signal<const mosquitto_message * /*msg*/> msgReceived;
+	// emitted for every message, see subscribe() with handler for receiving messages per topic filter;
+	// the message is only valid while being emitted, keep an MqttMessage to use it afterwards
+	KDBindings::Signal<const MqttMessageView & /*msg*/> msgReceived;
 
 	KDBindings::Signal<> error;
 
@@ -118,7 +138,10 @@ class IMqttClient
 	virtual int publish(int *msgId, const char *topic, int payloadlen = 0, const void *payload = nullptr, int qos = 0, bool retain = false) = 0;
 
 	virtual int subscribe(const char *pattern, int qos = 0) = 0;
+	virtual int subscribe(const char *pattern, MessageHandler handler, int qos = 0) = 0;
+	virtual int subscribe(const std::vector<std::string> &patterns, int qos = 0) = 0;
 	virtual int unsubscribe(const char *pattern) = 0;
+	virtual int unsubscribe(const std::vector<std::string> &patterns) = 0;
 };
 
 /*
@@ -133,22 +156,86 @@ class MqttClient : public IMqttClient
 
   public:
 	MqttClient(const std::string &clientId, bool cleanSession = true, bool verbose = false);
-	~MqttClient() = default;
+	~MqttClient();
 
 	int setTls(const File &cafile) override;
 	int setUsernameAndPassword(const std::string &username, const std::string &password) override;
 	int setWill(const std::string &topic, int payloadlen = 0, const void *payload = nullptr, int qos = 0, bool retain = false) override;
 
+	// does not block: returns once connecting started, connectionState turns CONNECTED on
+	// CONNACK or DISCONNECTED (emitting error) if the connection cannot be established;
+	// once connected, all topics of the SubscriptionsRegistry are subscribed to again
 	int connect(const Url &host, int port = c_defaultPort, int keepalive = c_defaultKeepAliveSeconds) override;
 	int disconnect() override;
 
 	int publish(int *msgId, const char *topic, int payloadlen = 0, const void *payload = nullptr, int qos = 0, bool retain = false) override;
 
 	int subscribe(const char *pattern, int qos = 0) override;
+	// handler is called for every message matching pattern (wildcards included), in addition to
+	// msgReceived; subscribing to the same pattern again adds another handler
+	int subscribe(const char *pattern, MessageHandler handler, int qos = 0) override;
+	// subscribes to all patterns with one SUBSCRIBE packet, i.e. one round trip; the broker
+	// grants the QoS of each pattern individually (see subscriptions and grantedQos in the SUBACK)
+	int subscribe(const std::vector<std::string> &patterns, int qos = 0) override;
+	// removes all handlers of pattern
 	int unsubscribe(const char *pattern) override;
+	// unsubscribes from all patterns with one UNSUBSCRIBE packet, removing all their handlers
+	int unsubscribe(const std::vector<std::string> &patterns) override;
+
+	// limits the packets read and the time spent reading per wakeup of the socket, so that
+	// a flood of messages cannot starve the event loop; the rest is read on the next wakeup
+	void setReadBudget(int maxPackets, std::chrono::microseconds maxDuration);
+
+	// when enabled, packets of publish() (and subscribe() etc.) are not sent right away but
+	// queued and flushed together once the event loop got to process the socket, with the
+	// socket corked (TCP_CORK) while flushing if corkSocket is set, so that many small
+	// messages are sent in few TCP segments; not allowed while connecting;
+	// corking is Linux only, corkSocket has no effect on other platforms
+	int setPublishBatching(bool isEnabled, bool corkSocket = true);
+
+	// limits the QoS 1 and 2 messages sent but not acknowledged yet (MOSQ_OPT_SEND_MAXIMUM),
+	// further messages wait in mosquitto's queue; only allowed when disconnected
+	int setMaxInflightMessages(int maxInflightMessages);
+	// isOutboundQueueWritable turns false once highWaterBytes of messages are published but not
+	// acknowledged (QoS 1 and 2) or sent (QoS 0) yet, and true again below half of it, so that
+	// producers can throttle; publish() fails with MOSQ_ERR_NOMEM once maxBytes would be
+	// exceeded (0: no limit)
+	void setOutboundQueueLimits(std::size_t highWaterBytes, std::size_t maxBytes = 0);
+	[[nodiscard]] std::size_t outboundQueueMessages() const;
+	[[nodiscard]] std::size_t outboundQueueBytes() const;
+
+	KDBindings::Property<bool> isOutboundQueueWritable { true };
+
+	// publish() appends messages to a PublishStore in directoryPath instead of rejecting them while
+	// not connected, and as long as stored messages are left, to keep the order of messages; once
+	// connected, up to replayBatchSize stored messages are published per replayInterval, as long as
+	// isOutboundQueueWritable; an empty directoryPath disables it; only allowed when disconnected
+	int setStoreAndForward(const std::string &directoryPath, const PublishStore::Options &options = {},
+						   int replayBatchSize = c_defaultReplayBatchSize, std::chrono::milliseconds replayInterval = c_defaultReplayInterval);
+
+	// when enabled, the client connects again whenever the connection got lost or could not be
+	// established, until disconnect() is called; the n-th attempt is delayed by a random time
+	// between half of and initialDelay * 2^n, but at most maxDelay, so that clients losing their
+	// broker at the same time do not reconnect all at once
+	void setAutoReconnect(bool isEnabled, std::chrono::milliseconds initialDelay = c_defaultReconnectInitialDelay,
+						  std::chrono::milliseconds maxDelay = c_defaultReconnectMaxDelay);
+
+	// emitted once reconnected and subscribed to all topics again after the connection got lost,
+	// with the time passed since it got lost
+	KDBindings::Signal<std::chrono::milliseconds /*timeToRecover*/> connectionRecovered;
 
   private:
 	bool m_verbose;
+	int m_readBudgetPackets { c_defaultReadBudgetPackets };
+	std::chrono::microseconds m_readBudgetDuration { c_defaultReadBudgetDuration };
+	bool m_corksSocketWhenFlushing { false };
+	std::size_t m_outboundQueueHighWaterBytes { c_defaultOutboundQueueHighWaterBytes };
+	std::size_t m_outboundQueueMaxBytes { 0 };
+	// see publishAndCheckIfSent()
+	bool m_isPublishing { false };
+	std::vector<int> m_msgIdsSentWhilePublishing;
+	// see mqtt_clients_connected in MetricsRegistry::instance()
+	bool m_isCountedAsConnected { false };
 
 	/*
 	 * Mosquitto client event handlers
@@ -161,6 +248,7 @@ class MqttClient : public IMqttClient
 	void onUnsubscribed(int msgId);
 	void onLog(int level, const char *str) const;
 	void onError();
+	void onConnectFinished(int result, std::chrono::steady_clock::duration elapsedTime);
 
 	/*
 	 * Event loop handlers
@@ -168,6 +256,17 @@ class MqttClient : public IMqttClient
 	void onReadOpRequested();
 	void onWriteOpRequested();
 	void onMiscTaskRequested();
+	void updateWriteOpInterest();
+	void updateOutboundQueueWritability();
+	int publishAndCheckIfSent(int *msgId, const std::string &topic, int payloadlen, const void *payload, int qos, bool retain, bool &isSent);
+	int storeMessage(int *msgId, const char *topic, int payloadlen, const void *payload, int qos, bool retain);
+	void onReplayRequested();
+	int startConnecting();
+	void stopReconnecting();
+	void scheduleReconnect();
+	void onReconnectRequested();
+	void resubscribe();
+	void reportRecovery();
 
 	/*
 	 * This struct modularizes the mechanism to hook mosquitto's
@@ -175,6 +274,12 @@ class MqttClient : public IMqttClient
 	 * This is done by monitoring the client's network socket
 	 * using FileDescriptorNotifiers and having an additional
 	 * timer to trigger cyclic misc tasks.
+	 * As a connected socket is almost always writable, the socket
+	 * is only monitored for writability while mosquitto has data
+	 * pending to be sent (see updateWriteOpInterest()).
+	 * The interest is mostly lost from within the slot of the write
+	 * notifier, so the notifier is deleted afterwards, unless the
+	 * interest comes back meanwhile.
 	 */
 	struct EventLoopHook
 	{
@@ -184,13 +289,22 @@ class MqttClient : public IMqttClient
 		void engage(int socket);
 		void disengage();
 
+		void setWriteOpInterest(bool isInterested);
+		// calls MqttClient::onReadOpRequested() on the next event loop iteration,
+		// for data the read notifier cannot report (see MqttClient::onReadOpRequested())
+		void readLater();
+
 		[[nodiscard]] bool isSetup() const;
 		[[nodiscard]] bool isEngaged() const;
 
 	  private:
 		std::unique_ptr<FileDescriptorNotifier> readOpNotifier;
 		std::unique_ptr<FileDescriptorNotifier> writeOpNotifier;
+		bool isInterestedInWriteOps { false };
 		std::unique_ptr<Timer> miscTaskTimer;
+		std::unique_ptr<Timer> cleanupTimer;
+		std::unique_ptr<Timer> readTimer;
+		int socket { -1 };
 		MqttClient *parent { nullptr };
 	};
 	EventLoopHook m_eventLoopHook;
@@ -207,14 +321,73 @@ class MqttClient : public IMqttClient
 	struct MosquittoClientDependency
 	{
 	  public:
+		~MosquittoClientDependency();
+
 		void init(MosquittoClient *client, MqttClient *parent);
 		MosquittoClient *client();
+		// the caller takes ownership of the client, see AsyncConnector::abandon()
+		MosquittoClient *release();
 
 	  private:
 		MosquittoClient* mosquittoClient { nullptr };
 	};
 	MosquittoClientDependency m_mosquitto;
 
+	/*
+	 * This struct runs the blocking MosquittoClient::connect(), i.e. DNS lookup,
+	 * TCP and TLS handshakes and sending CONNECT, on a helper thread.
+	 * mosquitto_connect_async() is no alternative, as it does not work with TLS
+	 * (see https://github.com/eclipse/mosquitto/issues/990) and resolves the
+	 * host name blocking anyway.
+	 * The helper thread passes the result through a pipe watched by a
+	 * FileDescriptorNotifier, so that it is handled on the event loop's thread.
+	 * Nothing else must use the mosquitto client while the helper thread runs.
+	 */
+	struct AsyncConnector
+	{
+	  public:
+		AsyncConnector();
+		// see abandon()
+		~AsyncConnector();
+
+		// returns true in case of error
+		bool start(MosquittoClient *client, const std::string &host, int port, int keepalive, MqttClient *parent);
+		[[nodiscard]] bool isRunning() const;
+		// a running connect cannot be interrupted and may block for minutes -> instead of waiting for it,
+		// the helper thread is detached, drops the result and deletes client (taking ownership of it)
+		void abandon(MosquittoClient *client);
+
+	  private:
+		void onFinished();
+		void closePipe();
+
+		// shared with the helper thread, which outlives an abandoned connector
+		struct ThreadState
+		{
+			std::mutex mutex;
+			bool isFinished { false };
+			bool isAbandoned { false };
+			MosquittoClient *client { nullptr };
+		};
+
+		std::thread thread;
+		std::shared_ptr<ThreadState> threadState;
+		int resultPipe[2] { -1, -1 };
+		std::unique_ptr<FileDescriptorNotifier> resultNotifier;
+		// the connect finishes from within the slot of the notifier -> deleted afterwards,
+		// unless another connect has been started meanwhile, which reuses pipe and notifier
+		Timer cleanupTimer;
+		std::chrono::steady_clock::time_point startTime;
+		MqttClient *parent { nullptr };
+	};
+	AsyncConnector m_asyncConnector;
+	// disconnect() while AsyncConnector runs -> disconnect once connected
+	bool m_isDisconnectRequestedWhileConnecting { false };
+	// parameters of connect(), used for reconnecting as well
+	std::string m_host;
+	int m_port { c_defaultPort };
+	int m_keepalive { c_defaultKeepAliveSeconds };
+
 	/*
 	 * This struct modularizes the registry maintaining all
 	 * subscriptions to MQTT topics this MqttClient has.
@@ -222,16 +395,94 @@ class MqttClient : public IMqttClient
 	struct SubscriptionsRegistry
 	{
 	  public:
-		void registerPendingRegistryOperation(std::string_view topic, int msgId);
-		std::string registerTopicSubscriptionAndReturnTopicName(int msgId, int grantedQos);
-		std::string unregisterTopicSubscriptionAndReturnTopicName(int msgId);
+		enum class Operation {
+			SUBSCRIBE,
+			UNSUBSCRIBE
+		};
+
+		void registerPendingRegistryOperation(Operation operation, std::vector<std::string> topics, int msgId, int requestedQos = 0);
+		// topics the broker refused (granted QoS 0x80) are not registered and not returned
+		std::vector<std::string> registerTopicSubscriptionsAndReturnTopicNames(int msgId, int qosCount, const int *grantedQos);
+		std::vector<std::string> unregisterTopicSubscriptionsAndReturnTopicNames(int msgId);
+		// the broker never acknowledges operations pending when the connection got lost ->
+		// topics being subscribed to are registered with their requested QoS, to be subscribed
+		// to again once reconnected, topics being unsubscribed from are unregistered
+		void resolvePendingOperationsLostOnDisconnect();
 
 		std::vector<std::string> subscribedTopics() const;
+		std::map<int, std::vector<std::string>> subscribedTopicsByGrantedQos() const;
 		int grantedQosForTopic(const std::string &topic) const;
 
 	  private:
+		struct PendingOperation
+		{
+			Operation operation;
+			std::vector<std::string> topics;
+			int requestedQos;
+		};
 		std::unordered_map<std::string,int> qosByTopicOfActiveSubscriptions;
-		std::unordered_map<int,std::string> topicByMsgIdOfPendingOperations;
+		std::unordered_map<int,PendingOperation> pendingOperationByMsgId;
 	};
 	SubscriptionsRegistry m_subscriptionsRegistry;
+
+	/*
+	 * This struct keeps track of the messages published but not
+	 * acknowledged (QoS 1 and 2) or sent (QoS 0) yet, i.e. of the
+	 * messages in mosquitto's outbound queue.
+	 */
+	struct OutboundQueue
+	{
+	  public:
+		~OutboundQueue();
+
+		void add(int msgId, std::size_t size, int qos);
+		void remove(int msgId);
+		// mosquitto drops QoS 0 messages on disconnect and resends the others after reconnecting
+		void removeQos0Messages();
+
+		[[nodiscard]] std::size_t numberOfMessages() const;
+		[[nodiscard]] std::size_t numberOfBytes() const;
+
+	  private:
+		struct Message
+		{
+			std::size_t size;
+			int qos;
+		};
+		std::unordered_map<int, Message> messageByMsgId;
+		std::size_t bytes { 0 };
+	};
+	OutboundQueue m_outboundQueue;
+
+	/*
+	 * Store and forward, see setStoreAndForward()
+	 */
+	struct ReplayedRecord
+	{
+		std::uint64_t recordId;
+		int qos;
+	};
+	std::unique_ptr<PublishStore> m_publishStore;
+	int m_replayBatchSize { c_defaultReplayBatchSize };
+	Timer m_replayTimer;
+	// stored messages published but not acknowledged yet
+	std::unordered_map<int, ReplayedRecord> m_replayedRecordByMsgId;
+
+	/*
+	 * Auto reconnect, see setAutoReconnect()
+	 */
+	bool m_isAutoReconnectEnabled { false };
+	// set by connect(), reset by disconnect()
+	bool m_isReconnectWanted { false };
+	std::chrono::milliseconds m_reconnectInitialDelay { c_defaultReconnectInitialDelay };
+	std::chrono::milliseconds m_reconnectMaxDelay { c_defaultReconnectMaxDelay };
+	int m_reconnectAttempt { 0 };
+	Timer m_reconnectTimer;
+	std::mt19937 m_reconnectDelayRandomEngine { std::random_device{}() };
+	// SUBSCRIBE packets of resubscribe() not acknowledged yet
+	std::vector<int> m_pendingResubscriptionMsgIds;
+	// time the connection got lost, until recovered, see reportRecovery()
+	std::optional<std::chrono::steady_clock::time_point> m_connectionLostTime;
+
+	TopicRouter m_topicRouter;
 };
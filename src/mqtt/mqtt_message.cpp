@@ -0,0 +1,152 @@
+#include "mqtt_message.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+MqttMessageView MqttMessageView::fromMosquittoMessage(const mosquitto_message &message)
+{
+	MqttMessageView view;
+	view.msgId = message.mid;
+	view.topic = (message.topic != nullptr) ? std::string_view(message.topic) : std::string_view();
+	if ((message.payload != nullptr) && (message.payloadlen > 0)) {
+		view.payload = std::span(static_cast<const std::byte*>(message.payload), static_cast<std::size_t>(message.payloadlen));
+	}
+	view.qos = message.qos;
+	view.retain = message.retain;
+	return view;
+}
+
+std::string_view MqttMessageView::payloadAsString() const
+{
+	return std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size());
+}
+
+MqttMessagePool::MqttMessagePool(std::size_t slotSize, std::size_t slotsPerSlab)
+	: m_slotSize{slotSize}
+	, m_slotsPerSlab{std::max<std::size_t>(slotsPerSlab, 1)}
+{
+}
+
+MqttMessagePool &MqttMessagePool::instance()
+{
+	static MqttMessagePool s_instance;
+	return s_instance;
+}
+
+std::byte *MqttMessagePool::allocate(std::size_t size)
+{
+	if (size > m_slotSize) {
+		return new std::byte[size];
+	}
+
+	const std::lock_guard lock(m_mutex);
+	if (m_freeSlots.empty()) {
+		auto &slab = m_slabs.emplace_back(std::make_unique_for_overwrite<std::byte[]>(m_slotSize * m_slotsPerSlab));
+		m_freeSlots.reserve(m_slabs.size() * m_slotsPerSlab);
+		for (std::size_t i = m_slotsPerSlab; i > 0; --i) {
+			m_freeSlots.push_back(slab.get() + (i - 1) * m_slotSize);
+		}
+	}
+	auto *slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	return slot;
+}
+
+void MqttMessagePool::deallocate(std::byte *data, std::size_t size)
+{
+	if (data == nullptr) {
+		return;
+	}
+
+	if (size > m_slotSize) {
+		delete[] data;
+		return;
+	}
+
+	const std::lock_guard lock(m_mutex);
+	m_freeSlots.push_back(data);
+}
+
+std::size_t MqttMessagePool::slotSize() const
+{
+	return m_slotSize;
+}
+
+std::size_t MqttMessagePool::numberOfFreeSlots() const
+{
+	const std::lock_guard lock(m_mutex);
+	return m_freeSlots.size();
+}
+
+MqttMessage::MqttMessage(const MqttMessageView &message, MqttMessagePool &pool)
+	: m_topicSize{message.topic.size()}
+	, m_payloadSize{message.payload.size()}
+	, m_msgId{message.msgId}
+	, m_qos{message.qos}
+	, m_retain{message.retain}
+	, m_pool{&pool}
+{
+	m_data = m_pool->allocate(m_topicSize + m_payloadSize);
+	if (m_topicSize > 0) {
+		std::memcpy(m_data, message.topic.data(), m_topicSize);
+	}
+	if (m_payloadSize > 0) {
+		std::memcpy(m_data + m_topicSize, message.payload.data(), m_payloadSize);
+	}
+}
+
+MqttMessage::~MqttMessage()
+{
+	release();
+}
+
+MqttMessage::MqttMessage(MqttMessage &&other) noexcept
+	: m_data{std::exchange(other.m_data, nullptr)}
+	, m_topicSize{std::exchange(other.m_topicSize, 0)}
+	, m_payloadSize{std::exchange(other.m_payloadSize, 0)}
+	, m_msgId{other.m_msgId}
+	, m_qos{other.m_qos}
+	, m_retain{other.m_retain}
+	, m_pool{std::exchange(other.m_pool, nullptr)}
+{
+}
+
+MqttMessage &MqttMessage::operator=(MqttMessage &&other) noexcept
+{
+	if (this != &other) {
+		release();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_topicSize = std::exchange(other.m_topicSize, 0);
+		m_payloadSize = std::exchange(other.m_payloadSize, 0);
+		m_msgId = other.m_msgId;
+		m_qos = other.m_qos;
+		m_retain = other.m_retain;
+		m_pool = std::exchange(other.m_pool, nullptr);
+	}
+	return *this;
+}
+
+MqttMessageView MqttMessage::view() const
+{
+	MqttMessageView view;
+	view.msgId = m_msgId;
+	view.topic = std::string_view(reinterpret_cast<const char*>(m_data), m_topicSize);
+	view.payload = std::span<const std::byte>(m_data + m_topicSize, m_payloadSize);
+	view.qos = m_qos;
+	view.retain = m_retain;
+	return view;
+}
+
+bool MqttMessage::isEmpty() const
+{
+	return (m_pool == nullptr);
+}
+
+void MqttMessage::release()
+{
+	if (m_pool != nullptr) {
+		m_pool->deallocate(m_data, m_topicSize + m_payloadSize);
+		m_pool = nullptr;
+		m_data = nullptr;
+	}
+}
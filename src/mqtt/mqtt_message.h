@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mosquitto.h>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+/*
+ * Class: MqttMessageView
+ *
+ * Non-owning view of a received MQTT message, valid only while the
+ * message is being handled (see IMqttClient::msgReceived). The payload
+ * is not necessarily NUL terminated, use payloadAsString() to read text.
+ * Keep an MqttMessage to use the message afterwards.
+ */
+struct MqttMessageView
+{
+	int msgId { 0 };
+	std::string_view topic;
+	std::span<const std::byte> payload;
+	int qos { 0 };
+	bool retain { false };
+
+	static MqttMessageView fromMosquittoMessage(const mosquitto_message &message);
+
+	[[nodiscard]] std::string_view payloadAsString() const;
+};
+
+/*
+ * Class: MqttMessagePool
+ *
+ * Hands out fixed size slots for the data of MqttMessages, which are
+ * carved out of slabs allocated on demand and reused once released, so
+ * that keeping a message does not cost a heap allocation per message.
+ * Data not fitting into a slot is allocated on the heap.
+ * Safe to use from any thread, must outlive the messages using it.
+ */
+class MqttMessagePool
+{
+  public:
+	explicit MqttMessagePool(std::size_t slotSize = 512, std::size_t slotsPerSlab = 64);
+
+	MqttMessagePool(const MqttMessagePool&) = delete;
+	MqttMessagePool &operator=(const MqttMessagePool&) = delete;
+
+	static MqttMessagePool &instance();
+
+	std::byte *allocate(std::size_t size);
+	// size has to match the size passed to allocate()
+	void deallocate(std::byte *data, std::size_t size);
+
+	[[nodiscard]] std::size_t slotSize() const;
+	[[nodiscard]] std::size_t numberOfFreeSlots() const;
+
+  private:
+	const std::size_t m_slotSize;
+	const std::size_t m_slotsPerSlab;
+	mutable std::mutex m_mutex;
+	std::vector<std::unique_ptr<std::byte[]>> m_slabs;
+	std::vector<std::byte*> m_freeSlots;
+};
+
+/*
+ * Class: MqttMessage
+ *
+ * Move-only copy of a received MQTT message, for consumers using it
+ * beyond the handling of the message. Its topic and payload are stored
+ * back to back in a slot of an MqttMessagePool.
+ */
+class MqttMessage
+{
+  public:
+	MqttMessage() = default;
+	explicit MqttMessage(const MqttMessageView &message, MqttMessagePool &pool = MqttMessagePool::instance());
+	~MqttMessage();
+
+	MqttMessage(MqttMessage &&other) noexcept;
+	MqttMessage &operator=(MqttMessage &&other) noexcept;
+
+	MqttMessage(const MqttMessage&) = delete;
+	MqttMessage &operator=(const MqttMessage&) = delete;
+
+	// valid as long as this MqttMessage is neither destroyed nor assigned to
+	[[nodiscard]] MqttMessageView view() const;
+	[[nodiscard]] bool isEmpty() const;
+
+  private:
+	void release();
+
+	std::byte *m_data { nullptr };
+	std::size_t m_topicSize { 0 };
+	std::size_t m_payloadSize { 0 };
+	int m_msgId { 0 };
+	int m_qos { 0 };
+	bool m_retain { false };
+	MqttMessagePool *m_pool { nullptr };
+};
@@ -0,0 +1,429 @@
+#include "publish_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char c_magic[4] = { 'M', 'Q', 'S', 'F' };
+constexpr std::uint32_t c_version = 1;
+constexpr std::size_t c_segmentHeaderSize = sizeof(c_magic) + sizeof(c_version);
+constexpr std::size_t c_recordAlignment = 8;
+constexpr std::uint8_t c_acknowledgedFlag = 0x01;
+constexpr std::string_view c_segmentFileExtension = ".seg";
+
+struct RecordHeader
+{
+	std::uint32_t size;
+	std::uint8_t flags;
+	std::uint8_t qos;
+	std::uint8_t retain;
+	std::uint8_t reserved;
+	std::uint16_t topicSize;
+	std::uint16_t reserved2;
+	std::uint32_t payloadSize;
+};
+static_assert(sizeof(RecordHeader) == 16);
+constexpr std::size_t c_flagsOffset = offsetof(RecordHeader, flags);
+
+std::size_t alignedRecordSize(std::size_t topicSize, std::size_t payloadSize)
+{
+	const auto size = sizeof(RecordHeader) + topicSize + payloadSize;
+	return (size + c_recordAlignment - 1) / c_recordAlignment * c_recordAlignment;
+}
+
+std::string segmentFileName(std::uint64_t sequenceNumber)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(sequenceNumber));
+	return std::string(name) + std::string(c_segmentFileExtension);
+}
+
+}
+
+PublishStore::~PublishStore()
+{
+	close();
+}
+
+bool PublishStore::open(const std::string &directoryPath, const Options &options)
+{
+	spdlog::debug("PublishStore::open() - {}", directoryPath);
+
+	close();
+
+	if (options.segmentSize < c_segmentHeaderSize + alignedRecordSize(0, 0)) {
+		spdlog::error("PublishStore::open() - Segment size {} is too small.", options.segmentSize);
+		return true;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(directoryPath, ec);
+	if (ec) {
+		spdlog::error("PublishStore::open() - Cannot create {}: {}", directoryPath, ec.message());
+		return true;
+	}
+
+	std::vector<std::uint64_t> sequenceNumbers;
+	for (const auto &entry : std::filesystem::directory_iterator(directoryPath, ec)) {
+		const auto &path = entry.path();
+		if (!entry.is_regular_file() || (path.extension() != c_segmentFileExtension)) {
+			continue;
+		}
+		const auto stem = path.stem().string();
+		std::uint64_t sequenceNumber;
+		const auto result = std::from_chars(stem.data(), stem.data() + stem.size(), sequenceNumber, 16);
+		if ((result.ec == std::errc()) && (result.ptr == stem.data() + stem.size())) {
+			sequenceNumbers.push_back(sequenceNumber);
+		}
+	}
+	if (ec) {
+		spdlog::error("PublishStore::open() - Cannot read {}: {}", directoryPath, ec.message());
+		return true;
+	}
+	std::ranges::sort(sequenceNumbers);
+
+	m_directoryPath = directoryPath;
+	m_options = options;
+	for (const auto sequenceNumber : sequenceNumbers) {
+		Segment segment;
+		segment.sequenceNumber = sequenceNumber;
+		segment.path = (std::filesystem::path(directoryPath) / segmentFileName(sequenceNumber)).string();
+		if (openSegment(segment, false)) {
+			spdlog::warn("PublishStore::open() - Skipping segment {}.", segment.path);
+			continue;
+		}
+		readRecords(segment);
+		m_segments.push_back(std::move(segment));
+	}
+	m_nextSequenceNumber = sequenceNumbers.empty() ? 0 : (sequenceNumbers.back() + 1);
+	// first record of the first segment
+	m_cursor = (m_segments.empty() ? m_nextSequenceNumber : m_segments.front().sequenceNumber) << 32;
+	removeAcknowledgedSegments();
+
+	spdlog::info("PublishStore::open() - {} records to be forwarded in {} segments", m_numberOfRecords, m_segments.size());
+	return false;
+}
+
+void PublishStore::close()
+{
+	for (auto &segment : m_segments) {
+		closeSegment(segment, false);
+	}
+	m_segments.clear();
+	m_directoryPath.clear();
+	m_numberOfRecords = 0;
+	m_numberOfPendingRecords = 0;
+}
+
+bool PublishStore::isOpen() const
+{
+	return !m_directoryPath.empty();
+}
+
+bool PublishStore::append(std::string_view topic, std::span<const std::byte> payload, int qos, bool retain)
+{
+	if (!isOpen()) {
+		spdlog::error("PublishStore::append() - Store is not open.");
+		return true;
+	}
+
+	const auto recordSize = alignedRecordSize(topic.size(), payload.size());
+	if ((topic.size() > UINT16_MAX) || (recordSize > m_options.segmentSize - c_segmentHeaderSize)) {
+		spdlog::error("PublishStore::append() - Message of {} bytes does not fit into a segment.", recordSize);
+		return true;
+	}
+
+	if (m_segments.empty() || (m_segments.back().writeOffset + recordSize > m_segments.back().size)) {
+		if (appendSegment()) {
+			return true;
+		}
+	}
+
+	auto &segment = m_segments.back();
+	auto *record = segment.data + segment.writeOffset;
+	RecordHeader header {};
+	header.qos = static_cast<std::uint8_t>(qos);
+	header.retain = retain ? 1 : 0;
+	header.topicSize = static_cast<std::uint16_t>(topic.size());
+	header.payloadSize = static_cast<std::uint32_t>(payload.size());
+	std::memcpy(record, &header, sizeof(header));
+	std::memcpy(record + sizeof(header), topic.data(), topic.size());
+	if (!payload.empty()) {
+		std::memcpy(record + sizeof(header) + topic.size(), payload.data(), payload.size());
+	}
+	// the size commits the record, a record without size terminates the log when reading it after a crash
+	const auto size = static_cast<std::uint32_t>(recordSize);
+	std::memcpy(record, &size, sizeof(size));
+
+	if (m_options.syncOnAppend) {
+		const auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+		const auto syncOffset = segment.writeOffset / pageSize * pageSize;
+		if (::msync(segment.data + syncOffset, segment.writeOffset + recordSize - syncOffset, MS_SYNC) != 0) {
+			spdlog::warn("PublishStore::append() - msync() failed: {}", std::strerror(errno));
+		}
+	}
+
+	segment.recordOffsets.push_back(static_cast<std::uint32_t>(segment.writeOffset));
+	segment.recordStates.push_back(RecordState::PENDING);
+	segment.writeOffset += recordSize;
+	++m_numberOfRecords;
+	++m_numberOfPendingRecords;
+	return false;
+}
+
+std::optional<PublishStore::Record> PublishStore::next()
+{
+	if (m_numberOfPendingRecords == 0) {
+		return std::nullopt;
+	}
+
+	for (auto &segment : m_segments) {
+		const auto cursorSequenceNumber = m_cursor >> 32;
+		if (segment.sequenceNumber < cursorSequenceNumber) {
+			continue;
+		}
+
+		const auto firstIndex = (segment.sequenceNumber == cursorSequenceNumber) ? static_cast<std::size_t>(m_cursor & UINT32_MAX) : 0;
+		for (auto index = firstIndex; index < segment.recordStates.size(); ++index) {
+			if (segment.recordStates[index] != RecordState::PENDING) {
+				continue;
+			}
+			segment.recordStates[index] = RecordState::HANDED_OUT;
+			--m_numberOfPendingRecords;
+			m_cursor = recordId(segment, index + 1);
+
+			const auto *record = segment.data + segment.recordOffsets[index];
+			RecordHeader header;
+			std::memcpy(&header, record, sizeof(header));
+			Record result { recordId(segment, index), {} };
+			result.message.topic = std::string_view(reinterpret_cast<const char*>(record + sizeof(header)), header.topicSize);
+			result.message.payload = std::span(record + sizeof(header) + header.topicSize, header.payloadSize);
+			result.message.qos = header.qos;
+			result.message.retain = (header.retain != 0);
+			return result;
+		}
+	}
+
+	spdlog::error("PublishStore::next() - Pending records not found.");
+	m_numberOfPendingRecords = 0;
+	return std::nullopt;
+}
+
+void PublishStore::acknowledge(std::uint64_t recordId)
+{
+	auto *segment = segmentOfRecord(recordId);
+	if (segment == nullptr) {
+		// dropped meanwhile, see DropPolicy::DROP_OLDEST
+		return;
+	}
+
+	const auto index = static_cast<std::size_t>(recordId & UINT32_MAX);
+	auto &state = segment->recordStates[index];
+	if (state == RecordState::ACKNOWLEDGED) {
+		return;
+	}
+	if (state == RecordState::PENDING) {
+		--m_numberOfPendingRecords;
+	}
+	state = RecordState::ACKNOWLEDGED;
+	segment->data[segment->recordOffsets[index] + c_flagsOffset] |= std::byte { c_acknowledgedFlag };
+	++segment->numberOfAcknowledgedRecords;
+	--m_numberOfRecords;
+
+	removeAcknowledgedSegments();
+}
+
+void PublishStore::requeue(std::uint64_t recordId)
+{
+	auto *segment = segmentOfRecord(recordId);
+	if (segment == nullptr) {
+		return;
+	}
+
+	auto &state = segment->recordStates[static_cast<std::size_t>(recordId & UINT32_MAX)];
+	if (state != RecordState::HANDED_OUT) {
+		return;
+	}
+	state = RecordState::PENDING;
+	++m_numberOfPendingRecords;
+	m_cursor = std::min(m_cursor, recordId);
+}
+
+bool PublishStore::hasPendingRecords() const
+{
+	return (m_numberOfPendingRecords > 0);
+}
+
+std::size_t PublishStore::numberOfRecords() const
+{
+	return m_numberOfRecords;
+}
+
+bool PublishStore::openSegment(Segment &segment, bool isNew)
+{
+	const auto flags = O_RDWR | O_CLOEXEC | (isNew ? (O_CREAT | O_EXCL) : 0);
+	segment.fd = ::open(segment.path.c_str(), flags, 0644);
+	if (segment.fd < 0) {
+		spdlog::error("PublishStore::openSegment() - Cannot open {}: {}", segment.path, std::strerror(errno));
+		return true;
+	}
+
+	if (isNew) {
+		segment.size = m_options.segmentSize;
+		if (::ftruncate(segment.fd, static_cast<off_t>(segment.size)) != 0) {
+			spdlog::error("PublishStore::openSegment() - Cannot resize {}: {}", segment.path, std::strerror(errno));
+			closeSegment(segment, true);
+			return true;
+		}
+	} else {
+		struct stat status;
+		if ((::fstat(segment.fd, &status) != 0) || (static_cast<std::size_t>(status.st_size) < c_segmentHeaderSize)) {
+			spdlog::error("PublishStore::openSegment() - Invalid segment {}.", segment.path);
+			closeSegment(segment, false);
+			return true;
+		}
+		segment.size = static_cast<std::size_t>(status.st_size);
+	}
+
+	auto *data = ::mmap(nullptr, segment.size, PROT_READ | PROT_WRITE, MAP_SHARED, segment.fd, 0);
+	if (data == MAP_FAILED) {
+		spdlog::error("PublishStore::openSegment() - Cannot map {}: {}", segment.path, std::strerror(errno));
+		closeSegment(segment, isNew);
+		return true;
+	}
+	segment.data = static_cast<std::byte*>(data);
+
+	if (isNew) {
+		std::memcpy(segment.data, c_magic, sizeof(c_magic));
+		std::memcpy(segment.data + sizeof(c_magic), &c_version, sizeof(c_version));
+	} else {
+		std::uint32_t version;
+		std::memcpy(&version, segment.data + sizeof(c_magic), sizeof(version));
+		if ((std::memcmp(segment.data, c_magic, sizeof(c_magic)) != 0) || (version != c_version)) {
+			spdlog::error("PublishStore::openSegment() - {} is no segment of version {}.", segment.path, c_version);
+			closeSegment(segment, false);
+			return true;
+		}
+	}
+	segment.writeOffset = c_segmentHeaderSize;
+	return false;
+}
+
+void PublishStore::readRecords(Segment &segment)
+{
+	while (segment.writeOffset + sizeof(RecordHeader) <= segment.size) {
+		RecordHeader header;
+		std::memcpy(&header, segment.data + segment.writeOffset, sizeof(header));
+		if (header.size == 0) {
+			break;
+		}
+		const auto isValid = (header.size == alignedRecordSize(header.topicSize, header.payloadSize))
+			&& (segment.writeOffset + header.size <= segment.size);
+		if (!isValid) {
+			// appending continues here, overwriting the garbage
+			spdlog::warn("PublishStore::readRecords() - Invalid record at offset {} of {}.", segment.writeOffset, segment.path);
+			break;
+		}
+
+		const auto isAcknowledged = (header.flags & c_acknowledgedFlag) != 0;
+		segment.recordOffsets.push_back(static_cast<std::uint32_t>(segment.writeOffset));
+		segment.recordStates.push_back(isAcknowledged ? RecordState::ACKNOWLEDGED : RecordState::PENDING);
+		if (isAcknowledged) {
+			++segment.numberOfAcknowledgedRecords;
+		} else {
+			++m_numberOfRecords;
+			++m_numberOfPendingRecords;
+		}
+		segment.writeOffset += header.size;
+	}
+}
+
+void PublishStore::closeSegment(Segment &segment, bool deleteFile)
+{
+	if (segment.data != nullptr) {
+		::munmap(segment.data, segment.size);
+		segment.data = nullptr;
+	}
+	if (segment.fd >= 0) {
+		::close(segment.fd);
+		segment.fd = -1;
+	}
+	if (deleteFile) {
+		::unlink(segment.path.c_str());
+	}
+}
+
+bool PublishStore::appendSegment()
+{
+	// the last segment is full now
+	removeAcknowledgedSegments(true);
+
+	const auto maxNumberOfSegments = std::max<std::size_t>(m_options.maxSize / m_options.segmentSize, 1);
+	while (m_segments.size() >= maxNumberOfSegments) {
+		if (m_options.dropPolicy == DropPolicy::DROP_NEWEST) {
+			spdlog::warn("PublishStore::appendSegment() - Store is full, dropping the message.");
+			return true;
+		}
+		dropOldestSegment();
+	}
+
+	Segment segment;
+	segment.sequenceNumber = m_nextSequenceNumber++;
+	segment.path = (std::filesystem::path(m_directoryPath) / segmentFileName(segment.sequenceNumber)).string();
+	if (openSegment(segment, true)) {
+		return true;
+	}
+	m_segments.push_back(std::move(segment));
+	return false;
+}
+
+void PublishStore::dropOldestSegment()
+{
+	auto &segment = m_segments.front();
+	const auto numberOfPendingRecords = std::ranges::count(segment.recordStates, RecordState::PENDING);
+	const auto numberOfRecords = segment.recordStates.size() - segment.numberOfAcknowledgedRecords;
+	spdlog::warn("PublishStore::dropOldestSegment() - Store is full, dropping {} records.", numberOfRecords);
+
+	m_numberOfPendingRecords -= static_cast<std::size_t>(numberOfPendingRecords);
+	m_numberOfRecords -= numberOfRecords;
+	closeSegment(segment, true);
+	m_segments.pop_front();
+}
+
+void PublishStore::removeAcknowledgedSegments(bool includingLastSegment)
+{
+	for (auto segment = m_segments.begin(); segment != m_segments.end();) {
+		const auto isLastSegment = (std::next(segment) == m_segments.end());
+		const auto isAcknowledged = (segment->numberOfAcknowledgedRecords == segment->recordStates.size());
+		if (!isAcknowledged || (isLastSegment && !includingLastSegment)) {
+			++segment;
+			continue;
+		}
+		closeSegment(*segment, true);
+		segment = m_segments.erase(segment);
+	}
+}
+
+PublishStore::Segment *PublishStore::segmentOfRecord(std::uint64_t recordId)
+{
+	const auto segment = std::ranges::lower_bound(m_segments, recordId >> 32, {}, &Segment::sequenceNumber);
+	if ((segment == m_segments.end()) || (segment->sequenceNumber != (recordId >> 32))
+		|| ((recordId & UINT32_MAX) >= segment->recordStates.size())) {
+		return nullptr;
+	}
+	return &*segment;
+}
+
+std::uint64_t PublishStore::recordId(const Segment &segment, std::size_t index)
+{
+	return (segment.sequenceNumber << 32) | static_cast<std::uint64_t>(index);
+}
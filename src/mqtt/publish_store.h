@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "mqtt_message.h"
+
+/*
+ * Class: PublishStore
+ *
+ * Append-only log of messages to be published, stored in memory-mapped
+ * segment files of fixed size in a directory, so that messages published
+ * while disconnected survive until they can be forwarded to the broker,
+ * even if the process crashes meanwhile.
+ * Records are handed out in order of appending (see next()) and marked as
+ * acknowledged in their segment once the broker received them, segments of
+ * acknowledged records only are deleted. Records handed out but not
+ * acknowledged before a crash are handed out again after reopening, i.e.
+ * messages are forwarded at least once.
+ *
+ * Segment file layout, all numbers in host byte order:
+ * - header: magic "MQSF" and version (uint32)
+ * - records, each aligned to 8 bytes:
+ *   size of the record (uint32, written last, 0 terminates the log),
+ *   flags (uint8, bit 0: acknowledged), qos (uint8), retain (uint8), reserved (uint8),
+ *   topic size (uint16), reserved (uint16), payload size (uint32),
+ *   topic, payload
+ */
+class PublishStore
+{
+  public:
+	enum class DropPolicy {
+		DROP_OLDEST, // delete the oldest segment, including its records not forwarded yet
+		DROP_NEWEST  // reject appending
+	};
+
+	struct Options
+	{
+		std::size_t segmentSize { 1024 * 1024 };
+		// the store never takes more than max(maxSize, segmentSize) on disk
+		std::size_t maxSize { 64 * 1024 * 1024 };
+		DropPolicy dropPolicy { DropPolicy::DROP_OLDEST };
+		// msync() every record, i.e. keep it on power loss as well, at the cost of latency
+		bool syncOnAppend { false };
+	};
+
+	struct Record
+	{
+		std::uint64_t id;
+		// valid until the store is modified the next time
+		MqttMessageView message;
+	};
+
+	PublishStore() = default;
+	~PublishStore();
+
+	PublishStore(const PublishStore&) = delete;
+	PublishStore &operator=(const PublishStore&) = delete;
+
+	// creates directoryPath if necessary and reads the segments in there;
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool open(const std::string &directoryPath, const Options &options);
+	void close();
+	[[nodiscard]] bool isOpen() const;
+
+	// returns true in case of error, e.g. if the store is full (DROP_NEWEST) or the message too large
+	bool append(std::string_view topic, std::span<const std::byte> payload, int qos, bool retain);
+
+	// oldest record neither handed out nor acknowledged yet
+	std::optional<Record> next();
+	void acknowledge(std::uint64_t recordId);
+	// hands out a record again with the next call of next(), e.g. if it got lost on a disconnect
+	void requeue(std::uint64_t recordId);
+
+	// records neither handed out nor acknowledged yet
+	[[nodiscard]] bool hasPendingRecords() const;
+	// records not acknowledged yet
+	[[nodiscard]] std::size_t numberOfRecords() const;
+
+  private:
+	enum class RecordState : std::uint8_t {
+		PENDING,
+		HANDED_OUT,
+		ACKNOWLEDGED
+	};
+
+	struct Segment
+	{
+		std::uint64_t sequenceNumber;
+		std::string path;
+		int fd { -1 };
+		std::byte *data { nullptr };
+		std::size_t size { 0 };
+		std::size_t writeOffset { 0 };
+		std::vector<std::uint32_t> recordOffsets;
+		std::vector<RecordState> recordStates;
+		std::size_t numberOfAcknowledgedRecords { 0 };
+	};
+
+	bool openSegment(Segment &segment, bool isNew);
+	void closeSegment(Segment &segment, bool deleteFile);
+	bool appendSegment();
+	void readRecords(Segment &segment);
+	void dropOldestSegment();
+	// deletes segments with acknowledged records only, except for the one being appended to
+	void removeAcknowledgedSegments(bool includingLastSegment = false);
+	Segment *segmentOfRecord(std::uint64_t recordId);
+
+	static std::uint64_t recordId(const Segment &segment, std::size_t index);
+
+	std::string m_directoryPath;
+	Options m_options;
+	std::deque<Segment> m_segments;
+	std::uint64_t m_nextSequenceNumber { 0 };
+	// id of the record next() starts searching from
+	std::uint64_t m_cursor { 0 };
+	std::size_t m_numberOfRecords { 0 };
+	std::size_t m_numberOfPendingRecords { 0 };
+};
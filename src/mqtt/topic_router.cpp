@@ -0,0 +1,175 @@
+#include "topic_router.h"
+#include <spdlog/spdlog.h>
+
+namespace {
+
+void splitTopicLevels(std::string_view topic, std::vector<std::string_view> &levels)
+{
+	levels.clear();
+	while (true) {
+		const auto separator = topic.find('/');
+		levels.push_back(topic.substr(0, separator));
+		if (separator == std::string_view::npos) {
+			return;
+		}
+		topic.remove_prefix(separator + 1);
+	}
+}
+
+}
+
+bool TopicRouter::addHandler(std::string_view filter, MessageHandler handler)
+{
+	spdlog::debug("TopicRouter::addHandler() - filter:{}", filter);
+
+	if (!isValidFilter(filter)) {
+		spdlog::error("TopicRouter::addHandler() - Invalid filter {}.", filter);
+		return true;
+	}
+
+	if (!handler) {
+		spdlog::error("TopicRouter::addHandler() - No handler for filter {}.", filter);
+		return true;
+	}
+
+	std::vector<std::string_view> levels;
+	splitTopicLevels(filter, levels);
+	const auto hasMultiLevelWildcard = (levels.back() == "#");
+	if (hasMultiLevelWildcard) {
+		levels.pop_back();
+	}
+
+	auto *node = &m_root;
+	for (const auto level : levels) {
+		if (level == "+") {
+			if (!node->singleLevelWildcardChild) {
+				node->singleLevelWildcardChild = std::make_unique<Node>();
+			}
+			node = node->singleLevelWildcardChild.get();
+			continue;
+		}
+
+		auto child = node->children.find(level);
+		if (child == node->children.end()) {
+			child = node->children.emplace(std::string(level), std::make_unique<Node>()).first;
+		}
+		node = child->second.get();
+	}
+
+	auto &handlers = hasMultiLevelWildcard ? node->multiLevelWildcardHandlers : node->handlers;
+	handlers.push_back(std::make_shared<MessageHandler>(std::move(handler)));
+	return false;
+}
+
+void TopicRouter::removeHandlers(std::string_view filter)
+{
+	spdlog::debug("TopicRouter::removeHandlers() - filter:{}", filter);
+
+	if (!isValidFilter(filter)) {
+		spdlog::error("TopicRouter::removeHandlers() - Invalid filter {}.", filter);
+		return;
+	}
+
+	std::vector<std::string_view> levels;
+	splitTopicLevels(filter, levels);
+	removeHandlers(m_root, levels, 0);
+}
+
+bool TopicRouter::removeHandlers(Node &node, const std::vector<std::string_view> &levels, std::size_t levelIndex)
+{
+	if (levelIndex == levels.size()) {
+		node.handlers.clear();
+		return node.isEmpty();
+	}
+
+	const auto level = levels[levelIndex];
+	if (level == "#") {
+		node.multiLevelWildcardHandlers.clear();
+		return node.isEmpty();
+	}
+
+	if (level == "+") {
+		if (node.singleLevelWildcardChild && removeHandlers(*node.singleLevelWildcardChild, levels, levelIndex + 1)) {
+			node.singleLevelWildcardChild.reset();
+		}
+		return node.isEmpty();
+	}
+
+	const auto child = node.children.find(level);
+	if ((child != node.children.end()) && removeHandlers(*child->second, levels, levelIndex + 1)) {
+		node.children.erase(child);
+	}
+	return node.isEmpty();
+}
+
+std::size_t TopicRouter::route(const MqttMessageView &message)
+{
+	splitTopicLevels(message.topic, m_topicLevels);
+
+	// a handler might route a message itself -> nested calls do not reuse the buffer
+	auto matchingHandlers = std::move(m_matchingHandlers);
+	matchingHandlers.clear();
+	collectHandlers(m_root, m_topicLevels, 0, matchingHandlers);
+
+	for (const auto &handler : matchingHandlers) {
+		(*handler)(message);
+	}
+
+	const auto numberOfHandlers = matchingHandlers.size();
+	matchingHandlers.clear();
+	m_matchingHandlers = std::move(matchingHandlers);
+	return numberOfHandlers;
+}
+
+void TopicRouter::collectHandlers(const Node &node, const std::vector<std::string_view> &levels, std::size_t levelIndex, std::vector<std::shared_ptr<MessageHandler>> &handlers)
+{
+	// wildcards do not match topics starting with "$" on their first level, e.g. "$SYS/..."
+	const auto mayMatchWildcard = (levelIndex > 0) || !levels.front().starts_with('$');
+
+	// "a/#" also matches "a"
+	if (mayMatchWildcard) {
+		handlers.insert(handlers.end(), node.multiLevelWildcardHandlers.begin(), node.multiLevelWildcardHandlers.end());
+	}
+
+	if (levelIndex == levels.size()) {
+		handlers.insert(handlers.end(), node.handlers.begin(), node.handlers.end());
+		return;
+	}
+
+	const auto child = node.children.find(levels[levelIndex]);
+	if (child != node.children.end()) {
+		collectHandlers(*child->second, levels, levelIndex + 1, handlers);
+	}
+
+	if (mayMatchWildcard && node.singleLevelWildcardChild) {
+		collectHandlers(*node.singleLevelWildcardChild, levels, levelIndex + 1, handlers);
+	}
+}
+
+bool TopicRouter::isEmpty() const
+{
+	return m_root.isEmpty();
+}
+
+bool TopicRouter::isValidFilter(std::string_view filter)
+{
+	if (filter.empty()) {
+		return false;
+	}
+
+	std::vector<std::string_view> levels;
+	splitTopicLevels(filter, levels);
+	for (std::size_t i = 0; i < levels.size(); ++i) {
+		const auto level = levels[i];
+		const auto isWildcard = (level == "+") || ((level == "#") && (i == levels.size() - 1));
+		if (!isWildcard && (level.find_first_of("+#") != std::string_view::npos)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TopicRouter::Node::isEmpty() const
+{
+	return children.empty() && !singleLevelWildcardChild && handlers.empty() && multiLevelWildcardHandlers.empty();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "mqtt_message.h"
+
+/*
+ * Class: TopicRouter
+ *
+ * Dispatches received MQTT messages to the handlers of all topic filters
+ * matching their topic, including filters with "+" and "#" wildcards.
+ * The filters are split into their topic levels once when added and stored
+ * in a trie of topic levels, so routing a message costs one lookup per
+ * topic level instead of matching the topic against every filter.
+ */
+class TopicRouter
+{
+  public:
+	using MessageHandler = std::function<void(const MqttMessageView &message)>;
+
+	// several handlers may be added for the same filter;
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool addHandler(std::string_view filter, MessageHandler handler);
+	// removes all handlers of filter
+	void removeHandlers(std::string_view filter);
+
+	// handlers removed while a message is routed are still called for this message;
+	// returns the number of handlers called
+	std::size_t route(const MqttMessageView &message);
+
+	[[nodiscard]] bool isEmpty() const;
+
+	// as defined in chapter 4.7 of the MQTT specification
+	static bool isValidFilter(std::string_view filter);
+
+  private:
+	struct TransparentStringHash
+	{
+		using is_transparent = void;
+		std::size_t operator()(std::string_view text) const { return std::hash<std::string_view>{}(text); }
+	};
+
+	struct Node
+	{
+		std::unordered_map<std::string, std::unique_ptr<Node>, TransparentStringHash, std::equal_to<>> children;
+		// child for the "+" level
+		std::unique_ptr<Node> singleLevelWildcardChild;
+		// handlers of the filter ending at this node
+		std::vector<std::shared_ptr<MessageHandler>> handlers;
+		// handlers of the filter ending at this node followed by "#"
+		std::vector<std::shared_ptr<MessageHandler>> multiLevelWildcardHandlers;
+
+		[[nodiscard]] bool isEmpty() const;
+	};
+
+	// returns true if node became empty and can be removed
+	static bool removeHandlers(Node &node, const std::vector<std::string_view> &levels, std::size_t levelIndex);
+	static void collectHandlers(const Node &node, const std::vector<std::string_view> &levels, std::size_t levelIndex, std::vector<std::shared_ptr<MessageHandler>> &handlers);
+
+	Node m_root;
+	// reused to avoid allocations per message, see route()
+	std::vector<std::shared_ptr<MessageHandler>> m_matchingHandlers;
+	std::vector<std::string_view> m_topicLevels;
+};
@@ -0,0 +1,1077 @@
+#include <KDFoundation/core_application.h>
+#include "metrics_registry.h"
+#include "mqtt.h"
+#include "mqtt_message.h"
+#include "publish_store.h"
+#include "topic_router.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+auto app = CoreApplication();
+[[maybe_unused]] const auto mqttLibInitResult = MqttLib::instance().init();
+
+/*
+ * Class: MosquittoClientFake
+ *
+ * Stands in for the mosquitto client, connecting "immediately" to one end of
+ * a socket pair. Every byte sent by the broker, i.e. written to the other end,
+ * is read as one packet. Packets are recorded instead of being sent;
+ * publishing leaves data pending to be written until the next loopWrite().
+ */
+class MosquittoClientFake : public MosquittoClient
+{
+  public:
+	enum class Transport {
+		UNIX, // socket pair
+		TCP   // connection over the loopback interface, e.g. for TCP_CORK
+	};
+
+	explicit MosquittoClientFake(Transport transport = Transport::UNIX)
+		: MosquittoClient("fake")
+	{
+		if (transport == Transport::UNIX) {
+			::socketpair(AF_UNIX, SOCK_STREAM, 0, m_sockets);
+			return;
+		}
+
+		const auto listeningSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in address {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t addressSize = sizeof(address);
+		::bind(listeningSocket, reinterpret_cast<const sockaddr*>(&address), addressSize);
+		::listen(listeningSocket, 1);
+		::getsockname(listeningSocket, reinterpret_cast<sockaddr*>(&address), &addressSize);
+		m_sockets[0] = ::socket(AF_INET, SOCK_STREAM, 0);
+		::connect(m_sockets[0], reinterpret_cast<const sockaddr*>(&address), addressSize);
+		m_sockets[1] = ::accept(listeningSocket, nullptr, nullptr);
+		::close(listeningSocket);
+	}
+
+	~MosquittoClientFake()
+	{
+		::close(m_sockets[0]);
+		::close(m_sockets[1]);
+		if (isDestroyed) {
+			*isDestroyed = true;
+		}
+	}
+
+	// runs on the helper thread of MqttClient::AsyncConnector
+	int connect(const std::string&, int, int) override {
+		if (connectGate.valid()) {
+			connectGate.wait();
+		}
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int disconnect() override {
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int publish(int *msgId, const std::string &topic, int, const void*, int qos, bool) override {
+		const auto id = ++m_lastMsgId;
+		if (msgId) {
+			*msgId = id;
+		}
+		publishedTopics.push_back(topic);
+		if ((qos == 0) && isSendingQos0Immediately) {
+			// like mosquitto, which may write the packet from within publish()
+			published.emit(id);
+			return MOSQ_ERR_SUCCESS;
+		}
+		++numberOfPendingWrites;
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int subscribe(int *msgId, const std::string &sub, int qos) override {
+		*msgId = ++m_lastMsgId;
+		subscriptions.push_back({ { sub }, qos });
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int subscribeMultiple(int *msgId, const std::vector<std::string> &subs, int qos) override {
+		*msgId = ++m_lastMsgId;
+		subscriptions.push_back({ subs, qos });
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int socket() override {
+		return m_sockets[0];
+	}
+
+	int loopRead(int) override {
+		char packet;
+		if (::recv(m_sockets[0], &packet, sizeof(packet), MSG_DONTWAIT) == sizeof(packet)) {
+			++numberOfReads;
+		}
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int loopWrite(int) override {
+		++numberOfWrites;
+		isCorkedWhileWriting = isCorked();
+		numberOfPendingWrites = 0;
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	int loopMisc() override {
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	bool wantWrite() override {
+		return (numberOfPendingWrites > 0);
+	}
+
+	int threadedSet(bool threaded) override {
+		isThreaded = threaded;
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	void sendPackets(int numberOfPackets) {
+		const std::string packets(static_cast<std::size_t>(numberOfPackets), 'p');
+		REQUIRE(::send(m_sockets[1], packets.data(), packets.size(), 0) == numberOfPackets);
+	}
+
+	bool isCorked() const {
+#ifdef TCP_CORK
+		int value = 0;
+		socklen_t valueSize = sizeof(value);
+		::getsockopt(m_sockets[0], IPPROTO_TCP, TCP_CORK, &value, &valueSize);
+		return (value != 0);
+#else
+		return false;
+#endif
+	}
+
+	int lastMsgId() const {
+		return m_lastMsgId;
+	}
+
+	struct Subscription
+	{
+		std::vector<std::string> topics;
+		int qos;
+	};
+
+	int numberOfReads { 0 };
+	int numberOfWrites { 0 };
+	int numberOfPendingWrites { 0 };
+	bool isThreaded { false };
+	bool isCorkedWhileWriting { false };
+	bool isSendingQos0Immediately { false };
+	std::vector<std::string> publishedTopics;
+	std::vector<Subscription> subscriptions;
+	// connect() blocks until connectGate is ready, if valid
+	std::shared_future<void> connectGate;
+	// set on destruction, the fake is owned by its MqttClient
+	std::shared_ptr<std::atomic<bool>> isDestroyed;
+
+  private:
+	int m_sockets[2] { -1, -1 };
+	int m_lastMsgId { 0 };
+};
+
+class MqttUnitTestHarness
+{
+  public:
+	using SubscriptionsRegistry = MqttClient::SubscriptionsRegistry;
+
+	// client takes ownership of mosquittoClient
+	static void setMosquittoClient(MqttClient &client, MosquittoClient *mosquittoClient) {
+		client.m_mosquitto.init(mosquittoClient, &client);
+	}
+
+	static bool isEngaged(MqttClient &client) {
+		return client.m_eventLoopHook.isEngaged();
+	}
+};
+
+namespace {
+
+bool processEventsUntil(const std::function<bool()> &condition)
+{
+	for (int i = 0; i < 200 && !condition(); ++i) {
+		app.processEvents(10);
+	}
+	return condition();
+}
+
+std::span<const std::byte> asBytes(std::string_view text)
+{
+	return std::as_bytes(std::span(text.data(), text.size()));
+}
+
+void connect(MqttClient &client, MosquittoClientFake *mosquitto)
+{
+	REQUIRE(client.connect(Url("broker")) == MOSQ_ERR_SUCCESS);
+	REQUIRE(processEventsUntil([&]() { return MqttUnitTestHarness::isEngaged(client); }));
+	mosquitto->connected.emit(0);
+	REQUIRE(client.connectionState.get() == IMqttClient::ConnectionState::CONNECTED);
+}
+
+// connects client, whose MosquittoClient is replaced by the returned fake
+MosquittoClientFake *connectToFakeBroker(MqttClient &client)
+{
+	auto *mosquitto = new MosquittoClientFake();
+	MqttUnitTestHarness::setMosquittoClient(client, mosquitto);
+	connect(client, mosquitto);
+	return mosquitto;
+}
+
+}
+
+TEST_SUITE("Mqtt")
+{
+	TEST_CASE("MqttClient read budget")
+	{
+		MqttClient client("client");
+		auto *mosquitto = connectToFakeBroker(client);
+		const auto &exhaustedReadBudgets = MetricsRegistry::instance().counter("mqtt_read_budgets_exhausted", "");
+		const auto numberOfExhaustedReadBudgets = exhaustedReadBudgets.value();
+
+		SUBCASE("All packets available are read on one wakeup of the socket")
+		{
+			// WHEN
+			mosquitto->sendPackets(10);
+			REQUIRE(processEventsUntil([&]() { return mosquitto->numberOfReads > 0; }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfReads == 10);
+			REQUIRE(exhaustedReadBudgets.value() == numberOfExhaustedReadBudgets);
+		}
+
+		SUBCASE("The number of packets read per wakeup is limited")
+		{
+			// GIVEN
+			client.setReadBudget(4, std::chrono::seconds(1));
+
+			// WHEN
+			mosquitto->sendPackets(10);
+			REQUIRE(processEventsUntil([&]() { return mosquitto->numberOfReads > 0; }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfReads == 4);
+			REQUIRE(exhaustedReadBudgets.value() == numberOfExhaustedReadBudgets + 1);
+
+			// WHEN
+			REQUIRE(processEventsUntil([&]() { return mosquitto->numberOfReads == 10; }));
+
+			// THEN
+			REQUIRE(exhaustedReadBudgets.value() == numberOfExhaustedReadBudgets + 2);
+		}
+
+		SUBCASE("The time spent reading per wakeup is limited")
+		{
+			// GIVEN
+			client.setReadBudget(100, std::chrono::microseconds(0));
+
+			// WHEN
+			mosquitto->sendPackets(3);
+			REQUIRE(processEventsUntil([&]() { return mosquitto->numberOfReads > 0; }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfReads == 1);
+			REQUIRE(exhaustedReadBudgets.value() == numberOfExhaustedReadBudgets + 1);
+
+			// WHEN
+			REQUIRE(processEventsUntil([&]() { return mosquitto->numberOfReads == 3; }));
+
+			// THEN
+			REQUIRE(exhaustedReadBudgets.value() == numberOfExhaustedReadBudgets + 2);
+		}
+	}
+
+	TEST_CASE("MqttClient destroyed while connecting")
+	{
+		// GIVEN
+		std::promise<void> connectMayFinish;
+		auto isMosquittoDestroyed = std::make_shared<std::atomic<bool>>(false);
+		auto client = std::make_unique<MqttClient>("client");
+		auto *mosquitto = new MosquittoClientFake();
+		mosquitto->connectGate = connectMayFinish.get_future().share();
+		mosquitto->isDestroyed = isMosquittoDestroyed;
+		MqttUnitTestHarness::setMosquittoClient(*client, mosquitto);
+		REQUIRE(client->connect(Url("broker")) == MOSQ_ERR_SUCCESS);
+
+		// WHEN
+		client.reset();
+
+		// THEN
+		REQUIRE_FALSE(*isMosquittoDestroyed);
+
+		// WHEN
+		connectMayFinish.set_value();
+		for (int i = 0; i < 200 && !*isMosquittoDestroyed; ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+
+		// THEN
+		REQUIRE(*isMosquittoDestroyed);
+	}
+
+	TEST_CASE("MqttClient write interest")
+	{
+		MqttClient client("client");
+		auto *mosquitto = connectToFakeBroker(client);
+
+		SUBCASE("Publishing, flushing and publishing again on the same connection")
+		{
+			// WHEN
+			REQUIRE(client.publish(nullptr, "a", 0, nullptr, 1) == MOSQ_ERR_SUCCESS);
+			REQUIRE(processEventsUntil([&]() { return !mosquitto->wantWrite(); }));
+			REQUIRE(client.publish(nullptr, "b", 0, nullptr, 1) == MOSQ_ERR_SUCCESS);
+			REQUIRE(processEventsUntil([&]() { return !mosquitto->wantWrite(); }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfWrites == 2);
+			REQUIRE(mosquitto->publishedTopics == std::vector<std::string>{ "a", "b" });
+		}
+
+		SUBCASE("The socket is not watched for writability once flushed")
+		{
+			// GIVEN
+			REQUIRE(client.publish(nullptr, "a", 0, nullptr, 1) == MOSQ_ERR_SUCCESS);
+			REQUIRE(processEventsUntil([&]() { return !mosquitto->wantWrite(); }));
+
+			// WHEN
+			for (int i = 0; i < 5; ++i) {
+				app.processEvents(10);
+			}
+
+			// THEN
+			REQUIRE(mosquitto->numberOfWrites == 1);
+		}
+	}
+
+	TEST_CASE("TopicRouter")
+	{
+		TopicRouter router;
+		std::vector<std::string> calledHandlers;
+		auto handler = [&](const std::string &name) -> TopicRouter::MessageHandler {
+			return [&calledHandlers, name](const MqttMessageView&) { calledHandlers.push_back(name); };
+		};
+		auto route = [&](std::string_view topic) {
+			calledHandlers.clear();
+			MqttMessageView message;
+			message.topic = topic;
+			REQUIRE(router.route(message) == calledHandlers.size());
+			std::ranges::sort(calledHandlers);
+			return calledHandlers;
+		};
+
+		SUBCASE("A multi-level wildcard matches its parent level as well")
+		{
+			// GIVEN
+			REQUIRE_FALSE(router.addHandler("a/#", handler("a/#")));
+
+			// WHEN / THEN
+			REQUIRE(route("a") == std::vector<std::string>{ "a/#" });
+			REQUIRE(route("a/b/c") == std::vector<std::string>{ "a/#" });
+			REQUIRE(route("ab").empty());
+			REQUIRE(route("b/a").empty());
+		}
+
+		SUBCASE("A single-level wildcard matches exactly one level, a multi-level wildcard any number of levels")
+		{
+			// GIVEN
+			REQUIRE_FALSE(router.addHandler("a/+", handler("a/+")));
+			REQUIRE_FALSE(router.addHandler("a/#", handler("a/#")));
+			REQUIRE_FALSE(router.addHandler("a/+/c", handler("a/+/c")));
+			REQUIRE_FALSE(router.addHandler("a/b/c", handler("a/b/c")));
+
+			// WHEN / THEN
+			REQUIRE(route("a") == std::vector<std::string>{ "a/#" });
+			REQUIRE(route("a/b") == std::vector<std::string>{ "a/#", "a/+" });
+			REQUIRE(route("a/b/c") == std::vector<std::string>{ "a/#", "a/+/c", "a/b/c" });
+			REQUIRE(route("a//c") == std::vector<std::string>{ "a/#", "a/+/c" });
+			REQUIRE(route("a/b/c/d") == std::vector<std::string>{ "a/#" });
+		}
+
+		SUBCASE("Wildcards on the first level do not match topics starting with $")
+		{
+			// GIVEN
+			REQUIRE_FALSE(router.addHandler("#", handler("#")));
+			REQUIRE_FALSE(router.addHandler("+/x", handler("+/x")));
+			REQUIRE_FALSE(router.addHandler("$SYS/#", handler("$SYS/#")));
+
+			// WHEN / THEN
+			REQUIRE(route("$SYS/x") == std::vector<std::string>{ "$SYS/#" });
+			REQUIRE(route("x/x") == std::vector<std::string>{ "#", "+/x" });
+		}
+
+		SUBCASE("Invalid filters are rejected")
+		{
+			// WHEN / THEN
+			REQUIRE(router.addHandler("a/b#", handler("a/b#")));
+			REQUIRE(router.addHandler("a/#/b", handler("a/#/b")));
+			REQUIRE(router.addHandler("a+", handler("a+")));
+			REQUIRE(router.addHandler("", handler("")));
+			REQUIRE(router.isEmpty());
+		}
+
+		SUBCASE("Removing handlers prunes the trie")
+		{
+			// GIVEN
+			REQUIRE_FALSE(router.addHandler("a/b/c", handler("a/b/c")));
+			REQUIRE_FALSE(router.addHandler("a/b/c", handler("a/b/c again")));
+			REQUIRE_FALSE(router.addHandler("a/+/c", handler("a/+/c")));
+			REQUIRE_FALSE(router.addHandler("a/#", handler("a/#")));
+
+			// WHEN
+			router.removeHandlers("a/b/c");
+			router.removeHandlers("a/b");
+
+			// THEN
+			REQUIRE(route("a/b/c") == std::vector<std::string>{ "a/#", "a/+/c" });
+
+			// WHEN
+			router.removeHandlers("a/+/c");
+			router.removeHandlers("a/#");
+
+			// THEN
+			REQUIRE(router.isEmpty());
+			REQUIRE(route("a/b/c").empty());
+		}
+
+		SUBCASE("Handlers may remove handlers and route messages while a message is routed")
+		{
+			// GIVEN
+			REQUIRE_FALSE(router.addHandler("x", [&](const MqttMessageView&) {
+				calledHandlers.push_back("x removing");
+				router.removeHandlers("x");
+				MqttMessageView message;
+				message.topic = "y";
+				REQUIRE(router.route(message) == 1);
+			}));
+			REQUIRE_FALSE(router.addHandler("x", handler("x")));
+			REQUIRE_FALSE(router.addHandler("y", handler("y")));
+
+			// WHEN
+			MqttMessageView message;
+			message.topic = "x";
+			const auto numberOfHandlers = router.route(message);
+
+			// THEN
+			REQUIRE(numberOfHandlers == 2);
+			REQUIRE(calledHandlers == std::vector<std::string>{ "x removing", "y", "x" });
+			REQUIRE(route("x").empty());
+		}
+	}
+
+	TEST_CASE("MqttMessagePool")
+	{
+		MqttMessagePool pool(16, 2);
+
+		SUBCASE("Released slots are reused before another slab is allocated")
+		{
+			// WHEN
+			auto *first = pool.allocate(16);
+			auto *second = pool.allocate(1);
+
+			// THEN
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+			REQUIRE(second - first == 16);
+
+			// WHEN
+			pool.deallocate(first, 16);
+			auto *reused = pool.allocate(8);
+
+			// THEN
+			REQUIRE(reused == first);
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+
+			// WHEN
+			auto *third = pool.allocate(16);
+
+			// THEN
+			REQUIRE(pool.numberOfFreeSlots() == 1);
+			pool.deallocate(reused, 8);
+			pool.deallocate(second, 1);
+			pool.deallocate(third, 16);
+			REQUIRE(pool.numberOfFreeSlots() == 4);
+		}
+
+		SUBCASE("Data exceeding the slot size is allocated on the heap")
+		{
+			// WHEN
+			auto *data = pool.allocate(17);
+
+			// THEN
+			REQUIRE(data != nullptr);
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+			pool.deallocate(data, 17);
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+		}
+	}
+
+	TEST_CASE("MqttMessage")
+	{
+		MqttMessagePool pool(16, 2);
+		const char payload[] = { 'p', '\0', 'q' };
+		mosquitto_message rawMessage {};
+		rawMessage.mid = 7;
+		rawMessage.topic = const_cast<char*>("t/1");
+		rawMessage.payload = const_cast<char*>(payload);
+		rawMessage.payloadlen = sizeof(payload);
+		rawMessage.qos = 1;
+		rawMessage.retain = true;
+		const auto view = MqttMessageView::fromMosquittoMessage(rawMessage);
+
+		SUBCASE("A message copies topic and payload into a slot of the pool")
+		{
+			// WHEN
+			const MqttMessage message(view, pool);
+			rawMessage.topic = const_cast<char*>("xxx");
+
+			// THEN
+			REQUIRE_FALSE(message.isEmpty());
+			REQUIRE(pool.numberOfFreeSlots() == 1);
+			REQUIRE(message.view().msgId == 7);
+			REQUIRE(message.view().topic == "t/1");
+			REQUIRE(message.view().payloadAsString() == std::string_view(payload, sizeof(payload)));
+			REQUIRE(message.view().qos == 1);
+			REQUIRE(message.view().retain);
+		}
+
+		SUBCASE("A message exceeding the slot size is stored on the heap")
+		{
+			// GIVEN
+			std::string topic(40, 't');
+			rawMessage.topic = topic.data();
+
+			// WHEN
+			const MqttMessage message(MqttMessageView::fromMosquittoMessage(rawMessage), pool);
+
+			// THEN
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+			REQUIRE(message.view().topic == topic);
+			REQUIRE(message.view().payloadAsString() == std::string_view(payload, sizeof(payload)));
+		}
+
+		SUBCASE("Moving a message transfers its slot")
+		{
+			// GIVEN
+			MqttMessage message(view, pool);
+
+			// WHEN
+			const MqttMessage movedMessage(std::move(message));
+
+			// THEN
+			REQUIRE(message.isEmpty());
+			REQUIRE(message.view().topic.empty());
+			REQUIRE(movedMessage.view().topic == "t/1");
+			REQUIRE(pool.numberOfFreeSlots() == 1);
+		}
+
+		SUBCASE("Assigning to a message releases its slot")
+		{
+			// GIVEN
+			MqttMessage message(view, pool);
+			MqttMessage otherMessage(view, pool);
+			REQUIRE(pool.numberOfFreeSlots() == 0);
+
+			// WHEN
+			message = std::move(otherMessage);
+
+			// THEN
+			REQUIRE(pool.numberOfFreeSlots() == 1);
+			REQUIRE(otherMessage.isEmpty());
+			REQUIRE(message.view().topic == "t/1");
+
+			// WHEN
+			message = MqttMessage();
+
+			// THEN
+			REQUIRE(message.isEmpty());
+			REQUIRE(pool.numberOfFreeSlots() == 2);
+		}
+
+		SUBCASE("Destroying a message releases its slot")
+		{
+			// WHEN
+			{
+				const MqttMessage message(view, pool);
+				REQUIRE(pool.numberOfFreeSlots() == 1);
+			}
+
+			// THEN
+			REQUIRE(pool.numberOfFreeSlots() == 2);
+		}
+	}
+
+	TEST_CASE("MqttClient publish batching")
+	{
+		MqttClient client("client");
+		auto *mosquitto = new MosquittoClientFake(MosquittoClientFake::Transport::TCP);
+		MqttUnitTestHarness::setMosquittoClient(client, mosquitto);
+		connect(client, mosquitto);
+
+		SUBCASE("Packets published meanwhile are flushed by one write once the socket is writable, with the socket corked")
+		{
+			// GIVEN
+			REQUIRE(client.setPublishBatching(true) == MOSQ_ERR_SUCCESS);
+			REQUIRE(mosquitto->isThreaded);
+
+			// WHEN
+			for (int i = 0; i < 50; ++i) {
+				REQUIRE(client.publish(nullptr, "t") == MOSQ_ERR_SUCCESS);
+			}
+
+			// THEN
+			REQUIRE(mosquitto->numberOfWrites == 0);
+
+			// WHEN
+			REQUIRE(processEventsUntil([&]() { return !mosquitto->wantWrite(); }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfWrites == 1);
+#ifdef TCP_CORK
+			REQUIRE(mosquitto->isCorkedWhileWriting);
+#endif
+			REQUIRE_FALSE(mosquitto->isCorked());
+		}
+
+		SUBCASE("The socket is not corked unless wanted")
+		{
+			// GIVEN
+			REQUIRE(client.setPublishBatching(true, false) == MOSQ_ERR_SUCCESS);
+
+			// WHEN
+			REQUIRE(client.publish(nullptr, "t") == MOSQ_ERR_SUCCESS);
+			REQUIRE(processEventsUntil([&]() { return !mosquitto->wantWrite(); }));
+
+			// THEN
+			REQUIRE(mosquitto->numberOfWrites == 1);
+			REQUIRE_FALSE(mosquitto->isCorkedWhileWriting);
+		}
+
+		SUBCASE("Disabling batching lets mosquitto send packets right away again")
+		{
+			// GIVEN
+			REQUIRE(client.setPublishBatching(true) == MOSQ_ERR_SUCCESS);
+
+			// WHEN
+			const auto result = client.setPublishBatching(false);
+
+			// THEN
+			REQUIRE(result == MOSQ_ERR_SUCCESS);
+			REQUIRE_FALSE(mosquitto->isThreaded);
+		}
+
+		SUBCASE("Batching cannot be changed while connecting")
+		{
+			// GIVEN
+			mosquitto->disconnected.emit(0);
+			REQUIRE(client.connect(Url("broker")) == MOSQ_ERR_SUCCESS);
+
+			// WHEN
+			const auto result = client.setPublishBatching(true);
+
+			// THEN
+			REQUIRE(result == MOSQ_ERR_UNKNOWN);
+			REQUIRE_FALSE(mosquitto->isThreaded);
+			REQUIRE(processEventsUntil([&]() { return MqttUnitTestHarness::isEngaged(client); }));
+		}
+	}
+
+	TEST_CASE("MqttClient outbound queue")
+	{
+		MqttClient client("client");
+		auto *mosquitto = connectToFakeBroker(client);
+		client.setOutboundQueueLimits(10, 20);
+		std::vector<int> publishedMsgIds;
+		client.msgPublished.connect([&](int msgId) { publishedMsgIds.push_back(msgId); });
+		const char payload[9] = {};
+
+		SUBCASE("QoS 0 messages sent from within publish() are not queued")
+		{
+			// GIVEN
+			mosquitto->isSendingQos0Immediately = true;
+
+			// WHEN
+			for (int i = 0; i < 5; ++i) {
+				REQUIRE(client.publish(nullptr, "t", sizeof(payload), payload, 0) == MOSQ_ERR_SUCCESS);
+			}
+
+			// THEN
+			REQUIRE(publishedMsgIds == std::vector<int>{ 1, 2, 3, 4, 5 });
+			REQUIRE(client.outboundQueueMessages() == 0);
+			REQUIRE(client.outboundQueueBytes() == 0);
+			REQUIRE(client.isOutboundQueueWritable.get());
+		}
+
+		SUBCASE("Messages are queued until acknowledged")
+		{
+			// GIVEN
+			int msgId = 0;
+
+			// WHEN
+			REQUIRE(client.publish(&msgId, "t", sizeof(payload), payload, 1) == MOSQ_ERR_SUCCESS);
+			REQUIRE(client.publish(nullptr, "t", sizeof(payload), payload, 1) == MOSQ_ERR_SUCCESS);
+
+			// THEN
+			REQUIRE(client.outboundQueueMessages() == 2);
+			REQUIRE(client.outboundQueueBytes() == 20);
+			REQUIRE_FALSE(client.isOutboundQueueWritable.get());
+			REQUIRE(client.publish(nullptr, "t", sizeof(payload), payload, 1) == MOSQ_ERR_NOMEM);
+
+			// WHEN
+			mosquitto->published.emit(msgId);
+
+			// THEN
+			REQUIRE(publishedMsgIds == std::vector<int>{ msgId });
+			REQUIRE(client.outboundQueueMessages() == 1);
+			REQUIRE_FALSE(client.isOutboundQueueWritable.get());
+
+			// WHEN
+			mosquitto->published.emit(msgId + 1);
+
+			// THEN
+			REQUIRE(client.outboundQueueMessages() == 0);
+			REQUIRE(client.isOutboundQueueWritable.get());
+		}
+	}
+
+	TEST_CASE("PublishStore")
+	{
+		const auto directoryPath = std::filesystem::temp_directory_path() / "publishStoreTest";
+		std::filesystem::remove_all(directoryPath);
+
+		// three records of appendRecords() per segment, three segments at most
+		PublishStore::Options options;
+		options.segmentSize = 8 + 3 * 32;
+		options.maxSize = 3 * options.segmentSize;
+
+		PublishStore store;
+		REQUIRE_FALSE(store.open(directoryPath.string(), options));
+
+		auto appendRecords = [&](int first, int last) {
+			for (int i = first; i <= last; ++i) {
+				REQUIRE_FALSE(store.append("t/" + std::to_string(i), asBytes("payload" + std::to_string(i)), 1, false));
+			}
+		};
+		// hands out all pending records
+		auto nextTopics = [&]() {
+			std::vector<std::string> topics;
+			while (const auto record = store.next()) {
+				topics.emplace_back(record->message.topic);
+			}
+			return topics;
+		};
+		auto numberOfSegmentFiles = [&]() {
+			return std::distance(std::filesystem::directory_iterator(directoryPath), std::filesystem::directory_iterator());
+		};
+
+		SUBCASE("Records are handed out in order of appending and kept until acknowledged")
+		{
+			// GIVEN
+			REQUIRE_FALSE(store.append("t/0", asBytes("payload0"), 2, true));
+			appendRecords(1, 2);
+
+			// WHEN
+			const auto record = store.next();
+
+			// THEN
+			REQUIRE(record);
+			REQUIRE(record->message.topic == "t/0");
+			REQUIRE(record->message.payloadAsString() == "payload0");
+			REQUIRE(record->message.qos == 2);
+			REQUIRE(record->message.retain);
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/1", "t/2" });
+			REQUIRE_FALSE(store.hasPendingRecords());
+			REQUIRE(store.numberOfRecords() == 3);
+
+			// WHEN
+			store.acknowledge(record->id);
+			store.acknowledge(record->id);
+
+			// THEN
+			REQUIRE(store.numberOfRecords() == 2);
+		}
+
+		SUBCASE("Records handed out but not acknowledged are handed out again after reopening")
+		{
+			// GIVEN
+			appendRecords(0, 2);
+			const auto record = store.next();
+			REQUIRE(record);
+			store.acknowledge(record->id);
+			REQUIRE(store.next());
+
+			// WHEN
+			store.close();
+			REQUIRE_FALSE(store.open(directoryPath.string(), options));
+
+			// THEN
+			REQUIRE(store.numberOfRecords() == 2);
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/1", "t/2" });
+		}
+
+		SUBCASE("A record of size 0, e.g. torn by a crash, ends the log")
+		{
+			// GIVEN
+			appendRecords(0, 2);
+			store.close();
+			{
+				// the size is the first field of the second record
+				std::fstream file(directoryPath / "0000000000000000.seg", std::ios::in | std::ios::out | std::ios::binary);
+				const std::uint32_t size = 0;
+				file.seekp(8 + 32);
+				file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+			}
+
+			// WHEN
+			REQUIRE_FALSE(store.open(directoryPath.string(), options));
+
+			// THEN
+			REQUIRE(store.numberOfRecords() == 1);
+
+			// WHEN
+			appendRecords(3, 3);
+
+			// THEN
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/0", "t/3" });
+		}
+
+		SUBCASE("DROP_OLDEST drops the oldest segment when the store is full")
+		{
+			// WHEN
+			appendRecords(0, 9);
+
+			// THEN
+			REQUIRE(store.numberOfRecords() == 7);
+			REQUIRE(numberOfSegmentFiles() == 3);
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/3", "t/4", "t/5", "t/6", "t/7", "t/8", "t/9" });
+		}
+
+		SUBCASE("DROP_NEWEST rejects appending when the store is full")
+		{
+			// GIVEN
+			store.close();
+			options.dropPolicy = PublishStore::DropPolicy::DROP_NEWEST;
+			REQUIRE_FALSE(store.open(directoryPath.string(), options));
+			appendRecords(0, 8);
+
+			// WHEN
+			const auto hasError = store.append("t/9", asBytes("payload9"), 1, false);
+
+			// THEN
+			REQUIRE(hasError);
+			REQUIRE(store.numberOfRecords() == 9);
+			REQUIRE(nextTopics().front() == "t/0");
+		}
+
+		SUBCASE("Segments are deleted once all their records are acknowledged, except for the one being appended to")
+		{
+			// GIVEN
+			appendRecords(0, 3);
+			REQUIRE(numberOfSegmentFiles() == 2);
+			std::vector<std::uint64_t> recordIds;
+			while (const auto record = store.next()) {
+				recordIds.push_back(record->id);
+			}
+
+			// WHEN
+			store.acknowledge(recordIds[0]);
+			store.acknowledge(recordIds[1]);
+
+			// THEN
+			REQUIRE(numberOfSegmentFiles() == 2);
+
+			// WHEN
+			store.acknowledge(recordIds[2]);
+			store.acknowledge(recordIds[3]);
+
+			// THEN
+			REQUIRE(numberOfSegmentFiles() == 1);
+			REQUIRE(store.numberOfRecords() == 0);
+		}
+
+		SUBCASE("Requeueing a record hands it out again")
+		{
+			// GIVEN
+			appendRecords(0, 2);
+			const auto first = store.next();
+			const auto second = store.next();
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/2" });
+
+			// WHEN
+			store.requeue(second->id);
+			store.requeue(first->id);
+
+			// THEN
+			REQUIRE(store.hasPendingRecords());
+			REQUIRE(nextTopics() == std::vector<std::string>{ "t/0", "t/1" });
+			REQUIRE(store.numberOfRecords() == 3);
+		}
+
+		store.close();
+		std::filesystem::remove_all(directoryPath);
+	}
+
+	TEST_CASE("MqttClient::SubscriptionsRegistry")
+	{
+		using Operation = MqttUnitTestHarness::SubscriptionsRegistry::Operation;
+		MqttUnitTestHarness::SubscriptionsRegistry registry;
+
+		SUBCASE("A SUBACK registers the topics of a SUBSCRIBE packet with their granted QoS")
+		{
+			// GIVEN
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a", "b", "c" }, 1, 2);
+			const int grantedQos[] = { 2, 0x80, 0 };
+
+			// WHEN
+			const auto topics = registry.registerTopicSubscriptionsAndReturnTopicNames(1, 3, grantedQos);
+
+			// THEN
+			REQUIRE(topics == std::vector<std::string>{ "a", "c" });
+			REQUIRE(registry.subscribedTopics() == std::vector<std::string>{ "a", "c" });
+			REQUIRE(registry.grantedQosForTopic("a") == 2);
+			REQUIRE(registry.grantedQosForTopic("c") == 0);
+			REQUIRE(registry.subscribedTopicsByGrantedQos() == std::map<int, std::vector<std::string>>{ { 0, { "c" } }, { 2, { "a" } } });
+		}
+
+		SUBCASE("Topics without granted QoS in the SUBACK are refused")
+		{
+			// GIVEN
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a", "b" }, 1, 1);
+			const int grantedQos[] = { 1 };
+
+			// WHEN
+			const auto topics = registry.registerTopicSubscriptionsAndReturnTopicNames(1, 1, grantedQos);
+
+			// THEN
+			REQUIRE(topics == std::vector<std::string>{ "a" });
+			REQUIRE(registry.subscribedTopics() == std::vector<std::string>{ "a" });
+		}
+
+		SUBCASE("Acknowledgements of unknown operations are ignored")
+		{
+			// GIVEN
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a" }, 1, 1);
+			const int grantedQos[] = { 1 };
+
+			// WHEN
+			const auto topics = registry.registerTopicSubscriptionsAndReturnTopicNames(2, 1, grantedQos);
+			const auto unsubscribedTopics = registry.unregisterTopicSubscriptionsAndReturnTopicNames(3);
+
+			// THEN
+			REQUIRE(topics.empty());
+			REQUIRE(unsubscribedTopics.empty());
+			REQUIRE(registry.subscribedTopics().empty());
+		}
+
+		SUBCASE("An UNSUBACK unregisters the topics of an UNSUBSCRIBE packet")
+		{
+			// GIVEN
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a", "b", "c" }, 1, 0);
+			const int grantedQos[] = { 0, 0, 0 };
+			registry.registerTopicSubscriptionsAndReturnTopicNames(1, 3, grantedQos);
+			registry.registerPendingRegistryOperation(Operation::UNSUBSCRIBE, { "a", "c" }, 2);
+
+			// WHEN
+			const auto topics = registry.unregisterTopicSubscriptionsAndReturnTopicNames(2);
+
+			// THEN
+			REQUIRE(topics == std::vector<std::string>{ "a", "c" });
+			REQUIRE(registry.subscribedTopics() == std::vector<std::string>{ "b" });
+		}
+
+		SUBCASE("Operations lost on disconnect are resolved in order of sending")
+		{
+			// GIVEN
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a", "x" }, 1, 0);
+			const int grantedQos[] = { 0, 0 };
+			registry.registerTopicSubscriptionsAndReturnTopicNames(1, 2, grantedQos);
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "b", "c" }, 2, 2);
+			registry.registerPendingRegistryOperation(Operation::UNSUBSCRIBE, { "a", "x" }, 3);
+			registry.registerPendingRegistryOperation(Operation::SUBSCRIBE, { "a" }, 4, 1);
+
+			// WHEN
+			registry.resolvePendingOperationsLostOnDisconnect();
+
+			// THEN
+			REQUIRE(registry.subscribedTopicsByGrantedQos() == std::map<int, std::vector<std::string>>{ { 1, { "a" } }, { 2, { "b", "c" } } });
+			const int lateGrantedQos[] = { 0, 0 };
+			REQUIRE(registry.registerTopicSubscriptionsAndReturnTopicNames(2, 2, lateGrantedQos).empty());
+			REQUIRE(registry.grantedQosForTopic("b") == 2);
+		}
+	}
+
+	TEST_CASE("MqttClient resubscribe")
+	{
+		MqttClient client("client");
+		auto *mosquitto = connectToFakeBroker(client);
+
+		SUBCASE("Topics are subscribed to again after reconnecting, with one SUBSCRIBE packet per QoS")
+		{
+			// GIVEN
+			REQUIRE(client.subscribe("a", 0) == MOSQ_ERR_SUCCESS);
+			const int grantedQos0[] = { 0 };
+			mosquitto->subscribed.emit(mosquitto->lastMsgId(), 1, grantedQos0);
+			REQUIRE(client.subscribe(std::vector<std::string>{ "b", "c" }, 1) == MOSQ_ERR_SUCCESS);
+			const int grantedQos1[] = { 1, 1 };
+			mosquitto->subscribed.emit(mosquitto->lastMsgId(), 2, grantedQos1);
+			// not acknowledged before the connection got lost
+			REQUIRE(client.subscribe("d", 1) == MOSQ_ERR_SUCCESS);
+			mosquitto->disconnected.emit(7);
+			REQUIRE(client.subscriptions.get() == std::vector<std::string>{ "a", "b", "c", "d" });
+			mosquitto->subscriptions.clear();
+
+			// WHEN
+			connect(client, mosquitto);
+
+			// THEN
+			REQUIRE(mosquitto->subscriptions.size() == 2);
+			REQUIRE(mosquitto->subscriptions[0].topics == std::vector<std::string>{ "a" });
+			REQUIRE(mosquitto->subscriptions[0].qos == 0);
+			REQUIRE(mosquitto->subscriptions[1].topics == std::vector<std::string>{ "b", "c", "d" });
+			REQUIRE(mosquitto->subscriptions[1].qos == 1);
+			REQUIRE(client.subscriptionState.get() == IMqttClient::SubscriptionState::SUBSCRIBING);
+
+			// WHEN
+			const int grantedQos[] = { 1, 0x80, 1 };
+			mosquitto->subscribed.emit(mosquitto->lastMsgId(), 3, grantedQos);
+			mosquitto->subscribed.emit(mosquitto->lastMsgId() - 1, 1, grantedQos0);
+
+			// THEN
+			REQUIRE(client.subscriptions.get() == std::vector<std::string>{ "a", "b", "d" });
+			REQUIRE(client.subscriptionState.get() == IMqttClient::SubscriptionState::SUBSCRIBED);
+		}
+
+		SUBCASE("Nothing is subscribed to after reconnecting without subscriptions")
+		{
+			// GIVEN
+			mosquitto->disconnected.emit(7);
+
+			// WHEN
+			connect(client, mosquitto);
+
+			// THEN
+			REQUIRE(mosquitto->subscriptions.empty());
+		}
+	}
+}
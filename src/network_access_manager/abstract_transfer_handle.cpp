@@ -1,8 +1,54 @@
 #include "abstract_transfer_handle.h"
+#include "network_access_manager.h"
+#include "transfer_handle_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
 #include <spdlog/spdlog.h>
 
-// TODO -> allow for reusing handles for multiple transfers
 // "re-using handles is a key to good performance with libcurl" -> see https://curl.se/libcurl/c/curl_easy_cleanup.html
+// handles are reused by TransferHandlePool, see reuse()
+
+namespace {
+
+constexpr std::string_view c_unixSocketSchemeSuffix = "+unix";
+
+int hexValueOf(char c)
+{
+	if ((c >= '0') && (c <= '9')) {
+		return c - '0';
+	}
+	if ((c >= 'a') && (c <= 'f')) {
+		return c - 'a' + 10;
+	}
+	if ((c >= 'A') && (c <= 'F')) {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+// returns false if text contains an invalid escape sequence
+bool percentDecode(std::string_view text, std::string &decodedText)
+{
+	decodedText.clear();
+	decodedText.reserve(text.size());
+	for (std::size_t i = 0; i < text.size(); ++i) {
+		if (text[i] != '%') {
+			decodedText.push_back(text[i]);
+			continue;
+		}
+		const auto high = (i + 2 < text.size()) ? hexValueOf(text[i + 1]) : -1;
+		const auto low = (i + 2 < text.size()) ? hexValueOf(text[i + 2]) : -1;
+		if ((high < 0) || (low < 0)) {
+			return false;
+		}
+		decodedText.push_back(static_cast<char>((high << 4) | low));
+		i += 2;
+	}
+	return true;
+}
+
+}
 
 AbstractTransferHandle::AbstractTransferHandle(const Url &url, bool verbose)
 	: m_url{url}
@@ -12,7 +58,72 @@ AbstractTransferHandle::AbstractTransferHandle(const Url &url, bool verbose)
 		spdlog::error("curl_easy_init()");
 		return;
 	}
-	curl_easy_setopt(m_handle, CURLOPT_URL, url.url().c_str());
+	setDefaultOptions(verbose);
+}
+
+AbstractTransferHandle::~AbstractTransferHandle()
+{
+	// the deadline and cancellation callbacks of a transfer destroyed while registered refer to this handle
+	if ((m_deadlineTimerId != TimerWheel::c_invalidTimerId) || m_cancellationConnection.isActive()) {
+		NetworkAccessManager::instance().releaseDeadlineAndCancellation(*this);
+	}
+	curl_easy_cleanup(m_handle);
+}
+
+void AbstractTransferHandle::reuse(const Url &url, bool verbose)
+{
+	m_url = url;
+	m_errorBuffer[0] = '\0';
+	m_digest.reset();
+	m_expectedDigest.clear();
+	m_activeSocket = CURL_SOCKET_BAD;
+	finished.disconnectAll();
+
+	if (!m_handle) {
+		spdlog::error("AbstractTransferHandle::reuse() - no curl handle");
+		return;
+	}
+
+	// unlike curl_easy_cleanup() + curl_easy_init(), this keeps live connections,
+	// the DNS cache and TLS session IDs of the handle
+	curl_easy_reset(m_handle);
+	setDefaultOptions(verbose);
+}
+
+void AbstractTransferHandle::setDefaultOptions(bool verbose)
+{
+	m_unixSocketPath.clear();
+	const auto &url = m_url.url();
+	const auto schemeEnd = url.find("://");
+	const auto scheme = std::string_view(url).substr(0, (schemeEnd == std::string::npos) ? 0 : schemeEnd);
+	if (scheme.ends_with(c_unixSocketSchemeSuffix)) {
+		// http+unix://<socket>/path -> http://localhost/path via <socket>
+		const auto authorityBegin = schemeEnd + 3;
+		const auto authorityEnd = std::min(url.find_first_of("/?#", authorityBegin), url.size());
+		const auto isValid = percentDecode(std::string_view(url).substr(authorityBegin, authorityEnd - authorityBegin), m_unixSocketPath)
+			&& !m_unixSocketPath.empty() && (m_unixSocketPath != "@");
+		if (!isValid) {
+			// libcurl fails the transfer because of the unsupported scheme
+			spdlog::error("AbstractTransferHandle::setDefaultOptions() - invalid Unix socket URL {}", url);
+			m_unixSocketPath.clear();
+			curl_easy_setopt(m_handle, CURLOPT_URL, url.c_str());
+		}
+		else {
+			auto tcpUrl = std::string(scheme.substr(0, scheme.size() - c_unixSocketSchemeSuffix.size())) + "://localhost";
+			tcpUrl += (authorityEnd < url.size()) ? std::string_view(url).substr(authorityEnd) : std::string_view("/");
+			// libcurl copies string options
+			curl_easy_setopt(m_handle, CURLOPT_URL, tcpUrl.c_str());
+			if (m_unixSocketPath.front() == '@') {
+				curl_easy_setopt(m_handle, CURLOPT_ABSTRACT_UNIX_SOCKET, m_unixSocketPath.c_str() + 1);
+			}
+			else {
+				curl_easy_setopt(m_handle, CURLOPT_UNIX_SOCKET_PATH, m_unixSocketPath.c_str());
+			}
+		}
+	}
+	else {
+		curl_easy_setopt(m_handle, CURLOPT_URL, url.c_str());
+	}
 	curl_easy_setopt(m_handle, CURLOPT_VERBOSE, verbose ? 1L : 0L);
 	curl_easy_setopt(m_handle, CURLOPT_PRIVATE, this); // complementing method making use of this is -> fromCurlEasyHandle()
 
@@ -25,14 +136,9 @@ AbstractTransferHandle::AbstractTransferHandle(const Url &url, bool verbose)
 	curl_easy_setopt(m_handle, CURLOPT_WRITEDATA, this);
 }
 
-AbstractTransferHandle::~AbstractTransferHandle()
-{
-	curl_easy_cleanup(m_handle);
-}
-
 AbstractTransferHandle *AbstractTransferHandle::fromCurlEasyHandle(CURL *easyHandle)
 {
-	AbstractTransferHandle *transferHandle;
+	AbstractTransferHandle *transferHandle = nullptr;
 	curl_easy_getinfo(easyHandle, CURLINFO_PRIVATE, &transferHandle);
 	return transferHandle;
 }
@@ -52,6 +158,56 @@ std::string AbstractTransferHandle::error() const
 	return std::string(m_errorBuffer);
 }
 
+Url AbstractTransferHandle::unixSocketUrl(std::string_view socketPath, std::string_view path, std::string_view scheme)
+{
+	static constexpr char c_hexDigits[] = "0123456789ABCDEF";
+
+	auto url = std::string(scheme) + std::string(c_unixSocketSchemeSuffix) + "://";
+	for (const auto c : socketPath) {
+		const auto isUnreserved = std::isalnum(static_cast<unsigned char>(c)) || (c == '-') || (c == '.') || (c == '_') || (c == '~');
+		if (isUnreserved) {
+			url.push_back(c);
+		}
+		else {
+			url.push_back('%');
+			url.push_back(c_hexDigits[static_cast<unsigned char>(c) >> 4]);
+			url.push_back(c_hexDigits[static_cast<unsigned char>(c) & 0xF]);
+		}
+	}
+	if (!path.starts_with('/')) {
+		url.push_back('/');
+	}
+	url += path;
+	return Url(url);
+}
+
+const std::string &AbstractTransferHandle::unixSocketPath() const
+{
+	return m_unixSocketPath;
+}
+
+curl_socket_t AbstractTransferHandle::activeSocket() const
+{
+	return m_activeSocket;
+}
+
+void AbstractTransferHandle::setExpectedDigest(TransferDigest::Algorithm algorithm, std::string_view expectedHexDigest)
+{
+	m_digest.emplace(algorithm);
+	m_expectedDigest = expectedHexDigest;
+
+	// handles passing data to libcurl directly (e.g. FTP transfers from and to a FILE) use the callbacks from now on
+	curl_easy_setopt(m_handle, CURLOPT_READFUNCTION, readCallback);
+	curl_easy_setopt(m_handle, CURLOPT_READDATA, this);
+	curl_easy_setopt(m_handle, CURLOPT_WRITEFUNCTION, writeCallback);
+	curl_easy_setopt(m_handle, CURLOPT_WRITEDATA, this);
+}
+
+std::string AbstractTransferHandle::digest() const
+{
+	return m_digest ? m_digest->hexDigest() : std::string();
+}
+
 size_t AbstractTransferHandle::readCallbackImpl(const char *data, size_t size, size_t nmemb)
 {
 	const size_t realSize = size * nmemb;
@@ -80,16 +236,32 @@ size_t AbstractTransferHandle::writeCallbackImpl(const char *data, size_t size,
 
 size_t AbstractTransferHandle::readCallback(const char *data, size_t size, size_t nmemb, AbstractTransferHandle *self)
 {
-	return self->readCallbackImpl(data, size, nmemb);
+	const auto numberOfBytes = self->readCallbackImpl(data, size, nmemb);
+	// CURL_READFUNC_ABORT and CURL_READFUNC_PAUSE exceed the size of the buffer
+	if (self->m_digest && (numberOfBytes <= size * nmemb)) {
+		self->m_digest->update(data, numberOfBytes);
+	}
+	return numberOfBytes;
 }
 
 size_t AbstractTransferHandle::writeCallback(const char *data, size_t size, size_t nmemb, AbstractTransferHandle *self)
 {
-	return self->writeCallbackImpl(data, size, nmemb);
+	const auto numberOfBytes = self->writeCallbackImpl(data, size, nmemb);
+	// CURL_WRITEFUNC_PAUSE exceeds the size of the data, libcurl delivers paused data again
+	if (self->m_digest && (numberOfBytes <= size * nmemb)) {
+		self->m_digest->update(data, numberOfBytes);
+	}
+	return numberOfBytes;
 }
 
 void AbstractTransferHandle::transferDoneCallback(CURLcode result)
 {
+	if ((result == CURLE_OK) && m_digest && !m_expectedDigest.empty() && !m_digest->matches(m_expectedDigest)) {
+		std::snprintf(m_errorBuffer, CURL_ERROR_SIZE, "%s digest mismatch: expected %s, got %s",
+					  TransferDigest::nameOf(m_digest->algorithm()).data(), m_expectedDigest.c_str(), m_digest->hexDigest().c_str());
+		result = CURLE_BAD_CONTENT_ENCODING;
+	}
+
 	transferDoneCallbackImpl(result);
 
 	if (result != CURLcode::CURLE_OK) {
@@ -97,4 +269,10 @@ void AbstractTransferHandle::transferDoneCallback(CURLcode result)
 	}
 
 	finished.emit((int)result);
+
+	// handles of a TransferHandlePool return to their pool once finished was emitted,
+	// the pool may destroy this handle -> do not access members afterwards
+	if (m_pool) {
+		m_pool->recycle(*this);
+	}
 }
@@ -4,14 +4,21 @@
 #include <kdbindings/signal.h>
 #include <KDFoundation/object.h>
 #include <KDUtils/url.h>
+#include <optional>
 #include <string>
+#include <string_view>
+#include "timer_wheel.h"
+#include "transfer_digest.h"
 
 using namespace KDFoundation;
 using namespace KDUtils;
 
+class AbstractTransferHandlePool;
+
 class AbstractTransferHandle : public Object
 {
 	friend class AbstractTransferHandleUnitTestHarness;
+	friend class AbstractTransferHandlePool;
 	friend class NetworkAccessManager;
 
   public:
@@ -26,17 +33,57 @@ class AbstractTransferHandle : public Object
 	const Url &url() const;
 	std::string error() const;
 
+	// URLs with a scheme suffixed by "+unix" (e.g. "http+unix://%2Frun%2Fdaemon.sock/status")
+	// reach a local service via a Unix domain socket instead of TCP loopback: the authority is
+	// the percent-encoded path of the socket, a path starting with '@' names a socket in the
+	// abstract namespace (Linux). libcurl sends "localhost" as host and reuses connections per socket.
+	static Url unixSocketUrl(std::string_view socketPath, std::string_view path = "/", std::string_view scheme = "http");
+	// socket of a Unix socket URL (including a leading '@'), empty if the transfer uses TCP
+	[[nodiscard]] const std::string &unixSocketPath() const;
+
+	// hashes the data passing the read and write callbacks while it is transferred, so verifying
+	// a transfer costs no extra I/O; a transfer whose digest differs from expectedHexDigest
+	// finishes with CURLE_BAD_CONTENT_ENCODING (an empty expectedHexDigest computes digest() only).
+	// Call before the transfer starts receiving or sending data, reuse() resets it.
+	void setExpectedDigest(TransferDigest::Algorithm algorithm, std::string_view expectedHexDigest);
+	// digest of the data transferred so far, empty if no digest is computed
+	[[nodiscard]] std::string digest() const;
+
   protected:
+	// prepares this handle for another transfer, see TransferHandlePool
+	void reuse(const Url &url, bool verbose = false);
+
 	virtual size_t readCallbackImpl(const char *data, size_t size, size_t nmemb);
 	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb);
 	virtual void transferDoneCallbackImpl(CURLcode result) = 0;
 
+	// for handles ending their transfer themselves, after unregistering it
+	void transferDoneCallback(CURLcode result);
+
+	// socket libcurl watches for this transfer (see NetworkAccessManager::socketCallback()),
+	// CURL_SOCKET_BAD if there is none
+	[[nodiscard]] curl_socket_t activeSocket() const;
+
 	CURL *m_handle;
 	Url m_url;
 	char m_errorBuffer[CURL_ERROR_SIZE];
 
   private:
+	void setDefaultOptions(bool verbose);
+
 	static size_t readCallback(const char *data, size_t size, size_t nmemb, AbstractTransferHandle *self);
 	static size_t writeCallback(const char *data, size_t size, size_t nmemb, AbstractTransferHandle *self);
-	void transferDoneCallback(CURLcode result);
+
+	AbstractTransferHandlePool *m_pool { nullptr };
+	std::size_t m_poolIndex { 0 };
+
+	std::string m_unixSocketPath;
+	curl_socket_t m_activeSocket { CURL_SOCKET_BAD };
+
+	std::optional<TransferDigest> m_digest;
+	std::string m_expectedDigest;
+
+	// see NetworkAccessManager::registerTransfer(transferHandle, options)
+	TimerWheel::TimerId m_deadlineTimerId { TimerWheel::c_invalidTimerId };
+	KDBindings::ConnectionHandle m_cancellationConnection;
 };
@@ -0,0 +1,472 @@
+/*
+ * This implements minimal HTTP/1.1 and FTP stand-in servers listening on
+ * the loopback interface. They are used by bench_network_access_manager.cpp
+ * to measure NetworkAccessManager without any external network access.
+ *
+ * Both servers serve payloads of arbitrary size; the requested size is
+ * taken from the last path segment of the URL, e.g.
+ * - http://127.0.0.1:<port>/65536
+ * - ftp://127.0.0.1:<port>/65536
+ *
+ * The HTTP server handles all connections (keep-alive) in one thread using poll().
+ * The FTP server handles each control connection in its own thread using blocking I/O
+ * and supports just enough commands for curl to download files in passive mode.
+ *
+ * POSIX only.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <list>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace LoopbackServer {
+
+// all servers stream from this buffer, so serving a payload does not allocate
+inline const std::string &payloadChunk()
+{
+	static const std::string s_chunk(256 * 1024, 'x');
+	return s_chunk;
+}
+
+inline std::size_t sizeFromPath(const std::string &path)
+{
+	const auto pos = path.find_last_of('/');
+	const auto name = (pos == std::string::npos) ? path : path.substr(pos + 1);
+	return std::strtoull(name.c_str(), nullptr, 10);
+}
+
+// returns listening socket bound to 127.0.0.1 on an ephemeral port, -1 on error
+inline int listenOnLoopback(int &port, int backlog = SOMAXCONN)
+{
+	const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+
+	const int reuse = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in address {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+
+	socklen_t addressLength = sizeof(address);
+	if ((::bind(fd, reinterpret_cast<sockaddr*>(&address), addressLength) != 0)
+		|| (::listen(fd, backlog) != 0)
+		|| (::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0)) {
+		::close(fd);
+		return -1;
+	}
+
+	port = ntohs(address.sin_port);
+	return fd;
+}
+
+inline bool sendAll(int fd, const char *data, std::size_t size)
+{
+	while (size > 0) {
+		const auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (n <= 0) {
+			return false;
+		}
+		data += n;
+		size -= n;
+	}
+	return true;
+}
+
+inline bool sendPayload(int fd, std::size_t size)
+{
+	const auto &chunk = payloadChunk();
+	while (size > 0) {
+		const auto n = std::min(size, chunk.size());
+		if (!sendAll(fd, chunk.data(), n)) {
+			return false;
+		}
+		size -= n;
+	}
+	return true;
+}
+
+/*
+ * Class: HttpServer
+ *
+ * Answers every "GET /<size> HTTP/1.1" request with <size> bytes.
+ */
+class HttpServer
+{
+  public:
+	HttpServer() = default;
+	~HttpServer() { stop(); }
+
+	HttpServer(const HttpServer&) = delete;
+	HttpServer &operator=(const HttpServer&) = delete;
+
+	bool start()
+	{
+		m_listenFd = listenOnLoopback(m_port);
+		if (m_listenFd < 0) {
+			return false;
+		}
+		::fcntl(m_listenFd, F_SETFL, O_NONBLOCK);
+		::pipe(m_wakeupPipe);
+		m_thread = std::thread([this]() { run(); });
+		return true;
+	}
+
+	void stop()
+	{
+		if (!m_thread.joinable()) {
+			return;
+		}
+		const char c = 'q';
+		::write(m_wakeupPipe[1], &c, 1);
+		m_thread.join();
+		::close(m_wakeupPipe[0]);
+		::close(m_wakeupPipe[1]);
+		::close(m_listenFd);
+	}
+
+	[[nodiscard]] int port() const { return m_port; }
+	[[nodiscard]] std::size_t numberOfServedRequests() const { return m_numberOfServedRequests; }
+
+  private:
+	struct Connection
+	{
+		std::string input;
+		std::string header;
+		std::size_t headerOffset { 0 };
+		std::size_t payloadLeft { 0 };
+		std::size_t payloadOffset { 0 };
+	};
+
+	void run()
+	{
+		std::unordered_map<int, Connection> connections;
+		std::vector<pollfd> pollFds;
+
+		for (;;) {
+			pollFds.clear();
+			pollFds.push_back({ m_wakeupPipe[0], POLLIN, 0 });
+			pollFds.push_back({ m_listenFd, POLLIN, 0 });
+			for (const auto &[fd, connection] : connections) {
+				const auto isSending = (connection.headerOffset < connection.header.size()) || (connection.payloadLeft > 0);
+				pollFds.push_back({ fd, short(isSending ? POLLOUT : POLLIN), 0 });
+			}
+
+			if (::poll(pollFds.data(), pollFds.size(), -1) < 0) {
+				continue;
+			}
+
+			if (pollFds[0].revents) {
+				break;
+			}
+
+			if (pollFds[1].revents & POLLIN) {
+				int fd;
+				while ((fd = ::accept(m_listenFd, nullptr, nullptr)) >= 0) {
+					::fcntl(fd, F_SETFL, O_NONBLOCK);
+					const int noDelay = 1;
+					::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+					connections.emplace(fd, Connection{});
+				}
+			}
+
+			for (std::size_t i = 2; i < pollFds.size(); ++i) {
+				if (!pollFds[i].revents) {
+					continue;
+				}
+				const auto fd = pollFds[i].fd;
+				auto &connection = connections.at(fd);
+				const auto keepOpen = (pollFds[i].revents & POLLOUT) ? onWritable(fd, connection) : onReadable(fd, connection);
+				if (!keepOpen) {
+					::close(fd);
+					connections.erase(fd);
+				}
+			}
+		}
+
+		for (const auto &[fd, connection] : connections) {
+			::close(fd);
+		}
+	}
+
+	bool onReadable(int fd, Connection &connection)
+	{
+		char buffer[4096];
+		const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+		if (n <= 0) {
+			return false;
+		}
+		connection.input.append(buffer, n);
+
+		const auto endOfHeader = connection.input.find("\r\n\r\n");
+		if (endOfHeader == std::string::npos) {
+			return true;
+		}
+
+		// request line: GET /<size> HTTP/1.1
+		const auto pathBegin = connection.input.find(' ') + 1;
+		const auto pathEnd = connection.input.find(' ', pathBegin);
+		const auto size = sizeFromPath(connection.input.substr(pathBegin, pathEnd - pathBegin));
+		connection.input.erase(0, endOfHeader + 4);
+
+		connection.header = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n";
+		connection.headerOffset = 0;
+		connection.payloadLeft = size;
+		connection.payloadOffset = 0;
+		++m_numberOfServedRequests;
+
+		return onWritable(fd, connection);
+	}
+
+	bool onWritable(int fd, Connection &connection)
+	{
+		while (connection.headerOffset < connection.header.size()) {
+			const auto n = ::send(fd, connection.header.data() + connection.headerOffset, connection.header.size() - connection.headerOffset, MSG_NOSIGNAL);
+			if (n < 0) {
+				return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+			}
+			connection.headerOffset += n;
+		}
+
+		const auto &chunk = payloadChunk();
+		while (connection.payloadLeft > 0) {
+			const auto offset = connection.payloadOffset % chunk.size();
+			const auto length = std::min(connection.payloadLeft, chunk.size() - offset);
+			const auto n = ::send(fd, chunk.data() + offset, length, MSG_NOSIGNAL);
+			if (n < 0) {
+				return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+			}
+			connection.payloadLeft -= n;
+			connection.payloadOffset += n;
+		}
+		return true;
+	}
+
+	int m_listenFd { -1 };
+	int m_port { 0 };
+	int m_wakeupPipe[2] { -1, -1 };
+	std::atomic<std::size_t> m_numberOfServedRequests { 0 };
+	std::thread m_thread;
+};
+
+/*
+ * Class: FtpServer
+ *
+ * Supports anonymous login and RETR in passive mode (EPSV/PASV).
+ * RETR /<size> sends <size> bytes.
+ *
+ * A session ends when its client closes the control connection (libcurl keeps
+ * idle ones in its connection cache); its thread is joined when the next
+ * control connection is accepted, so threads and descriptors do not pile up.
+ */
+class FtpServer
+{
+  public:
+	FtpServer() = default;
+	~FtpServer() { stop(); }
+
+	FtpServer(const FtpServer&) = delete;
+	FtpServer &operator=(const FtpServer&) = delete;
+
+	bool start()
+	{
+		m_listenFd = listenOnLoopback(m_port);
+		if (m_listenFd < 0) {
+			return false;
+		}
+		m_acceptThread = std::thread([this]() {
+			int fd;
+			while ((fd = ::accept(m_listenFd, nullptr, nullptr)) >= 0) {
+				const int noDelay = 1;
+				::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+				std::lock_guard lock(m_mutex);
+				reapFinishedSessions();
+				auto &session = m_sessions.emplace_back(fd);
+				session.thread = std::thread([this, &session]() { runSession(session); });
+			}
+		});
+		return true;
+	}
+
+	void stop()
+	{
+		if (!m_acceptThread.joinable()) {
+			return;
+		}
+		::shutdown(m_listenFd, SHUT_RDWR);
+		::close(m_listenFd);
+		m_acceptThread.join();
+
+		{
+			std::lock_guard lock(m_mutex);
+			for (const auto &session : m_sessions) {
+				if (session.controlFd >= 0) {
+					::shutdown(session.controlFd, SHUT_RDWR);
+				}
+			}
+		}
+		// sessions close their control connection under m_mutex before they end
+		for (auto &session : m_sessions) {
+			session.thread.join();
+		}
+		m_sessions.clear();
+	}
+
+	[[nodiscard]] int port() const { return m_port; }
+	[[nodiscard]] std::size_t numberOfServedRequests() const { return m_numberOfServedRequests; }
+
+  private:
+	struct Session
+	{
+		explicit Session(int fd) : controlFd{fd} {}
+
+		int controlFd; // -1 once the session closed it
+		std::thread thread;
+		std::atomic<bool> isFinished { false };
+	};
+
+	// gives up if the client does not connect or closes the control connection (see stop())
+	static constexpr int c_dataConnectionTimeoutMs = 10000;
+
+	// requires m_mutex
+	void reapFinishedSessions()
+	{
+		std::erase_if(m_sessions, [](Session &session) {
+			if (!session.isFinished) {
+				return false;
+			}
+			session.thread.join();
+			return true;
+		});
+	}
+
+	static int acceptDataConnection(int passiveFd, int controlFd)
+	{
+		pollfd pollFds[] = { { passiveFd, POLLIN, 0 }, { controlFd, POLLIN, 0 } };
+		if ((::poll(pollFds, 2, c_dataConnectionTimeoutMs) <= 0) || !(pollFds[0].revents & POLLIN)) {
+			return -1;
+		}
+		return ::accept(passiveFd, nullptr, nullptr);
+	}
+
+	void runSession(Session &session)
+	{
+		const auto controlFd = session.controlFd;
+		auto reply = [controlFd](const std::string &line) { return sendAll(controlFd, line.data(), line.size()); };
+
+		int passiveFd = -1;
+		std::string input;
+		char buffer[1024];
+
+		reply("220 mecaps loopback ftp\r\n");
+
+		for (;;) {
+			const auto endOfLine = input.find("\r\n");
+			if (endOfLine == std::string::npos) {
+				const auto n = ::recv(controlFd, buffer, sizeof(buffer), 0);
+				if (n <= 0) {
+					break;
+				}
+				input.append(buffer, n);
+				continue;
+			}
+
+			const auto line = input.substr(0, endOfLine);
+			input.erase(0, endOfLine + 2);
+
+			const auto separator = line.find(' ');
+			const auto command = line.substr(0, separator);
+			const auto argument = (separator == std::string::npos) ? std::string() : line.substr(separator + 1);
+
+			if (command == "USER") {
+				reply("331 any password\r\n");
+			} else if (command == "PASS") {
+				reply("230 logged in\r\n");
+			} else if (command == "PWD") {
+				reply("257 \"/\"\r\n");
+			} else if (command == "CWD") {
+				reply("250 ok\r\n");
+			} else if (command == "TYPE") {
+				reply("200 ok\r\n");
+			} else if (command == "SIZE") {
+				reply("213 " + std::to_string(sizeFromPath(argument)) + "\r\n");
+			} else if ((command == "EPSV") || (command == "PASV")) {
+				if (passiveFd >= 0) {
+					::close(passiveFd);
+				}
+				int dataPort = 0;
+				passiveFd = listenOnLoopback(dataPort, 1);
+				if (passiveFd < 0) {
+					reply("425 cannot open data connection\r\n");
+				} else if (command == "EPSV") {
+					reply("229 Entering Extended Passive Mode (|||" + std::to_string(dataPort) + "|)\r\n");
+				} else {
+					reply("227 Entering Passive Mode (127,0,0,1," + std::to_string(dataPort / 256) + "," + std::to_string(dataPort % 256) + ")\r\n");
+				}
+			} else if (command == "RETR") {
+				if (passiveFd < 0) {
+					reply("425 use EPSV or PASV first\r\n");
+					continue;
+				}
+				const auto size = sizeFromPath(argument);
+				reply("150 opening data connection (" + std::to_string(size) + " bytes)\r\n");
+				const int dataFd = acceptDataConnection(passiveFd, controlFd);
+				::close(passiveFd);
+				passiveFd = -1;
+				if (dataFd < 0) {
+					reply("425 no data connection\r\n");
+					continue;
+				}
+				const auto sent = sendPayload(dataFd, size);
+				::close(dataFd);
+				++m_numberOfServedRequests;
+				reply(sent ? "226 transfer complete\r\n" : "426 transfer aborted\r\n");
+			} else if (command == "QUIT") {
+				reply("221 bye\r\n");
+				break;
+			} else {
+				reply("502 not implemented\r\n");
+			}
+		}
+
+		if (passiveFd >= 0) {
+			::close(passiveFd);
+		}
+		{
+			// stop() must not shut down a descriptor number that was reused in the meantime
+			std::lock_guard lock(m_mutex);
+			::close(session.controlFd);
+			session.controlFd = -1;
+		}
+		session.isFinished = true;
+	}
+
+	int m_listenFd { -1 };
+	int m_port { 0 };
+	std::atomic<std::size_t> m_numberOfServedRequests { 0 };
+	std::thread m_acceptThread;
+	std::mutex m_mutex;
+	std::list<Session> m_sessions; // stable addresses, the threads refer to their session
+};
+
+} // namespace LoopbackServer
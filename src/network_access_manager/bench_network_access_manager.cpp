@@ -0,0 +1,313 @@
+/*
+ * This implements a loopback benchmark for class NetworkAccessManager
+ * and the related transfer classes deriving from AbstractTransferHandle.
+ *
+ * In contrast to tst_network_access_manager.cpp the real libcurl is used.
+ * Transfers are served by in-process HTTP and FTP stand-in servers listening
+ * on 127.0.0.1 (see bench_loopback_server.h), so no external network access
+ * is required.
+ *
+ * For each scenario (protocol, number of concurrent transfers, payload size)
+ * the benchmark reports
+ * - requests per second
+ * - p50 and p99 latency (registerTransfer() until finished is emitted)
+ * - CPU time of the event loop thread per MB transferred
+ * - heap allocations of the event loop thread per request
+ *
+ * Usage:
+ *   bench_network_access_manager [--protocol http|ftp|all]
+ *                                [--concurrency 1,10,100]
+ *                                [--sizes 1024,65536]
+ *                                [--requests <number of requests per scenario>]
+ */
+
+#include <KDFoundation/core_application.h>
+#include "bench_loopback_server.h"
+#include "ftp_transfer_handle.h"
+#include "http_transfer_handle.h"
+#include "network_access_manager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+/*
+ * Allocation counting.
+ * Only allocations made on the event loop thread are counted, so the
+ * stand-in servers running in their own threads do not distort results.
+ */
+namespace {
+std::atomic<std::size_t> s_numberOfAllocations { 0 };
+std::thread::id s_eventLoopThreadId;
+} // namespace
+
+void *operator new(std::size_t size)
+{
+	if (std::this_thread::get_id() == s_eventLoopThreadId) {
+		s_numberOfAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Protocol {
+	HTTP,
+	FTP
+};
+
+struct Scenario
+{
+	Protocol protocol;
+	std::size_t concurrency;
+	std::size_t size;
+	std::size_t requests;
+};
+
+struct Result
+{
+	std::size_t finished { 0 };
+	std::size_t failed { 0 };
+	double seconds { 0 };
+	double p50Us { 0 };
+	double p99Us { 0 };
+	double cpuSeconds { 0 };
+	std::size_t allocations { 0 };
+	bool timedOut { false };
+};
+
+double cpuTimeOfThisThread()
+{
+#ifdef RUSAGE_THREAD
+	rusage usage {};
+	getrusage(RUSAGE_THREAD, &usage);
+	return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#else
+	return double(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
+
+void raiseFileDescriptorLimit()
+{
+	rlimit limit {};
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+}
+
+std::vector<std::size_t> parseList(const char *argument)
+{
+	std::vector<std::size_t> values;
+	const std::string list(argument);
+	std::size_t begin = 0;
+	while (begin < list.size()) {
+		const auto end = std::min(list.find(',', begin), list.size());
+		values.push_back(std::strtoull(list.substr(begin, end - begin).c_str(), nullptr, 10));
+		begin = end + 1;
+	}
+	return values;
+}
+
+Result runScenario(CoreApplication &app, const Scenario &scenario, int port)
+{
+	static File s_devNull = File("/dev/null");
+	const auto timeout = std::chrono::seconds(120);
+
+	auto &networkAccessManager = NetworkAccessManager::instance();
+
+	std::vector<std::unique_ptr<AbstractTransferHandle>> transfers(scenario.requests);
+	std::vector<Clock::time_point> startTimes(scenario.requests);
+	std::vector<double> latenciesUs;
+	latenciesUs.reserve(scenario.requests);
+	std::vector<std::size_t> finishedTransfers;
+	finishedTransfers.reserve(scenario.requests);
+
+	const auto scheme = (scenario.protocol == Protocol::HTTP) ? "http" : "ftp";
+	const auto url = Url(std::string(scheme) + "://127.0.0.1:" + std::to_string(port) + "/" + std::to_string(scenario.size));
+
+	Result result;
+	std::size_t numberOfStartedTransfers = 0;
+
+	std::function<void()> startNextTransfer = [&]() {
+		const auto i = numberOfStartedTransfers++;
+		if (scenario.protocol == Protocol::HTTP) {
+			transfers[i] = std::make_unique<HttpTransferHandle>(url);
+		} else {
+			transfers[i] = std::make_unique<FtpDownloadTransferHandle>(s_devNull, url);
+		}
+
+		transfers[i]->finished.connect([&, i](int curlResult) {
+			latenciesUs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - startTimes[i]).count());
+			result.failed += (curlResult != CURLE_OK) ? 1 : 0;
+			++result.finished;
+			// transfers must not be deleted while emitting finished, release them from the loop below
+			finishedTransfers.push_back(i);
+			if (numberOfStartedTransfers < scenario.requests) {
+				startNextTransfer();
+			}
+		});
+
+		startTimes[i] = Clock::now();
+		networkAccessManager.registerTransfer(*transfers[i]);
+	};
+
+	s_numberOfAllocations = 0;
+	const auto cpuStart = cpuTimeOfThisThread();
+	const auto start = Clock::now();
+
+	while (numberOfStartedTransfers < std::min(scenario.concurrency, scenario.requests)) {
+		startNextTransfer();
+	}
+
+	while (result.finished < scenario.requests) {
+		app.processEvents(100);
+
+		for (const auto i : finishedTransfers) {
+			transfers[i].reset();
+		}
+		finishedTransfers.clear();
+
+		if (Clock::now() - start > timeout) {
+			result.timedOut = true;
+			for (auto &transfer : transfers) {
+				if (transfer) {
+					networkAccessManager.unregisterTransfer(*transfer);
+				}
+			}
+			break;
+		}
+	}
+
+	result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	result.cpuSeconds = cpuTimeOfThisThread() - cpuStart;
+	result.allocations = s_numberOfAllocations;
+
+	std::sort(latenciesUs.begin(), latenciesUs.end());
+	if (!latenciesUs.empty()) {
+		result.p50Us = latenciesUs[latenciesUs.size() * 50 / 100];
+		result.p99Us = latenciesUs[std::min(latenciesUs.size() - 1, latenciesUs.size() * 99 / 100)];
+	}
+
+	return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	std::vector<Protocol> protocols = { Protocol::HTTP, Protocol::FTP };
+	std::vector<std::size_t> concurrencies = { 1, 10, 100, 1000, 10000 };
+	std::vector<std::size_t> sizes = { 1024, 64 * 1024, 1024 * 1024 };
+	std::size_t requests = 0; // 0 -> derived from concurrency
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		const std::string option(argv[i]);
+		if (option == "--protocol") {
+			const std::string value(argv[i + 1]);
+			protocols = (value == "http") ? std::vector{ Protocol::HTTP } : (value == "ftp") ? std::vector{ Protocol::FTP } : protocols;
+		} else if (option == "--concurrency") {
+			concurrencies = parseList(argv[i + 1]);
+		} else if (option == "--sizes") {
+			sizes = parseList(argv[i + 1]);
+		} else if (option == "--requests") {
+			requests = std::strtoull(argv[i + 1], nullptr, 10);
+		} else {
+			std::fprintf(stderr, "unknown option %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	raiseFileDescriptorLimit();
+	s_eventLoopThreadId = std::this_thread::get_id();
+
+	CoreApplication app;
+
+	LoopbackServer::HttpServer httpServer;
+	LoopbackServer::FtpServer ftpServer;
+	if (!httpServer.start() || !ftpServer.start()) {
+		std::fprintf(stderr, "cannot start loopback servers\n");
+		return EXIT_FAILURE;
+	}
+
+	std::printf("%-5s %11s %10s %9s %10s %11s %11s %10s %11s %7s\n",
+		"proto", "concurrency", "size", "requests", "req/s", "p50 [us]", "p99 [us]", "cpu ms/MB", "allocs/req", "failed");
+
+	// libcurl 7.x (seen with 7.88) stalls passive FTP transfers driven by curl_multi_socket_action() if it reads
+	// the reply to EPSV right after sending it on a reused control connection: the transfer then waits for
+	// neither a socket nor a timeout, so the scenario could only end by timing out
+	const auto *curlVersion = curl_version_info(CURLVERSION_NOW);
+	const auto isFtpSupported = (curlVersion->version_num >= 0x080000);
+
+	auto hasFailures = false;
+	for (const auto protocol : protocols) {
+		if ((protocol == Protocol::FTP) && !isFtpSupported) {
+			std::printf("ftp   skipped: libcurl %s stalls passive mode transfers, libcurl 8 or later is required\n", curlVersion->version);
+			continue;
+		}
+		for (const auto concurrency : concurrencies) {
+			// every FTP transfer occupies a control connection, a data connection and a server thread
+			if ((protocol == Protocol::FTP) && (concurrency > 100)) {
+				std::printf("ftp   %11zu skipped: more than 100 concurrent transfers would need as many server threads\n", concurrency);
+				continue;
+			}
+			for (const auto size : sizes) {
+				const auto numberOfRequests = requests ? requests : std::max<std::size_t>(concurrency, 200);
+				// keep the amount of data moved per scenario within reasonable bounds
+				if (!requests && (numberOfRequests * size > (std::size_t(2) << 30))) {
+					std::printf("%-5s %11zu %10zu skipped: more than 2 GiB per scenario, see --requests\n",
+						(protocol == Protocol::HTTP) ? "http" : "ftp", concurrency, size);
+					continue;
+				}
+
+				const auto scenario = Scenario { protocol, concurrency, size, numberOfRequests };
+				const auto port = (protocol == Protocol::HTTP) ? httpServer.port() : ftpServer.port();
+				const auto result = runScenario(app, scenario, port);
+
+				// a timed out scenario only counts the transfers that finished
+				const auto megabytes = double(result.finished * size) / (1024.0 * 1024.0);
+				std::printf("%-5s %11zu %10zu %9zu %10.0f %11.0f %11.0f %10.2f %11.1f %7zu%s\n",
+					(protocol == Protocol::HTTP) ? "http" : "ftp",
+					concurrency,
+					size,
+					numberOfRequests,
+					double(result.finished) / result.seconds,
+					result.p50Us,
+					result.p99Us,
+					megabytes > 0 ? (result.cpuSeconds * 1000.0) / megabytes : 0.0,
+					result.finished ? double(result.allocations) / double(result.finished) : 0.0,
+					result.failed,
+					result.timedOut ? " (timed out)" : "");
+				std::fflush(stdout);
+
+				hasFailures = hasFailures || result.timedOut || (result.failed > 0);
+			}
+		}
+	}
+
+	return hasFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <kdbindings/signal.h>
+#include <memory>
+
+/*
+ * Class: CancellationToken
+ *
+ * Cancellation state shared by all copies of a token.
+ * Pass the same token to NetworkAccessManager::registerTransfer() for all transfers
+ * belonging to e.g. a view and cancel them with one call once the view is left.
+ */
+class CancellationToken
+{
+  public:
+	CancellationToken()
+		: m_state{std::make_shared<State>()}
+	{
+	}
+
+	void cancel() const
+	{
+		// a slot may destroy the token cancel() was called on
+		const auto state = m_state;
+		if (state->isCancelled) {
+			return;
+		}
+		state->isCancelled = true;
+		state->cancelled.emit();
+	}
+
+	[[nodiscard]] bool isCancelled() const { return m_state->isCancelled; }
+
+	// emitted by the first call of cancel() only
+	KDBindings::Signal<> &cancelled() const { return m_state->cancelled; }
+
+  private:
+	struct State
+	{
+		bool isCancelled { false };
+		KDBindings::Signal<> cancelled;
+	};
+
+	std::shared_ptr<State> m_state;
+};
@@ -0,0 +1,260 @@
+#include "ftp_batch_transfer.h"
+#include <algorithm>
+#include <cmath>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+FtpBatchTransfer::FtpBatchTransfer(const INetworkAccessManager &networkAccessManager, FtpBatchTransferOptions options)
+	: m_options{options}
+	, m_downloadPool{networkAccessManager, std::max<std::size_t>(options.maxParallelConnections, 1)}
+	, m_uploadPool{networkAccessManager, std::max<std::size_t>(options.maxParallelConnections, 1)}
+{
+	if (m_options.maxParallelConnections == 0) {
+		spdlog::warn("FtpBatchTransfer::FtpBatchTransfer() - maxParallelConnections must not be zero, using 1 instead");
+		m_options.maxParallelConnections = 1;
+	}
+
+	m_startTimer.interval.set(std::chrono::microseconds(1));
+	m_startTimer.timeout.connect([this]() {
+		m_startTimer.running.set(false);
+		startQueuedFiles();
+	});
+}
+
+FtpBatchTransfer::~FtpBatchTransfer()
+{
+	if (m_state == State::RUNNING) {
+		cancelRunningAndQueuedFiles(CURLE_ABORTED_BY_CALLBACK);
+	}
+}
+
+bool FtpBatchTransfer::submit(std::vector<FtpBatchItem> items)
+{
+	spdlog::debug("FtpBatchTransfer::submit() - {} files", items.size());
+
+	if (m_state == State::RUNNING) {
+		spdlog::error("FtpBatchTransfer::submit() - Batch is already running.");
+		return true;
+	}
+
+	m_items = std::move(items);
+	m_results.assign(m_items.size(), CURLE_OK);
+	m_numberOfBytesTransferredPerFile.assign(m_items.size(), 0);
+	m_numberOfBytesPerFile.assign(m_items.size(), 0);
+	m_nextQueuedFile = 0;
+
+	// the size of uploads is known right away, the one of downloads once the server reported it
+	curl_off_t totalNumberOfBytes = 0;
+	for (std::size_t i = 0; i < m_items.size(); ++i) {
+		if (m_items[i].direction == FtpBatchItem::Direction::UPLOAD) {
+			m_numberOfBytesPerFile[i] = static_cast<curl_off_t>(File(m_items[i].localPath).size());
+			totalNumberOfBytes += m_numberOfBytesPerFile[i];
+		}
+	}
+
+	numberOfFinishedFiles.set(0);
+	numberOfFailedFiles.set(0);
+	totalNumberOfFiles.set(m_items.size());
+	numberOfBytesTransferred.set(0);
+	totalNumberOfBytesToTransfer.set(totalNumberOfBytes);
+
+	m_state = State::RUNNING;
+	startQueuedFiles();
+	return false;
+}
+
+void FtpBatchTransfer::cancel()
+{
+	spdlog::debug("FtpBatchTransfer::cancel()");
+
+	if (m_state != State::RUNNING) {
+		return;
+	}
+
+	cancelRunningAndQueuedFiles(CURLE_ABORTED_BY_CALLBACK);
+	finish();
+}
+
+std::size_t FtpBatchTransfer::size() const
+{
+	return m_items.size();
+}
+
+const FtpBatchItem &FtpBatchTransfer::item(std::size_t index) const
+{
+	return m_items.at(index);
+}
+
+const std::vector<CURLcode> &FtpBatchTransfer::results() const
+{
+	return m_results;
+}
+
+void FtpBatchTransfer::startQueuedFiles()
+{
+	if (m_state != State::RUNNING) {
+		return;
+	}
+
+	while ((m_runningTransfers.size() < m_options.maxParallelConnections) && (m_nextQueuedFile < m_items.size())) {
+		const auto index = m_nextQueuedFile++;
+		const auto hasError = startFile(index);
+		if (hasError) {
+			const auto cancel = recordResultAndCheckForCancellation(index, m_results[index]);
+			if (cancel) {
+				cancelRunningAndQueuedFiles(CURLE_ABORTED_BY_CALLBACK);
+				break;
+			}
+		}
+	}
+
+	if (m_runningTransfers.empty() && (m_nextQueuedFile == m_items.size())) {
+		finish();
+	}
+}
+
+bool FtpBatchTransfer::startFile(std::size_t index)
+{
+	const auto &item = m_items[index];
+	auto file = File(item.localPath);
+
+	RunningTransfer runningTransfer { index, nullptr, nullptr, {}, {} };
+	AbstractFtpTransferHandle *transfer = nullptr;
+	if (item.direction == FtpBatchItem::Direction::DOWNLOAD) {
+		transfer = runningTransfer.download = m_downloadPool.start(file, item.url, m_options.verbose);
+	}
+	else if (!file.exists()) {
+		spdlog::error("FtpBatchTransfer::startFile() - file {} does not exist", item.localPath);
+		m_results[index] = CURLE_READ_ERROR;
+		return true;
+	}
+	else {
+		transfer = runningTransfer.upload = m_uploadPool.start(file, item.url, m_options.verbose);
+	}
+
+	if (!transfer) {
+		m_results[index] = CURLE_FAILED_INIT;
+		return true;
+	}
+	if (!item.expectedDigest.empty()) {
+		// registered transfers receive data from the event loop only -> not too late
+		transfer->setExpectedDigest(item.digestAlgorithm, item.expectedDigest);
+	}
+
+	runningTransfer.bytesTransferredConnection = transfer->numberOfBytesTransferred.valueChanged().connect([this, index, transfer](curl_off_t numberOfBytes) {
+		onFileProgress(index, numberOfBytes, transfer->totalNumberOfBytesToTransfer.get());
+	});
+	runningTransfer.totalBytesConnection = transfer->totalNumberOfBytesToTransfer.valueChanged().connect([this, index, transfer](curl_off_t totalNumberOfBytes) {
+		onFileProgress(index, transfer->numberOfBytesTransferred.get(), totalNumberOfBytes);
+	});
+	transfer->finished.connect([this, index](int result) { onFileFinished(index, result); });
+
+	m_runningTransfers.push_back(std::move(runningTransfer));
+	return false;
+}
+
+void FtpBatchTransfer::onFileFinished(std::size_t index, int result)
+{
+	auto it = std::ranges::find(m_runningTransfers, index, &RunningTransfer::index);
+	if ((m_state != State::RUNNING) || (it == m_runningTransfers.end())) {
+		return;
+	}
+
+	// the pool keeps connections to signals other than finished
+	disconnect(*it);
+	m_runningTransfers.erase(it);
+
+	const auto cancel = recordResultAndCheckForCancellation(index, static_cast<CURLcode>(result));
+	if (cancel) {
+		spdlog::debug("FtpBatchTransfer::onFileFinished() - file {} failed, cancelling remaining files", index);
+		cancelRunningAndQueuedFiles(CURLE_ABORTED_BY_CALLBACK);
+	}
+
+	if (m_runningTransfers.empty() && (m_nextQueuedFile == m_items.size())) {
+		finish();
+		return;
+	}
+
+	// starting the next file right here would need another transfer handle,
+	// the one which just finished returns to its pool after this signal emission
+	m_startTimer.running = true;
+}
+
+void FtpBatchTransfer::onFileProgress(std::size_t index, curl_off_t numberOfBytes, curl_off_t totalNumberOfBytes)
+{
+	const auto numberOfBytesDelta = numberOfBytes - std::exchange(m_numberOfBytesTransferredPerFile[index], numberOfBytes);
+	if (numberOfBytesDelta != 0) {
+		numberOfBytesTransferred.set(numberOfBytesTransferred.get() + numberOfBytesDelta);
+	}
+
+	// libcurl reports a total of 0 as long as the size of a download is unknown
+	if (totalNumberOfBytes > 0) {
+		const auto totalNumberOfBytesDelta = totalNumberOfBytes - std::exchange(m_numberOfBytesPerFile[index], totalNumberOfBytes);
+		if (totalNumberOfBytesDelta != 0) {
+			totalNumberOfBytesToTransfer.set(totalNumberOfBytesToTransfer.get() + totalNumberOfBytesDelta);
+		}
+	}
+}
+
+bool FtpBatchTransfer::recordResultAndCheckForCancellation(std::size_t index, CURLcode result)
+{
+	m_results[index] = result;
+
+	const auto hasFailed = (result != CURLE_OK);
+	if (hasFailed) {
+		numberOfFailedFiles.set(numberOfFailedFiles.get() + 1);
+	}
+	numberOfFinishedFiles.set(numberOfFinishedFiles.get() + 1);
+	fileFinished.emit(index, result);
+
+	return hasFailed && m_options.cancelOnFirstError;
+}
+
+void FtpBatchTransfer::cancelRunningAndQueuedFiles(CURLcode resultOfUnfinishedFiles)
+{
+	auto numberOfUnfinishedFiles = m_runningTransfers.size() + (m_items.size() - m_nextQueuedFile);
+
+	// cancelled transfers do not emit finished, they return to their pool right away
+	auto runningTransfers = std::move(m_runningTransfers);
+	m_runningTransfers.clear();
+	for (auto &runningTransfer : runningTransfers) {
+		disconnect(runningTransfer);
+		if (runningTransfer.download) {
+			m_downloadPool.cancel(*runningTransfer.download);
+		}
+		else {
+			m_uploadPool.cancel(*runningTransfer.upload);
+		}
+		m_results[runningTransfer.index] = resultOfUnfinishedFiles;
+	}
+
+	for (auto i = m_nextQueuedFile; i < m_items.size(); ++i) {
+		m_results[i] = resultOfUnfinishedFiles;
+	}
+	m_nextQueuedFile = m_items.size();
+	m_startTimer.running = false;
+
+	if (numberOfUnfinishedFiles > 0) {
+		numberOfFailedFiles.set(numberOfFailedFiles.get() + numberOfUnfinishedFiles);
+		numberOfFinishedFiles.set(numberOfFinishedFiles.get() + numberOfUnfinishedFiles);
+	}
+}
+
+void FtpBatchTransfer::finish()
+{
+	spdlog::debug("FtpBatchTransfer::finish() - {} of {} files failed", numberOfFailedFiles.get(), totalNumberOfFiles.get());
+
+	m_state = State::FINISHED;
+	finished.emit(m_results);
+}
+
+void FtpBatchTransfer::disconnect(RunningTransfer &runningTransfer)
+{
+	runningTransfer.bytesTransferredConnection.disconnect();
+	runningTransfer.totalBytesConnection.disconnect();
+}
+
+int FtpBatchTransfer::calculateProgressPercent(curl_off_t numberOfBytesTransferred, curl_off_t totalNumberOfBytesToTransfer)
+{
+	return std::round(totalNumberOfBytesToTransfer ? ((100 * numberOfBytesTransferred)/totalNumberOfBytesToTransfer) : 0);
+}
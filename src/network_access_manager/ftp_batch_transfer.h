@@ -0,0 +1,131 @@
+#pragma once
+
+#include "ftp_transfer_handle.h"
+#include "network_access_manager.h"
+#include "transfer_handle_pool.h"
+#include <KDFoundation/timer.h>
+#include <kdbindings/binding.h>
+#include <string>
+#include <vector>
+
+using namespace KDBindings;
+
+struct FtpBatchTransferOptions
+{
+	// number of control connections transferring files at the same time, each with its own data connection
+	std::size_t maxParallelConnections { 1 };
+	bool cancelOnFirstError { false };
+	bool verbose { false };
+};
+
+/*
+ * Struct: FtpBatchItem
+ *
+ * File transferred by FtpBatchTransfer.
+ */
+struct FtpBatchItem
+{
+	enum class Direction {
+		DOWNLOAD,
+		UPLOAD
+	};
+
+	Direction direction;
+	std::string localPath;
+	Url url;
+	// verified while the file is transferred, see AbstractTransferHandle::setExpectedDigest()
+	std::string expectedDigest {};
+	TransferDigest::Algorithm digestAlgorithm { TransferDigest::Algorithm::SHA256 };
+};
+
+/*
+ * Class: FtpBatchTransfer
+ *
+ * Transfers many files from and to FTP servers over few control connections.
+ * Up to maxParallelConnections files are transferred at the same time, every
+ * connection transfers its files one after another. libcurl keeps the control
+ * connection of a finished transfer alive and the next transfer to the same
+ * server reuses it, i.e. the login and connection setup happen once per
+ * connection instead of once per file. The transfer handles are recycled via
+ * TransferHandlePool as well.
+ *
+ * Progress is aggregated over all files. The size of a download is added to
+ * totalNumberOfBytesToTransfer as soon as the server reported it, the size of
+ * an upload on submit().
+ * Do not delete a batch from within its finished signal, use deleteLater() instead.
+ */
+class FtpBatchTransfer : public Object
+{
+  public:
+	explicit FtpBatchTransfer(const INetworkAccessManager &networkAccessManager, FtpBatchTransferOptions options = {});
+	~FtpBatchTransfer();
+
+	FtpBatchTransfer(const FtpBatchTransfer&) = delete;
+	FtpBatchTransfer &operator=(const FtpBatchTransfer&) = delete;
+
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool submit(std::vector<FtpBatchItem> items);
+	void cancel();
+
+	[[nodiscard]] std::size_t size() const;
+	[[nodiscard]] const FtpBatchItem &item(std::size_t index) const;
+	[[nodiscard]] const std::vector<CURLcode> &results() const;
+
+	Property<std::size_t> numberOfFinishedFiles { 0 };
+	Property<std::size_t> numberOfFailedFiles { 0 };
+	Property<std::size_t> totalNumberOfFiles { 0 };
+
+	Property<curl_off_t> numberOfBytesTransferred { 0 };
+	Property<curl_off_t> totalNumberOfBytesToTransfer { 0 };
+
+	Property<int> progressPercent = makeBoundProperty(calculateProgressPercent, numberOfBytesTransferred, totalNumberOfBytesToTransfer);
+
+	// not emitted for files which got cancelled
+	KDBindings::Signal<std::size_t /*index*/, CURLcode /*result*/> fileFinished;
+
+	// emitted once, after the last file of the batch finished or the batch got cancelled
+	KDBindings::Signal<const std::vector<CURLcode> & /*results*/> finished;
+
+  private:
+	enum class State {
+		IDLE,
+		RUNNING,
+		FINISHED
+	};
+
+	struct RunningTransfer
+	{
+		std::size_t index;
+		FtpDownloadTransferHandle *download;
+		FtpUploadTransferHandle *upload;
+		ConnectionHandle bytesTransferredConnection;
+		ConnectionHandle totalBytesConnection;
+	};
+
+	void startQueuedFiles();
+	bool startFile(std::size_t index);
+	void onFileFinished(std::size_t index, int result);
+	void onFileProgress(std::size_t index, curl_off_t numberOfBytes, curl_off_t totalNumberOfBytes);
+	bool recordResultAndCheckForCancellation(std::size_t index, CURLcode result);
+	void cancelRunningAndQueuedFiles(CURLcode resultOfUnfinishedFiles);
+	void finish();
+
+	static void disconnect(RunningTransfer &runningTransfer);
+	static int calculateProgressPercent(curl_off_t numberOfBytesTransferred, curl_off_t totalNumberOfBytesToTransfer);
+
+	FtpBatchTransferOptions m_options;
+
+	std::vector<FtpBatchItem> m_items;
+	std::vector<CURLcode> m_results;
+	std::vector<curl_off_t> m_numberOfBytesTransferredPerFile;
+	std::vector<curl_off_t> m_numberOfBytesPerFile;
+	std::vector<RunningTransfer> m_runningTransfers;
+	std::size_t m_nextQueuedFile { 0 };
+	State m_state { State::IDLE };
+
+	TransferHandlePool<FtpDownloadTransferHandle> m_downloadPool;
+	TransferHandlePool<FtpUploadTransferHandle> m_uploadPool;
+
+	// the next file is started from the event loop, once the finished transfer returned to its pool
+	Timer m_startTimer;
+};
@@ -0,0 +1,344 @@
+#include "ftp_directory_index.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <system_error>
+
+namespace {
+
+template<typename Integer>
+bool parseInteger(std::string_view text, Integer &value)
+{
+	const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+	return !text.empty() && (ec == std::errc()) && (end == text.data() + text.size());
+}
+
+bool equalsIgnoringCase(std::string_view text, std::string_view lowerCaseText)
+{
+	return std::ranges::equal(text, lowerCaseText, [](char c, char lowerCaseChar) { return std::tolower(static_cast<unsigned char>(c)) == lowerCaseChar; });
+}
+
+std::int64_t secondsSinceEpoch(int year, unsigned month, unsigned day, int hours = 0, int minutes = 0, int seconds = 0)
+{
+	const auto date = std::chrono::year_month_day{ std::chrono::year{year}, std::chrono::month{month}, std::chrono::day{day} };
+	if (!date.ok()) {
+		return FtpDirectoryEntry::c_unknownTime;
+	}
+	const auto timePoint = std::chrono::sys_days{date} + std::chrono::hours{hours} + std::chrono::minutes{minutes} + std::chrono::seconds{seconds};
+	return timePoint.time_since_epoch().count();
+}
+
+// YYYYMMDDHHMMSS[.sss] in UTC, see RFC 3659 section 2.3
+std::int64_t parseMlsdTime(std::string_view text)
+{
+	int year = 0;
+	unsigned month = 0, day = 0;
+	int hours = 0, minutes = 0, seconds = 0;
+	if ((text.size() < 14)
+		|| !parseInteger(text.substr(0, 4), year) || !parseInteger(text.substr(4, 2), month) || !parseInteger(text.substr(6, 2), day)
+		|| !parseInteger(text.substr(8, 2), hours) || !parseInteger(text.substr(10, 2), minutes) || !parseInteger(text.substr(12, 2), seconds)) {
+		return FtpDirectoryEntry::c_unknownTime;
+	}
+	return secondsSinceEpoch(year, month, day, hours, minutes, seconds);
+}
+
+unsigned parseMonth(std::string_view text)
+{
+	static constexpr std::array<std::string_view, 12> c_months = { "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec" };
+	for (std::size_t i = 0; i < c_months.size(); ++i) {
+		if (equalsIgnoringCase(text, c_months[i])) {
+			return static_cast<unsigned>(i + 1);
+		}
+	}
+	return 0;
+}
+
+std::int64_t floorDivide(std::int64_t value, std::int64_t divisor)
+{
+	const auto quotient = value / divisor;
+	return ((value % divisor) < 0) ? quotient - 1 : quotient;
+}
+
+}
+
+std::optional<FtpDirectoryEntry> FtpDirectoryIndex::parseMlsdLine(std::string_view line)
+{
+	// "fact=value;fact=value; name"
+	const auto separator = line.find(' ');
+	if ((separator == std::string_view::npos) || (separator + 1 == line.size())) {
+		return std::nullopt;
+	}
+
+	FtpDirectoryEntry entry;
+	entry.name = line.substr(separator + 1);
+
+	auto facts = line.substr(0, separator);
+	auto hasType = false;
+	while (!facts.empty()) {
+		const auto end = std::min(facts.find(';'), facts.size());
+		const auto fact = facts.substr(0, end);
+		facts.remove_prefix(std::min(end + 1, facts.size()));
+
+		const auto equals = fact.find('=');
+		if (equals == std::string_view::npos) {
+			continue;
+		}
+		const auto name = fact.substr(0, equals);
+		const auto value = fact.substr(equals + 1);
+
+		if (equalsIgnoringCase(name, "type")) {
+			// cdir and pdir are the listed directory and its parent, other types e.g. symbolic links
+			if (equalsIgnoringCase(value, "file")) {
+				entry.type = FtpDirectoryEntry::Type::FILE;
+			}
+			else if (equalsIgnoringCase(value, "dir")) {
+				entry.type = FtpDirectoryEntry::Type::DIRECTORY;
+			}
+			else {
+				return std::nullopt;
+			}
+			hasType = true;
+		}
+		else if (equalsIgnoringCase(name, "size")) {
+			parseInteger(value, entry.size);
+		}
+		else if (equalsIgnoringCase(name, "modify")) {
+			entry.modificationTime = parseMlsdTime(value);
+		}
+	}
+
+	if (!hasType) {
+		return std::nullopt;
+	}
+	return entry;
+}
+
+std::optional<FtpDirectoryEntry> FtpDirectoryIndex::parseListLine(std::string_view line, std::int64_t now)
+{
+	// "-rw-r--r--   1 owner    group        1234 Mar  7 14:02 name" (servers may omit the group)
+	FtpDirectoryEntry entry;
+	if (line.starts_with('-')) {
+		entry.type = FtpDirectoryEntry::Type::FILE;
+	}
+	else if (line.starts_with('d')) {
+		entry.type = FtpDirectoryEntry::Type::DIRECTORY;
+	}
+	else {
+		return std::nullopt;
+	}
+
+	constexpr std::size_t c_maxNumberOfFields = 8;
+	std::array<std::string_view, c_maxNumberOfFields> fields;
+	std::size_t numberOfFields = 0;
+	auto rest = line;
+	unsigned month = 0;
+	while (numberOfFields < c_maxNumberOfFields) {
+		const auto begin = rest.find_first_not_of(' ');
+		if (begin == std::string_view::npos) {
+			return std::nullopt;
+		}
+		rest.remove_prefix(begin);
+		const auto end = std::min(rest.find(' '), rest.size());
+		fields[numberOfFields++] = rest.substr(0, end);
+		rest.remove_prefix(end);
+
+		// the date starts with the month, preceded by the size (at least 5th field)
+		if (numberOfFields >= 5) {
+			month = parseMonth(fields[numberOfFields - 1]);
+			if (month != 0) {
+				break;
+			}
+		}
+	}
+	if (month == 0) {
+		return std::nullopt;
+	}
+
+	// day and time or year follow the month, the name is the rest of the line
+	std::array<std::string_view, 2> dateFields;
+	for (auto &dateField : dateFields) {
+		const auto begin = rest.find_first_not_of(' ');
+		if (begin == std::string_view::npos) {
+			return std::nullopt;
+		}
+		rest.remove_prefix(begin);
+		const auto end = std::min(rest.find(' '), rest.size());
+		dateField = rest.substr(0, end);
+		rest.remove_prefix(end);
+	}
+	const auto nameBegin = rest.find_first_not_of(' ');
+	if (nameBegin == std::string_view::npos) {
+		return std::nullopt;
+	}
+	entry.name = rest.substr(nameBegin);
+	if ((entry.name == ".") || (entry.name == "..")) {
+		return std::nullopt;
+	}
+
+	unsigned day = 0;
+	if (!parseInteger(fields[numberOfFields - 2], entry.size) || !parseInteger(dateFields[0], day)) {
+		return std::nullopt;
+	}
+
+	const auto &timeOrYear = dateFields[1];
+	int year = 0;
+	int hours = 0;
+	int minutes = 0;
+	if ((timeOrYear.size() == 5) && (timeOrYear[2] == ':') && parseInteger(timeOrYear.substr(0, 2), hours) && parseInteger(timeOrYear.substr(3, 2), minutes)) {
+		// files of the last six months are listed with time, but without year
+		const auto today = std::chrono::year_month_day{ std::chrono::floor<std::chrono::days>(std::chrono::sys_seconds{std::chrono::seconds{now}}) };
+		year = static_cast<int>(today.year());
+		entry.modificationTime = secondsSinceEpoch(year, month, day, hours, minutes);
+		if ((entry.modificationTime != FtpDirectoryEntry::c_unknownTime) && (entry.modificationTime > now + 24 * 3600)) {
+			entry.modificationTime = secondsSinceEpoch(year - 1, month, day, hours, minutes);
+		}
+		entry.timePrecision = FtpDirectoryEntry::TimePrecision::MINUTES;
+	}
+	else if (parseInteger(timeOrYear, year)) {
+		entry.modificationTime = secondsSinceEpoch(year, month, day);
+		entry.timePrecision = FtpDirectoryEntry::TimePrecision::DAYS;
+	}
+
+	return entry;
+}
+
+FtpDirectoryIndex FtpDirectoryIndex::fromLocalDirectory(const std::string &rootPath)
+{
+	FtpDirectoryIndex index;
+
+	std::error_code ec;
+	const auto root = std::filesystem::path(rootPath);
+	for (auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied, ec);
+		 !ec && (it != std::filesystem::recursive_directory_iterator()); it.increment(ec)) {
+		const auto &directoryEntry = *it;
+
+		// errors of single entries do not end the iteration
+		std::error_code entryEc;
+		FtpDirectoryEntry entry;
+		if (directoryEntry.is_regular_file(entryEc)) {
+			entry.type = FtpDirectoryEntry::Type::FILE;
+			entry.size = directoryEntry.file_size(entryEc);
+		}
+		else if (directoryEntry.is_directory(entryEc)) {
+			entry.type = FtpDirectoryEntry::Type::DIRECTORY;
+		}
+		else {
+			continue;
+		}
+
+		const auto modificationTime = directoryEntry.last_write_time(entryEc);
+		if (!entryEc) {
+			const auto systemTime = std::chrono::file_clock::to_sys(modificationTime);
+			entry.modificationTime = std::chrono::floor<std::chrono::seconds>(systemTime).time_since_epoch().count();
+		}
+
+		const auto path = directoryEntry.path().lexically_relative(root).generic_string();
+		entry.name = path;
+		index.add({}, entry);
+	}
+
+	if (ec) {
+		spdlog::debug("FtpDirectoryIndex::fromLocalDirectory() - {}: {}", rootPath, ec.message());
+	}
+
+	index.sort();
+	return index;
+}
+
+void FtpDirectoryIndex::add(std::string_view directory, const FtpDirectoryEntry &entry)
+{
+	const auto pathOffset = m_paths.size();
+	if (!directory.empty()) {
+		m_paths.append(directory);
+		m_paths.push_back('/');
+	}
+	m_paths.append(entry.name);
+
+	const auto record = Record { static_cast<std::uint32_t>(pathOffset), static_cast<std::uint32_t>(m_paths.size() - pathOffset), entry.size, entry.modificationTime, entry.type, entry.timePrecision };
+	m_isSorted = m_isSorted && (m_records.empty() || (pathOf(m_records.back()) < pathOf(record)));
+	m_records.push_back(record);
+}
+
+void FtpDirectoryIndex::clear()
+{
+	m_paths.clear();
+	m_records.clear();
+	m_isSorted = true;
+}
+
+void FtpDirectoryIndex::sort()
+{
+	if (m_isSorted) {
+		return;
+	}
+	std::ranges::sort(m_records, {}, [this](const Record &record) { return pathOf(record); });
+	m_isSorted = true;
+}
+
+std::optional<FtpDirectoryEntry> FtpDirectoryIndex::find(std::string_view path) const
+{
+	if (!m_isSorted) {
+		spdlog::error("FtpDirectoryIndex::find() - index is not sorted");
+		return std::nullopt;
+	}
+
+	const auto it = std::ranges::lower_bound(m_records, path, {}, [this](const Record &record) { return pathOf(record); });
+	if ((it == m_records.end()) || (pathOf(*it) != path)) {
+		return std::nullopt;
+	}
+	return entry(static_cast<std::size_t>(it - m_records.begin()));
+}
+
+std::size_t FtpDirectoryIndex::size() const
+{
+	return m_records.size();
+}
+
+FtpDirectoryEntry FtpDirectoryIndex::entry(std::size_t index) const
+{
+	const auto &record = m_records.at(index);
+	return FtpDirectoryEntry { pathOf(record), record.type, record.size, record.modificationTime, record.timePrecision };
+}
+
+std::vector<std::size_t> FtpDirectoryIndex::changedFiles(const FtpDirectoryIndex &otherIndex) const
+{
+	std::vector<std::size_t> indices;
+	for (std::size_t i = 0; i < m_records.size(); ++i) {
+		const auto fileEntry = entry(i);
+		if (fileEntry.type != FtpDirectoryEntry::Type::FILE) {
+			continue;
+		}
+
+		const auto otherEntry = otherIndex.find(fileEntry.name);
+		const auto isChanged = !otherEntry
+			|| (otherEntry->type != FtpDirectoryEntry::Type::FILE)
+			|| (otherEntry->size != fileEntry.size)
+			|| !isSameModificationTime(fileEntry, *otherEntry);
+		if (isChanged) {
+			indices.push_back(i);
+		}
+	}
+	return indices;
+}
+
+bool FtpDirectoryIndex::isSameModificationTime(const FtpDirectoryEntry &entry, const FtpDirectoryEntry &otherEntry)
+{
+	// without modification times the size has to do
+	if ((entry.modificationTime == FtpDirectoryEntry::c_unknownTime) || (otherEntry.modificationTime == FtpDirectoryEntry::c_unknownTime)) {
+		return true;
+	}
+
+	// compare with the lower precision of both, e.g. LIST reports the day only for older files
+	const auto precision = std::max(entry.timePrecision, otherEntry.timePrecision);
+	const std::int64_t granularity = (precision == FtpDirectoryEntry::TimePrecision::DAYS) ? 24 * 3600 : (precision == FtpDirectoryEntry::TimePrecision::MINUTES) ? 60 : 1;
+	return floorDivide(entry.modificationTime, granularity) == floorDivide(otherEntry.modificationTime, granularity);
+}
+
+std::string_view FtpDirectoryIndex::pathOf(const Record &record) const
+{
+	return std::string_view(m_paths).substr(record.pathOffset, record.pathLength);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ * Struct: FtpDirectoryEntry
+ *
+ * File or directory of a directory listing. In an FtpDirectoryIndex, name is the
+ * path relative to the root of the index and refers to the index's storage.
+ */
+struct FtpDirectoryEntry
+{
+	enum class Type : std::uint8_t {
+		FILE,
+		DIRECTORY
+	};
+
+	// LIST reports modification times with a precision of minutes or days only
+	enum class TimePrecision : std::uint8_t {
+		SECONDS,
+		MINUTES,
+		DAYS
+	};
+
+	static constexpr std::int64_t c_unknownTime = INT64_MIN;
+
+	std::string_view name;
+	Type type { Type::FILE };
+	std::uint64_t size { 0 };
+	std::int64_t modificationTime { c_unknownTime }; // seconds since the epoch
+	TimePrecision timePrecision { TimePrecision::SECONDS };
+};
+
+/*
+ * Class: FtpDirectoryIndex
+ *
+ * Compact index of a directory tree, e.g. of an FTP server (see FtpMirror).
+ * All paths are stored in one buffer, every entry adds a fixed size record only,
+ * so indexing trees with hundreds of thousands of files stays cheap.
+ *
+ * Listings are parsed line by line, in the format of MLSD (RFC 3659), which
+ * reports exact sizes and times in UTC, or of LIST, which is not standardized
+ * (Unix ls -l style only).
+ */
+class FtpDirectoryIndex
+{
+  public:
+	// parse one line of a listing, return std::nullopt for lines which do not describe
+	// a file or directory (e.g. ".", "..", symbolic links or "total 42")
+	static std::optional<FtpDirectoryEntry> parseMlsdLine(std::string_view line);
+	static std::optional<FtpDirectoryEntry> parseListLine(std::string_view line, std::int64_t now);
+
+	// index of a local directory tree, modification times as reported by the file system
+	static FtpDirectoryIndex fromLocalDirectory(const std::string &rootPath);
+
+	// entry.name is relative to directory, which is relative to the root of the index
+	void add(std::string_view directory, const FtpDirectoryEntry &entry);
+	void clear();
+
+	// find() requires the index to be sorted
+	void sort();
+	[[nodiscard]] std::optional<FtpDirectoryEntry> find(std::string_view path) const;
+
+	[[nodiscard]] std::size_t size() const;
+	[[nodiscard]] FtpDirectoryEntry entry(std::size_t index) const;
+
+	// indices of files of this index which are missing in otherIndex or differ in size or modification time
+	[[nodiscard]] std::vector<std::size_t> changedFiles(const FtpDirectoryIndex &otherIndex) const;
+
+	static bool isSameModificationTime(const FtpDirectoryEntry &entry, const FtpDirectoryEntry &otherEntry);
+
+  private:
+	struct Record
+	{
+		std::uint32_t pathOffset;
+		std::uint32_t pathLength;
+		std::uint64_t size;
+		std::int64_t modificationTime;
+		FtpDirectoryEntry::Type type;
+		FtpDirectoryEntry::TimePrecision timePrecision;
+	};
+
+	std::string_view pathOf(const Record &record) const;
+
+	std::string m_paths;
+	std::vector<Record> m_records;
+	bool m_isSorted { true };
+};
@@ -0,0 +1,261 @@
+#include "ftp_mirror.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include <system_error>
+
+namespace {
+
+// percent-encodes all characters of a path except unreserved ones (RFC 3986) and '/'
+std::string percentEncodePath(std::string_view path)
+{
+	static constexpr char c_hexDigits[] = "0123456789ABCDEF";
+
+	std::string encodedPath;
+	encodedPath.reserve(path.size());
+	for (const auto c : path) {
+		const auto isUnreserved = std::isalnum(static_cast<unsigned char>(c)) || (c == '-') || (c == '.') || (c == '_') || (c == '~') || (c == '/');
+		if (isUnreserved) {
+			encodedPath.push_back(c);
+		}
+		else {
+			encodedPath.push_back('%');
+			encodedPath.push_back(c_hexDigits[static_cast<unsigned char>(c) >> 4]);
+			encodedPath.push_back(c_hexDigits[static_cast<unsigned char>(c) & 0xF]);
+		}
+	}
+	return encodedPath;
+}
+
+}
+
+FtpMirror::FtpMirror(const INetworkAccessManager &networkAccessManager, const Url &remoteDirectoryUrl, const std::string &localDirectoryPath, FtpMirrorOptions options)
+	: m_remoteDirectoryUrl{remoteDirectoryUrl.url()}
+	, m_localDirectoryPath{localDirectoryPath}
+	, m_options{options}
+	, m_listingPool{networkAccessManager, std::max<std::size_t>(options.maxConcurrentListings, 1)}
+	, m_batch{networkAccessManager, { .maxParallelConnections = options.maxParallelConnections, .verbose = options.verbose }}
+{
+	if (m_options.maxConcurrentListings == 0) {
+		spdlog::warn("FtpMirror::FtpMirror() - maxConcurrentListings must not be zero, using 1 instead");
+		m_options.maxConcurrentListings = 1;
+	}
+	if (!m_remoteDirectoryUrl.ends_with('/')) {
+		m_remoteDirectoryUrl.push_back('/');
+	}
+
+	m_batch.fileFinished.connect([this](std::size_t index, CURLcode result) { onFileTransferred(index, result); });
+	m_batch.finished.connect([this](const std::vector<CURLcode> &results) {
+		const auto it = std::ranges::find_if(results, [](CURLcode result) { return result != CURLE_OK; });
+		finish((it == results.end()) ? CURLE_OK : *it);
+	});
+
+	m_startTimer.interval.set(std::chrono::microseconds(1));
+	m_startTimer.timeout.connect([this]() {
+		m_startTimer.running.set(false);
+		startQueuedListings();
+	});
+}
+
+bool FtpMirror::start()
+{
+	spdlog::debug("FtpMirror::start() - {} -> {}", m_remoteDirectoryUrl, m_localDirectoryPath);
+
+	if ((state.get() == State::LISTING) || (state.get() == State::TRANSFERRING)) {
+		spdlog::error("FtpMirror::start() - Mirror is already running.");
+		return true;
+	}
+
+	m_remoteIndex.clear();
+	m_changedFiles.clear();
+	m_queuedDirectories.assign(1, std::string());
+	numberOfListedDirectories = 0;
+
+	state = State::LISTING;
+	startQueuedListings();
+	return false;
+}
+
+void FtpMirror::cancel()
+{
+	spdlog::debug("FtpMirror::cancel()");
+
+	if (state.get() == State::LISTING) {
+		cancelListings();
+		finish(CURLE_ABORTED_BY_CALLBACK);
+	}
+	else if (state.get() == State::TRANSFERRING) {
+		// finishes via the finished signal of the batch
+		m_batch.cancel();
+	}
+}
+
+const FtpDirectoryIndex &FtpMirror::remoteIndex() const
+{
+	return m_remoteIndex;
+}
+
+const std::vector<std::size_t> &FtpMirror::changedFiles() const
+{
+	return m_changedFiles;
+}
+
+const FtpBatchTransfer &FtpMirror::transfer() const
+{
+	return m_batch;
+}
+
+void FtpMirror::startQueuedListings()
+{
+	if (state.get() != State::LISTING) {
+		return;
+	}
+
+	while ((m_runningListings.size() < m_options.maxConcurrentListings) && !m_queuedDirectories.empty()) {
+		auto directory = std::move(m_queuedDirectories.front());
+		m_queuedDirectories.pop_front();
+
+		auto listing = m_listingPool.start(urlOf(directory, true), m_listingFormat, m_options.verbose);
+		if (!listing) {
+			cancelListings();
+			finish(CURLE_FAILED_INIT);
+			return;
+		}
+		listing->finished.connect([this, listing](int result) { onListingFinished(listing, result); });
+		m_runningListings.push_back({ listing, std::move(directory) });
+	}
+
+	if (m_runningListings.empty()) {
+		startTransfers();
+	}
+}
+
+void FtpMirror::onListingFinished(FtpListingTransferHandle *listing, int result)
+{
+	auto it = std::ranges::find(m_runningListings, listing, &RunningListing::listing);
+	if ((state.get() != State::LISTING) || (it == m_runningListings.end())) {
+		return;
+	}
+	const auto directory = std::move(it->directory);
+	m_runningListings.erase(it);
+
+	// servers not supporting MLSD reject the command -> list this and all following directories via LIST
+	if ((result == CURLE_FTP_COULDNT_RETR_FILE) && (listing->format() == FtpListingTransferHandle::Format::MLSD)) {
+		spdlog::info("FtpMirror::onListingFinished() - MLSD failed, falling back to LIST");
+		m_listingFormat = FtpListingTransferHandle::Format::LIST;
+		m_queuedDirectories.push_front(directory);
+		m_startTimer.running = true;
+		return;
+	}
+
+	if (result != CURLE_OK) {
+		spdlog::error("FtpMirror::onListingFinished() - listing {} failed with code {}", directory, result);
+		cancelListings();
+		finish(static_cast<CURLcode>(result));
+		return;
+	}
+
+	const auto &entries = listing->entries();
+	for (std::size_t i = 0; i < entries.size(); ++i) {
+		const auto entry = entries.entry(i);
+		// names must not leave the mirrored directory
+		const auto isValidName = (entry.name != ".") && (entry.name != "..") && (entry.name.find_first_of("/\\") == std::string_view::npos);
+		if (!isValidName) {
+			spdlog::warn("FtpMirror::onListingFinished() - skipping entry {} of {}", entry.name, directory);
+			continue;
+		}
+		m_remoteIndex.add(directory, entry);
+		if (entry.type == FtpDirectoryEntry::Type::DIRECTORY) {
+			m_queuedDirectories.push_back(directory.empty() ? std::string(entry.name) : directory + '/' + std::string(entry.name));
+		}
+	}
+	numberOfListedDirectories = numberOfListedDirectories.get() + 1;
+
+	m_startTimer.running = true;
+}
+
+void FtpMirror::cancelListings()
+{
+	for (auto &runningListing : m_runningListings) {
+		m_listingPool.cancel(*runningListing.listing);
+	}
+	m_runningListings.clear();
+	m_queuedDirectories.clear();
+	m_startTimer.running = false;
+}
+
+void FtpMirror::startTransfers()
+{
+	m_remoteIndex.sort();
+	const auto localIndex = FtpDirectoryIndex::fromLocalDirectory(m_localDirectoryPath);
+	m_changedFiles = m_remoteIndex.changedFiles(localIndex);
+
+	spdlog::info("FtpMirror::startTransfers() - {} of {} entries changed", m_changedFiles.size(), m_remoteIndex.size());
+
+	std::error_code ec;
+	for (std::size_t i = 0; i < m_remoteIndex.size(); ++i) {
+		const auto entry = m_remoteIndex.entry(i);
+		if (entry.type == FtpDirectoryEntry::Type::DIRECTORY) {
+			std::filesystem::create_directories(localPathOf(entry.name), ec);
+		}
+	}
+	std::filesystem::create_directories(m_localDirectoryPath, ec);
+
+	if (m_changedFiles.empty()) {
+		finish(CURLE_OK);
+		return;
+	}
+
+	std::vector<FtpBatchItem> items;
+	items.reserve(m_changedFiles.size());
+	for (const auto index : m_changedFiles) {
+		const auto path = m_remoteIndex.entry(index).name;
+		items.push_back({ FtpBatchItem::Direction::DOWNLOAD, localPathOf(path), urlOf(path, false) });
+	}
+
+	state = State::TRANSFERRING;
+	m_batch.submit(std::move(items));
+}
+
+void FtpMirror::onFileTransferred(std::size_t index, CURLcode result)
+{
+	if (result != CURLE_OK) {
+		return;
+	}
+
+	// the remote modification time lets the next run recognize the file as unchanged
+	const auto entry = m_remoteIndex.entry(m_changedFiles.at(index));
+	if (entry.modificationTime == FtpDirectoryEntry::c_unknownTime) {
+		return;
+	}
+	const auto modificationTime = std::chrono::sys_seconds{std::chrono::seconds{entry.modificationTime}};
+	std::error_code ec;
+	std::filesystem::last_write_time(localPathOf(entry.name), std::chrono::file_clock::from_sys(modificationTime), ec);
+	if (ec) {
+		spdlog::warn("FtpMirror::onFileTransferred() - cannot set modification time of {}: {}", entry.name, ec.message());
+	}
+}
+
+void FtpMirror::finish(CURLcode result)
+{
+	spdlog::debug("FtpMirror::finish() - result {}", static_cast<int>(result));
+
+	state = State::FINISHED;
+	finished.emit(result);
+}
+
+Url FtpMirror::urlOf(std::string_view path, bool isDirectory) const
+{
+	auto url = m_remoteDirectoryUrl + percentEncodePath(path);
+	if (isDirectory && !path.empty()) {
+		url.push_back('/');
+	}
+	return Url(url);
+}
+
+std::string FtpMirror::localPathOf(std::string_view path) const
+{
+	return (std::filesystem::path(m_localDirectoryPath) / std::filesystem::path(path)).string();
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "ftp_batch_transfer.h"
+#include "ftp_directory_index.h"
+#include "ftp_transfer_handle.h"
+#include "network_access_manager.h"
+#include "transfer_handle_pool.h"
+#include <KDFoundation/timer.h>
+#include <deque>
+#include <kdbindings/property.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace KDBindings;
+
+struct FtpMirrorOptions
+{
+	std::size_t maxConcurrentListings { 4 };
+	// downloads, see FtpBatchTransferOptions
+	std::size_t maxParallelConnections { 2 };
+	bool verbose { false };
+};
+
+/*
+ * Class: FtpMirror
+ *
+ * Mirrors a remote FTP directory tree into a local directory, transferring
+ * changed files only.
+ *
+ * The remote tree is listed directory by directory (at most maxConcurrentListings
+ * at a time) into an FtpDirectoryIndex, using MLSD and falling back to LIST for
+ * servers not supporting MLSD. The index is compared with the local tree, every
+ * remote file which is missing locally or differs in size or modification time
+ * is downloaded by an FtpBatchTransfer. Downloaded files get the modification
+ * time of the remote file, so unchanged files match on the next run.
+ * Local files missing on the server are kept.
+ *
+ * Do not delete a mirror from within its finished signal, use deleteLater() instead.
+ */
+class FtpMirror : public Object
+{
+  public:
+	enum class State {
+		IDLE,
+		LISTING,
+		TRANSFERRING,
+		FINISHED
+	};
+
+	FtpMirror(const INetworkAccessManager &networkAccessManager, const Url &remoteDirectoryUrl, const std::string &localDirectoryPath, FtpMirrorOptions options = {});
+
+	FtpMirror(const FtpMirror&) = delete;
+	FtpMirror &operator=(const FtpMirror&) = delete;
+
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool start();
+	void cancel();
+
+	[[nodiscard]] const FtpDirectoryIndex &remoteIndex() const;
+	// indices of the files in remoteIndex() which are transferred
+	[[nodiscard]] const std::vector<std::size_t> &changedFiles() const;
+	// progress of the downloads
+	[[nodiscard]] const FtpBatchTransfer &transfer() const;
+
+	Property<State> state { State::IDLE };
+	Property<std::size_t> numberOfListedDirectories { 0 };
+
+	// emitted once, with CURLE_OK if all listings and downloads succeeded and the first error otherwise
+	KDBindings::Signal<CURLcode> finished;
+
+  private:
+	struct RunningListing
+	{
+		FtpListingTransferHandle *listing;
+		std::string directory;
+	};
+
+	void startQueuedListings();
+	void onListingFinished(FtpListingTransferHandle *listing, int result);
+	void cancelListings();
+	void startTransfers();
+	void onFileTransferred(std::size_t index, CURLcode result);
+	void finish(CURLcode result);
+
+	Url urlOf(std::string_view path, bool isDirectory) const;
+	std::string localPathOf(std::string_view path) const;
+
+	std::string m_remoteDirectoryUrl; // ends with '/'
+	std::string m_localDirectoryPath;
+	FtpMirrorOptions m_options;
+
+	FtpListingTransferHandle::Format m_listingFormat { FtpListingTransferHandle::Format::MLSD };
+	std::deque<std::string> m_queuedDirectories;
+	std::vector<RunningListing> m_runningListings;
+	FtpDirectoryIndex m_remoteIndex;
+	std::vector<std::size_t> m_changedFiles;
+
+	TransferHandlePool<FtpListingTransferHandle> m_listingPool;
+	FtpBatchTransfer m_batch;
+
+	// listings are started from the event loop, once the finished listing returned to its pool
+	Timer m_startTimer;
+};
@@ -1,10 +1,30 @@
 #include "ftp_transfer_handle.h"
+#include <chrono>
 #include <cmath>
 #include <spdlog/spdlog.h>
 
 AbstractFtpTransferHandle::AbstractFtpTransferHandle(const Url &url, bool verbose)
 	: AbstractTransferHandle(url, verbose)
 	, m_file{nullptr}
+{
+	setFtpOptions();
+}
+
+void AbstractFtpTransferHandle::reuse(const Url &url, bool verbose)
+{
+	AbstractTransferHandle::reuse(url, verbose);
+	setFtpOptions();
+
+	// the file of a cancelled transfer is still open
+	if (m_file) {
+		fclose(m_file);
+		m_file = nullptr;
+	}
+	numberOfBytesTransferred = 0;
+	totalNumberOfBytesToTransfer = 0;
+}
+
+void AbstractFtpTransferHandle::setFtpOptions()
 {
 	// switch on progress meter for FTP requests
 	curl_easy_setopt(m_handle, CURLOPT_NOPROGRESS, 0L);
@@ -24,6 +44,17 @@ int AbstractFtpTransferHandle::calculateProgressPercent(curl_off_t numberOfBytes
 
 FtpDownloadTransferHandle::FtpDownloadTransferHandle(File &file, const Url &url, bool verbose)
 	: AbstractFtpTransferHandle(url, verbose)
+{
+	openFile(file);
+}
+
+void FtpDownloadTransferHandle::reuse(File &file, const Url &url, bool verbose)
+{
+	AbstractFtpTransferHandle::reuse(url, verbose);
+	openFile(file);
+}
+
+void FtpDownloadTransferHandle::openFile(File &file)
 {
 	m_file = fopen(file.path().c_str(), "wb");
 	if (!m_file) {
@@ -36,6 +67,15 @@ FtpDownloadTransferHandle::FtpDownloadTransferHandle(File &file, const Url &url,
 	curl_easy_setopt(m_handle, CURLOPT_WRITEDATA, m_file);
 }
 
+size_t FtpDownloadTransferHandle::writeCallbackImpl(const char *data, size_t size, size_t nmemb)
+{
+	// returning less than the size of the data fails the transfer with CURLE_WRITE_ERROR
+	if (!m_file) {
+		return 0;
+	}
+	return fwrite(data, size, nmemb, m_file) * size;
+}
+
 int FtpDownloadTransferHandle::progressCallbackImpl(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 {
 	numberOfBytesTransferred.set(dlnow);
@@ -55,6 +95,17 @@ void FtpDownloadTransferHandle::transferDoneCallbackImpl(CURLcode result)
 
 FtpUploadTransferHandle::FtpUploadTransferHandle(File &file, const Url &url, bool verbose)
 	: AbstractFtpTransferHandle(url, verbose)
+{
+	openFile(file);
+}
+
+void FtpUploadTransferHandle::reuse(File &file, const Url &url, bool verbose)
+{
+	AbstractFtpTransferHandle::reuse(url, verbose);
+	openFile(file);
+}
+
+void FtpUploadTransferHandle::openFile(File &file)
 {
 	m_file = fopen(file.path().c_str(), "rb");
 	if (!m_file) {
@@ -81,6 +132,19 @@ FtpUploadTransferHandle::FtpUploadTransferHandle(File &file, const Url &url, boo
 	curl_easy_setopt(m_handle, CURLOPT_INFILESIZE_LARGE, fileSize);
 }
 
+size_t FtpUploadTransferHandle::readCallbackImpl(const char *data, size_t size, size_t nmemb)
+{
+	if (!m_file) {
+		return CURL_READFUNC_ABORT;
+	}
+	// libcurl passes its upload buffer
+	const auto numberOfItems = fread(const_cast<char*>(data), size, nmemb, m_file);
+	if (ferror(m_file)) {
+		return CURL_READFUNC_ABORT;
+	}
+	return numberOfItems * size;
+}
+
 int FtpUploadTransferHandle::progressCallbackImpl(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
 {
 	numberOfBytesTransferred.set(ulnow);
@@ -97,3 +161,85 @@ void FtpUploadTransferHandle::transferDoneCallbackImpl(CURLcode result)
 		m_file = nullptr;
 	}
 }
+
+FtpListingTransferHandle::FtpListingTransferHandle(const Url &directoryUrl, Format format, bool verbose)
+	: AbstractTransferHandle(directoryUrl, verbose)
+	, m_format{format}
+{
+	setListingOptions();
+}
+
+void FtpListingTransferHandle::reuse(const Url &directoryUrl, Format format, bool verbose)
+{
+	AbstractTransferHandle::reuse(directoryUrl, verbose);
+	m_format = format;
+	setListingOptions();
+}
+
+FtpListingTransferHandle::Format FtpListingTransferHandle::format() const
+{
+	return m_format;
+}
+
+const FtpDirectoryIndex &FtpListingTransferHandle::entries() const
+{
+	return m_entries;
+}
+
+void FtpListingTransferHandle::setListingOptions()
+{
+	m_entries.clear();
+	m_lineBuffer.clear();
+	m_listingTime = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now()).time_since_epoch().count();
+
+	// libcurl sends LIST unless another listing command is requested
+	curl_easy_setopt(m_handle, CURLOPT_CUSTOMREQUEST, (m_format == Format::MLSD) ? "MLSD" : NULL);
+}
+
+size_t FtpListingTransferHandle::writeCallbackImpl(const char *data, size_t size, size_t nmemb)
+{
+	const size_t realSize = size * nmemb;
+	auto chunk = std::string_view(data, realSize);
+
+	// lines received in one piece are parsed without copying them
+	while (!chunk.empty()) {
+		const auto end = chunk.find('\n');
+		if (end == std::string_view::npos) {
+			m_lineBuffer.append(chunk);
+			break;
+		}
+
+		if (m_lineBuffer.empty()) {
+			parseLine(chunk.substr(0, end));
+		}
+		else {
+			m_lineBuffer.append(chunk.substr(0, end));
+			parseLine(m_lineBuffer);
+			m_lineBuffer.clear();
+		}
+		chunk.remove_prefix(end + 1);
+	}
+
+	return realSize;
+}
+
+void FtpListingTransferHandle::transferDoneCallbackImpl(CURLcode result)
+{
+	// the last line may lack its line break
+	if (!m_lineBuffer.empty()) {
+		parseLine(m_lineBuffer);
+		m_lineBuffer.clear();
+	}
+}
+
+void FtpListingTransferHandle::parseLine(std::string_view line)
+{
+	if (line.ends_with('\r')) {
+		line.remove_suffix(1);
+	}
+
+	const auto entry = (m_format == Format::MLSD) ? FtpDirectoryIndex::parseMlsdLine(line) : FtpDirectoryIndex::parseListLine(line, m_listingTime);
+	if (entry) {
+		m_entries.add({}, *entry);
+	}
+}
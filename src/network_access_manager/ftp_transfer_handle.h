@@ -1,8 +1,10 @@
 #pragma once
 
 #include "abstract_transfer_handle.h"
+#include "ftp_directory_index.h"
 #include <kdbindings/binding.h>
 #include <KDUtils/file.h>
+#include <string>
 
 using namespace KDUtils;
 using namespace KDBindings;
@@ -20,10 +22,14 @@ class AbstractFtpTransferHandle : public AbstractTransferHandle
 	Property<int> progressPercent = makeBoundProperty(calculateProgressPercent, numberOfBytesTransferred, totalNumberOfBytesToTransfer);
 
   protected:
+	void reuse(const Url &url, bool verbose = false);
+
 	virtual int progressCallbackImpl(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) = 0;
 	FILE *m_file;
 
   private:
+	void setFtpOptions();
+
 	static int progressCallback(AbstractFtpTransferHandle *self, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
 	static int calculateProgressPercent(curl_off_t numberOfBytesTransferred, curl_off_t totalNumberOfBytesToTransfer);
 };
@@ -34,9 +40,17 @@ class FtpDownloadTransferHandle : public AbstractFtpTransferHandle
   public:
 	FtpDownloadTransferHandle(File &file, const Url &url, bool verbose = false);
 
+	// prepares this handle for another transfer, as if newly constructed, see TransferHandlePool
+	void reuse(File &file, const Url &url, bool verbose = false);
+
   protected:
+	// used instead of fwrite() by libcurl only if a digest is computed, see setExpectedDigest()
+	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb) override;
 	virtual int progressCallbackImpl(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) override;
 	virtual void transferDoneCallbackImpl(CURLcode result) override;
+
+  private:
+	void openFile(File &file);
 };
 
 
@@ -45,7 +59,55 @@ class FtpUploadTransferHandle : public AbstractFtpTransferHandle
   public:
 	FtpUploadTransferHandle(File &file, const Url &url, bool verbose = false);
 
+	// prepares this handle for another transfer, as if newly constructed, see TransferHandlePool
+	void reuse(File &file, const Url &url, bool verbose = false);
+
   protected:
+	// used instead of fread() by libcurl only if a digest is computed, see setExpectedDigest()
+	virtual size_t readCallbackImpl(const char *data, size_t size, size_t nmemb) override;
 	virtual int progressCallbackImpl(curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) override;
 	virtual void transferDoneCallbackImpl(CURLcode result) override;
+
+  private:
+	void openFile(File &file);
+};
+
+
+/*
+ * Class: FtpListingTransferHandle
+ *
+ * Lists a directory (url ending with '/'), via MLSD or LIST.
+ * The listing is parsed line by line while it is received, the entries are
+ * available once the handle emitted finished.
+ */
+class FtpListingTransferHandle : public AbstractTransferHandle
+{
+  public:
+	enum class Format {
+		MLSD,
+		LIST
+	};
+
+	explicit FtpListingTransferHandle(const Url &directoryUrl, Format format = Format::MLSD, bool verbose = false);
+
+	// prepares this handle for another transfer, as if newly constructed, see TransferHandlePool
+	void reuse(const Url &directoryUrl, Format format = Format::MLSD, bool verbose = false);
+
+	[[nodiscard]] Format format() const;
+
+	// names are relative to the listed directory
+	[[nodiscard]] const FtpDirectoryIndex &entries() const;
+
+  protected:
+	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb) override;
+	virtual void transferDoneCallbackImpl(CURLcode result) override;
+
+  private:
+	void setListingOptions();
+	void parseLine(std::string_view line);
+
+	Format m_format;
+	FtpDirectoryIndex m_entries;
+	std::string m_lineBuffer;
+	std::int64_t m_listingTime { 0 }; // LIST omits the year of recent files
 };
@@ -0,0 +1,67 @@
+#include "http_transfer_awaitable.h"
+#include "network_access_manager.h"
+#include <spdlog/spdlog.h>
+
+HttpTransferAwaitable::HttpTransferAwaitable(NetworkAccessManager &networkAccessManager, const Url &url, bool verbose)
+	: m_networkAccessManager{networkAccessManager}
+	, m_transfer{url, verbose}
+{
+	m_transfer.finished.connect(&HttpTransferAwaitable::onTransferFinished, this);
+}
+
+HttpTransferAwaitable::~HttpTransferAwaitable()
+{
+	switch (m_state) {
+	case State::RUNNING:
+		spdlog::debug("HttpTransferAwaitable::~HttpTransferAwaitable() - awaiting coroutine destroyed, cancelling transfer");
+		m_networkAccessManager.unregisterTransfer(m_transfer);
+		break;
+	case State::RESUMPTION_SCHEDULED:
+		m_networkAccessManager.cancelResumption(m_awaitingCoroutine);
+		break;
+	default:
+		break;
+	}
+}
+
+bool HttpTransferAwaitable::await_suspend(std::coroutine_handle<> awaitingCoroutine)
+{
+	m_awaitingCoroutine = awaitingCoroutine;
+
+	const auto hasError = m_networkAccessManager.registerTransfer(m_transfer);
+	if (hasError) {
+		// do not suspend, await_resume() reports the failed transfer
+		m_result = CURLE_FAILED_INIT;
+		m_state = State::DONE;
+		return false;
+	}
+
+	m_state = State::RUNNING;
+	return true;
+}
+
+HttpResponse HttpTransferAwaitable::await_resume()
+{
+	m_state = State::DONE;
+
+	HttpResponse response;
+	response.result = m_result;
+	if (m_result == CURLE_OK) {
+		curl_easy_getinfo(m_transfer.handle(), CURLINFO_RESPONSE_CODE, &response.statusCode);
+		response.data = m_transfer.dataRead();
+	}
+	else {
+		response.error = m_transfer.error();
+	}
+	return response;
+}
+
+void HttpTransferAwaitable::onTransferFinished(int result)
+{
+	m_result = static_cast<CURLcode>(result);
+
+	// do not resume from within the finished signal emission,
+	// resuming may destroy this awaitable and with it the emitting transfer handle
+	m_state = State::RESUMPTION_SCHEDULED;
+	m_networkAccessManager.scheduleResumption(m_awaitingCoroutine);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "http_transfer_handle.h"
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+class NetworkAccessManager;
+
+/*
+ * Struct: HttpResponse
+ *
+ * Result of an awaited HTTP transfer.
+ */
+struct HttpResponse
+{
+	CURLcode result { CURLE_OK };
+	long statusCode { 0 };
+	std::string data;
+	std::string error;
+
+	[[nodiscard]] bool isOk() const { return result == CURLE_OK; }
+};
+
+/*
+ * Class: HttpTransferAwaitable
+ *
+ * Awaitable returned by NetworkAccessManager::get().
+ * The transfer handle lives inside the awaitable, i.e. inside the awaiting
+ * coroutine's frame, so no heap allocated handle needs to be cleaned up.
+ * The transfer is registered when the coroutine suspends and the coroutine is
+ * resumed from the event loop once the transfer finished.
+ * Destroying a suspended coroutine destroys the awaitable, which cancels the transfer.
+ */
+class HttpTransferAwaitable
+{
+	friend class NetworkAccessManager;
+
+  private:
+	HttpTransferAwaitable(NetworkAccessManager &networkAccessManager, const Url &url, bool verbose);
+
+  public:
+	~HttpTransferAwaitable();
+
+	HttpTransferAwaitable(const HttpTransferAwaitable&) = delete;
+	HttpTransferAwaitable &operator=(const HttpTransferAwaitable&) = delete;
+
+	bool await_ready() const noexcept { return false; }
+	bool await_suspend(std::coroutine_handle<> awaitingCoroutine);
+	HttpResponse await_resume();
+
+  private:
+	enum class State {
+		IDLE,
+		RUNNING,
+		RESUMPTION_SCHEDULED,
+		DONE
+	};
+
+	void onTransferFinished(int result);
+
+	NetworkAccessManager &m_networkAccessManager;
+	HttpTransferHandle m_transfer;
+	std::coroutine_handle<> m_awaitingCoroutine;
+	State m_state { State::IDLE };
+	CURLcode m_result { CURLE_OK };
+};
+
+/*
+ * Class: TransferTask
+ *
+ * Minimal coroutine return type for coroutines awaiting transfers.
+ * The coroutine starts eagerly and its frame is owned by the TransferTask object.
+ * Destroying (or reassigning) the TransferTask destroys the coroutine frame,
+ * which cancels a transfer the coroutine is currently waiting for.
+ */
+class TransferTask
+{
+  public:
+	struct promise_type
+	{
+		TransferTask get_return_object() { return TransferTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() { }
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	TransferTask() = default;
+	~TransferTask() { reset(); }
+
+	TransferTask(const TransferTask&) = delete;
+	TransferTask &operator=(const TransferTask&) = delete;
+
+	TransferTask(TransferTask &&other) noexcept : m_coroutine{std::exchange(other.m_coroutine, {})} { }
+	TransferTask &operator=(TransferTask &&other) noexcept {
+		if (this != &other) {
+			reset();
+			m_coroutine = std::exchange(other.m_coroutine, {});
+		}
+		return *this;
+	}
+
+	[[nodiscard]] bool isDone() const { return m_coroutine && m_coroutine.done(); }
+
+	void reset() {
+		if (m_coroutine) {
+			m_coroutine.destroy();
+			m_coroutine = {};
+		}
+	}
+
+  private:
+	explicit TransferTask(std::coroutine_handle<promise_type> coroutine) : m_coroutine{coroutine} { }
+
+	std::coroutine_handle<promise_type> m_coroutine;
+};
@@ -1,7 +1,28 @@
 #include "http_transfer_handle.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
 
 HttpTransferHandle::HttpTransferHandle(const Url &url, bool verbose)
 	: AbstractTransferHandle(url, verbose)
+{
+	setHttpOptions();
+}
+
+void HttpTransferHandle::reuse(const Url &url, bool verbose)
+{
+	AbstractTransferHandle::reuse(url, verbose);
+	setHttpOptions();
+
+	// keeps the capacity of the buffer for the next transfer
+	m_writeBuffer.clear();
+	m_readOffset = 0;
+	numberOfBytesBuffered = 0;
+	m_lowWatermark = 0;
+	m_highWatermark = 0;
+	m_isPaused = false;
+}
+
+void HttpTransferHandle::setHttpOptions()
 {
 	// switch off progress meter for HTTP requests
 	curl_easy_setopt(m_handle, CURLOPT_NOPROGRESS, 1L);
@@ -9,13 +30,88 @@ HttpTransferHandle::HttpTransferHandle(const Url &url, bool verbose)
 
 std::string HttpTransferHandle::dataRead() const
 {
-	return m_writeBuffer.str();
+	return m_writeBuffer.substr(m_readOffset);
+}
+
+std::string HttpTransferHandle::takeDataRead(std::size_t maxSize)
+{
+	std::string data;
+	if ((m_readOffset == 0) && (maxSize >= m_writeBuffer.size())) {
+		data.swap(m_writeBuffer);
+	}
+	else {
+		// erasing the data taken from the front of the buffer would move the rest on every call
+		const auto size = std::min(maxSize, numberOfUnreadBytes());
+		data.assign(m_writeBuffer, m_readOffset, size);
+		m_readOffset += size;
+		if (m_readOffset == m_writeBuffer.size()) {
+			m_writeBuffer.clear();
+			m_readOffset = 0;
+		}
+	}
+	numberOfBytesBuffered = numberOfUnreadBytes();
+
+	resumeIfDrained();
+	return data;
+}
+
+void HttpTransferHandle::setWatermarks(std::size_t lowWatermark, std::size_t highWatermark)
+{
+	if (lowWatermark > highWatermark) {
+		spdlog::warn("HttpTransferHandle::setWatermarks() - lowWatermark {} exceeds highWatermark {}, using highWatermark", lowWatermark, highWatermark);
+		lowWatermark = highWatermark;
+	}
+	m_lowWatermark = lowWatermark;
+	m_highWatermark = highWatermark;
+
+	resumeIfDrained();
+}
+
+bool HttpTransferHandle::isPaused() const
+{
+	return m_isPaused;
 }
 
 size_t HttpTransferHandle::writeCallbackImpl(const char *data, size_t size, size_t nmemb)
 {
 	const size_t realsize = size * nmemb;
-	const auto chunk = std::string(data, nmemb);
-	m_writeBuffer << chunk;
+
+	// do not take the chunk, libcurl delivers it again once the transfer is resumed
+	if (m_highWatermark && (numberOfUnreadBytes() >= m_highWatermark)) {
+		m_isPaused = true;
+		return CURL_WRITEFUNC_PAUSE;
+	}
+
+	if (m_readOffset >= numberOfUnreadBytes()) {
+		m_writeBuffer.erase(0, m_readOffset);
+		m_readOffset = 0;
+	}
+	m_writeBuffer.append(data, realsize);
+	numberOfBytesBuffered = numberOfUnreadBytes();
 	return realsize;
 }
+
+void HttpTransferHandle::transferDoneCallbackImpl(CURLcode result)
+{
+	m_isPaused = false;
+}
+
+std::size_t HttpTransferHandle::numberOfUnreadBytes() const
+{
+	return m_writeBuffer.size() - m_readOffset;
+}
+
+void HttpTransferHandle::resumeIfDrained()
+{
+	const auto isDrained = !m_highWatermark || (numberOfUnreadBytes() <= m_lowWatermark);
+	if (!m_isPaused || !isDrained) {
+		return;
+	}
+
+	// libcurl may deliver pending data (and pause again) from within curl_easy_pause()
+	m_isPaused = false;
+	const auto rc = curl_easy_pause(m_handle, CURLPAUSE_CONT);
+	if (rc != CURLE_OK) {
+		spdlog::error("HttpTransferHandle::resumeIfDrained() - curl_easy_pause() returned error {}", curl_easy_strerror(rc));
+	}
+}
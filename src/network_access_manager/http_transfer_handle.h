@@ -1,21 +1,50 @@
 #pragma once
 
 #include "abstract_transfer_handle.h"
-#include <sstream>
+#include <kdbindings/property.h>
+#include <limits>
+#include <string>
+
+using namespace KDBindings;
 
 class HttpTransferHandle : public AbstractTransferHandle
 {
   public:
 	explicit HttpTransferHandle(const Url &url, bool verbose = false);
 
+	// prepares this handle for another transfer, as if newly constructed, see TransferHandlePool
+	void reuse(const Url &url, bool verbose = false);
+
 	std::string dataRead() const;
 
+	// returns up to maxSize bytes of the data read so far and removes them from the buffer,
+	// a transfer paused by flow control is resumed once the buffer is drained to the low watermark
+	std::string takeDataRead(std::size_t maxSize = std::numeric_limits<std::size_t>::max());
+
+	// Flow control for consumers slower than the network:
+	// The transfer is paused as soon as highWatermark bytes are buffered (at most one chunk
+	// delivered by libcurl more) and resumed once takeDataRead() drained the buffer to lowWatermark bytes.
+	// highWatermark == 0 disables flow control, i.e. the buffer is unbounded (default).
+	void setWatermarks(std::size_t lowWatermark, std::size_t highWatermark);
+	bool isPaused() const;
+
+	Property<std::size_t> numberOfBytesBuffered { 0 };
+
   protected:
 	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb) override;
-	virtual void transferDoneCallbackImpl(CURLcode result) override { /* nothing to do */ }
+	virtual void transferDoneCallbackImpl(CURLcode result) override;
 
-	std::ostringstream m_writeBuffer; // TODO -> this is most probalby not how we want to maintain data read during transfer(?)
+	// data before m_readOffset was taken by takeDataRead() already, it is dropped once it
+	// outweighs the data left (copying every byte at most once more), or the buffer is drained
+	std::string m_writeBuffer;
+	std::size_t m_readOffset { 0 };
 
   private:
+	void setHttpOptions();
+	void resumeIfDrained();
+	[[nodiscard]] std::size_t numberOfUnreadBytes() const;
 
+	std::size_t m_lowWatermark { 0 };
+	std::size_t m_highWatermark { 0 };
+	bool m_isPaused { false };
 };
@@ -1,6 +1,9 @@
 #include "network_access_manager.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <functional>
+#include <utility>
 #include <spdlog/spdlog.h>
 
 const std::map<int,const std::string> NetworkAccessManager::s_curlPollEventToString = {
@@ -26,18 +29,100 @@ NetworkAccessManager &NetworkAccessManager::instance()
 bool NetworkAccessManager::registerTransfer(AbstractTransferHandle &transferHandle) const
 {
 	spdlog::debug("NetworkAccessManager::registerTransfer()");
+	if (m_persistentState) {
+		m_persistentState->apply(transferHandle.handle());
+	}
 	auto rc = curl_multi_add_handle(m_handle, transferHandle.handle());
-	return checkCurlMultiResultAndDoDebugPrints(rc);
+	const auto hasError = checkCurlMultiResultAndDoDebugPrints(rc);
+	if (!hasError) {
+		m_metrics.startedTransfers.increment();
+	}
+	return hasError;
 }
 
 bool NetworkAccessManager::unregisterTransfer(AbstractTransferHandle &transferHandle) const
 {
 	spdlog::debug("NetworkAccessManager::unregisterTransfer()");
+	releaseDeadlineAndCancellation(transferHandle);
 	auto rc = curl_multi_remove_handle(m_handle, transferHandle.handle());
 	return checkCurlMultiResultAndDoDebugPrints(rc);
 }
 
+bool NetworkAccessManager::registerTransfer(AbstractTransferHandle &transferHandle, const TransferOptions &options)
+{
+	if (options.cancellationToken && options.cancellationToken->isCancelled()) {
+		spdlog::warn("NetworkAccessManager::registerTransfer() - transfer cancelled before its registration");
+		return true;
+	}
+
+	const auto hasError = registerTransfer(transferHandle);
+	if (hasError) {
+		return true;
+	}
+
+	if (options.deadline > std::chrono::milliseconds(0)) {
+		transferHandle.m_deadlineTimerId = m_deadlineWheel.schedule(TimerWheel::Clock::now() + options.deadline, [this, &transferHandle]() {
+			abortTransfer(transferHandle, CURLE_OPERATION_TIMEDOUT);
+		});
+		updateDeadlineTimer();
+	}
+
+	if (options.cancellationToken) {
+		transferHandle.m_cancellationConnection = options.cancellationToken->cancelled().connect([this, &transferHandle]() {
+			// a token is cancelled once only -> the connection is dropped instead of disconnecting it from within its own slot
+			transferHandle.m_cancellationConnection = {};
+			abortTransfer(transferHandle, CURLE_ABORTED_BY_CALLBACK);
+		});
+	}
+
+	return false;
+}
+
+HttpTransferAwaitable NetworkAccessManager::get(const Url &url, bool verbose)
+{
+	spdlog::debug("NetworkAccessManager::get() - url:{}", url.url());
+	return HttpTransferAwaitable(*this, url, verbose);
+}
+
+bool NetworkAccessManager::enablePersistentState(const std::string &directoryPath)
+{
+	spdlog::debug("NetworkAccessManager::enablePersistentState() - {}", directoryPath);
+
+	if (m_persistentState) {
+		if (m_persistentState->directoryPath() == directoryPath) {
+			return false;
+		}
+		spdlog::error("NetworkAccessManager::enablePersistentState() - already enabled for {}", m_persistentState->directoryPath());
+		return true;
+	}
+
+	auto persistentState = std::make_unique<PersistentConnectionState>(directoryPath);
+	const auto hasError = persistentState->load();
+	if (hasError) {
+		return true;
+	}
+	m_persistentState = std::move(persistentState);
+	return false;
+}
+
+bool NetworkAccessManager::savePersistentState()
+{
+	if (!m_persistentState) {
+		spdlog::error("NetworkAccessManager::savePersistentState() - persistent state is not enabled");
+		return true;
+	}
+	return m_persistentState->save();
+}
+
 NetworkAccessManager::NetworkAccessManager()
+	: m_metrics{
+		MetricsRegistry::instance().counter("nam_transfers_started", "Transfers registered with the NetworkAccessManager"),
+		MetricsRegistry::instance().counter("nam_transfers_finished", "Finished transfers by result", { { "result", "ok" } }),
+		MetricsRegistry::instance().counter("nam_transfers_finished", "Finished transfers by result", { { "result", "error" } }),
+		MetricsRegistry::instance().gauge("nam_transfers_running", "Transfers libcurl is working on"),
+		MetricsRegistry::instance().histogram("nam_transfer_duration_seconds", "Total time of finished transfers (CURLINFO_TOTAL_TIME_T)",
+											  Histogram::exponentialBounds(0.001, 2.0, 15)),
+	}
 {
 	curl_global_init(CURL_GLOBAL_ALL);
 
@@ -62,10 +147,23 @@ NetworkAccessManager::NetworkAccessManager()
 		m_timeoutTimer.running.set(false);
 		onTimeoutTimerTriggered();
 	});
+
+	m_deadlineTimer.timeout.connect([this]() {
+		m_deadlineTimer.running.set(false);
+		onDeadlineTimerTriggered();
+	});
+
+	m_resumptionTimer.interval.set(std::chrono::microseconds(1));
+	m_resumptionTimer.timeout.connect([this]() {
+		m_resumptionTimer.running.set(false);
+		onResumptionTimerTriggered();
+	});
 }
 
 NetworkAccessManager::~NetworkAccessManager()
 {
+	// saves the persistent state
+	m_persistentState.reset();
 	curl_multi_cleanup(NetworkAccessManager::m_handle);
 }
 
@@ -75,6 +173,16 @@ int NetworkAccessManager::socketCallback(CURL *handle, curl_socket_t socket, int
 
 	self->m_fdnRegistry.manageFileDescriptorNotifiers(socket, eventType);
 
+	// e.g. WebSocketTransferHandle waits for its socket to become writable itself
+	if (auto transferHandle = AbstractTransferHandle::fromCurlEasyHandle(handle)) {
+		if (eventType != CURL_POLL_REMOVE) {
+			transferHandle->m_activeSocket = socket;
+		}
+		else if (transferHandle->m_activeSocket == socket) {
+			transferHandle->m_activeSocket = CURL_SOCKET_BAD;
+		}
+	}
+
 	return 0;
 }
 
@@ -85,10 +193,15 @@ int NetworkAccessManager::timerCallback(CURLM *handle, long timeoutMs, Timer *ti
 	const auto curlRequestsTimeoutTimerToBeStopped = (timeoutMs == -1);
 	const auto curlRequestsTimeoutTimerToTimeoutAsap = (timeoutMs == 0);
 
+	// always restart the timer, even if the requested timeout equals the current interval:
+	// libcurl expects the timeout to expire timeoutMs from now and only calls again if its timeout changes
+	timeoutTimer->running = false;
+
 	if (curlRequestsTimeoutTimerToBeStopped) {
-		timeoutTimer->running = false;
+		return 0;
 	}
-	else if (curlRequestsTimeoutTimerToTimeoutAsap) {
+
+	if (curlRequestsTimeoutTimerToTimeoutAsap) {
 		timeoutTimer->interval.set(std::chrono::microseconds(1));
 		timeoutTimer->running = true;
 	}
@@ -104,7 +217,8 @@ void NetworkAccessManager::onFileDescriptorNotifierTriggered(int nfd, FileDescri
 {
 	spdlog::debug("NetworkAccessManager::onFileDescriptorNotifierTriggered() - fd:{}, {}", nfd, s_notificationTypeToString.at(fdnType));
 
-	m_timeoutTimer.running = false;
+	// the timeout timer is left untouched: libcurl calls timerCallback() only if its next
+	// timeout changed, so stopping the timer here stalls transfers waiting for that timeout
 
 	auto cselectFromFileDescriptorNotificationType = [](FileDescriptorNotifier::NotificationType fdnType) {
 		switch (fdnType) {
@@ -119,6 +233,7 @@ void NetworkAccessManager::onFileDescriptorNotifierTriggered(int nfd, FileDescri
 
 	auto rc = curl_multi_socket_action(m_handle, nfd, cselectFromFileDescriptorNotificationType(fdnType), &m_numberOfRunningTransfers);
 	checkCurlMultiResultAndDoDebugPrints(rc);
+	m_metrics.runningTransfers.set(m_numberOfRunningTransfers);
 
 	processTransferMessages();
 }
@@ -129,6 +244,7 @@ void NetworkAccessManager::onTimeoutTimerTriggered()
 
 	auto rc = curl_multi_socket_action(m_handle, CURL_SOCKET_TIMEOUT, 0, &m_numberOfRunningTransfers);
 	checkCurlMultiResultAndDoDebugPrints(rc);
+	m_metrics.runningTransfers.set(m_numberOfRunningTransfers);
 
 	processTransferMessages();
 }
@@ -146,10 +262,107 @@ void NetworkAccessManager::processTransferMessages()
 				continue;
 			}
 
+			const auto result = msg->data.result;
+			curl_off_t totalTimeUs = 0;
+			if (curl_easy_getinfo(msg->easy_handle, CURLINFO_TOTAL_TIME_T, &totalTimeUs) == CURLE_OK) {
+				m_metrics.transferDuration.observe(double(totalTimeUs) / 1000000.0);
+			}
+			if (result == CURLE_OK) {
+				m_metrics.succeededTransfers.increment();
+			}
+			else {
+				m_metrics.failedTransfers.increment();
+			}
+
 			unregisterTransfer(*transferHandle);
-			transferHandle->transferDoneCallback(msg->data.result);
+			transferHandle->transferDoneCallback(result);
+		}
+	}
+}
+
+void NetworkAccessManager::abortTransfer(AbstractTransferHandle &transferHandle, CURLcode result)
+{
+	spdlog::debug("NetworkAccessManager::abortTransfer() - {}", curl_easy_strerror(result));
+
+	// removing the easy handle closes its connection unless it can be reused, i.e. it is freed right away
+	unregisterTransfer(transferHandle);
+	m_metrics.failedTransfers.increment();
+	std::snprintf(transferHandle.m_errorBuffer, CURL_ERROR_SIZE, "%s", (result == CURLE_OPERATION_TIMEDOUT) ? "Transfer deadline exceeded" : "Transfer cancelled");
+	transferHandle.transferDoneCallback(result);
+}
+
+void NetworkAccessManager::releaseDeadlineAndCancellation(AbstractTransferHandle &transferHandle) const
+{
+	if (transferHandle.m_deadlineTimerId != TimerWheel::c_invalidTimerId) {
+		// the deadline timer is left running while other deadlines are pending,
+		// a needless wakeup is cheaper than restarting it per transfer
+		m_deadlineWheel.cancel(std::exchange(transferHandle.m_deadlineTimerId, TimerWheel::c_invalidTimerId));
+		if (m_deadlineWheel.size() == 0) {
+			m_deadlineTimer.running = false;
+		}
+	}
+	if (transferHandle.m_cancellationConnection.isActive()) {
+		transferHandle.m_cancellationConnection.disconnect();
+	}
+}
+
+void NetworkAccessManager::updateDeadlineTimer()
+{
+	const auto nextExpiry = m_deadlineWheel.nextExpiry();
+	if (!nextExpiry) {
+		m_deadlineTimer.running = false;
+		return;
+	}
+
+	// restart the timer only if the next deadline expires before the timer does
+	if (m_deadlineTimer.running.get() && (m_deadlineTimerExpiry <= *nextExpiry)) {
+		return;
+	}
+
+	const auto interval = std::chrono::ceil<std::chrono::microseconds>(*nextExpiry - TimerWheel::Clock::now());
+	m_deadlineTimerExpiry = *nextExpiry;
+	m_deadlineTimer.running = false;
+	m_deadlineTimer.interval = std::max(interval, std::chrono::microseconds(1));
+	m_deadlineTimer.running = true;
+}
+
+void NetworkAccessManager::onDeadlineTimerTriggered()
+{
+	const auto numberOfExpiredDeadlines = m_deadlineWheel.advance(TimerWheel::Clock::now());
+	spdlog::debug("NetworkAccessManager::onDeadlineTimerTriggered() - {} deadline(s) expired", numberOfExpiredDeadlines);
+
+	updateDeadlineTimer();
+}
+
+void NetworkAccessManager::scheduleResumption(std::coroutine_handle<> coroutine)
+{
+	m_pendingResumptions.push_back(coroutine);
+	m_resumptionTimer.running = true;
+}
+
+void NetworkAccessManager::cancelResumption(std::coroutine_handle<> coroutine)
+{
+	std::erase(m_pendingResumptions, coroutine);
+	std::replace(m_resumptionsInProgress.begin(), m_resumptionsInProgress.end(), coroutine, std::coroutine_handle<>{});
+	if (m_pendingResumptions.empty()) {
+		m_resumptionTimer.running = false;
+	}
+}
+
+void NetworkAccessManager::onResumptionTimerTriggered()
+{
+	spdlog::debug("NetworkAccessManager::onResumptionTimerTriggered() - resuming {} coroutine(s)", m_pendingResumptions.size());
+
+	// a resumed coroutine may await further transfers or destroy other coroutines
+	// which are part of this batch -> cancelResumption() clears those entries
+	m_resumptionsInProgress.swap(m_pendingResumptions);
+	for (std::size_t i = 0; i < m_resumptionsInProgress.size(); ++i) {
+		const auto coroutine = std::exchange(m_resumptionsInProgress[i], {});
+		if (coroutine) {
+			coroutine.resume();
 		}
 	}
+	m_resumptionsInProgress.clear();
 }
 
 bool NetworkAccessManager::checkCurlMultiResultAndDoDebugPrints(CURLMcode c) const
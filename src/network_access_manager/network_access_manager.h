@@ -2,8 +2,19 @@
 
 #include <KDFoundation/file_descriptor_notifier.h>
 #include <KDFoundation/timer.h>
+#include <chrono>
+#include <coroutine>
 #include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 #include "abstract_transfer_handle.h"
+#include "cancellation_token.h"
+#include "http_transfer_awaitable.h"
+#include "metrics_registry.h"
+#include "persistent_connection_state.h"
+#include "timer_wheel.h"
 
 using namespace KDFoundation;
 
@@ -20,9 +31,23 @@ class INetworkAccessManager
 	virtual ~INetworkAccessManager() {};
 };
 
+/*
+ * Struct: TransferOptions
+ *
+ * Options of NetworkAccessManager::registerTransfer(transferHandle, options).
+ */
+struct TransferOptions
+{
+	// maximum duration of the transfer from its registration on, 0 means no deadline
+	std::chrono::milliseconds deadline { 0 };
+	std::optional<CancellationToken> cancellationToken;
+};
+
 class NetworkAccessManager : public INetworkAccessManager
 {
 	friend class NetworkAccessManagerUnitTestHarness;
+	friend class HttpTransferAwaitable;
+	friend class AbstractTransferHandle;
 
   private:
 	NetworkAccessManager();
@@ -37,6 +62,20 @@ class NetworkAccessManager : public INetworkAccessManager
 	bool registerTransfer(AbstractTransferHandle &transferHandle) const final;
 	bool unregisterTransfer(AbstractTransferHandle &transferHandle) const final;
 
+	// a transfer exceeding its deadline finishes with CURLE_OPERATION_TIMEDOUT, a cancelled one
+	// with CURLE_ABORTED_BY_CALLBACK; both are unregistered right away, which frees their connection
+	bool registerTransfer(AbstractTransferHandle &transferHandle, const TransferOptions &options);
+
+	// coroutine API -> HttpResponse response = co_await NetworkAccessManager::instance().get(url);
+	HttpTransferAwaitable get(const Url &url, bool verbose = false);
+
+	// shares TLS sessions and HSTS entries between all transfers registered from now on and keeps
+	// HSTS and Alt-Svc entries in files of directoryPath, so that connections after a restart skip
+	// redirects to HTTPS, see PersistentConnectionState; returns true in case of error
+	bool enablePersistentState(const std::string &directoryPath);
+	// also done on destruction
+	bool savePersistentState();
+
   private:
 	static int socketCallback(CURL *handle, curl_socket_t socket, int eventType, NetworkAccessManager *self, void *);
 	static int timerCallback(CURLM *handle, long timeoutMs, Timer *timeoutTimer);
@@ -45,12 +84,34 @@ class NetworkAccessManager : public INetworkAccessManager
 	void onTimeoutTimerTriggered();
 
 	void processTransferMessages();
+
+	void abortTransfer(AbstractTransferHandle &transferHandle, CURLcode result);
+	void releaseDeadlineAndCancellation(AbstractTransferHandle &transferHandle) const;
+	void updateDeadlineTimer();
+	void onDeadlineTimerTriggered();
+
+	void scheduleResumption(std::coroutine_handle<> coroutine);
+	void cancelResumption(std::coroutine_handle<> coroutine);
+	void onResumptionTimerTriggered();
 	bool checkCurlMultiResultAndDoDebugPrints(CURLMcode c) const;
 
 	int m_numberOfRunningTransfers;
 	CURLM *m_handle;
 	Timer m_timeoutTimer;
 
+	// coroutines awaiting finished transfers are resumed from the event loop via this timer
+	Timer m_resumptionTimer;
+	std::vector<std::coroutine_handle<>> m_pendingResumptions;
+	std::vector<std::coroutine_handle<>> m_resumptionsInProgress;
+
+	std::unique_ptr<PersistentConnectionState> m_persistentState;
+
+	// deadlines of all transfers share one timer wheel, driven by one timer
+	// (mutable: unregisterTransfer() cancels the deadline of the transfer)
+	mutable TimerWheel m_deadlineWheel;
+	mutable Timer m_deadlineTimer;
+	TimerWheel::Clock::time_point m_deadlineTimerExpiry;
+
 	struct FileDescriptorNotifierRegistry
 	{
 		void manageFileDescriptorNotifiers(curl_socket_t socket, int eventType);
@@ -62,6 +123,17 @@ class NetworkAccessManager : public INetworkAccessManager
 	};
 	FileDescriptorNotifierRegistry m_fdnRegistry;
 
+	// exported via MetricsRegistry::instance()
+	struct Metrics
+	{
+		Counter &startedTransfers;
+		Counter &succeededTransfers;
+		Counter &failedTransfers;
+		Gauge &runningTransfers;
+		Histogram &transferDuration;
+	};
+	Metrics m_metrics;
+
 	// DEBUG RELATED LUTs
 	static const std::map<int,const std::string> s_curlPollEventToString;
 	static const std::map<FileDescriptorNotifier::NotificationType, const std::string> s_notificationTypeToString;
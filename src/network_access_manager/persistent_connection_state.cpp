@@ -0,0 +1,244 @@
+#include "persistent_connection_state.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+constexpr auto c_hstsFileName = "hsts.txt";
+constexpr auto c_altSvcFileName = "altsvc.txt";
+constexpr auto c_altSvcControl = static_cast<long>(CURLALTSVC_H1 | CURLALTSVC_H2 | CURLALTSVC_H3);
+// HSTS file in the format libcurl uses for CURLOPT_HSTS: one entry per line, the host (with a
+// leading dot for includeSubDomains) followed by the quoted expiry, "unlimited" if it never expires
+constexpr auto c_hstsUnlimitedExpiry = "unlimited";
+// MAX_HSTS_HOSTLEN of libcurl
+constexpr std::size_t c_maxHstsHostLength = 256;
+
+bool replaceFile(const std::string &filePath, const std::string &content, std::string_view func)
+{
+	// replace the file at once, a crash must not leave a truncated one behind
+	const auto temporaryFilePath = filePath + ".tmp";
+	{
+		std::ofstream file(temporaryFilePath, std::ios::binary | std::ios::trunc);
+		file.write(content.data(), static_cast<std::streamsize>(content.size()));
+		if (!file.flush()) {
+			spdlog::error("{} - cannot write {}", func, temporaryFilePath);
+			return true;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temporaryFilePath, filePath, ec);
+	if (ec) {
+		spdlog::error("{} - cannot replace {}: {}", func, filePath, ec.message());
+		return true;
+	}
+	return false;
+}
+
+}
+
+PersistentConnectionState::PersistentConnectionState(const std::string &directoryPath)
+	: m_directoryPath{directoryPath}
+	, m_hstsFilePath{(std::filesystem::path(directoryPath) / c_hstsFileName).string()}
+	, m_altSvcFilePath{(std::filesystem::path(directoryPath) / c_altSvcFileName).string()}
+{
+}
+
+PersistentConnectionState::~PersistentConnectionState()
+{
+	if (m_stateHandle) {
+		saveHstsEntries();
+	}
+	if (m_share) {
+		// fails if easy handles still use the share, which then is leaked rather than freed under their feet
+		const auto rc = curl_share_cleanup(m_share);
+		if (rc != CURLSHE_OK) {
+			spdlog::warn("PersistentConnectionState::~PersistentConnectionState() - curl_share_cleanup() failed: {}", curl_share_strerror(rc));
+		}
+	}
+}
+
+bool PersistentConnectionState::load()
+{
+	spdlog::debug("PersistentConnectionState::load() - {}", m_directoryPath);
+
+	std::error_code ec;
+	std::filesystem::create_directories(m_directoryPath, ec);
+	if (ec) {
+		spdlog::error("PersistentConnectionState::load() - cannot create directory {}: {}", m_directoryPath, ec.message());
+		return true;
+	}
+
+	if (!m_share) {
+		m_share = curl_share_init();
+		if (!m_share) {
+			spdlog::error("PersistentConnectionState::load() - curl_share_init() returned nullptr");
+			return true;
+		}
+		// all transfers run on the event loop's thread -> no lock functions needed
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+#if LIBCURL_VERSION_NUM >= 0x075800
+		curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HSTS);
+#endif
+	}
+
+	if (m_stateHandle) {
+		return false;
+	}
+	const auto hasError = initializeStateHandle();
+	if (hasError) {
+		return true;
+	}
+	loadHstsEntries();
+	return false;
+}
+
+bool PersistentConnectionState::save()
+{
+	if (!m_stateHandle) {
+		spdlog::error("PersistentConnectionState::save() - state not loaded");
+		return true;
+	}
+
+	const auto hasHstsError = saveHstsEntries();
+	return initializeStateHandle() || hasHstsError;
+}
+
+void PersistentConnectionState::apply(CURL *easyHandle) const
+{
+	if (!m_share) {
+		return;
+	}
+	curl_easy_setopt(easyHandle, CURLOPT_SHARE, m_share);
+	curl_easy_setopt(easyHandle, CURLOPT_HSTS_CTRL, static_cast<long>(CURLHSTS_ENABLE));
+	// libcurl pulls the entries when the transfer starts, i.e. the first transfer loads them into the share
+	const auto hasHstsEntriesToLoad = !m_hstsEntriesToLoad.empty();
+	curl_easy_setopt(easyHandle, CURLOPT_HSTSREADFUNCTION, hasHstsEntriesToLoad ? onHstsEntryRequested : nullptr);
+	curl_easy_setopt(easyHandle, CURLOPT_HSTSREADDATA, hasHstsEntriesToLoad ? this : nullptr);
+	// no CURLOPT_ALTSVC: libcurl would read the file on every transfer and every easy handle
+	// would overwrite it on cleanup
+	curl_easy_setopt(easyHandle, CURLOPT_ALTSVC_CTRL, c_altSvcControl);
+}
+
+const std::string &PersistentConnectionState::directoryPath() const
+{
+	return m_directoryPath;
+}
+
+bool PersistentConnectionState::initializeStateHandle()
+{
+	m_stateHandle = curl_easy_init();
+	if (!m_stateHandle) {
+		spdlog::error("PersistentConnectionState::initializeStateHandle() - curl_easy_init() returned nullptr");
+		return true;
+	}
+
+	// no CURLOPT_HSTS: libcurl would overwrite the file with the entries of the share on cleanup,
+	// which lacks the entries of the file as long as no transfer loaded them
+	curl_easy_setopt(m_stateHandle, CURLOPT_SHARE, m_share);
+	curl_easy_setopt(m_stateHandle, CURLOPT_HSTS_CTRL, static_cast<long>(CURLHSTS_ENABLE));
+	curl_easy_setopt(m_stateHandle, CURLOPT_HSTSWRITEFUNCTION, onHstsEntrySaved);
+	curl_easy_setopt(m_stateHandle, CURLOPT_HSTSWRITEDATA, this);
+	// libcurl reads the file right away and writes it on cleanup, see saveHstsEntries()
+	curl_easy_setopt(m_stateHandle, CURLOPT_ALTSVC_CTRL, c_altSvcControl);
+	curl_easy_setopt(m_stateHandle, CURLOPT_ALTSVC, m_altSvcFilePath.c_str());
+	return false;
+}
+
+bool PersistentConnectionState::loadHstsEntries()
+{
+	std::ifstream file(m_hstsFilePath);
+	if (!file) {
+		return false; // first start
+	}
+
+	m_hstsEntriesToLoad.clear();
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line.starts_with('#')) {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string host;
+		std::string expiry;
+		fields >> host;
+		std::getline(fields >> std::ws, expiry);
+		if ((expiry.size() >= 2) && expiry.starts_with('"') && expiry.ends_with('"')) {
+			expiry = expiry.substr(1, expiry.size() - 2);
+		}
+		const auto includeSubDomains = host.starts_with('.');
+		if (includeSubDomains) {
+			host.erase(0, 1);
+		}
+		if (host.empty() || (host.size() > c_maxHstsHostLength) || (expiry.size() >= sizeof(curl_hstsentry::expire))) {
+			spdlog::warn("PersistentConnectionState::loadHstsEntries() - ignoring invalid line in {}: {}", m_hstsFilePath, line);
+			continue;
+		}
+		if (expiry == c_hstsUnlimitedExpiry) {
+			expiry.clear();
+		}
+		m_hstsEntriesToLoad.push_back({ std::move(host), includeSubDomains, std::move(expiry) });
+	}
+	spdlog::debug("PersistentConnectionState::loadHstsEntries() - {} entries loaded", m_hstsEntriesToLoad.size());
+	return false;
+}
+
+bool PersistentConnectionState::saveHstsEntries()
+{
+	m_hstsEntriesToSave.clear();
+	curl_easy_cleanup(m_stateHandle);
+	m_stateHandle = nullptr;
+
+	// entries not fed into the share yet, e.g. as there was no transfer, are kept
+	std::unordered_set<std::string> hosts;
+	for (const auto &entry : m_hstsEntriesToSave) {
+		hosts.insert(entry.host);
+	}
+	for (const auto &entry : m_hstsEntriesToLoad) {
+		if (!hosts.contains(entry.host)) {
+			m_hstsEntriesToSave.push_back(entry);
+		}
+	}
+
+	std::string content = "# HSTS cache, see https://curl.se/docs/hsts.html\n";
+	for (const auto &entry : m_hstsEntriesToSave) {
+		content += entry.includeSubDomains ? "." : "";
+		content += entry.host;
+		content += " \"";
+		content += entry.expiry.empty() ? c_hstsUnlimitedExpiry : entry.expiry;
+		content += "\"\n";
+	}
+	const auto hasError = replaceFile(m_hstsFilePath, content, "PersistentConnectionState::saveHstsEntries()");
+	m_hstsEntriesToSave.clear();
+	return hasError;
+}
+
+CURLSTScode PersistentConnectionState::onHstsEntryRequested(CURL*, curl_hstsentry *entry, PersistentConnectionState *self)
+{
+	auto &entries = self->m_hstsEntriesToLoad;
+	while (!entries.empty()) {
+		const auto hstsEntry = std::move(entries.back());
+		entries.pop_back();
+		// libcurl passes a buffer of MAX_HSTS_HOSTLEN, longer host names are rejected when loading
+		if (hstsEntry.host.size() <= entry->namelen) {
+			std::memcpy(entry->name, hstsEntry.host.c_str(), hstsEntry.host.size() + 1);
+			entry->includeSubDomains = hstsEntry.includeSubDomains;
+			std::memcpy(entry->expire, hstsEntry.expiry.c_str(), hstsEntry.expiry.size() + 1);
+			return CURLSTS_OK;
+		}
+	}
+	return CURLSTS_DONE;
+}
+
+CURLSTScode PersistentConnectionState::onHstsEntrySaved(CURL*, curl_hstsentry *entry, curl_index*, PersistentConnectionState *self)
+{
+	const auto expiry = std::string(entry->expire);
+	self->m_hstsEntriesToSave.push_back({ std::string(entry->name), entry->includeSubDomains != 0, (expiry == c_hstsUnlimitedExpiry) ? std::string() : expiry });
+	return CURLSTS_OK;
+}
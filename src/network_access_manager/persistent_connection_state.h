@@ -0,0 +1,68 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <string>
+#include <vector>
+
+/*
+ * Class: PersistentConnectionState
+ *
+ * State of libcurl which makes new connections cheaper, shared by all transfers and kept
+ * in files of a directory across restarts (see NetworkAccessManager::enablePersistentState()):
+ * - TLS sessions: resuming a session saves the full handshake. All transfers share one
+ *   session cache, which is not kept across restarts (libcurl before 8.12 cannot export sessions).
+ * - HSTS entries: hosts known to require HTTPS are not contacted via HTTP first. libcurl
+ *   loads HSTS entries only when a transfer starts, so the entries of the file are fed into
+ *   the share by the first transfer, and entries not fed yet are kept when saving.
+ * - Alt-Svc entries: alternative services (e.g. HTTP/3) are used without being advertised first.
+ *   libcurl cannot share them between transfers, so the state handle holds the entries of the
+ *   file, which libcurl reads once when loading and writes when save() cleans the handle up.
+ *   Transfers cache the entries they learn in memory only (per easy handle, no file I/O).
+ */
+class PersistentConnectionState
+{
+  public:
+	explicit PersistentConnectionState(const std::string &directoryPath);
+	~PersistentConnectionState();
+
+	PersistentConnectionState(const PersistentConnectionState&) = delete;
+	PersistentConnectionState &operator=(const PersistentConnectionState&) = delete;
+
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool load();
+	bool save();
+
+	// call before every transfer of easyHandle, curl_easy_reset() clears the options
+	void apply(CURL *easyHandle) const;
+
+	[[nodiscard]] const std::string &directoryPath() const;
+
+  private:
+	struct HstsEntry
+	{
+		std::string host;
+		bool includeSubDomains;
+		// "YYYYMMDD HH:MM:SS" (UTC) or empty if it never expires
+		std::string expiry;
+	};
+
+	bool initializeStateHandle();
+	bool loadHstsEntries();
+	// cleans up the state handle, which passes the entries of the share to onHstsEntrySaved()
+	// and writes the Alt-Svc file
+	bool saveHstsEntries();
+
+	static CURLSTScode onHstsEntryRequested(CURL *easyHandle, curl_hstsentry *entry, PersistentConnectionState *self);
+	static CURLSTScode onHstsEntrySaved(CURL *easyHandle, curl_hstsentry *entry, curl_index *index, PersistentConnectionState *self);
+
+	std::string m_directoryPath;
+	std::string m_hstsFilePath;
+	std::string m_altSvcFilePath;
+
+	CURLSH *m_share { nullptr };
+	// exports the HSTS entries of the share, holds the Alt-Svc entries
+	CURL *m_stateHandle { nullptr };
+	// entries of the HSTS file not fed into the share yet (mutable: fed by transfers, see apply())
+	mutable std::vector<HstsEntry> m_hstsEntriesToLoad;
+	std::vector<HstsEntry> m_hstsEntriesToSave;
+};
@@ -0,0 +1,248 @@
+#include "sse_transfer_handle.h"
+#include <charconv>
+#include <spdlog/spdlog.h>
+
+SseTransferHandle::SseTransferHandle(const INetworkAccessManager &networkAccessManager, const Url &url, bool verbose)
+	: AbstractTransferHandle(url, verbose)
+	, m_networkAccessManager{networkAccessManager}
+{
+	// switch off progress meter, the transfer lasts as long as the stream
+	curl_easy_setopt(m_handle, CURLOPT_NOPROGRESS, 1L);
+	// detect dead connections of idle streams
+	curl_easy_setopt(m_handle, CURLOPT_TCP_KEEPALIVE, 1L);
+
+	m_reconnectTimer.timeout.connect([this]() {
+		m_reconnectTimer.running.set(false);
+		connect();
+	});
+}
+
+SseTransferHandle::~SseTransferHandle()
+{
+	close();
+	curl_slist_free_all(m_requestHeaders);
+}
+
+bool SseTransferHandle::open()
+{
+	if (connectionState.get() != ConnectionState::CLOSED) {
+		spdlog::warn("SseTransferHandle::open() - already open");
+		return true;
+	}
+	return connect();
+}
+
+void SseTransferHandle::close()
+{
+	if (connectionState.get() == ConnectionState::CLOSED) {
+		return;
+	}
+	m_reconnectTimer.running = false;
+	m_networkAccessManager.unregisterTransfer(*this);
+	connectionState = ConnectionState::CLOSED;
+}
+
+const std::string &SseTransferHandle::lastEventId() const
+{
+	return m_lastEventId;
+}
+
+std::chrono::milliseconds SseTransferHandle::reconnectionTime() const
+{
+	return m_reconnectionTime;
+}
+
+size_t SseTransferHandle::writeCallbackImpl(const char *data, size_t size, size_t nmemb)
+{
+	const size_t realSize = size * nmemb;
+
+	// returning 0 aborts the transfer with CURLE_WRITE_ERROR
+	if (!m_isResponseChecked && !checkResponse()) {
+		return 0;
+	}
+
+	parse(std::string_view(data, realSize));
+	return realSize;
+}
+
+void SseTransferHandle::transferDoneCallbackImpl(CURLcode result)
+{
+	long responseCode = 0;
+	curl_easy_getinfo(m_handle, CURLINFO_RESPONSE_CODE, &responseCode);
+
+	// the server ended the stream (200) or the connection failed -> reconnect,
+	// other responses (e.g. 204 No Content) ask the client to stop
+	const auto isReconnectRequired = !m_isFailed && ((result != CURLE_OK) || (responseCode == 200));
+	if (!isReconnectRequired) {
+		spdlog::info("SseTransferHandle::transferDoneCallbackImpl() - stream closed by server, response code {}", responseCode);
+		connectionState = ConnectionState::CLOSED;
+		return;
+	}
+
+	spdlog::debug("SseTransferHandle::transferDoneCallbackImpl() - reconnecting in {} ms", m_reconnectionTime.count());
+	connectionState = ConnectionState::WAITING_FOR_RECONNECT;
+	m_reconnectTimer.interval = m_reconnectionTime;
+	m_reconnectTimer.running = true;
+}
+
+bool SseTransferHandle::connect()
+{
+	resetParser();
+	setRequestHeaders();
+	m_isResponseChecked = false;
+	m_isFailed = false;
+
+	connectionState = ConnectionState::CONNECTING;
+	const auto hasError = m_networkAccessManager.registerTransfer(*this);
+	if (hasError) {
+		connectionState = ConnectionState::CLOSED;
+	}
+	return hasError;
+}
+
+bool SseTransferHandle::checkResponse()
+{
+	m_isResponseChecked = true;
+
+	long responseCode = 0;
+	curl_easy_getinfo(m_handle, CURLINFO_RESPONSE_CODE, &responseCode);
+	char *contentType = nullptr;
+	curl_easy_getinfo(m_handle, CURLINFO_CONTENT_TYPE, &contentType);
+
+	const auto isEventStream = contentType && std::string_view(contentType).starts_with("text/event-stream");
+	if ((responseCode != 200) || !isEventStream) {
+		spdlog::error("SseTransferHandle::checkResponse() - no event stream, response code {}, content type {}", responseCode, contentType ? contentType : "none");
+		m_isFailed = true;
+		return false;
+	}
+
+	connectionState = ConnectionState::OPEN;
+	return true;
+}
+
+void SseTransferHandle::setRequestHeaders()
+{
+	curl_slist_free_all(m_requestHeaders);
+	m_requestHeaders = nullptr;
+
+	m_requestHeaders = curl_slist_append(m_requestHeaders, "Accept: text/event-stream");
+	m_requestHeaders = curl_slist_append(m_requestHeaders, "Cache-Control: no-cache");
+	if (!m_lastEventId.empty()) {
+		m_requestHeaders = curl_slist_append(m_requestHeaders, ("Last-Event-ID: " + m_lastEventId).c_str());
+	}
+	curl_easy_setopt(m_handle, CURLOPT_HTTPHEADER, m_requestHeaders);
+}
+
+void SseTransferHandle::resetParser()
+{
+	// the last event id and the reconnection time survive reconnects
+	m_lineBuffer.clear();
+	m_eventType.clear();
+	m_data.clear();
+	m_isAtStreamStart = true;
+	m_isCarriageReturnPending = false;
+}
+
+void SseTransferHandle::parse(std::string_view chunk)
+{
+	if (m_isAtStreamStart) {
+		m_isAtStreamStart = false;
+		if (chunk.starts_with("\xEF\xBB\xBF")) {
+			chunk.remove_prefix(3);
+		}
+	}
+
+	// a CR at the end of the previous chunk may be followed by its LF
+	if (m_isCarriageReturnPending) {
+		m_isCarriageReturnPending = false;
+		if (chunk.starts_with('\n')) {
+			chunk.remove_prefix(1);
+		}
+	}
+
+	// lines end with CRLF, LF or CR
+	while (!chunk.empty()) {
+		auto end = chunk.find_first_of("\r\n");
+		if (end == std::string_view::npos) {
+			m_lineBuffer.append(chunk);
+			return;
+		}
+
+		// lines received in one piece are processed without copying them
+		if (m_lineBuffer.empty()) {
+			processLine(chunk.substr(0, end));
+		}
+		else {
+			m_lineBuffer.append(chunk.substr(0, end));
+			processLine(m_lineBuffer);
+			m_lineBuffer.clear();
+		}
+
+		if (chunk[end] == '\r') {
+			if (end + 1 == chunk.size()) {
+				m_isCarriageReturnPending = true;
+			}
+			else if (chunk[end + 1] == '\n') {
+				++end;
+			}
+		}
+		chunk.remove_prefix(end + 1);
+	}
+}
+
+void SseTransferHandle::processLine(std::string_view line)
+{
+	if (line.empty()) {
+		dispatchEvent();
+		return;
+	}
+
+	// comment, e.g. used by servers to keep connections alive
+	if (line.starts_with(':')) {
+		return;
+	}
+
+	const auto colon = line.find(':');
+	const auto field = line.substr(0, colon);
+	auto value = (colon == std::string_view::npos) ? std::string_view() : line.substr(colon + 1);
+	if (value.starts_with(' ')) {
+		value.remove_prefix(1);
+	}
+
+	if (field == "event") {
+		m_eventType = value;
+	}
+	else if (field == "data") {
+		m_data.append(value);
+		m_data.push_back('\n');
+	}
+	else if (field == "id") {
+		if (value.find('\0') == std::string_view::npos) {
+			m_lastEventId = value;
+		}
+	}
+	else if (field == "retry") {
+		unsigned long reconnectionTimeMs = 0;
+		const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), reconnectionTimeMs);
+		if (!value.empty() && (ec == std::errc()) && (end == value.data() + value.size())) {
+			m_reconnectionTime = std::chrono::milliseconds(reconnectionTimeMs);
+		}
+	}
+}
+
+void SseTransferHandle::dispatchEvent()
+{
+	if (m_data.empty()) {
+		m_eventType.clear();
+		return;
+	}
+
+	// the last data line is not followed by a line feed
+	const auto data = std::string_view(m_data).substr(0, m_data.size() - 1);
+	const auto type = m_eventType.empty() ? std::string_view("message") : std::string_view(m_eventType);
+	eventReceived.emit(ServerSentEvent { type, data, m_lastEventId });
+
+	// keeps the capacity of the buffers for the next event
+	m_data.clear();
+	m_eventType.clear();
+}
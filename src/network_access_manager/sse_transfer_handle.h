@@ -0,0 +1,97 @@
+#pragma once
+
+#include "network_access_manager.h"
+#include <KDFoundation/timer.h>
+#include <chrono>
+#include <kdbindings/property.h>
+#include <string>
+#include <string_view>
+
+using namespace KDBindings;
+
+/*
+ * Struct: ServerSentEvent
+ *
+ * Event received by SseTransferHandle.
+ * The views refer to buffers of the handle and are valid during the emission of eventReceived only.
+ */
+struct ServerSentEvent
+{
+	std::string_view type; // "message" unless the event names a type
+	std::string_view data;
+	std::string_view lastEventId;
+};
+
+/*
+ * Class: SseTransferHandle
+ *
+ * Server-Sent Events client (text/event-stream), see
+ * https://html.spec.whatwg.org/multipage/server-sent-events.html
+ * The stream is parsed incrementally while it is received, every event is emitted
+ * as soon as it is complete, so the never ending body is not buffered.
+ *
+ * open() registers the handle with the NetworkAccessManager. Whenever the stream
+ * ends or the connection fails, the handle reconnects after the reconnection time
+ * (which the server may change) and sends the id of the last event received as
+ * Last-Event-ID, so the server can continue the stream. finished is emitted whenever
+ * a connection ends. No reconnect happens after close(), after a response other than
+ * 200 with content type text/event-stream and after a 204 response.
+ */
+class SseTransferHandle : public AbstractTransferHandle
+{
+	friend class SseTransferHandleUnitTestHarness;
+
+  public:
+	enum class ConnectionState {
+		CONNECTING,
+		OPEN,
+		WAITING_FOR_RECONNECT,
+		CLOSED
+	};
+
+	SseTransferHandle(const INetworkAccessManager &networkAccessManager, const Url &url, bool verbose = false);
+	~SseTransferHandle();
+
+	SseTransferHandle(const SseTransferHandle&) = delete;
+	SseTransferHandle &operator=(const SseTransferHandle&) = delete;
+
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool open();
+	void close();
+
+	[[nodiscard]] const std::string &lastEventId() const;
+	[[nodiscard]] std::chrono::milliseconds reconnectionTime() const;
+
+	Property<ConnectionState> connectionState { ConnectionState::CLOSED };
+
+	KDBindings::Signal<const ServerSentEvent &> eventReceived;
+
+  protected:
+	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb) override;
+	virtual void transferDoneCallbackImpl(CURLcode result) override;
+
+  private:
+	bool connect();
+	bool checkResponse();
+	void setRequestHeaders();
+	void resetParser();
+
+	void parse(std::string_view chunk);
+	void processLine(std::string_view line);
+	void dispatchEvent();
+
+	const INetworkAccessManager &m_networkAccessManager;
+	curl_slist *m_requestHeaders { nullptr };
+	Timer m_reconnectTimer;
+	std::chrono::milliseconds m_reconnectionTime { 3000 };
+	bool m_isResponseChecked { false };
+	bool m_isFailed { false };
+
+	// parser state
+	std::string m_lineBuffer;
+	std::string m_eventType;
+	std::string m_data;
+	std::string m_lastEventId;
+	bool m_isAtStreamStart { true };
+	bool m_isCarriageReturnPending { false };
+};
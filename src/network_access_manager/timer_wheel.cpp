@@ -0,0 +1,226 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+#include <utility>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution, Clock::time_point now)
+	: m_resolution{std::max(resolution, std::chrono::milliseconds(1))}
+	, m_start{now}
+{
+	m_heads.fill(c_noEntry);
+	m_levelSizes.fill(0);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(Clock::time_point deadline, std::function<void()> callback)
+{
+	std::uint32_t index;
+	if (m_freeEntries.empty()) {
+		index = static_cast<std::uint32_t>(m_entries.size());
+		m_entries.emplace_back();
+	}
+	else {
+		index = m_freeEntries.back();
+		m_freeEntries.pop_back();
+	}
+
+	auto &entry = m_entries[index];
+	// timers never fire early and due timers fire with the next call of advance(),
+	// never from within schedule() or from within the advance() which is running right now
+	entry.expiryTick = std::max(tickOf(deadline, true), m_currentTick + 1);
+	entry.callback = std::move(callback);
+	insert(index);
+	++m_size;
+
+	return (static_cast<TimerId>(entry.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerId timerId)
+{
+	const auto index = static_cast<std::uint32_t>(timerId);
+	const auto generation = static_cast<std::uint32_t>(timerId >> 32);
+	if ((index >= m_entries.size()) || (m_entries[index].generation != generation) || (m_entries[index].list == c_noEntry)) {
+		return false;
+	}
+
+	unlink(index);
+	release(index);
+	--m_size;
+	return true;
+}
+
+std::size_t TimerWheel::advance(Clock::time_point now)
+{
+	const auto targetTick = tickOf(now, false);
+
+	while (m_currentTick < targetTick) {
+		if (m_size == 0) {
+			m_currentTick = targetTick;
+			break;
+		}
+
+		// nothing fires before level 0 wraps around -> skip the empty slots
+		if (m_levelSizes[0] == 0) {
+			const auto wrapTick = (m_currentTick | c_slotMask) + 1;
+			if (wrapTick > targetTick) {
+				m_currentTick = targetTick;
+				break;
+			}
+			m_currentTick = wrapTick - 1;
+		}
+
+		++m_currentTick;
+
+		// the lower bits of the tick are all 0 at the beginning of a slot of a higher level
+		for (auto level = c_numberOfLevels - 1; level > 0; --level) {
+			const auto lowerBitsMask = (std::uint64_t(1) << (c_bitsPerLevel * level)) - 1;
+			if ((m_currentTick & lowerBitsMask) == 0) {
+				cascade(level);
+			}
+		}
+
+		auto index = std::exchange(m_heads[m_currentTick & c_slotMask], c_noEntry);
+		while (index != c_noEntry) {
+			const auto next = m_entries[index].next;
+			--m_levelSizes[0];
+			link(index, c_expiredList);
+			index = next;
+		}
+	}
+
+	// a callback may schedule and cancel timers, including those about to fire
+	std::size_t numberOfFiredTimers = 0;
+	while (m_heads[c_expiredList] != c_noEntry) {
+		const auto index = m_heads[c_expiredList];
+		unlink(index);
+		auto callback = std::move(m_entries[index].callback);
+		release(index);
+		--m_size;
+
+		++numberOfFiredTimers;
+		callback();
+	}
+	return numberOfFiredTimers;
+}
+
+std::optional<TimerWheel::Clock::time_point> TimerWheel::nextExpiry() const
+{
+	if (m_size == 0) {
+		return std::nullopt;
+	}
+
+	// the timers of the higher levels are cascaded when level 0 wraps around
+	const auto wrapTick = (m_currentTick | c_slotMask) + 1;
+	if (m_levelSizes[0] > 0) {
+		for (auto tick = m_currentTick + 1; tick < wrapTick; ++tick) {
+			if (m_heads[tick & c_slotMask] != c_noEntry) {
+				return timeOf(tick);
+			}
+		}
+	}
+	return timeOf(wrapTick);
+}
+
+std::size_t TimerWheel::size() const
+{
+	return m_size;
+}
+
+std::uint64_t TimerWheel::tickOf(Clock::time_point timePoint, bool roundUp) const
+{
+	if (timePoint <= m_start) {
+		return 0;
+	}
+
+	const auto elapsed = timePoint - m_start;
+	const auto ticks = static_cast<std::uint64_t>(elapsed / m_resolution);
+	return (roundUp && (elapsed % m_resolution != Clock::duration::zero())) ? ticks + 1 : ticks;
+}
+
+TimerWheel::Clock::time_point TimerWheel::timeOf(std::uint64_t tick) const
+{
+	return m_start + tick * m_resolution;
+}
+
+void TimerWheel::insert(std::uint32_t index)
+{
+	const auto expiryTick = m_entries[index].expiryTick;
+	if (expiryTick <= m_currentTick) {
+		link(index, c_expiredList);
+		return;
+	}
+
+	const auto delta = expiryTick - m_currentTick;
+	for (std::uint32_t level = 0; level < c_numberOfLevels; ++level) {
+		if (delta < (std::uint64_t(1) << (c_bitsPerLevel * (level + 1)))) {
+			const auto slot = (expiryTick >> (c_bitsPerLevel * level)) & c_slotMask;
+			link(index, level * c_slotsPerLevel + static_cast<std::uint32_t>(slot));
+			return;
+		}
+	}
+
+	// beyond the range of the wheel -> park in the last slot of the highest level,
+	// the timer is redistributed once that slot gets cascaded
+	const auto lastLevel = c_numberOfLevels - 1;
+	const auto parkingTick = m_currentTick + (std::uint64_t(1) << (c_bitsPerLevel * c_numberOfLevels)) - 1;
+	const auto slot = (parkingTick >> (c_bitsPerLevel * lastLevel)) & c_slotMask;
+	link(index, lastLevel * c_slotsPerLevel + static_cast<std::uint32_t>(slot));
+}
+
+void TimerWheel::link(std::uint32_t index, std::uint32_t list)
+{
+	auto &entry = m_entries[index];
+	entry.list = list;
+	entry.previous = c_noEntry;
+	entry.next = m_heads[list];
+	if (entry.next != c_noEntry) {
+		m_entries[entry.next].previous = index;
+	}
+	m_heads[list] = index;
+
+	if (list < c_numberOfSlots) {
+		++m_levelSizes[list / c_slotsPerLevel];
+	}
+}
+
+void TimerWheel::unlink(std::uint32_t index)
+{
+	auto &entry = m_entries[index];
+	if (entry.previous != c_noEntry) {
+		m_entries[entry.previous].next = entry.next;
+	}
+	else {
+		m_heads[entry.list] = entry.next;
+	}
+	if (entry.next != c_noEntry) {
+		m_entries[entry.next].previous = entry.previous;
+	}
+
+	if (entry.list < c_numberOfSlots) {
+		--m_levelSizes[entry.list / c_slotsPerLevel];
+	}
+	entry.list = c_noEntry;
+}
+
+void TimerWheel::cascade(std::uint32_t level)
+{
+	const auto slot = (m_currentTick >> (c_bitsPerLevel * level)) & c_slotMask;
+	auto index = std::exchange(m_heads[level * c_slotsPerLevel + slot], c_noEntry);
+	while (index != c_noEntry) {
+		const auto next = m_entries[index].next;
+		--m_levelSizes[level];
+		insert(index);
+		index = next;
+	}
+}
+
+void TimerWheel::release(std::uint32_t index)
+{
+	auto &entry = m_entries[index];
+	entry.callback = nullptr;
+	entry.list = c_noEntry;
+	// 0 is reserved for c_invalidTimerId
+	if (++entry.generation == 0) {
+		entry.generation = 1;
+	}
+	m_freeEntries.push_back(index);
+}
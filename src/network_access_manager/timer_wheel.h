@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+/*
+ * Class: TimerWheel
+ *
+ * Hierarchical timer wheel for large numbers of one shot timers, e.g. transfer deadlines.
+ * Scheduling and cancelling a timer costs O(1), independent of the number of pending timers.
+ *
+ * Time is divided into ticks of the given resolution. Level 0 holds the timers of the
+ * next c_slotsPerLevel ticks, one slot per tick, every further level covers a
+ * c_slotsPerLevel times longer period with the same number of slots. Whenever level 0
+ * wraps around, the due slot of the next level is cascaded, i.e. its timers are
+ * redistributed to the lower levels. Timers beyond the range of the highest level are
+ * parked in its last slot and redistributed until they are due.
+ *
+ * The wheel has no clock of its own, the owner calls advance() at (or after)
+ * nextExpiry(). Timers fire at most one tick late.
+ */
+class TimerWheel
+{
+  public:
+	using Clock = std::chrono::steady_clock;
+	using TimerId = std::uint64_t;
+	static constexpr TimerId c_invalidTimerId = 0;
+
+	explicit TimerWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(1), Clock::time_point now = Clock::now());
+
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel &operator=(const TimerWheel&) = delete;
+
+	TimerId schedule(Clock::time_point deadline, std::function<void()> callback);
+	// returns false if the timer already fired or got cancelled
+	bool cancel(TimerId timerId);
+
+	// fires all timers due at now, returns the number of fired timers
+	std::size_t advance(Clock::time_point now);
+
+	// point in time advance() needs to be called at next, std::nullopt if no timer is pending
+	[[nodiscard]] std::optional<Clock::time_point> nextExpiry() const;
+	[[nodiscard]] std::size_t size() const;
+
+  private:
+	static constexpr std::uint32_t c_bitsPerLevel = 6;
+	static constexpr std::uint32_t c_slotsPerLevel = 1 << c_bitsPerLevel;
+	static constexpr std::uint32_t c_numberOfLevels = 4;
+	static constexpr std::uint64_t c_slotMask = c_slotsPerLevel - 1;
+	static constexpr std::uint32_t c_numberOfSlots = c_slotsPerLevel * c_numberOfLevels;
+	static constexpr std::uint32_t c_expiredList = c_numberOfSlots; // timers about to fire
+	static constexpr std::uint32_t c_noEntry = UINT32_MAX;
+
+	struct Entry
+	{
+		std::uint64_t expiryTick { 0 };
+		std::function<void()> callback;
+		std::uint32_t generation { 1 }; // invalidates TimerIds of fired and cancelled timers
+		std::uint32_t list { c_noEntry };
+		std::uint32_t previous { c_noEntry };
+		std::uint32_t next { c_noEntry };
+	};
+
+	std::uint64_t tickOf(Clock::time_point timePoint, bool roundUp) const;
+	Clock::time_point timeOf(std::uint64_t tick) const;
+
+	void insert(std::uint32_t index);
+	void link(std::uint32_t index, std::uint32_t list);
+	void unlink(std::uint32_t index);
+	void cascade(std::uint32_t level);
+	void release(std::uint32_t index);
+
+	const std::chrono::milliseconds m_resolution;
+	const Clock::time_point m_start;
+	std::uint64_t m_currentTick { 0 };
+
+	std::vector<Entry> m_entries;
+	std::vector<std::uint32_t> m_freeEntries;
+	std::array<std::uint32_t, c_numberOfSlots + 1> m_heads; // first entry of each list
+	std::array<std::size_t, c_numberOfLevels> m_levelSizes;
+	std::size_t m_size { 0 };
+};
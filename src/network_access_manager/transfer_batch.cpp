@@ -0,0 +1,167 @@
+#include "transfer_batch.h"
+#include <spdlog/spdlog.h>
+
+TransferBatch::TransferBatch(const INetworkAccessManager &networkAccessManager, TransferBatchOptions options)
+	: m_networkAccessManager{networkAccessManager}
+	, m_options{options}
+{
+	if (m_options.maxConcurrentTransfers == 0) {
+		spdlog::warn("TransferBatch::TransferBatch() - maxConcurrentTransfers must not be zero, using 1 instead");
+		m_options.maxConcurrentTransfers = 1;
+	}
+}
+
+TransferBatch::~TransferBatch()
+{
+	if (m_state == State::RUNNING) {
+		unregisterRunningTransfers(CURLE_ABORTED_BY_CALLBACK);
+	}
+}
+
+bool TransferBatch::submit(std::vector<std::unique_ptr<AbstractTransferHandle>> transfers)
+{
+	spdlog::debug("TransferBatch::submit() - {} transfers", transfers.size());
+
+	if (m_state == State::RUNNING) {
+		spdlog::error("TransferBatch::submit() - Batch is already running.");
+		return true;
+	}
+
+	m_transfers = std::move(transfers);
+	m_results.assign(m_transfers.size(), CURLE_OK);
+	m_isRunning.assign(m_transfers.size(), false);
+	m_nextQueuedTransfer = 0;
+	m_numberOfRunningTransfers = 0;
+
+	for (std::size_t i = 0; i < m_transfers.size(); ++i) {
+		m_transfers[i]->finished.connect([this, i](int result) { onTransferFinished(i, result); });
+	}
+
+	numberOfFinishedTransfers.set(0);
+	numberOfFailedTransfers.set(0);
+	totalNumberOfTransfers.set(m_transfers.size());
+
+	m_state = State::RUNNING;
+	startQueuedTransfers();
+	return false;
+}
+
+void TransferBatch::cancel()
+{
+	spdlog::debug("TransferBatch::cancel()");
+
+	if (m_state != State::RUNNING) {
+		return;
+	}
+
+	unregisterRunningTransfers(CURLE_ABORTED_BY_CALLBACK);
+	finish();
+}
+
+std::size_t TransferBatch::size() const
+{
+	return m_transfers.size();
+}
+
+AbstractTransferHandle &TransferBatch::transfer(std::size_t index) const
+{
+	return *m_transfers.at(index);
+}
+
+const std::vector<CURLcode> &TransferBatch::results() const
+{
+	return m_results;
+}
+
+void TransferBatch::startQueuedTransfers()
+{
+	while ((m_numberOfRunningTransfers < m_options.maxConcurrentTransfers) && (m_nextQueuedTransfer < m_transfers.size())) {
+		const auto index = m_nextQueuedTransfer++;
+		const auto hasError = m_networkAccessManager.registerTransfer(*m_transfers[index]);
+		if (hasError) {
+			const auto cancel = recordResultAndCheckForCancellation(index, CURLE_FAILED_INIT);
+			if (cancel) {
+				unregisterRunningTransfers(CURLE_ABORTED_BY_CALLBACK);
+				break;
+			}
+			continue;
+		}
+		m_isRunning[index] = true;
+		++m_numberOfRunningTransfers;
+	}
+
+	if ((m_numberOfRunningTransfers == 0) && (m_nextQueuedTransfer == m_transfers.size())) {
+		finish();
+	}
+}
+
+void TransferBatch::onTransferFinished(std::size_t index, int result)
+{
+	if ((m_state != State::RUNNING) || !m_isRunning[index]) {
+		return;
+	}
+
+	m_isRunning[index] = false;
+	--m_numberOfRunningTransfers;
+
+	const auto cancel = recordResultAndCheckForCancellation(index, static_cast<CURLcode>(result));
+	if (cancel) {
+		spdlog::debug("TransferBatch::onTransferFinished() - transfer {} failed, cancelling remaining transfers", index);
+		unregisterRunningTransfers(CURLE_ABORTED_BY_CALLBACK);
+	}
+
+	startQueuedTransfers();
+}
+
+bool TransferBatch::recordResultAndCheckForCancellation(std::size_t index, CURLcode result)
+{
+	m_results[index] = result;
+
+	const auto hasFailed = (result != CURLE_OK);
+	if (hasFailed) {
+		numberOfFailedTransfers.set(numberOfFailedTransfers.get() + 1);
+	}
+	numberOfFinishedTransfers.set(numberOfFinishedTransfers.get() + 1);
+
+	return hasFailed && m_options.cancelOnFirstError;
+}
+
+void TransferBatch::unregisterRunningTransfers(CURLcode resultOfUnfinishedTransfers)
+{
+	auto numberOfUnfinishedTransfers = std::size_t(0);
+
+	for (std::size_t i = 0; i < m_transfers.size(); ++i) {
+		if (m_isRunning[i]) {
+			m_networkAccessManager.unregisterTransfer(*m_transfers[i]);
+			m_isRunning[i] = false;
+			m_results[i] = resultOfUnfinishedTransfers;
+			++numberOfUnfinishedTransfers;
+		}
+	}
+
+	for (std::size_t i = m_nextQueuedTransfer; i < m_transfers.size(); ++i) {
+		m_results[i] = resultOfUnfinishedTransfers;
+		++numberOfUnfinishedTransfers;
+	}
+
+	m_numberOfRunningTransfers = 0;
+	m_nextQueuedTransfer = m_transfers.size();
+
+	if (numberOfUnfinishedTransfers > 0) {
+		numberOfFailedTransfers.set(numberOfFailedTransfers.get() + numberOfUnfinishedTransfers);
+		numberOfFinishedTransfers.set(numberOfFinishedTransfers.get() + numberOfUnfinishedTransfers);
+	}
+}
+
+void TransferBatch::finish()
+{
+	spdlog::debug("TransferBatch::finish() - {} of {} transfers failed", numberOfFailedTransfers.get(), totalNumberOfTransfers.get());
+
+	m_state = State::FINISHED;
+	finished.emit(m_results);
+}
+
+int TransferBatch::calculateFinishedTransfersPercent(std::size_t numberOfFinishedTransfers, std::size_t totalNumberOfTransfers)
+{
+	return totalNumberOfTransfers ? static_cast<int>((100 * numberOfFinishedTransfers) / totalNumberOfTransfers) : 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "network_access_manager.h"
+#include <kdbindings/binding.h>
+#include <memory>
+#include <vector>
+
+using namespace KDBindings;
+
+struct TransferBatchOptions
+{
+	std::size_t maxConcurrentTransfers { 8 };
+	bool cancelOnFirstError { false };
+};
+
+/*
+ * Class: TransferBatch
+ *
+ * Registers many transfers with one call and reports their completion once.
+ * At most maxConcurrentTransfers transfers are registered with the
+ * NetworkAccessManager at any time, the remaining ones are queued and
+ * registered as soon as running transfers finish.
+ * The batch owns all transfer handles submitted to it.
+ * Do not delete a batch from within its finished signal, use deleteLater() instead.
+ */
+class TransferBatch : public Object
+{
+  public:
+	explicit TransferBatch(const INetworkAccessManager &networkAccessManager, TransferBatchOptions options = {});
+	~TransferBatch();
+
+	TransferBatch(const TransferBatch&) = delete;
+	TransferBatch &operator=(const TransferBatch&) = delete;
+
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool submit(std::vector<std::unique_ptr<AbstractTransferHandle>> transfers);
+	void cancel();
+
+	[[nodiscard]] std::size_t size() const;
+	[[nodiscard]] AbstractTransferHandle &transfer(std::size_t index) const;
+	[[nodiscard]] const std::vector<CURLcode> &results() const;
+
+	Property<std::size_t> numberOfFinishedTransfers { 0 };
+	Property<std::size_t> numberOfFailedTransfers { 0 };
+	Property<std::size_t> totalNumberOfTransfers { 0 };
+
+	// share of finished transfers, regardless of their sizes
+	Property<int> finishedTransfersPercent = makeBoundProperty(calculateFinishedTransfersPercent, numberOfFinishedTransfers, totalNumberOfTransfers);
+
+	// emitted once, after the last transfer of the batch finished or the batch got cancelled
+	KDBindings::Signal<const std::vector<CURLcode> & /*results*/> finished;
+
+  private:
+	enum class State {
+		IDLE,
+		RUNNING,
+		FINISHED
+	};
+
+	void startQueuedTransfers();
+	void onTransferFinished(std::size_t index, int result);
+	bool recordResultAndCheckForCancellation(std::size_t index, CURLcode result);
+	void unregisterRunningTransfers(CURLcode resultOfUnfinishedTransfers);
+	void finish();
+
+	static int calculateFinishedTransfersPercent(std::size_t numberOfFinishedTransfers, std::size_t totalNumberOfTransfers);
+
+	const INetworkAccessManager &m_networkAccessManager;
+	TransferBatchOptions m_options;
+
+	std::vector<std::unique_ptr<AbstractTransferHandle>> m_transfers;
+	std::vector<CURLcode> m_results;
+	std::vector<bool> m_isRunning;
+	std::size_t m_nextQueuedTransfer { 0 };
+	std::size_t m_numberOfRunningTransfers { 0 };
+	State m_state { State::IDLE };
+};
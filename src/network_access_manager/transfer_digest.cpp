@@ -0,0 +1,351 @@
+#include "transfer_digest.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TRANSFER_DIGEST_X86_64
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define TRANSFER_DIGEST_ARM_CRC32
+#include <arm_acle.h>
+#endif
+
+namespace {
+
+// --- CRC-32C ---
+
+constexpr std::uint32_t c_crc32cPolynomial = 0x82F63B78; // reflected 0x1EDC6F41
+
+// c_crc32cTables[k][b] is the CRC of byte b followed by k zero bytes
+constexpr auto c_crc32cTables = []() {
+	std::array<std::array<std::uint32_t, 256>, 8> tables {};
+	for (std::uint32_t b = 0; b < 256; ++b) {
+		auto crc = b;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc >> 1) ^ ((crc & 1) ? c_crc32cPolynomial : 0);
+		}
+		tables[0][b] = crc;
+	}
+	for (std::size_t k = 1; k < tables.size(); ++k) {
+		for (std::uint32_t b = 0; b < 256; ++b) {
+			tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+		}
+	}
+	return tables;
+}();
+
+std::uint32_t crc32cPortable(std::uint32_t crc, const std::uint8_t *data, std::size_t size)
+{
+	const auto &t = c_crc32cTables;
+	for (; size >= 8; data += 8, size -= 8) {
+		const auto low = crc ^ (std::uint32_t(data[0]) | (std::uint32_t(data[1]) << 8) | (std::uint32_t(data[2]) << 16) | (std::uint32_t(data[3]) << 24));
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+			^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+	}
+	for (; size > 0; ++data, --size) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	}
+	return crc;
+}
+
+#if defined(TRANSFER_DIGEST_X86_64)
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cSse42(std::uint32_t crc, const std::uint8_t *data, std::size_t size)
+{
+	std::uint64_t crc64 = crc;
+	for (; size >= 8; data += 8, size -= 8) {
+		std::uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	crc = static_cast<std::uint32_t>(crc64);
+	for (; size > 0; ++data, --size) {
+		crc = _mm_crc32_u8(crc, *data);
+	}
+	return crc;
+}
+#endif
+
+#if defined(TRANSFER_DIGEST_ARM_CRC32)
+std::uint32_t crc32cArm(std::uint32_t crc, const std::uint8_t *data, std::size_t size)
+{
+	for (; size >= 8; data += 8, size -= 8) {
+		std::uint64_t word;
+		std::memcpy(&word, data, sizeof(word));
+		crc = __crc32cd(crc, word);
+	}
+	for (; size > 0; ++data, --size) {
+		crc = __crc32cb(crc, *data);
+	}
+	return crc;
+}
+#endif
+
+using Crc32cFunction = std::uint32_t (*)(std::uint32_t, const std::uint8_t*, std::size_t);
+
+Crc32cFunction selectCrc32cFunction()
+{
+#if defined(TRANSFER_DIGEST_ARM_CRC32)
+	return crc32cArm;
+#else
+#if defined(TRANSFER_DIGEST_X86_64)
+	if (__builtin_cpu_supports("sse4.2")) {
+		return crc32cSse42;
+	}
+#endif
+	return crc32cPortable;
+#endif
+}
+
+// --- SHA-256 ---
+
+alignas(16) constexpr std::uint32_t c_sha256RoundConstants[64] = {
+	0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+	0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+	0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+	0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+	0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+	0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+	0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+	0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+constexpr std::uint32_t rotateRight(std::uint32_t value, int bits)
+{
+	return (value >> bits) | (value << (32 - bits));
+}
+
+void sha256CompressPortable(std::uint32_t *state, const std::uint8_t *blocks, std::size_t numberOfBlocks)
+{
+	for (; numberOfBlocks > 0; blocks += 64, --numberOfBlocks) {
+		std::uint32_t w[64];
+		for (int i = 0; i < 16; ++i) {
+			w[i] = (std::uint32_t(blocks[4 * i]) << 24) | (std::uint32_t(blocks[4 * i + 1]) << 16) | (std::uint32_t(blocks[4 * i + 2]) << 8) | std::uint32_t(blocks[4 * i + 3]);
+		}
+		for (int i = 16; i < 64; ++i) {
+			const auto s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+			const auto s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+			w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+		}
+
+		auto a = state[0], b = state[1], c = state[2], d = state[3];
+		auto e = state[4], f = state[5], g = state[6], h = state[7];
+		for (int i = 0; i < 64; ++i) {
+			const auto t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) + c_sha256RoundConstants[i] + w[i];
+			const auto t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+#if defined(TRANSFER_DIGEST_X86_64)
+// the SHA extensions operate on the state as the register pairs ABEF and CDGH, four rounds per message word group
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256CompressShaNi(std::uint32_t *state, const std::uint8_t *blocks, std::size_t numberOfBlocks)
+{
+	const auto byteSwapMask = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+	auto dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1); // CDAB
+	auto hgfe = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B); // EFGH
+	auto abef = _mm_alignr_epi8(dcba, hgfe, 8);
+	auto cdgh = _mm_blend_epi16(hgfe, dcba, 0xF0);
+
+	for (; numberOfBlocks > 0; blocks += 64, --numberOfBlocks) {
+		const auto abefSaved = abef;
+		const auto cdghSaved = cdgh;
+
+		__m128i words[4];
+		for (int i = 0; i < 4; ++i) {
+			words[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + 16 * i)), byteSwapMask);
+		}
+
+		for (int group = 0; group < 16; ++group) {
+			auto &w = words[group % 4];
+			auto message = _mm_add_epi32(w, _mm_load_si128(reinterpret_cast<const __m128i*>(&c_sha256RoundConstants[4 * group])));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, message);
+			message = _mm_shuffle_epi32(message, 0x0E);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, message);
+
+			// message words of group + 4 from the ones of group ... group + 3
+			if (group < 12) {
+				const auto &w1 = words[(group + 1) % 4];
+				const auto &w2 = words[(group + 2) % 4];
+				const auto &w3 = words[(group + 3) % 4];
+				w = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w, w1), _mm_alignr_epi8(w3, w2, 4)), w3);
+			}
+		}
+
+		abef = _mm_add_epi32(abef, abefSaved);
+		cdgh = _mm_add_epi32(cdgh, cdghSaved);
+	}
+
+	const auto feba = _mm_shuffle_epi32(abef, 0x1B);
+	const auto dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(feba, dchg, 0xF0));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(dchg, feba, 8));
+}
+#endif
+
+using Sha256CompressFunction = void (*)(std::uint32_t*, const std::uint8_t*, std::size_t);
+
+Sha256CompressFunction selectSha256CompressFunction()
+{
+#if defined(TRANSFER_DIGEST_X86_64)
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+		return sha256CompressShaNi;
+	}
+#endif
+	return sha256CompressPortable;
+}
+
+// CPU features are detected once, on first use
+std::uint32_t crc32c(std::uint32_t crc, const std::uint8_t *data, std::size_t size)
+{
+	static const auto s_function = selectCrc32cFunction();
+	return s_function(crc, data, size);
+}
+
+void sha256Compress(std::uint32_t *state, const std::uint8_t *blocks, std::size_t numberOfBlocks)
+{
+	static const auto s_function = selectSha256CompressFunction();
+	s_function(state, blocks, numberOfBlocks);
+}
+
+}
+
+void Crc32c::update(const void *data, std::size_t size)
+{
+	m_state = crc32c(m_state, static_cast<const std::uint8_t*>(data), size);
+}
+
+std::uint32_t Crc32c::value() const
+{
+	return ~m_state;
+}
+
+Sha256::Sha256()
+	: m_state{ 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 }
+{
+}
+
+void Sha256::update(const void *data, std::size_t size)
+{
+	auto bytes = static_cast<const std::uint8_t*>(data);
+	auto numberOfBufferedBytes = static_cast<std::size_t>(m_numberOfBytes % m_block.size());
+	m_numberOfBytes += size;
+
+	if (numberOfBufferedBytes > 0) {
+		const auto n = std::min(size, m_block.size() - numberOfBufferedBytes);
+		std::memcpy(m_block.data() + numberOfBufferedBytes, bytes, n);
+		bytes += n;
+		size -= n;
+		numberOfBufferedBytes += n;
+		if (numberOfBufferedBytes < m_block.size()) {
+			return;
+		}
+		sha256Compress(m_state.data(), m_block.data(), 1);
+	}
+
+	// whole blocks are hashed right from the caller's buffer
+	const auto numberOfBlocks = size / m_block.size();
+	if (numberOfBlocks > 0) {
+		sha256Compress(m_state.data(), bytes, numberOfBlocks);
+		bytes += numberOfBlocks * m_block.size();
+		size -= numberOfBlocks * m_block.size();
+	}
+	std::memcpy(m_block.data(), bytes, size);
+}
+
+Sha256::Digest Sha256::digest() const
+{
+	// padding: 0x80, zeros up to 56 mod 64, length in bits (big endian)
+	auto state = m_state;
+	std::array<std::uint8_t, 128> padding {};
+	const auto numberOfBufferedBytes = static_cast<std::size_t>(m_numberOfBytes % m_block.size());
+	const auto paddedSize = (numberOfBufferedBytes < 56) ? std::size_t(64) : std::size_t(128);
+	std::memcpy(padding.data(), m_block.data(), numberOfBufferedBytes);
+	padding[numberOfBufferedBytes] = 0x80;
+	const auto numberOfBits = m_numberOfBytes * 8;
+	for (int i = 0; i < 8; ++i) {
+		padding[paddedSize - 1 - i] = static_cast<std::uint8_t>(numberOfBits >> (8 * i));
+	}
+	sha256Compress(state.data(), padding.data(), paddedSize / 64);
+
+	Digest digest;
+	for (std::size_t i = 0; i < state.size(); ++i) {
+		digest[4 * i] = static_cast<std::uint8_t>(state[i] >> 24);
+		digest[4 * i + 1] = static_cast<std::uint8_t>(state[i] >> 16);
+		digest[4 * i + 2] = static_cast<std::uint8_t>(state[i] >> 8);
+		digest[4 * i + 3] = static_cast<std::uint8_t>(state[i]);
+	}
+	return digest;
+}
+
+TransferDigest::TransferDigest(Algorithm algorithm)
+{
+	if (algorithm == Algorithm::CRC32C) {
+		m_hash.emplace<Crc32c>();
+	}
+}
+
+TransferDigest::Algorithm TransferDigest::algorithm() const
+{
+	return std::holds_alternative<Sha256>(m_hash) ? Algorithm::SHA256 : Algorithm::CRC32C;
+}
+
+void TransferDigest::update(const void *data, std::size_t size)
+{
+	std::visit([data, size](auto &hash) { hash.update(data, size); }, m_hash);
+}
+
+std::string TransferDigest::hexDigest() const
+{
+	static constexpr char c_hexDigits[] = "0123456789abcdef";
+
+	std::string hexDigest;
+	const auto appendByte = [&hexDigest](std::uint8_t byte) {
+		hexDigest.push_back(c_hexDigits[byte >> 4]);
+		hexDigest.push_back(c_hexDigits[byte & 0xF]);
+	};
+
+	if (const auto sha256 = std::get_if<Sha256>(&m_hash)) {
+		std::ranges::for_each(sha256->digest(), appendByte);
+	}
+	else {
+		const auto crc = std::get<Crc32c>(m_hash).value();
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			appendByte(static_cast<std::uint8_t>(crc >> shift));
+		}
+	}
+	return hexDigest;
+}
+
+bool TransferDigest::matches(std::string_view expectedHexDigest) const
+{
+	return std::ranges::equal(hexDigest(), expectedHexDigest, [](char c, char expectedChar) {
+		return c == std::tolower(static_cast<unsigned char>(expectedChar));
+	});
+}
+
+std::string_view TransferDigest::nameOf(Algorithm algorithm)
+{
+	return (algorithm == Algorithm::SHA256) ? "SHA-256" : "CRC-32C";
+}
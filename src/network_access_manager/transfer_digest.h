@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <variant>
+
+/*
+ * Class: Crc32c
+ *
+ * Streaming CRC-32C (Castagnoli), as used by e.g. iSCSI, ext4 and cloud storage services.
+ * Uses the CRC32 instructions of SSE 4.2 (x86-64, detected at runtime) or ARMv8
+ * (if compiled for a CPU having them), and a slicing-by-8 table lookup otherwise.
+ */
+class Crc32c
+{
+  public:
+	void update(const void *data, std::size_t size);
+	[[nodiscard]] std::uint32_t value() const;
+
+  private:
+	std::uint32_t m_state { 0xFFFFFFFF };
+};
+
+/*
+ * Class: Sha256
+ *
+ * Streaming SHA-256 (FIPS 180-4). Uses the SHA extensions of x86-64 CPUs if available
+ * (detected at runtime), and a portable implementation otherwise.
+ */
+class Sha256
+{
+  public:
+	using Digest = std::array<std::uint8_t, 32>;
+
+	Sha256();
+
+	void update(const void *data, std::size_t size);
+	// the digest of all data passed so far, update() may be called afterwards
+	[[nodiscard]] Digest digest() const;
+
+  private:
+	std::array<std::uint32_t, 8> m_state;
+	std::array<std::uint8_t, 64> m_block;
+	std::uint64_t m_numberOfBytes { 0 };
+};
+
+/*
+ * Class: TransferDigest
+ *
+ * Digest of the data of a transfer, computed while it passes the transfer's read and write
+ * callbacks, see AbstractTransferHandle::setExpectedDigest(). Verifying a download this way
+ * does not need to read the file again.
+ */
+class TransferDigest
+{
+  public:
+	enum class Algorithm {
+		SHA256,
+		CRC32C
+	};
+
+	explicit TransferDigest(Algorithm algorithm);
+
+	[[nodiscard]] Algorithm algorithm() const;
+
+	void update(const void *data, std::size_t size);
+
+	// lower case hex digits, CRC-32C in big endian byte order (as e.g. "crc32c" checksums are usually printed)
+	[[nodiscard]] std::string hexDigest() const;
+	// case insensitive
+	[[nodiscard]] bool matches(std::string_view expectedHexDigest) const;
+
+	static std::string_view nameOf(Algorithm algorithm);
+
+  private:
+	std::variant<Sha256, Crc32c> m_hash;
+};
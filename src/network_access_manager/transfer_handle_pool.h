@@ -0,0 +1,142 @@
+#pragma once
+
+#include "network_access_manager.h"
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <utility>
+#include <vector>
+
+/*
+ * Class: AbstractTransferHandlePool
+ *
+ * Type independent part of TransferHandlePool, which lets a transfer handle
+ * return to its pool without knowing the pool's handle type.
+ */
+class AbstractTransferHandlePool
+{
+	friend class AbstractTransferHandle;
+
+  protected:
+	virtual ~AbstractTransferHandlePool() = default;
+
+	virtual void recycle(AbstractTransferHandle &transfer) = 0;
+
+	static void attach(AbstractTransferHandle &transfer, AbstractTransferHandlePool *pool, std::size_t index) {
+		transfer.m_pool = pool;
+		transfer.m_poolIndex = index;
+	}
+
+	static bool isAttachedTo(const AbstractTransferHandle &transfer, const AbstractTransferHandlePool *pool) { return transfer.m_pool == pool; }
+	static std::size_t indexOf(const AbstractTransferHandle &transfer) { return transfer.m_poolIndex; }
+};
+
+/*
+ * Class: TransferHandlePool
+ *
+ * Recycles transfer handles of type TransferHandle instead of allocating and
+ * deleting a handle per transfer.
+ * start() takes an idle handle, prepares it for the next transfer via
+ * TransferHandle::reuse() (or creates a new handle if none is idle) and registers
+ * it with the NetworkAccessManager. Once the handle emitted finished, it returns
+ * to the pool. Up to maxNumberOfIdleHandles handles are kept for reuse, surplus
+ * ones are deleted. Reusing the libcurl easy handle additionally keeps its
+ * connections, DNS cache and TLS session IDs alive for the next transfer.
+ *
+ * The pool owns all handles. Do not keep pointers to a handle after it emitted
+ * finished and do not delete a pool from within the finished signal of one of its handles.
+ * Slots connected to finished are disconnected when a handle gets reused,
+ * connections to other signals or properties of a handle have to be
+ * disconnected by their owner.
+ */
+template<typename TransferHandle>
+class TransferHandlePool : public AbstractTransferHandlePool
+{
+  public:
+	explicit TransferHandlePool(const INetworkAccessManager &networkAccessManager, std::size_t maxNumberOfIdleHandles = 8)
+		: m_networkAccessManager{networkAccessManager}
+		, m_maxNumberOfIdleHandles{maxNumberOfIdleHandles}
+	{
+	}
+
+	~TransferHandlePool()
+	{
+		for (auto &transfer : m_activeHandles) {
+			attach(*transfer, nullptr, 0);
+			m_networkAccessManager.unregisterTransfer(*transfer);
+		}
+	}
+
+	TransferHandlePool(const TransferHandlePool&) = delete;
+	TransferHandlePool &operator=(const TransferHandlePool&) = delete;
+
+	// arguments are those of TransferHandle's constructor,
+	// returns nullptr in case of error (the handle is returned to the pool right away)
+	template<typename... Args>
+	TransferHandle *start(Args&&... args)
+	{
+		std::unique_ptr<TransferHandle> transfer;
+		if (m_idleHandles.empty()) {
+			transfer = std::make_unique<TransferHandle>(std::forward<Args>(args)...);
+		}
+		else {
+			transfer = std::move(m_idleHandles.back());
+			m_idleHandles.pop_back();
+			transfer->reuse(std::forward<Args>(args)...);
+		}
+
+		auto &activeTransfer = *transfer;
+		attach(activeTransfer, this, m_activeHandles.size());
+		m_activeHandles.push_back(std::move(transfer));
+
+		const auto hasError = m_networkAccessManager.registerTransfer(activeTransfer);
+		if (hasError) {
+			recycle(activeTransfer);
+			return nullptr;
+		}
+		return &activeTransfer;
+	}
+
+	// unregisters a running transfer, which does not emit finished then, and returns it to the pool
+	void cancel(TransferHandle &transfer)
+	{
+		if (!isAttachedTo(transfer, this)) {
+			spdlog::warn("TransferHandlePool::cancel() - transfer is not running in this pool");
+			return;
+		}
+		m_networkAccessManager.unregisterTransfer(transfer);
+		recycle(transfer);
+	}
+
+	[[nodiscard]] std::size_t numberOfIdleHandles() const { return m_idleHandles.size(); }
+	[[nodiscard]] std::size_t numberOfActiveHandles() const { return m_activeHandles.size(); }
+
+  protected:
+	void recycle(AbstractTransferHandle &transfer) override
+	{
+		const auto index = indexOf(transfer);
+		if (!isAttachedTo(transfer, this) || (index >= m_activeHandles.size()) || (m_activeHandles[index].get() != &transfer)) {
+			spdlog::error("TransferHandlePool::recycle() - transfer does not belong to this pool");
+			return;
+		}
+
+		// swap with the last active handle to remove in constant time
+		auto recycledTransfer = std::move(m_activeHandles[index]);
+		if (index + 1 < m_activeHandles.size()) {
+			m_activeHandles[index] = std::move(m_activeHandles.back());
+			attach(*m_activeHandles[index], this, index);
+		}
+		m_activeHandles.pop_back();
+
+		attach(*recycledTransfer, nullptr, 0);
+		if (m_idleHandles.size() < m_maxNumberOfIdleHandles) {
+			m_idleHandles.push_back(std::move(recycledTransfer));
+		}
+	}
+
+  private:
+	const INetworkAccessManager &m_networkAccessManager;
+	const std::size_t m_maxNumberOfIdleHandles;
+
+	std::vector<std::unique_ptr<TransferHandle>> m_idleHandles;
+	std::vector<std::unique_ptr<TransferHandle>> m_activeHandles;
+};
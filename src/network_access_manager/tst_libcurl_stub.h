@@ -18,14 +18,23 @@ DEFINE_FFF_GLOBALS;
 FAKE(curl_global_init) \
 	FAKE(curl_easy_init) \
 	FAKE(curl_easy_cleanup) \
+	FAKE(curl_easy_reset) \
 	FAKE(curl_easy_setopt) \
 	FAKE(curl_easy_getinfo) \
+	FAKE(curl_easy_pause) \
+	FAKE(curl_slist_append) \
+	FAKE(curl_slist_free_all) \
 	FAKE(curl_multi_init) \
 	FAKE(curl_multi_setopt) \
 	FAKE(curl_multi_add_handle) \
 	FAKE(curl_multi_remove_handle) \
 	FAKE(curl_multi_socket_action) \
-	FAKE(curl_multi_info_read)
+	FAKE(curl_multi_info_read) \
+	FAKE(curl_share_init) \
+	FAKE(curl_share_setopt) \
+	FAKE(curl_share_cleanup) \
+	FAKE(curl_ws_meta) \
+	FAKE(curl_ws_send)
 
 // Declare and define curl_global fakes
 FAKE_VALUE_FUNC(CURLcode, curl_global_init, long);
@@ -33,8 +42,14 @@ FAKE_VALUE_FUNC(CURLcode, curl_global_init, long);
 // Declare and define curl_easy fakes
 FAKE_VALUE_FUNC(CURL*, curl_easy_init);
 FAKE_VOID_FUNC(curl_easy_cleanup, CURL*);
+FAKE_VOID_FUNC(curl_easy_reset, CURL*);
 FAKE_VALUE_FUNC_VARARG(CURLcode, curl_easy_setopt, CURL*, CURLoption, ...);
 FAKE_VALUE_FUNC_VARARG(CURLcode, curl_easy_getinfo, CURL*, CURLINFO, ...);
+FAKE_VALUE_FUNC(CURLcode, curl_easy_pause, CURL*, int);
+
+// Declare and define curl_slist fakes
+FAKE_VALUE_FUNC(curl_slist*, curl_slist_append, curl_slist*, const char*);
+FAKE_VOID_FUNC(curl_slist_free_all, curl_slist*);
 
 // Declare and define curl_multi fakes
 FAKE_VALUE_FUNC(CURLM*, curl_multi_init);
@@ -44,6 +59,15 @@ FAKE_VALUE_FUNC(CURLMcode, curl_multi_remove_handle, CURLM*, CURL*);
 FAKE_VALUE_FUNC(CURLMcode, curl_multi_socket_action, CURLM*, curl_socket_t, int, int*);
 FAKE_VALUE_FUNC(CURLMsg*, curl_multi_info_read, CURLM*,int*);
 
+// Declare and define curl_share fakes
+FAKE_VALUE_FUNC(CURLSH*, curl_share_init);
+FAKE_VALUE_FUNC_VARARG(CURLSHcode, curl_share_setopt, CURLSH*, CURLSHoption, ...);
+FAKE_VALUE_FUNC(CURLSHcode, curl_share_cleanup, CURLSH*);
+
+// Declare and define curl_ws fakes
+FAKE_VALUE_FUNC(curl_ws_frame*, curl_ws_meta, CURL*);
+FAKE_VALUE_FUNC(CURLcode, curl_ws_send, CURL*, const void*, size_t, size_t*, curl_off_t, unsigned int);
+
 // Provide function to reset fakes
 // and common FFF internal structures
 void fff_setup()
@@ -11,7 +11,7 @@
  * and is implemented in tst_libcurl_stub.h
  *
  * Additionally to the libcurl stub we use NetworkAccessManagerUnitTestHarness
- * to be able to
+ * (see tst_network_access_manager_harness.h) to be able to
  * - invoke callbacks, that would otherwise be invoked by libcurl
  * - access a few private members of NetworkAccessManager to do
  *   white box testing
@@ -19,12 +19,30 @@
  */
 
 #include <KDFoundation/core_application.h>
+#include "ftp_batch_transfer.h"
+#include "ftp_directory_index.h"
+#include "ftp_mirror.h"
 #include "ftp_transfer_handle.h"
 #include "http_transfer_handle.h"
 #include "network_access_manager.h"
+#include "sse_transfer_handle.h"
+#include "transfer_batch.h"
+#include "transfer_handle_pool.h"
+#include "websocket_transfer_handle.h"
 #include "tst_libcurl_stub.h"
+#include "tst_network_access_manager_harness.h"
 
+#include <chrono>
+#include <cstring>
 #include <cstdarg>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sys/socket.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
 #include <unordered_map>
 #include <variant>
 
@@ -46,6 +64,17 @@ class AbstractTransferHandleUnitTestHarness
 	static void *errorBuffer(AbstractTransferHandle &transfer) { return &transfer.m_errorBuffer; }
 	static void *readCallback() { return (void*)(&AbstractTransferHandle::readCallback); }
 	static void *writeCallback() { return (void*)(&AbstractTransferHandle::writeCallback); }
+	static size_t write(AbstractTransferHandle &transfer, const std::string &data) { return AbstractTransferHandle::writeCallback(data.data(), 1, data.size(), &transfer); }
+	static size_t read(AbstractTransferHandle &transfer, char *buffer, size_t size) { return AbstractTransferHandle::readCallback(buffer, 1, size, &transfer); }
+	static void transferDone(AbstractTransferHandle &transfer, CURLcode result) { transfer.transferDoneCallback(result); }
+	static void reuse(AbstractTransferHandle &transfer, const Url &url) { transfer.reuse(url); }
+};
+
+class WebSocketTransferHandleUnitTestHarness
+{
+  public:
+	static void *headerCallback() { return (void*)(&WebSocketTransferHandle::headerCallback); }
+	static size_t header(WebSocketTransferHandle &transfer, const std::string &line) { return WebSocketTransferHandle::headerCallback(line.data(), 1, line.size(), &transfer); }
 };
 
 class GenericFtpTransferHandleUnitTest : public AbstractFtpTransferHandle
@@ -63,20 +92,7 @@ class AbstractFtpTransferHandleUnitTestHarness
   public:
 	static void *progressCallback() { return (void*)(&AbstractFtpTransferHandle::progressCallback); }
 	static void *file(AbstractFtpTransferHandle &transfer) { return transfer.m_file; }
-};
-
-class NetworkAccessManagerUnitTestHarness
-{
-  public:
-	static int socketCallback(CURL *handle, curl_socket_t socket, int eventType) {
-		return NetworkAccessManager::socketCallback(handle, socket, eventType, &NetworkAccessManager::instance(), nullptr);
-	}
-	static int timerCallback(CURLM *handle, long timeoutMs) {
-		return NetworkAccessManager::timerCallback(handle, timeoutMs, &NetworkAccessManager::instance().m_timeoutTimer);
-	}
-
-	const Timer &timeoutTimer() { return NetworkAccessManager::instance().m_timeoutTimer; }
-	NetworkAccessManager::FileDescriptorNotifierRegistry &fileDescriptorNotifierRegistry() { return NetworkAccessManager::instance().m_fdnRegistry; }
+	static int progress(AbstractFtpTransferHandle &transfer, curl_off_t dltotal, curl_off_t dlnow) { return AbstractFtpTransferHandle::progressCallback(&transfer, dltotal, dlnow, 0, 0); }
 };
 
 
@@ -161,6 +177,8 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 		curl_easy_setopt_fake.custom_fake = [&](CURL*, CURLoption option, va_list param) -> CURLcode {
 			switch (option) {
 			case CURLOPT_URL:
+			case CURLOPT_UNIX_SOCKET_PATH:
+			case CURLOPT_ABSTRACT_UNIX_SOCKET:
 				curl_easy_setopt_fake_arg3_history[option] = std::string(va_arg(param,char*));
 				break;
 			case CURLOPT_VERBOSE:
@@ -371,6 +389,86 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 			REQUIRE(curl_easy_getinfo_fake.arg0_history[0] == dummyEasyHandlePtr);
 			REQUIRE(curl_easy_getinfo_fake.arg1_history[0] == CURLINFO_PRIVATE);
 		}
+
+		SUBCASE("AbstractTransferHandle connects via TCP for URLs without Unix socket")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+			// WHEN
+			auto transfer = GenericTransferHandleUnitTest(Url("http://localhost:8080/status"));
+
+			// THEN
+			REQUIRE(transfer.unixSocketPath().empty());
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "http://localhost:8080/status");
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_UNIX_SOCKET_PATH));
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_ABSTRACT_UNIX_SOCKET));
+		}
+
+		SUBCASE("AbstractTransferHandle connects via Unix socket path for +unix URLs")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			const auto unixSocketUrl = AbstractTransferHandle::unixSocketUrl("/run/my daemon.sock", "/v1/status?verbose=1");
+			REQUIRE(unixSocketUrl.url() == "http+unix://%2Frun%2Fmy%20daemon.sock/v1/status?verbose=1");
+
+			// WHEN
+			auto transfer = GenericTransferHandleUnitTest(unixSocketUrl);
+
+			// THEN
+			REQUIRE(transfer.unixSocketPath() == "/run/my daemon.sock");
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "http://localhost/v1/status?verbose=1");
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_UNIX_SOCKET_PATH]) == "/run/my daemon.sock");
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_ABSTRACT_UNIX_SOCKET));
+		}
+
+		SUBCASE("AbstractTransferHandle connects via abstract Unix socket for +unix URLs starting with @")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+			// WHEN
+			auto transfer = GenericTransferHandleUnitTest(AbstractTransferHandle::unixSocketUrl("@daemon", "events", "ws"));
+
+			// THEN
+			REQUIRE(transfer.url().url() == "ws+unix://%40daemon/events");
+			REQUIRE(transfer.unixSocketPath() == "@daemon");
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "ws://localhost/events");
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_ABSTRACT_UNIX_SOCKET]) == "daemon");
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_UNIX_SOCKET_PATH));
+		}
+
+		SUBCASE("AbstractTransferHandle passes invalid Unix socket URLs to libcurl unchanged")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+			// WHEN
+			auto transfer = GenericTransferHandleUnitTest(Url("http+unix://%2Frun%2/status"));
+
+			// THEN
+			REQUIRE(transfer.unixSocketPath().empty());
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "http+unix://%2Frun%2/status");
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_UNIX_SOCKET_PATH));
+		}
+
+		SUBCASE("AbstractTransferHandle reused for a TCP URL no longer uses the Unix socket")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = GenericTransferHandleUnitTest(AbstractTransferHandle::unixSocketUrl("/run/daemon.sock"));
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "http://localhost/");
+			curl_easy_setopt_fake_arg3_history.clear();
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::reuse(transfer, Url("https://www.example.com/"));
+
+			// THEN
+			REQUIRE(curl_easy_reset_fake.call_count == 1);
+			REQUIRE(transfer.unixSocketPath().empty());
+			REQUIRE(std::get<std::string>(curl_easy_setopt_fake_arg3_history[CURLOPT_URL]) == "https://www.example.com/");
+			REQUIRE_FALSE(curl_easy_setopt_fake_arg3_history.contains(CURLOPT_UNIX_SOCKET_PATH));
+		}
 	}
 
 	TEST_CASE("HttpTransferHandle")
@@ -416,6 +514,115 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 			const auto arg3_noProgress = std::get<long>(curl_easy_setopt_fake_arg3_history[CURLOPT_NOPROGRESS]);
 			REQUIRE(arg3_noProgress == 1L);
 		}
+
+		SUBCASE("HttpTransferHandle stores all data delivered by write callback")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = HttpTransferHandle(url);
+			const auto chunk = std::string(100, 'x');
+
+			// WHEN
+			const auto written = AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+
+			// THEN
+			REQUIRE(written == chunk.size());
+			REQUIRE(transfer.dataRead() == chunk);
+			REQUIRE(transfer.numberOfBytesBuffered.get() == chunk.size());
+		}
+
+		SUBCASE("HttpTransferHandle without watermarks never pauses transfer")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = HttpTransferHandle(url);
+			const auto chunk = std::string(64 * 1024, 'x');
+
+			// WHEN
+			for (auto i = 0; i < 16; ++i) {
+				REQUIRE(AbstractTransferHandleUnitTestHarness::write(transfer, chunk) == chunk.size());
+			}
+
+			// THEN
+			REQUIRE_FALSE(transfer.isPaused());
+			REQUIRE(transfer.dataRead().size() == 16 * chunk.size());
+		}
+
+		SUBCASE("HttpTransferHandle pauses transfer when high watermark is reached")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = HttpTransferHandle(url);
+			transfer.setWatermarks(100, 200);
+			const auto chunk = std::string(150, 'x');
+
+			// WHEN
+			const auto firstWritten = AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+			const auto secondWritten = AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+			const auto thirdWritten = AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+
+			// THEN (the chunk exceeding the high watermark is taken, the next one is refused)
+			REQUIRE(firstWritten == chunk.size());
+			REQUIRE(secondWritten == chunk.size());
+			REQUIRE(thirdWritten == CURL_WRITEFUNC_PAUSE);
+			REQUIRE(transfer.isPaused());
+			REQUIRE(transfer.numberOfBytesBuffered.get() == 2 * chunk.size());
+			REQUIRE(curl_easy_pause_fake.call_count == 0);
+		}
+
+		SUBCASE("HttpTransferHandle resumes paused transfer when buffer is drained to low watermark")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = HttpTransferHandle(url);
+			transfer.setWatermarks(100, 200);
+			const auto chunk = std::string(200, 'x');
+			AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+			REQUIRE(AbstractTransferHandleUnitTestHarness::write(transfer, chunk) == CURL_WRITEFUNC_PAUSE);
+
+			// WHEN (buffer is still above low watermark)
+			const auto firstData = transfer.takeDataRead(50);
+
+			// THEN
+			REQUIRE(firstData.size() == 50);
+			REQUIRE(transfer.isPaused());
+			REQUIRE(curl_easy_pause_fake.call_count == 0);
+
+			// WHEN (buffer is drained to low watermark)
+			const auto secondData = transfer.takeDataRead(50);
+
+			// THEN
+			REQUIRE(secondData.size() == 50);
+			REQUIRE(transfer.numberOfBytesBuffered.get() == 100);
+			REQUIRE_FALSE(transfer.isPaused());
+			REQUIRE(curl_easy_pause_fake.call_count == 1);
+			REQUIRE(curl_easy_pause_fake.arg0_val == dummyEasyHandlePtr);
+			REQUIRE(curl_easy_pause_fake.arg1_val == CURLPAUSE_CONT);
+		}
+
+		SUBCASE("HttpTransferHandle returns data in order when taking it in parts while data arrives")
+		{
+			// GIVEN
+			curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+			auto transfer = HttpTransferHandle(url);
+			std::string writtenData;
+			std::string takenData;
+
+			// WHEN
+			for (auto i = 0; i < 100; ++i) {
+				const auto chunk = std::to_string(i) + ";";
+				AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+				writtenData += chunk;
+				takenData += transfer.takeDataRead(2);
+			}
+
+			// THEN
+			REQUIRE(transfer.numberOfBytesBuffered.get() == writtenData.size() - takenData.size());
+			REQUIRE(takenData + transfer.dataRead() == writtenData);
+			REQUIRE(takenData + transfer.takeDataRead() == writtenData);
+			REQUIRE(transfer.numberOfBytesBuffered.get() == 0);
+			REQUIRE(transfer.dataRead().empty());
+		}
 	}
 
 	TEST_CASE("FtpTransferHandles")
@@ -841,8 +1048,11 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 
 		const int socket = 0;
 
-		SUBCASE("When FileDescriptorNotifier fires, timeout timer is stopped")
+		SUBCASE("When FileDescriptorNotifier fires, timeout timer keeps running")
 		{
+			// libcurl only calls the timer callback if its next timeout changed,
+			// so the timer requested before must still expire
+
 			// GIVEN
 			unitTestHarness.timerCallback(dummyMultiHandlePtr, 1000);
 			unitTestHarness.socketCallback(dummyMultiHandlePtr, socket, CURL_POLL_IN);
@@ -853,7 +1063,7 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 			notifier->triggered.emit(socket);
 
 			// THEN
-			REQUIRE_FALSE(unitTestHarness.timeoutTimer().running.get());
+			REQUIRE(unitTestHarness.timeoutTimer().running.get());
 		}
 
 		SUBCASE("When FileDescriptorNotifier with type 'Read' fires, curl_multi_socket_action() is called")
@@ -989,5 +1199,1974 @@ TEST_SUITE("NetworkAccessManager and TransferHandles")
 			// THEN
 			REQUIRE_FALSE(transferIsRunning);
 		}
+
+		SUBCASE("Started, finished and running transfers and their duration are exported as metrics")
+		{
+			// GIVEN
+			auto &registry = MetricsRegistry::instance();
+			const auto numberOfStartedTransfers = registry.counter("nam_transfers_started", {}).value();
+			const auto numberOfSucceededTransfers = registry.counter("nam_transfers_finished", {}, { { "result", "ok" } }).value();
+			const auto numberOfDurations = registry.histogram("nam_transfer_duration_seconds", {}, {}).snapshot().count;
+			curl_easy_getinfo_fake.custom_fake = [&](CURL*, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					*va_arg(param, AbstractTransferHandle**) = &transfer;
+				}
+				else if (info == CURLINFO_TOTAL_TIME_T) {
+					*va_arg(param, curl_off_t*) = 1500000;
+				}
+				return CURLE_OK;
+			};
+			curl_multi_socket_action_fake.custom_fake = [](CURLM*, curl_socket_t, int, int *runningHandles) {
+				*runningHandles = 3;
+				return CURLM_OK;
+			};
+			networkAccessManager.registerTransfer(transfer);
+
+			// WHEN
+			unitTestHarness.timeoutTimer().timeout.emit();
+
+			// THEN
+			REQUIRE(registry.counter("nam_transfers_started", {}).value() == numberOfStartedTransfers + 1);
+			REQUIRE(registry.counter("nam_transfers_finished", {}, { { "result", "ok" } }).value() == numberOfSucceededTransfers + 1);
+			REQUIRE(registry.gauge("nam_transfers_running", {}).value() == 3);
+			REQUIRE(registry.histogram("nam_transfer_duration_seconds", {}, {}).snapshot().count == numberOfDurations + 1);
+
+			const auto exposition = registry.exposition();
+			REQUIRE(exposition.find("nam_transfers_finished_total{result=\"ok\"}") != std::string::npos);
+			REQUIRE(exposition.find("nam_transfer_duration_seconds_bucket{le=\"2.048\"}") != std::string::npos);
+		}
+	}
+
+	TEST_CASE("TimerWheel")
+	{
+		using namespace std::chrono_literals;
+		const auto start = TimerWheel::Clock::now();
+		TimerWheel wheel(1ms, start);
+
+		// advances the wheel from expiry to expiry like its owner does
+		auto runUntil = [&](TimerWheel::Clock::time_point end) {
+			auto nextExpiry = wheel.nextExpiry();
+			while (nextExpiry && (*nextExpiry <= end)) {
+				wheel.advance(*nextExpiry);
+				nextExpiry = wheel.nextExpiry();
+			}
+			wheel.advance(end);
+		};
+
+		SUBCASE("Timer fires once its deadline is reached")
+		{
+			// GIVEN
+			auto fired = false;
+			wheel.schedule(start + 5ms, [&fired]() { fired = true; });
+
+			// WHEN
+			const auto numberOfFiredTimersEarly = wheel.advance(start + 4ms);
+			const auto numberOfFiredTimers = wheel.advance(start + 5ms);
+
+			// THEN
+			REQUIRE(numberOfFiredTimersEarly == 0);
+			REQUIRE(numberOfFiredTimers == 1);
+			REQUIRE(fired);
+			REQUIRE(wheel.size() == 0);
+			REQUIRE_FALSE(wheel.nextExpiry().has_value());
+		}
+
+		SUBCASE("Timers of all levels fire in order and not before their deadline")
+		{
+			// GIVEN
+			const std::vector<std::chrono::milliseconds> delays = { 20h, 3ms, 90s, 70ms, 1ms, 5000ms, 64ms, 4096ms, 2h };
+			std::vector<std::pair<std::size_t, TimerWheel::Clock::time_point>> firings;
+			TimerWheel::Clock::time_point now;
+			for (std::size_t i = 0; i < delays.size(); ++i) {
+				wheel.schedule(start + delays[i], [&firings, &now, i]() { firings.emplace_back(i, now); });
+			}
+
+			// WHEN
+			auto nextExpiry = wheel.nextExpiry();
+			while (nextExpiry) {
+				now = *nextExpiry;
+				wheel.advance(now);
+				nextExpiry = wheel.nextExpiry();
+			}
+
+			// THEN
+			REQUIRE(firings.size() == delays.size());
+			for (std::size_t i = 1; i < firings.size(); ++i) {
+				REQUIRE(delays[firings[i - 1].first] < delays[firings[i].first]);
+			}
+			for (const auto &[i, firingTime] : firings) {
+				REQUIRE(firingTime >= start + delays[i]);
+				REQUIRE(firingTime < start + delays[i] + 1ms);
+			}
+		}
+
+		SUBCASE("Cancelled timer does not fire")
+		{
+			// GIVEN
+			auto fired = false;
+			const auto timerId = wheel.schedule(start + 100ms, [&fired]() { fired = true; });
+
+			// WHEN
+			const auto isCancelled = wheel.cancel(timerId);
+			runUntil(start + 200ms);
+
+			// THEN
+			REQUIRE(isCancelled);
+			REQUIRE_FALSE(fired);
+			REQUIRE(wheel.size() == 0);
+			REQUIRE_FALSE(wheel.cancel(timerId));
+			REQUIRE_FALSE(wheel.cancel(TimerWheel::c_invalidTimerId));
+		}
+
+		SUBCASE("Fired timer can not be cancelled and its id is not reused")
+		{
+			// GIVEN
+			auto numberOfCalls = 0;
+			const auto timerId = wheel.schedule(start + 1ms, [&numberOfCalls]() { ++numberOfCalls; });
+			runUntil(start + 1ms);
+
+			// WHEN
+			const auto otherTimerId = wheel.schedule(start + 2ms, [&numberOfCalls]() { ++numberOfCalls; });
+
+			// THEN
+			REQUIRE(numberOfCalls == 1);
+			REQUIRE(otherTimerId != timerId);
+			REQUIRE_FALSE(wheel.cancel(timerId));
+			REQUIRE(wheel.cancel(otherTimerId));
+		}
+
+		SUBCASE("Callback may cancel timers due at the same time and schedule new ones")
+		{
+			// GIVEN
+			TimerWheel::TimerId otherTimerId = TimerWheel::c_invalidTimerId;
+			auto numberOfCalls = 0;
+			auto callback = [&]() {
+				++numberOfCalls;
+				wheel.cancel(otherTimerId);
+				wheel.schedule(start + 10ms, [&numberOfCalls]() { numberOfCalls += 10; });
+			};
+			const auto timerId = wheel.schedule(start + 5ms, callback);
+			otherTimerId = wheel.schedule(start + 5ms, callback);
+
+			// WHEN
+			const auto numberOfFiredTimers = wheel.advance(start + 5ms);
+			runUntil(start + 10ms);
+
+			// THEN
+			REQUIRE(numberOfFiredTimers == 1);
+			REQUIRE(numberOfCalls == 11);
+			REQUIRE(wheel.size() == 0);
+		}
+
+		SUBCASE("Timer due in the past fires with the next advance")
+		{
+			// GIVEN
+			wheel.advance(start + 10ms);
+			auto fired = false;
+
+			// WHEN
+			wheel.schedule(start, [&fired]() { fired = true; });
+
+			// THEN
+			REQUIRE_FALSE(fired);
+			REQUIRE(wheel.nextExpiry() == start + 11ms);
+			wheel.advance(start + 11ms);
+			REQUIRE(fired);
+		}
+	}
+
+	TEST_CASE("NetworkAccessManager transfer deadlines and cancellation")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		NetworkAccessManagerUnitTestHarness unitTestHarness;
+
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		CurlDummyHandle dummyEasyHandles[2];
+		CURL *dummyEasyHandlePtrs[2] = { &dummyEasyHandles[0], &dummyEasyHandles[1] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, 2);
+
+		HttpTransferHandle transfer(url);
+		HttpTransferHandle otherTransfer(url);
+		std::vector<int> results;
+		transfer.finished.connect([&results](int result) { results.push_back(result); });
+		otherTransfer.finished.connect([&results](int result) { results.push_back(result); });
+
+		SUBCASE("Transfer exceeding its deadline is unregistered and finishes with CURLE_OPERATION_TIMEDOUT")
+		{
+			// GIVEN
+			networkAccessManager.registerTransfer(transfer, { .deadline = std::chrono::milliseconds(1) });
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 1);
+			REQUIRE(unitTestHarness.deadlineTimer().running.get());
+
+			// WHEN
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			unitTestHarness.deadlineTimer().timeout.emit();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_remove_handle_fake.arg1_val == transfer.handle());
+			REQUIRE(results == std::vector<int>{ CURLE_OPERATION_TIMEDOUT });
+			REQUIRE(transfer.error() == "Transfer deadline exceeded");
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 0);
+			REQUIRE_FALSE(unitTestHarness.deadlineTimer().running.get());
+		}
+
+		SUBCASE("Deadline is released when the transfer is done in time")
+		{
+			// GIVEN
+			curl_easy_getinfo_fake.custom_fake = [&](CURL*, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+					*abstractTransferHandle = &transfer;
+				}
+				return CURLE_OK;
+			};
+			CURLMsg msgDone { CURLMSG_DONE, transfer.handle(), { .result = CURLE_OK } };
+			CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+			SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+			networkAccessManager.registerTransfer(transfer, { .deadline = std::chrono::milliseconds(1) });
+
+			// WHEN
+			unitTestHarness.timeoutTimer().timeout.emit();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_OK });
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 0);
+		}
+
+		SUBCASE("Cancelling a token unregisters all of its transfers")
+		{
+			// GIVEN
+			CancellationToken token;
+			networkAccessManager.registerTransfer(transfer, { .cancellationToken = token });
+			networkAccessManager.registerTransfer(otherTransfer, { .deadline = std::chrono::seconds(10), .cancellationToken = token });
+
+			// WHEN
+			token.cancel();
+			token.cancel();
+
+			// THEN
+			REQUIRE(token.isCancelled());
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 2);
+			REQUIRE(results == std::vector<int>{ CURLE_ABORTED_BY_CALLBACK, CURLE_ABORTED_BY_CALLBACK });
+			REQUIRE(transfer.error() == "Transfer cancelled");
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 0);
+			REQUIRE_FALSE(unitTestHarness.deadlineTimer().running.get());
+		}
+
+		SUBCASE("Cancelling a token does not affect unregistered transfers")
+		{
+			// GIVEN
+			CancellationToken token;
+			networkAccessManager.registerTransfer(transfer, { .cancellationToken = token });
+			networkAccessManager.unregisterTransfer(transfer);
+
+			// WHEN
+			token.cancel();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(results.empty());
+		}
+
+		SUBCASE("Destroying a registered transfer releases its deadline and cancellation")
+		{
+			// GIVEN
+			CancellationToken token;
+			auto destroyedTransfer = std::make_unique<HttpTransferHandle>(url);
+			destroyedTransfer->finished.connect([&results](int result) { results.push_back(result); });
+			networkAccessManager.registerTransfer(*destroyedTransfer, { .deadline = std::chrono::milliseconds(1), .cancellationToken = token });
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 1);
+
+			// WHEN
+			destroyedTransfer.reset();
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			unitTestHarness.deadlineTimer().timeout.emit();
+			token.cancel();
+
+			// THEN
+			REQUIRE(unitTestHarness.deadlineWheel().size() == 0);
+			REQUIRE_FALSE(unitTestHarness.deadlineTimer().running.get());
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 0);
+			REQUIRE(results.empty());
+		}
+
+		SUBCASE("Transfer with a cancelled token is not registered")
+		{
+			// GIVEN
+			CancellationToken token;
+			token.cancel();
+
+			// WHEN
+			const auto hasError = networkAccessManager.registerTransfer(transfer, { .cancellationToken = token });
+
+			// THEN
+			REQUIRE(hasError);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 0);
+		}
+	}
+
+	TEST_CASE("NetworkAccessManager persistent state")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		NetworkAccessManagerUnitTestHarness unitTestHarness;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+
+		CurlDummyHandle dummyShareHandle;
+		CurlDummyHandle dummyEasyHandles[4];
+		CURL *dummyEasyHandlePtrs[4] = { &dummyEasyHandles[0], &dummyEasyHandles[1], &dummyEasyHandles[2], &dummyEasyHandles[3] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, 4);
+		curl_share_init_fake.return_val = &dummyShareHandle;
+
+		std::vector<long> sharedData;
+		curl_share_setopt_fake.custom_fake = [&](CURLSH*, CURLSHoption option, va_list param) -> CURLSHcode {
+			if (option == CURLSHOPT_SHARE) {
+				sharedData.push_back(va_arg(param, long));
+			}
+			return CURLSHE_OK;
+		};
+		std::map<std::pair<CURL*, CURLoption>, std::variant<void*, std::string>> options;
+		std::map<CURL*, curl_hstsread_callback> hstsReadFunctions;
+		std::map<CURL*, curl_hstswrite_callback> hstsWriteFunctions;
+		curl_easy_setopt_fake.custom_fake = [&](CURL *handle, CURLoption option, va_list param) -> CURLcode {
+			if ((option == CURLOPT_HSTS) || (option == CURLOPT_ALTSVC)) {
+				options[{ handle, option }] = std::string(va_arg(param, const char*));
+			}
+			else if ((option == CURLOPT_SHARE) || (option == CURLOPT_HSTSREADDATA) || (option == CURLOPT_HSTSWRITEDATA)) {
+				options[{ handle, option }] = va_arg(param, void*);
+			}
+			else if (option == CURLOPT_HSTSREADFUNCTION) {
+				hstsReadFunctions[handle] = va_arg(param, curl_hstsread_callback);
+			}
+			else if (option == CURLOPT_HSTSWRITEFUNCTION) {
+				hstsWriteFunctions[handle] = va_arg(param, curl_hstswrite_callback);
+			}
+			return CURLE_OK;
+		};
+
+		// like libcurl, which passes the HSTS entries of the share on cleanup
+		std::vector<std::pair<std::string, std::string>> hstsEntriesOfShare;
+		curl_easy_cleanup_fake.custom_fake = [&](CURL *handle) {
+			const auto writeFunction = hstsWriteFunctions[handle];
+			if (!writeFunction) {
+				return;
+			}
+			curl_index index { 0, hstsEntriesOfShare.size() };
+			for (auto &[host, expiry] : hstsEntriesOfShare) {
+				curl_hstsentry entry {};
+				entry.name = host.data();
+				entry.namelen = host.size();
+				std::strncpy(entry.expire, expiry.c_str(), sizeof(entry.expire) - 1);
+				writeFunction(handle, &entry, &index, std::get<void*>(options[{ handle, CURLOPT_HSTSWRITEDATA }]));
+				++index.index;
+			}
+		};
+		// like libcurl, which pulls HSTS entries into the share when a transfer starts
+		const auto pullHstsEntries = [&](CURL *handle) {
+			std::vector<std::string> entries;
+			const auto readFunction = hstsReadFunctions[handle];
+			if (!readFunction) {
+				return entries;
+			}
+			char name[257];
+			curl_hstsentry entry {};
+			entry.name = name;
+			entry.namelen = sizeof(name) - 1;
+			while (readFunction(handle, &entry, std::get<void*>(options[{ handle, CURLOPT_HSTSREADDATA }])) == CURLSTS_OK) {
+				entries.push_back((entry.includeSubDomains ? "." : "") + std::string(entry.name) + " " + entry.expire);
+			}
+			return entries;
+		};
+		const auto readFile = [](const std::filesystem::path &filePath) {
+			std::ifstream file(filePath);
+			return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		};
+
+		const auto directoryPath = std::filesystem::temp_directory_path() / "persistentConnectionStateTest";
+		std::filesystem::remove_all(directoryPath);
+
+		SUBCASE("Enabling creates the directory and a share")
+		{
+			// WHEN
+			const auto hasError = networkAccessManager.enablePersistentState(directoryPath.string());
+
+			// THEN
+			REQUIRE_FALSE(hasError);
+			REQUIRE(std::filesystem::is_directory(directoryPath));
+			REQUIRE(std::ranges::find(sharedData, CURL_LOCK_DATA_SSL_SESSION) != sharedData.end());
+			REQUIRE(std::ranges::find(sharedData, CURL_LOCK_DATA_HSTS) != sharedData.end());
+			REQUIRE(std::get<void*>(options[{ dummyEasyHandlePtrs[0], CURLOPT_SHARE }]) == &dummyShareHandle);
+		}
+
+		SUBCASE("HSTS entries of earlier runs survive saving without transfers")
+		{
+			// GIVEN
+			std::filesystem::create_directories(directoryPath);
+			std::ofstream(directoryPath / "hsts.txt") << "# comment\n.example.com \"20301231 00:00:00\"\nexample.org \"unlimited\"\n";
+			networkAccessManager.enablePersistentState(directoryPath.string());
+
+			// WHEN
+			const auto hasError = networkAccessManager.savePersistentState();
+
+			// THEN
+			REQUIRE_FALSE(hasError);
+			const auto content = readFile(directoryPath / "hsts.txt");
+			REQUIRE(content.find(".example.com \"20301231 00:00:00\"\n") != std::string::npos);
+			REQUIRE(content.find("example.org \"unlimited\"\n") != std::string::npos);
+		}
+
+		SUBCASE("The first transfer loads the HSTS entries into the share")
+		{
+			// GIVEN
+			std::filesystem::create_directories(directoryPath);
+			std::ofstream(directoryPath / "hsts.txt") << ".example.com \"20301231 00:00:00\"\n";
+			networkAccessManager.enablePersistentState(directoryPath.string());
+			HttpTransferHandle transfer(Url("https://www.example.com"));
+			HttpTransferHandle nextTransfer(Url("https://www.example.com"));
+
+			// WHEN
+			networkAccessManager.registerTransfer(transfer);
+			const auto entries = pullHstsEntries(transfer.handle());
+			networkAccessManager.unregisterTransfer(transfer);
+			networkAccessManager.registerTransfer(nextTransfer);
+			networkAccessManager.unregisterTransfer(nextTransfer);
+			hstsEntriesOfShare = { { "example.com", "20301231 00:00:00" }, { "new.example.com", "unlimited" } };
+			networkAccessManager.savePersistentState();
+
+			// THEN
+			REQUIRE(entries == std::vector<std::string>{ ".example.com 20301231 00:00:00" });
+			REQUIRE(pullHstsEntries(nextTransfer.handle()).empty());
+			const auto content = readFile(directoryPath / "hsts.txt");
+			REQUIRE(content.find("example.com \"20301231 00:00:00\"\n") != std::string::npos);
+			REQUIRE(content.find("new.example.com \"unlimited\"\n") != std::string::npos);
+		}
+
+		SUBCASE("Registered transfers share the state")
+		{
+			// GIVEN
+			networkAccessManager.enablePersistentState(directoryPath.string());
+			HttpTransferHandle transfer(Url("https://www.example.com"));
+
+			// WHEN
+			networkAccessManager.registerTransfer(transfer);
+
+			// THEN
+			REQUIRE(std::get<void*>(options[{ transfer.handle(), CURLOPT_SHARE }]) == &dummyShareHandle);
+			// the Alt-Svc file is read and written by the state handle only
+			REQUIRE_FALSE(options.contains({ transfer.handle(), CURLOPT_ALTSVC }));
+			REQUIRE(std::get<std::string>(options[{ dummyEasyHandlePtrs[0], CURLOPT_ALTSVC }]) == (directoryPath / "altsvc.txt").string());
+			networkAccessManager.unregisterTransfer(transfer);
+		}
+
+		SUBCASE("Saving collects the HSTS entries of the share by cleaning up the state handle")
+		{
+			// GIVEN
+			networkAccessManager.enablePersistentState(directoryPath.string());
+			hstsEntriesOfShare = { { "example.com", "20301231 00:00:00" } };
+
+			// WHEN
+			const auto hasError = networkAccessManager.savePersistentState();
+
+			// THEN
+			REQUIRE_FALSE(hasError);
+			REQUIRE(curl_easy_cleanup_fake.call_count == 1);
+			REQUIRE(curl_easy_cleanup_fake.arg0_val == dummyEasyHandlePtrs[0]);
+			REQUIRE(std::get<void*>(options[{ dummyEasyHandlePtrs[1], CURLOPT_SHARE }]) == &dummyShareHandle);
+			REQUIRE(hstsWriteFunctions[dummyEasyHandlePtrs[1]] != nullptr);
+			REQUIRE(std::get<std::string>(options[{ dummyEasyHandlePtrs[1], CURLOPT_ALTSVC }]) == (directoryPath / "altsvc.txt").string());
+			REQUIRE(readFile(directoryPath / "hsts.txt").find("example.com \"20301231 00:00:00\"\n") != std::string::npos);
+		}
+
+		SUBCASE("Persistent state is enabled for one directory only")
+		{
+			// GIVEN
+			networkAccessManager.enablePersistentState(directoryPath.string());
+
+			// WHEN / THEN
+			REQUIRE_FALSE(networkAccessManager.enablePersistentState(directoryPath.string()));
+			REQUIRE(networkAccessManager.enablePersistentState((directoryPath / "other").string()));
+			REQUIRE(curl_share_init_fake.call_count == 1);
+		}
+
+		SUBCASE("Persistent state is not enabled without a share")
+		{
+			// GIVEN
+			curl_share_init_fake.return_val = nullptr;
+			HttpTransferHandle transfer(Url("https://www.example.com"));
+
+			// WHEN
+			const auto hasError = networkAccessManager.enablePersistentState(directoryPath.string());
+			networkAccessManager.registerTransfer(transfer);
+
+			// THEN
+			REQUIRE(hasError);
+			REQUIRE(networkAccessManager.savePersistentState());
+			REQUIRE_FALSE(options.contains({ transfer.handle(), CURLOPT_SHARE }));
+			networkAccessManager.unregisterTransfer(transfer);
+		}
+
+		unitTestHarness.disablePersistentState();
+		std::filesystem::remove_all(directoryPath);
+	}
+
+	TEST_CASE("NetworkAccessManager::get() coroutine API")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		NetworkAccessManagerUnitTestHarness unitTestHarness;
+
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		CurlDummyHandle dummyEasyHandle;
+		void *dummyEasyHandlePtr = &dummyEasyHandle;
+		curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+		// the transfer handle lives inside the awaitable,
+		// so capture its address when CURLOPT_PRIVATE is set
+		// and return it when CURLINFO_PRIVATE is requested.
+		AbstractTransferHandle *transferHandle = nullptr;
+		curl_easy_setopt_fake.custom_fake = [&](CURL*, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_PRIVATE) {
+				transferHandle = va_arg(param, AbstractTransferHandle*);
+			}
+			return CURLE_OK;
+		};
+		curl_easy_getinfo_fake.custom_fake = [&](CURL*, CURLINFO info, va_list param) -> CURLcode {
+			if (info == CURLINFO_PRIVATE) {
+				auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+				*abstractTransferHandle = transferHandle;
+			}
+			return CURLE_OK;
+		};
+
+		CURLMsg msgDone { CURLMSG_DONE, dummyEasyHandlePtr, { .result = CURLE_OK } };
+		CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+		SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+
+		std::optional<HttpResponse> response;
+		auto fetch = [&]() -> TransferTask {
+			response = co_await networkAccessManager.get(url);
+		};
+
+		SUBCASE("Awaiting get() registers transfer and suspends coroutine")
+		{
+			// GIVEN
+			auto task = fetch();
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_add_handle_fake.arg1_val == dummyEasyHandlePtr);
+			REQUIRE_FALSE(task.isDone());
+			REQUIRE_FALSE(response.has_value());
+		}
+
+		SUBCASE("Coroutine is resumed from the event loop after transfer finished")
+		{
+			// GIVEN
+			auto task = fetch();
+
+			// WHEN
+			unitTestHarness.timeoutTimer().timeout.emit();
+
+			// THEN (resumption is deferred to the event loop)
+			REQUIRE_FALSE(response.has_value());
+			app.processEvents(1);
+			REQUIRE(task.isDone());
+			REQUIRE(response.has_value());
+			REQUIRE(response->isOk());
+		}
+
+		SUBCASE("Destroying a suspended coroutine cancels its transfer")
+		{
+			// GIVEN
+			auto task = fetch();
+
+			// WHEN
+			task.reset();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_remove_handle_fake.arg1_val == dummyEasyHandlePtr);
+		}
+
+		SUBCASE("Destroying a coroutine scheduled for resumption does not resume it")
+		{
+			// GIVEN
+			auto task = fetch();
+			unitTestHarness.timeoutTimer().timeout.emit();
+
+			// WHEN
+			task.reset();
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE_FALSE(response.has_value());
+		}
+	}
+
+	TEST_CASE("TransferBatch")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		// each transfer of the batch needs its own easy handle
+		constexpr int numberOfTransfers = 3;
+		CurlDummyHandle dummyEasyHandles[numberOfTransfers];
+		CURL *dummyEasyHandlePtrs[numberOfTransfers] = { &dummyEasyHandles[0], &dummyEasyHandles[1], &dummyEasyHandles[2] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, numberOfTransfers);
+
+		std::map<CURL*, AbstractTransferHandle*> transferByEasyHandle;
+		curl_easy_setopt_fake.custom_fake = [&](CURL *handle, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_PRIVATE) {
+				transferByEasyHandle[handle] = va_arg(param, AbstractTransferHandle*);
+			}
+			return CURLE_OK;
+		};
+
+		auto makeTransfers = [&]() {
+			std::vector<std::unique_ptr<AbstractTransferHandle>> transfers;
+			for (int i = 0; i < numberOfTransfers; ++i) {
+				transfers.push_back(std::make_unique<HttpTransferHandle>(url));
+			}
+			return transfers;
+		};
+
+		// CURLMSG_DONE is delivered via NetworkAccessManager::processTransferMessages()
+		CURLMsg msgDone { CURLMSG_DONE, nullptr, { .result = CURLE_OK } };
+		auto finishTransfer = [&](int i, CURLcode result) {
+			msgDone.easy_handle = dummyEasyHandlePtrs[i];
+			msgDone.data.result = result;
+			CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+			SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+			curl_multi_info_read_fake.return_val_seq_idx = 0;
+			curl_easy_getinfo_fake.custom_fake = [&, i](CURL*, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+					*abstractTransferHandle = transferByEasyHandle[dummyEasyHandlePtrs[i]];
+				}
+				return CURLE_OK;
+			};
+			NetworkAccessManagerUnitTestHarness().timeoutTimer().timeout.emit();
+		};
+
+		auto numberOfFinishedSignals = 0;
+		std::vector<CURLcode> reportedResults;
+		auto onBatchFinished = [&](const std::vector<CURLcode> &results) {
+			++numberOfFinishedSignals;
+			reportedResults = results;
+		};
+
+		SUBCASE("Submit registers no more transfers than allowed concurrently")
+		{
+			// GIVEN
+			TransferBatch batch(networkAccessManager, { .maxConcurrentTransfers = 2 });
+
+			// WHEN
+			batch.submit(makeTransfers());
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 2);
+			REQUIRE(batch.totalNumberOfTransfers.get() == numberOfTransfers);
+		}
+
+		SUBCASE("Queued transfer is registered once a running transfer finished")
+		{
+			// GIVEN
+			TransferBatch batch(networkAccessManager, { .maxConcurrentTransfers = 2 });
+			batch.submit(makeTransfers());
+
+			// WHEN
+			finishTransfer(0, CURLE_OK);
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 3);
+			REQUIRE(curl_multi_add_handle_fake.arg1_val == dummyEasyHandlePtrs[2]);
+			REQUIRE(batch.numberOfFinishedTransfers.get() == 1);
+		}
+
+		SUBCASE("Finished signal is emitted once after all transfers finished")
+		{
+			// GIVEN
+			TransferBatch batch(networkAccessManager, { .maxConcurrentTransfers = 2 });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeTransfers());
+
+			// WHEN
+			finishTransfer(0, CURLE_OK);
+			REQUIRE(batch.finishedTransfersPercent.get() == 33);
+			finishTransfer(1, CURLE_COULDNT_CONNECT);
+			REQUIRE(numberOfFinishedSignals == 0);
+			finishTransfer(2, CURLE_OK);
+
+			// THEN
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(reportedResults == std::vector<CURLcode>{ CURLE_OK, CURLE_COULDNT_CONNECT, CURLE_OK });
+			REQUIRE(batch.numberOfFailedTransfers.get() == 1);
+			REQUIRE(batch.finishedTransfersPercent.get() == 100);
+		}
+
+		SUBCASE("First error cancels remaining transfers if requested")
+		{
+			// GIVEN
+			TransferBatch batch(networkAccessManager, { .maxConcurrentTransfers = 2, .cancelOnFirstError = true });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeTransfers());
+
+			// WHEN
+			finishTransfer(0, CURLE_COULDNT_CONNECT);
+
+			// THEN (transfer 0 is unregistered by NetworkAccessManager, transfer 1 by the batch)
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 2);
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 2);
+			REQUIRE(reportedResults == std::vector<CURLcode>{ CURLE_COULDNT_CONNECT, CURLE_ABORTED_BY_CALLBACK, CURLE_ABORTED_BY_CALLBACK });
+		}
+
+		SUBCASE("Destroying a running batch unregisters its running transfers")
+		{
+			// GIVEN
+			auto batch = std::make_unique<TransferBatch>(networkAccessManager, TransferBatchOptions{ .maxConcurrentTransfers = 2 });
+			batch->submit(makeTransfers());
+
+			// WHEN
+			batch.reset();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 2);
+		}
+	}
+
+	TEST_CASE("FtpBatchTransfer")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+
+		// the handles of finished files are reused -> one easy handle per connection
+		constexpr int numberOfConnections = 2;
+		CurlDummyHandle dummyEasyHandles[numberOfConnections];
+		CURL *dummyEasyHandlePtrs[numberOfConnections] = { &dummyEasyHandles[0], &dummyEasyHandles[1] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, numberOfConnections);
+
+		std::map<CURL*, AbstractTransferHandle*> transferByEasyHandle;
+		curl_easy_setopt_fake.custom_fake = [&](CURL *handle, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_PRIVATE) {
+				transferByEasyHandle[handle] = va_arg(param, AbstractTransferHandle*);
+			}
+			return CURLE_OK;
+		};
+
+		auto makeItems = [](int numberOfFiles) {
+			std::vector<FtpBatchItem> items;
+			for (int i = 0; i < numberOfFiles; ++i) {
+				const auto fileName = "ftpBatchFile" + std::to_string(i) + ".txt";
+				items.push_back({ FtpBatchItem::Direction::DOWNLOAD, std::filesystem::temp_directory_path().append(fileName).string(), Url("ftp://ftp.example.com/" + fileName) });
+			}
+			return items;
+		};
+
+		// CURLMSG_DONE is delivered via NetworkAccessManager::processTransferMessages()
+		CURLMsg msgDone { CURLMSG_DONE, nullptr, { .result = CURLE_OK } };
+		CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+		auto finishTransfer = [&](int connection, CURLcode result) {
+			msgDone.easy_handle = dummyEasyHandlePtrs[connection];
+			msgDone.data.result = result;
+			SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+			curl_multi_info_read_fake.return_val_seq_idx = 0;
+			curl_easy_getinfo_fake.custom_fake = [&, connection](CURL*, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+					*abstractTransferHandle = transferByEasyHandle[dummyEasyHandlePtrs[connection]];
+				}
+				return CURLE_OK;
+			};
+			NetworkAccessManagerUnitTestHarness().timeoutTimer().timeout.emit();
+		};
+		auto transferOf = [&](int connection) -> AbstractFtpTransferHandle & {
+			return *dynamic_cast<AbstractFtpTransferHandle*>(transferByEasyHandle[dummyEasyHandlePtrs[connection]]);
+		};
+
+		auto numberOfFinishedSignals = 0;
+		std::vector<CURLcode> reportedResults;
+		auto onBatchFinished = [&](const std::vector<CURLcode> &results) {
+			++numberOfFinishedSignals;
+			reportedResults = results;
+		};
+
+		SUBCASE("Files are transferred one after another over each connection, reusing its handle")
+		{
+			// GIVEN
+			FtpBatchTransfer batch(networkAccessManager, { .maxParallelConnections = numberOfConnections });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeItems(4));
+			REQUIRE(curl_multi_add_handle_fake.call_count == 2);
+
+			// WHEN
+			finishTransfer(0, CURLE_OK);
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 3);
+			REQUIRE(curl_multi_add_handle_fake.arg1_val == dummyEasyHandlePtrs[0]);
+			REQUIRE(curl_easy_reset_fake.call_count == 1);
+
+			// WHEN
+			finishTransfer(1, CURLE_OK);
+			app.processEvents(10);
+			finishTransfer(0, CURLE_OK);
+			app.processEvents(10);
+			finishTransfer(1, CURLE_OK);
+
+			// THEN
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(reportedResults == std::vector<CURLcode>(4, CURLE_OK));
+			REQUIRE(batch.numberOfFinishedFiles.get() == 4);
+			REQUIRE(curl_easy_init_fake.call_count == numberOfConnections);
+		}
+
+		SUBCASE("Progress is aggregated over all files")
+		{
+			// GIVEN
+			FtpBatchTransfer batch(networkAccessManager, { .maxParallelConnections = numberOfConnections });
+			batch.submit(makeItems(2));
+
+			// WHEN (the size of the second file is not known yet)
+			AbstractFtpTransferHandleUnitTestHarness::progress(transferOf(0), 100, 50);
+			AbstractFtpTransferHandleUnitTestHarness::progress(transferOf(1), 0, 50);
+
+			// THEN
+			REQUIRE(batch.numberOfBytesTransferred.get() == 100);
+			REQUIRE(batch.totalNumberOfBytesToTransfer.get() == 100);
+
+			// WHEN
+			AbstractFtpTransferHandleUnitTestHarness::progress(transferOf(1), 300, 150);
+
+			// THEN
+			REQUIRE(batch.numberOfBytesTransferred.get() == 200);
+			REQUIRE(batch.totalNumberOfBytesToTransfer.get() == 400);
+			REQUIRE(batch.progressPercent.get() == 50);
+		}
+
+		SUBCASE("Results are reported per file")
+		{
+			// GIVEN
+			FtpBatchTransfer batch(networkAccessManager, { .maxParallelConnections = numberOfConnections });
+			std::vector<std::pair<std::size_t, CURLcode>> finishedFiles;
+			batch.fileFinished.connect([&](std::size_t index, CURLcode result) { finishedFiles.emplace_back(index, result); });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeItems(2));
+
+			// WHEN
+			finishTransfer(1, CURLE_REMOTE_FILE_NOT_FOUND);
+			finishTransfer(0, CURLE_OK);
+
+			// THEN
+			REQUIRE(finishedFiles == std::vector<std::pair<std::size_t, CURLcode>>{ { 1, CURLE_REMOTE_FILE_NOT_FOUND }, { 0, CURLE_OK } });
+			REQUIRE(reportedResults == std::vector<CURLcode>{ CURLE_OK, CURLE_REMOTE_FILE_NOT_FOUND });
+			REQUIRE(batch.numberOfFailedFiles.get() == 1);
+		}
+
+		SUBCASE("First error cancels the remaining files if requested")
+		{
+			// GIVEN
+			FtpBatchTransfer batch(networkAccessManager, { .maxParallelConnections = 1, .cancelOnFirstError = true });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeItems(3));
+
+			// WHEN
+			finishTransfer(0, CURLE_LOGIN_DENIED);
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(reportedResults == std::vector<CURLcode>{ CURLE_LOGIN_DENIED, CURLE_ABORTED_BY_CALLBACK, CURLE_ABORTED_BY_CALLBACK });
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+		}
+
+		SUBCASE("Cancel unregisters running files")
+		{
+			// GIVEN
+			FtpBatchTransfer batch(networkAccessManager, { .maxParallelConnections = numberOfConnections });
+			batch.finished.connect(onBatchFinished);
+			batch.submit(makeItems(3));
+
+			// WHEN
+			batch.cancel();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 2);
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(reportedResults == std::vector<CURLcode>(3, CURLE_ABORTED_BY_CALLBACK));
+			REQUIRE(batch.numberOfFailedFiles.get() == 3);
+		}
+	}
+
+	TEST_CASE("FtpDirectoryIndex")
+	{
+		using namespace std::chrono;
+		const auto secondsSinceEpoch = [](sys_seconds timePoint) { return timePoint.time_since_epoch().count(); };
+		const auto now = secondsSinceEpoch(sys_days{2024y / March / 10} + 12h);
+
+		SUBCASE("MLSD lines are parsed")
+		{
+			// WHEN
+			const auto file = FtpDirectoryIndex::parseMlsdLine("Type=file;Size=1234;Modify=20240102030405.123;Perm=r; name with spaces.txt");
+			const auto directory = FtpDirectoryIndex::parseMlsdLine("type=dir;modify=20231231235959; logs");
+
+			// THEN
+			REQUIRE(file.has_value());
+			REQUIRE(file->name == "name with spaces.txt");
+			REQUIRE(file->type == FtpDirectoryEntry::Type::FILE);
+			REQUIRE(file->size == 1234);
+			REQUIRE(file->modificationTime == secondsSinceEpoch(sys_days{2024y / January / 2} + 3h + 4min + 5s));
+			REQUIRE(file->timePrecision == FtpDirectoryEntry::TimePrecision::SECONDS);
+			REQUIRE(directory.has_value());
+			REQUIRE(directory->type == FtpDirectoryEntry::Type::DIRECTORY);
+			REQUIRE_FALSE(FtpDirectoryIndex::parseMlsdLine("type=cdir; /pub").has_value());
+			REQUIRE_FALSE(FtpDirectoryIndex::parseMlsdLine("type=pdir; ..").has_value());
+			REQUIRE_FALSE(FtpDirectoryIndex::parseMlsdLine("type=OS.unix=symlink; link").has_value());
+			REQUIRE_FALSE(FtpDirectoryIndex::parseMlsdLine("size=12; no type").has_value());
+		}
+
+		SUBCASE("LIST lines are parsed")
+		{
+			// WHEN
+			const auto recentFile = FtpDirectoryIndex::parseListLine("-rw-r--r--   1 owner    group        1234 Mar  7 14:02 report 2024.pdf", now);
+			const auto lastYearsFile = FtpDirectoryIndex::parseListLine("-rw-r--r--   1 owner    group          42 Dec 24 18:00 gift.txt", now);
+			const auto oldFile = FtpDirectoryIndex::parseListLine("-rw-r--r--   1 owner    group          42 Jun  1  2019 old.txt", now);
+			const auto directory = FtpDirectoryIndex::parseListLine("drwxr-xr-x   2 owner    4096 Jan  1 00:00 logs", now);
+
+			// THEN
+			REQUIRE(recentFile.has_value());
+			REQUIRE(recentFile->name == "report 2024.pdf");
+			REQUIRE(recentFile->size == 1234);
+			REQUIRE(recentFile->modificationTime == secondsSinceEpoch(sys_days{2024y / March / 7} + 14h + 2min));
+			REQUIRE(recentFile->timePrecision == FtpDirectoryEntry::TimePrecision::MINUTES);
+			REQUIRE(lastYearsFile->modificationTime == secondsSinceEpoch(sys_days{2023y / December / 24} + 18h));
+			REQUIRE(oldFile->modificationTime == secondsSinceEpoch(sys_days{2019y / June / 1}));
+			REQUIRE(oldFile->timePrecision == FtpDirectoryEntry::TimePrecision::DAYS);
+			REQUIRE(directory.has_value());
+			REQUIRE(directory->type == FtpDirectoryEntry::Type::DIRECTORY);
+			REQUIRE(directory->name == "logs");
+			REQUIRE_FALSE(FtpDirectoryIndex::parseListLine("total 42", now).has_value());
+			REQUIRE_FALSE(FtpDirectoryIndex::parseListLine("lrwxrwxrwx   1 owner    group   7 Mar  7 14:02 link -> target", now).has_value());
+			REQUIRE_FALSE(FtpDirectoryIndex::parseListLine("drwxr-xr-x   2 owner    group   4096 Mar  7 14:02 ..", now).has_value());
+		}
+
+		SUBCASE("Changed files differ in size or modification time")
+		{
+			// GIVEN
+			FtpDirectoryIndex remoteIndex;
+			FtpDirectoryIndex localIndex;
+			const auto addFile = [](FtpDirectoryIndex &index, std::string_view directory, std::string_view name, std::uint64_t size, std::int64_t modificationTime,
+									FtpDirectoryEntry::TimePrecision timePrecision = FtpDirectoryEntry::TimePrecision::SECONDS) {
+				index.add(directory, { name, FtpDirectoryEntry::Type::FILE, size, modificationTime, timePrecision });
+			};
+			addFile(remoteIndex, "logs", "unchanged.log", 10, now);
+			addFile(remoteIndex, "logs", "grown.log", 20, now);
+			addFile(remoteIndex, "logs", "touched.log", 10, now);
+			addFile(remoteIndex, "", "new.txt", 10, now);
+			addFile(remoteIndex, "", "listed.txt", 10, now - now % 86400, FtpDirectoryEntry::TimePrecision::DAYS);
+			remoteIndex.add("", { "logs", FtpDirectoryEntry::Type::DIRECTORY });
+
+			addFile(localIndex, "", "listed.txt", 10, now);
+			addFile(localIndex, "logs", "unchanged.log", 10, now);
+			addFile(localIndex, "logs", "grown.log", 10, now);
+			addFile(localIndex, "logs", "touched.log", 10, now + 1);
+			addFile(localIndex, "", "deleted.txt", 10, now);
+
+			// WHEN
+			remoteIndex.sort();
+			localIndex.sort();
+			std::vector<std::string_view> changedFiles;
+			for (const auto index : remoteIndex.changedFiles(localIndex)) {
+				changedFiles.push_back(remoteIndex.entry(index).name);
+			}
+
+			// THEN
+			REQUIRE(remoteIndex.size() == 6);
+			REQUIRE(localIndex.find("logs/grown.log")->size == 10);
+			REQUIRE_FALSE(localIndex.find("logs").has_value());
+			REQUIRE(changedFiles == std::vector<std::string_view>{ "logs/grown.log", "logs/touched.log", "new.txt" });
+		}
+
+		SUBCASE("Local index contains files and directories relative to the root")
+		{
+			// GIVEN
+			const auto rootPath = std::filesystem::temp_directory_path() / "ftpDirectoryIndexTest";
+			std::filesystem::remove_all(rootPath);
+			std::filesystem::create_directories(rootPath / "sub");
+			std::ofstream(rootPath / "sub" / "file.txt") << "12345";
+
+			// WHEN
+			const auto index = FtpDirectoryIndex::fromLocalDirectory(rootPath.string());
+
+			// THEN
+			REQUIRE(index.size() == 2);
+			REQUIRE(index.find("sub")->type == FtpDirectoryEntry::Type::DIRECTORY);
+			REQUIRE(index.find("sub/file.txt")->size == 5);
+			REQUIRE(FtpDirectoryIndex::fromLocalDirectory((rootPath / "missing").string()).size() == 0);
+			std::filesystem::remove_all(rootPath);
+		}
+	}
+
+	TEST_CASE("FtpListingTransferHandle")
+	{
+		fff_setup();
+		CurlDummyHandle dummyEasyHandle;
+		curl_easy_init_fake.return_val = &dummyEasyHandle;
+
+		std::vector<const char*> customRequests;
+		curl_easy_setopt_fake.custom_fake = [&](CURL*, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_CUSTOMREQUEST) {
+				customRequests.push_back(va_arg(param, const char*));
+			}
+			return CURLE_OK;
+		};
+
+		SUBCASE("MLSD listing is requested and parsed across chunks")
+		{
+			// GIVEN
+			FtpListingTransferHandle listing(Url("ftp://ftp.example.com/pub/"));
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(listing, "type=cdir; /pub\r\ntype=file;size=3; a.t");
+			AbstractTransferHandleUnitTestHarness::write(listing, "xt\r\ntype=dir; sub\r\ntype=file;size=4; b.txt");
+			AbstractTransferHandleUnitTestHarness::transferDone(listing, CURLE_OK);
+
+			// THEN
+			REQUIRE(customRequests.size() == 1);
+			REQUIRE(std::string_view(customRequests[0]) == "MLSD");
+			REQUIRE(listing.entries().size() == 3);
+			REQUIRE(listing.entries().entry(0).name == "a.txt");
+			REQUIRE(listing.entries().entry(1).type == FtpDirectoryEntry::Type::DIRECTORY);
+			REQUIRE(listing.entries().entry(2).size == 4);
+		}
+
+		SUBCASE("LIST listing is requested by default command")
+		{
+			// GIVEN
+			FtpListingTransferHandle listing(Url("ftp://ftp.example.com/pub/"), FtpListingTransferHandle::Format::LIST);
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(listing, "total 1\r\n-rw-r--r--   1 owner    group   3 Jan  1  2020 a.txt\r\n");
+			AbstractTransferHandleUnitTestHarness::transferDone(listing, CURLE_OK);
+
+			// THEN
+			REQUIRE(customRequests.size() == 1);
+			REQUIRE(customRequests[0] == nullptr);
+			REQUIRE(listing.entries().size() == 1);
+			REQUIRE(listing.entries().entry(0).name == "a.txt");
+		}
+	}
+
+	TEST_CASE("FtpMirror")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		using namespace std::chrono;
+
+		constexpr int numberOfEasyHandles = 4;
+		CurlDummyHandle dummyEasyHandles[numberOfEasyHandles];
+		CURL *dummyEasyHandlePtrs[numberOfEasyHandles] = { &dummyEasyHandles[0], &dummyEasyHandles[1], &dummyEasyHandles[2], &dummyEasyHandles[3] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, numberOfEasyHandles);
+
+		std::map<CURL*, AbstractTransferHandle*> transferByEasyHandle;
+		std::vector<std::string> urls;
+		curl_easy_setopt_fake.custom_fake = [&](CURL *handle, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_PRIVATE) {
+				transferByEasyHandle[handle] = va_arg(param, AbstractTransferHandle*);
+			}
+			if (option == CURLOPT_URL) {
+				urls.push_back(va_arg(param, const char*));
+			}
+			return CURLE_OK;
+		};
+
+		// CURLMSG_DONE is delivered via NetworkAccessManager::processTransferMessages()
+		CURLMsg msgDone { CURLMSG_DONE, nullptr, { .result = CURLE_OK } };
+		CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+		auto finishTransfer = [&](CURL *handle, CURLcode result) {
+			msgDone.easy_handle = handle;
+			msgDone.data.result = result;
+			SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+			curl_multi_info_read_fake.return_val_seq_idx = 0;
+			curl_easy_getinfo_fake.custom_fake = [&, handle](CURL*, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+					*abstractTransferHandle = transferByEasyHandle[handle];
+				}
+				return CURLE_OK;
+			};
+			NetworkAccessManagerUnitTestHarness().timeoutTimer().timeout.emit();
+		};
+		auto listingOf = [&](int handle, const std::string &data, CURLcode result = CURLE_OK) {
+			AbstractTransferHandleUnitTestHarness::write(*transferByEasyHandle[dummyEasyHandlePtrs[handle]], data);
+			finishTransfer(dummyEasyHandlePtrs[handle], result);
+			app.processEvents(10);
+		};
+
+		const auto localPath = std::filesystem::temp_directory_path() / "ftpMirrorTest";
+		std::filesystem::remove_all(localPath);
+		std::filesystem::create_directories(localPath);
+		const auto modificationTime = sys_days{2024y / January / 2} + 3h + 4min + 5s;
+		std::ofstream(localPath / "unchanged.txt") << "abc";
+		std::ofstream(localPath / "touched.txt") << "abc";
+		std::filesystem::last_write_time(localPath / "unchanged.txt", file_clock::from_sys(modificationTime));
+
+		auto result = CURLE_FAILED_INIT;
+		FtpMirror mirror(networkAccessManager, Url("ftp://ftp.example.com/pub"), localPath.string(), { .maxConcurrentListings = 1 });
+		mirror.finished.connect([&result](CURLcode mirrorResult) { result = mirrorResult; });
+
+		SUBCASE("Only changed files are transferred")
+		{
+			// WHEN
+			mirror.start();
+			listingOf(0, "type=cdir; .\r\n"
+						 "type=file;size=3;modify=20240102030405; unchanged.txt\r\n"
+						 "type=file;size=3;modify=20240102030405; touched.txt\r\n"
+						 "type=dir;modify=20240102030405; sub\r\n"
+						 "type=file;size=5;modify=20240102030405; ../escape.txt\r\n");
+			listingOf(0, "type=file;size=5;modify=20240102030405; new file.txt\r\n");
+
+			// THEN
+			REQUIRE(mirror.state.get() == FtpMirror::State::TRANSFERRING);
+			REQUIRE(mirror.numberOfListedDirectories.get() == 2);
+			REQUIRE(mirror.remoteIndex().size() == 4);
+			REQUIRE(urls == std::vector<std::string>{
+				"ftp://ftp.example.com/pub/", "ftp://ftp.example.com/pub/sub/",
+				"ftp://ftp.example.com/pub/sub/new%20file.txt", "ftp://ftp.example.com/pub/touched.txt" });
+
+			// WHEN
+			finishTransfer(dummyEasyHandlePtrs[1], CURLE_OK);
+			finishTransfer(dummyEasyHandlePtrs[2], CURLE_OK);
+
+			// THEN
+			REQUIRE(result == CURLE_OK);
+			REQUIRE(mirror.state.get() == FtpMirror::State::FINISHED);
+			REQUIRE(std::filesystem::last_write_time(localPath / "touched.txt") == file_clock::from_sys(modificationTime));
+			REQUIRE(std::filesystem::exists(localPath / "sub" / "new file.txt"));
+		}
+
+		SUBCASE("Listing falls back to LIST if the server does not support MLSD")
+		{
+			// WHEN
+			mirror.start();
+			listingOf(0, "", CURLE_FTP_COULDNT_RETR_FILE);
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 2);
+			REQUIRE(dynamic_cast<FtpListingTransferHandle*>(transferByEasyHandle[dummyEasyHandlePtrs[0]])->format() == FtpListingTransferHandle::Format::LIST);
+
+			// WHEN
+			listingOf(0, "-rw-r--r--   1 owner    group   3 Jan  2  2024 unchanged.txt\r\n");
+
+			// THEN (LIST reports the day only, which matches)
+			REQUIRE(result == CURLE_OK);
+			REQUIRE(mirror.changedFiles().empty());
+		}
+
+		SUBCASE("Failed listing finishes the mirror")
+		{
+			// WHEN
+			mirror.start();
+			listingOf(0, "", CURLE_LOGIN_DENIED);
+
+			// THEN
+			REQUIRE(result == CURLE_LOGIN_DENIED);
+			REQUIRE(mirror.state.get() == FtpMirror::State::FINISHED);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+		}
+
+		std::filesystem::remove_all(localPath);
+	}
+
+	TEST_CASE("TransferDigest")
+	{
+		const auto digestOf = [](TransferDigest::Algorithm algorithm, const std::string &data, std::size_t chunkSize) {
+			TransferDigest digest(algorithm);
+			for (std::size_t i = 0; i < data.size(); i += chunkSize) {
+				digest.update(data.data() + i, std::min(chunkSize, data.size() - i));
+			}
+			return digest.hexDigest();
+		};
+
+		SUBCASE("SHA-256 of test vectors of FIPS 180-4")
+		{
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, "", 1) == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, "abc", 1) == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 7)
+					== "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+		}
+
+		SUBCASE("SHA-256 does not depend on how the data is split")
+		{
+			const auto data = std::string(1000000, 'a');
+			const auto expectedDigest = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, data, data.size()) == expectedDigest);
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, data, 63) == expectedDigest);
+			REQUIRE(digestOf(TransferDigest::Algorithm::SHA256, data, 16384) == expectedDigest);
+		}
+
+		SUBCASE("CRC-32C of check value and split data")
+		{
+			const auto data = std::string(1000, 'x');
+			REQUIRE(digestOf(TransferDigest::Algorithm::CRC32C, "123456789", 9) == "e3069283");
+			REQUIRE(digestOf(TransferDigest::Algorithm::CRC32C, "123456789", 2) == "e3069283");
+			REQUIRE(digestOf(TransferDigest::Algorithm::CRC32C, data, 3) == digestOf(TransferDigest::Algorithm::CRC32C, data, data.size()));
+		}
+
+		SUBCASE("Expected digests are compared case insensitively")
+		{
+			TransferDigest digest(TransferDigest::Algorithm::CRC32C);
+			digest.update("123456789", 9);
+
+			REQUIRE(digest.matches("E3069283"));
+			REQUIRE_FALSE(digest.matches("e306928"));
+			REQUIRE_FALSE(digest.matches("e3069284"));
+		}
+	}
+
+	TEST_CASE("Transfers verify their digest while transferring")
+	{
+		fff_setup();
+		CurlDummyHandle dummyEasyHandle;
+		curl_easy_init_fake.return_val = &dummyEasyHandle;
+
+		void *writeFunction = nullptr;
+		void *readFunction = nullptr;
+		curl_easy_setopt_fake.custom_fake = [&](CURL*, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_WRITEFUNCTION) {
+				writeFunction = va_arg(param, void*);
+			}
+			if (option == CURLOPT_READFUNCTION) {
+				readFunction = va_arg(param, void*);
+			}
+			return CURLE_OK;
+		};
+
+		const auto url = Url("ftp://ftp.example.com/file.txt");
+		const auto abcSha256 = std::string("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		std::vector<int> results;
+
+		SUBCASE("Transfer with matching digest succeeds")
+		{
+			// GIVEN
+			HttpTransferHandle transfer(url);
+			transfer.finished.connect([&results](int result) { results.push_back(result); });
+			transfer.setExpectedDigest(TransferDigest::Algorithm::SHA256, abcSha256);
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(transfer, "a");
+			AbstractTransferHandleUnitTestHarness::write(transfer, "bc");
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_OK });
+			REQUIRE(transfer.digest() == abcSha256);
+		}
+
+		SUBCASE("Transfer with differing digest fails")
+		{
+			// GIVEN
+			HttpTransferHandle transfer(url);
+			transfer.finished.connect([&results](int result) { results.push_back(result); });
+			transfer.setExpectedDigest(TransferDigest::Algorithm::CRC32C, "00000000");
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(transfer, "123456789");
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_BAD_CONTENT_ENCODING });
+			REQUIRE(transfer.error() == "CRC-32C digest mismatch: expected 00000000, got e3069283");
+		}
+
+		SUBCASE("Failed transfer keeps its result")
+		{
+			// GIVEN
+			HttpTransferHandle transfer(url);
+			transfer.finished.connect([&results](int result) { results.push_back(result); });
+			transfer.setExpectedDigest(TransferDigest::Algorithm::SHA256, abcSha256);
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_RECV_ERROR);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_RECV_ERROR });
+		}
+
+		SUBCASE("Paused data is hashed once it is taken")
+		{
+			// GIVEN
+			HttpTransferHandle transfer(url);
+			transfer.setWatermarks(1, 2);
+			transfer.setExpectedDigest(TransferDigest::Algorithm::SHA256, "");
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(transfer, "ab");
+			REQUIRE(AbstractTransferHandleUnitTestHarness::write(transfer, "c") == CURL_WRITEFUNC_PAUSE);
+			transfer.takeDataRead(2);
+			AbstractTransferHandleUnitTestHarness::write(transfer, "c");
+
+			// THEN
+			REQUIRE(transfer.digest() == abcSha256);
+		}
+
+		SUBCASE("FTP download is written to its file via the write callback")
+		{
+			// GIVEN
+			const auto filePath = std::filesystem::temp_directory_path().append("digestDownload.txt").string();
+			auto file = File(filePath);
+			FtpDownloadTransferHandle transfer(file, url);
+			REQUIRE(writeFunction == nullptr);
+
+			// WHEN
+			transfer.setExpectedDigest(TransferDigest::Algorithm::SHA256, abcSha256);
+			AbstractTransferHandleUnitTestHarness::write(transfer, "abc");
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+
+			// THEN
+			REQUIRE(writeFunction == AbstractTransferHandleUnitTestHarness::writeCallback());
+			REQUIRE(transfer.digest() == abcSha256);
+			std::ifstream downloadedFile(filePath);
+			REQUIRE(std::string(std::istreambuf_iterator<char>(downloadedFile), {}) == "abc");
+			std::filesystem::remove(filePath);
+		}
+
+		SUBCASE("FTP upload is read from its file via the read callback")
+		{
+			// GIVEN
+			const auto filePath = std::filesystem::temp_directory_path().append("digestUpload.txt").string();
+			std::ofstream(filePath) << "abc";
+			auto file = File(filePath);
+			FtpUploadTransferHandle transfer(file, url);
+			REQUIRE(readFunction == nullptr);
+
+			// WHEN
+			transfer.setExpectedDigest(TransferDigest::Algorithm::SHA256, abcSha256);
+			char buffer[2];
+			const auto firstRead = AbstractTransferHandleUnitTestHarness::read(transfer, buffer, sizeof(buffer));
+			const auto secondRead = AbstractTransferHandleUnitTestHarness::read(transfer, buffer, sizeof(buffer));
+			const auto thirdRead = AbstractTransferHandleUnitTestHarness::read(transfer, buffer, sizeof(buffer));
+
+			// THEN
+			REQUIRE(readFunction == AbstractTransferHandleUnitTestHarness::readCallback());
+			REQUIRE(firstRead == 2);
+			REQUIRE(secondRead == 1);
+			REQUIRE(thirdRead == 0);
+			REQUIRE(transfer.digest() == abcSha256);
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+			std::filesystem::remove(filePath);
+		}
+	}
+
+	TEST_CASE("TransferHandlePool")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+		const auto otherUrl = Url("www.example.org");
+
+		constexpr int numberOfEasyHandles = 2;
+		CurlDummyHandle dummyEasyHandles[numberOfEasyHandles];
+		CURL *dummyEasyHandlePtrs[numberOfEasyHandles] = { &dummyEasyHandles[0], &dummyEasyHandles[1] };
+		SET_RETURN_SEQ(curl_easy_init, dummyEasyHandlePtrs, numberOfEasyHandles);
+
+		std::map<CURL*, AbstractTransferHandle*> transferByEasyHandle;
+		std::vector<std::string> urls;
+		curl_easy_setopt_fake.custom_fake = [&](CURL *handle, CURLoption option, va_list param) -> CURLcode {
+			if (option == CURLOPT_PRIVATE) {
+				transferByEasyHandle[handle] = va_arg(param, AbstractTransferHandle*);
+			}
+			if (option == CURLOPT_URL) {
+				urls.push_back(va_arg(param, const char*));
+			}
+			return CURLE_OK;
+		};
+
+		// CURLMSG_DONE is delivered via NetworkAccessManager::processTransferMessages()
+		CURLMsg msgDone { CURLMSG_DONE, nullptr, { .result = CURLE_OK } };
+		auto finishTransfer = [&](AbstractTransferHandle &transfer) {
+			msgDone.easy_handle = transfer.handle();
+			CURLMsg *msgReturnValues[2] = { &msgDone, nullptr };
+			SET_RETURN_SEQ(curl_multi_info_read, msgReturnValues, 2);
+			curl_multi_info_read_fake.return_val_seq_idx = 0;
+			curl_easy_getinfo_fake.custom_fake = [&](CURL *handle, CURLINFO info, va_list param) -> CURLcode {
+				if (info == CURLINFO_PRIVATE) {
+					auto abstractTransferHandle = va_arg(param, AbstractTransferHandle**);
+					*abstractTransferHandle = transferByEasyHandle[handle];
+				}
+				return CURLE_OK;
+			};
+			NetworkAccessManagerUnitTestHarness().timeoutTimer().timeout.emit();
+		};
+
+		SUBCASE("Start creates a transfer handle and registers it")
+		{
+			// GIVEN
+			TransferHandlePool<HttpTransferHandle> pool(networkAccessManager);
+
+			// WHEN
+			auto transfer = pool.start(url);
+
+			// THEN
+			REQUIRE(transfer != nullptr);
+			REQUIRE(curl_easy_init_fake.call_count == 1);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_add_handle_fake.arg1_val == transfer->handle());
+			REQUIRE(pool.numberOfActiveHandles() == 1);
+			REQUIRE(pool.numberOfIdleHandles() == 0);
+		}
+
+		SUBCASE("Finished transfer handle returns to the pool and is reused by the next transfer")
+		{
+			// GIVEN
+			TransferHandlePool<HttpTransferHandle> pool(networkAccessManager);
+			auto firstTransfer = pool.start(url);
+			auto numberOfFinishedSignals = 0;
+			firstTransfer->finished.connect([&]() { ++numberOfFinishedSignals; });
+
+			// WHEN
+			finishTransfer(*firstTransfer);
+
+			// THEN
+			REQUIRE(numberOfFinishedSignals == 1);
+			REQUIRE(pool.numberOfActiveHandles() == 0);
+			REQUIRE(pool.numberOfIdleHandles() == 1);
+
+			// WHEN
+			auto secondTransfer = pool.start(otherUrl);
+
+			// THEN (same handle, reset instead of recreated, previous slots disconnected)
+			REQUIRE(secondTransfer == firstTransfer);
+			REQUIRE(curl_easy_init_fake.call_count == 1);
+			REQUIRE(curl_easy_reset_fake.call_count == 1);
+			REQUIRE(curl_easy_cleanup_fake.call_count == 0);
+			REQUIRE(urls.back() == otherUrl.url());
+			REQUIRE(secondTransfer->url().url() == otherUrl.url());
+
+			finishTransfer(*secondTransfer);
+			REQUIRE(numberOfFinishedSignals == 1);
+		}
+
+		SUBCASE("Surplus idle transfer handles are deleted")
+		{
+			// GIVEN
+			TransferHandlePool<HttpTransferHandle> pool(networkAccessManager, 1);
+			auto firstTransfer = pool.start(url);
+			auto secondTransfer = pool.start(url);
+			REQUIRE(pool.numberOfActiveHandles() == 2);
+
+			// WHEN
+			finishTransfer(*firstTransfer);
+			finishTransfer(*secondTransfer);
+
+			// THEN
+			REQUIRE(pool.numberOfActiveHandles() == 0);
+			REQUIRE(pool.numberOfIdleHandles() == 1);
+			REQUIRE(curl_easy_cleanup_fake.call_count == 1);
+			REQUIRE(curl_easy_cleanup_fake.arg0_val == dummyEasyHandlePtrs[1]);
+		}
+
+		SUBCASE("Cancel unregisters transfer and returns it to the pool")
+		{
+			// GIVEN
+			TransferHandlePool<HttpTransferHandle> pool(networkAccessManager);
+			auto transfer = pool.start(url);
+
+			// WHEN
+			pool.cancel(*transfer);
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_remove_handle_fake.arg1_val == dummyEasyHandlePtrs[0]);
+			REQUIRE(pool.numberOfActiveHandles() == 0);
+			REQUIRE(pool.numberOfIdleHandles() == 1);
+		}
+
+		SUBCASE("Destroying a pool unregisters its running transfers")
+		{
+			// GIVEN
+			auto pool = std::make_unique<TransferHandlePool<HttpTransferHandle>>(networkAccessManager);
+			pool->start(url);
+			pool->start(url);
+
+			// WHEN
+			pool.reset();
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 2);
+			REQUIRE(curl_easy_cleanup_fake.call_count == 2);
+		}
+	}
+
+	TEST_CASE("WebSocketTransferHandle")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		CurlDummyHandle dummyEasyHandle;
+		void *dummyEasyHandlePtr = &dummyEasyHandle;
+		curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("wss://www.example.com");
+
+		std::unordered_map<CURLoption,std::variant<void*, long, std::string>> curl_easy_setopt_fake_arg3_history;
+		curl_easy_setopt_fake.custom_fake = [&](CURL*, CURLoption option, va_list param) -> CURLcode {
+			switch (option) {
+			case CURLOPT_NOPROGRESS:
+				curl_easy_setopt_fake_arg3_history[option] = va_arg(param,long);
+				break;
+			default:
+				curl_easy_setopt_fake_arg3_history[option] = va_arg(param,void*);
+				break;
+			}
+			return CURLE_OK;
+		};
+
+		long responseCode = 101;
+		AbstractTransferHandle *transferHandle = nullptr;
+		curl_easy_getinfo_fake.custom_fake = [&](CURL*, CURLINFO info, va_list param) -> CURLcode {
+			if (info == CURLINFO_RESPONSE_CODE) {
+				*va_arg(param, long*) = responseCode;
+			}
+			if (info == CURLINFO_PRIVATE) {
+				*va_arg(param, AbstractTransferHandle**) = transferHandle;
+			}
+			return CURLE_OK;
+		};
+
+		curl_ws_frame frame {};
+		curl_ws_meta_fake.return_val = &frame;
+
+		std::vector<std::pair<std::string, unsigned int>> sentMessages;
+		curl_ws_send_fake.custom_fake = [&](CURL*, const void *buffer, size_t size, size_t *sent, curl_off_t, unsigned int flags) -> CURLcode {
+			sentMessages.emplace_back(std::string(static_cast<const char*>(buffer), size), flags);
+			*sent = size;
+			return CURLE_OK;
+		};
+
+		SUBCASE("WebSocketTransferHandle CTOR initializes CURLOPT_HEADERFUNCTION and CURLOPT_HEADERDATA on valid handle")
+		{
+			// WHEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+
+			// THEN
+			REQUIRE(std::get<void*>(curl_easy_setopt_fake_arg3_history[CURLOPT_HEADERFUNCTION]) == WebSocketTransferHandleUnitTestHarness::headerCallback());
+			REQUIRE(std::get<void*>(curl_easy_setopt_fake_arg3_history[CURLOPT_HEADERDATA]) == &transfer);
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CONNECTING);
+		}
+
+		SUBCASE("Connection is open after the server switched protocols")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+
+			// WHEN
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "HTTP/1.1 101 Switching Protocols\r\n");
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CONNECTING);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+
+			// THEN
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::OPEN);
+		}
+
+		SUBCASE("Message received in one piece is delivered without copying it")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			const auto chunk = std::string("hello");
+			frame.flags = CURLWS_TEXT;
+			frame.len = chunk.size();
+
+			std::vector<std::pair<const char*, std::string>> messages;
+			transfer.messageReceived.connect([&](std::string_view payload, int flags) {
+				REQUIRE(flags == CURLWS_TEXT);
+				messages.emplace_back(payload.data(), std::string(payload));
+			});
+
+			// WHEN
+			const auto written = AbstractTransferHandleUnitTestHarness::write(transfer, chunk);
+
+			// THEN
+			REQUIRE(written == chunk.size());
+			REQUIRE(messages.size() == 1);
+			REQUIRE(messages[0].first == chunk.data());
+			REQUIRE(messages[0].second == chunk);
+		}
+
+		SUBCASE("Fragmented message is delivered once its last frame arrived")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			std::vector<std::pair<std::string, int>> messages;
+			transfer.messageReceived.connect([&](std::string_view payload, int flags) { messages.emplace_back(payload, flags); });
+
+			// WHEN (first frame in two chunks, second and final frame in one chunk)
+			frame = { .flags = CURLWS_BINARY | CURLWS_CONT, .offset = 0, .bytesleft = 3 };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "abc");
+			frame = { .flags = CURLWS_BINARY | CURLWS_CONT, .offset = 3, .bytesleft = 0 };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "def");
+			REQUIRE(messages.empty());
+			frame = { .flags = CURLWS_BINARY, .offset = 0, .bytesleft = 0 };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "ghi");
+
+			// THEN
+			REQUIRE(messages.size() == 1);
+			REQUIRE(messages[0].first == "abcdefghi");
+			REQUIRE(messages[0].second == CURLWS_BINARY);
+		}
+
+		SUBCASE("Control frames are not delivered as messages")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			auto numberOfMessages = 0;
+			transfer.messageReceived.connect([&]() { ++numberOfMessages; });
+
+			// WHEN
+			frame = { .flags = CURLWS_PING };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "ping");
+			frame = { .flags = CURLWS_CLOSE };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "\x03\xe8" "bye");
+
+			// THEN
+			REQUIRE(numberOfMessages == 0);
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSING);
+		}
+
+		SUBCASE("Close frame of the peer is answered with its status code and ends the transfer")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+			transfer.send("dropped");
+			std::vector<int> results;
+			transfer.finished.connect([&](int result) { results.push_back(result); });
+
+			// WHEN
+			frame = { .flags = CURLWS_CLOSE };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "\x03\xe9" "going away");
+
+			// THEN
+			REQUIRE(sentMessages.size() == 1);
+			REQUIRE(sentMessages[0] == std::pair<std::string, unsigned int>(std::string("\x03\xe9"), CURLWS_CLOSE));
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSING);
+			REQUIRE(results.empty());
+
+			// WHEN
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_OK });
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSED);
+			REQUIRE(sentMessages.size() == 1);
+		}
+
+		SUBCASE("Close frame answering our own ends the transfer without answering it")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+			transfer.close();
+			app.processEvents(1);
+			REQUIRE(sentMessages.size() == 1);
+
+			// WHEN
+			frame = { .flags = CURLWS_CLOSE };
+			AbstractTransferHandleUnitTestHarness::write(transfer, "\x03\xe8");
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(sentMessages.size() == 1);
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSED);
+		}
+
+		SUBCASE("Messages sent while connecting are sent batched once connection is open")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			transfer.send("first");
+			transfer.send("second", CURLWS_BINARY);
+			app.processEvents(1);
+			REQUIRE(curl_ws_send_fake.call_count == 0);
+			REQUIRE(transfer.numberOfQueuedMessages.get() == 2);
+
+			// WHEN
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+			transfer.send("third");
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(sentMessages.size() == 3);
+			REQUIRE(sentMessages[0] == std::pair<std::string, unsigned int>("first", CURLWS_TEXT));
+			REQUIRE(sentMessages[1] == std::pair<std::string, unsigned int>("second", CURLWS_BINARY));
+			REQUIRE(sentMessages[2] == std::pair<std::string, unsigned int>("third", CURLWS_TEXT));
+			REQUIRE(transfer.numberOfQueuedMessages.get() == 0);
+		}
+
+		SUBCASE("Rest of a message libcurl could not send is sent once the socket is writable")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			transferHandle = &transfer;
+			int sockets[2];
+			REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+			NetworkAccessManagerUnitTestHarness::socketCallback(dummyEasyHandlePtr, sockets[0], CURL_POLL_IN);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+			std::vector<std::string> payloads;
+			CURLcode results[3] = { CURLE_OK, CURLE_AGAIN, CURLE_OK };
+			size_t sentSizes[3] = { 3, 0, 4 };
+			curl_ws_send_fake.custom_fake = [&](CURL*, const void *buffer, size_t size, size_t *sent, curl_off_t, unsigned int) -> CURLcode {
+				const auto call = payloads.size();
+				payloads.emplace_back(static_cast<const char*>(buffer), size);
+				*sent = sentSizes[call];
+				return results[call];
+			};
+
+			// WHEN
+			transfer.send("message");
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(payloads == std::vector<std::string>{ "message", "sage" });
+			REQUIRE(transfer.numberOfQueuedMessages.get() == 1);
+
+			// WHEN (the socket is writable, then the flush is due)
+			app.processEvents(10);
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(payloads == std::vector<std::string>{ "message", "sage", "sage" });
+			REQUIRE(transfer.numberOfQueuedMessages.get() == 0);
+			NetworkAccessManagerUnitTestHarness::socketCallback(dummyEasyHandlePtr, sockets[0], CURL_POLL_REMOVE);
+			::close(sockets[0]);
+			::close(sockets[1]);
+		}
+
+		SUBCASE("Failing to send a message fails the connection")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+			curl_ws_send_fake.custom_fake = nullptr;
+			curl_ws_send_fake.return_val = CURLE_SEND_ERROR;
+			std::vector<int> results;
+			transfer.finished.connect([&](int result) { results.push_back(result); });
+
+			// WHEN
+			transfer.send("message");
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(results == std::vector<int>{ CURLE_SEND_ERROR });
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSED);
+			REQUIRE(transfer.numberOfQueuedMessages.get() == 0);
+			REQUIRE_FALSE(transfer.error().empty());
+		}
+
+		SUBCASE("Close sends close frame and refuses further messages")
+		{
+			// GIVEN
+			WebSocketTransferHandle transfer(networkAccessManager, url);
+			WebSocketTransferHandleUnitTestHarness::header(transfer, "\r\n");
+
+			// WHEN
+			REQUIRE_FALSE(transfer.close(1001, "bye"));
+			app.processEvents(1);
+
+			// THEN
+			REQUIRE(transfer.connectionState.get() == WebSocketTransferHandle::ConnectionState::CLOSING);
+			REQUIRE(transfer.send("too late"));
+			REQUIRE(sentMessages.size() == 1);
+			REQUIRE(sentMessages[0] == std::pair<std::string, unsigned int>(std::string("\x03\xe9" "bye"), CURLWS_CLOSE));
+		}
+	}
+
+	TEST_CASE("SseTransferHandle")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		CurlDummyHandle dummyEasyHandle;
+		void *dummyEasyHandlePtr = &dummyEasyHandle;
+		curl_easy_init_fake.return_val = dummyEasyHandlePtr;
+
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("https://www.example.com/events");
+
+		long responseCode = 200;
+		const char *contentType = "text/event-stream; charset=utf-8";
+		curl_easy_getinfo_fake.custom_fake = [&](CURL*, CURLINFO info, va_list param) -> CURLcode {
+			if (info == CURLINFO_RESPONSE_CODE) {
+				*va_arg(param, long*) = responseCode;
+			}
+			if (info == CURLINFO_CONTENT_TYPE) {
+				*va_arg(param, const char**) = contentType;
+			}
+			return CURLE_OK;
+		};
+
+		std::vector<std::string> requestHeaders;
+		curl_slist_append_fake.custom_fake = [&](curl_slist *list, const char *header) -> curl_slist* {
+			requestHeaders.push_back(header);
+			return list;
+		};
+
+		std::vector<std::tuple<std::string, std::string, std::string>> events;
+		auto collectEvents = [&](const ServerSentEvent &event) {
+			events.emplace_back(event.type, event.data, event.lastEventId);
+		};
+
+		SUBCASE("Open registers transfer and requests event stream")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+
+			// WHEN
+			REQUIRE_FALSE(transfer.open());
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+			REQUIRE(std::ranges::find(requestHeaders, "Accept: text/event-stream") != requestHeaders.end());
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::CONNECTING);
+		}
+
+		SUBCASE("Events are emitted as soon as they are complete")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.eventReceived.connect(collectEvents);
+			transfer.open();
+
+			// WHEN (lines and line endings split across chunks)
+			AbstractTransferHandleUnitTestHarness::write(transfer, ": keep alive\ndata: first\n\nevent: upd");
+			REQUIRE(events.size() == 1);
+			AbstractTransferHandleUnitTestHarness::write(transfer, "ate\r\ndata: line 1\r");
+			AbstractTransferHandleUnitTestHarness::write(transfer, "\ndata:line 2\rid: 42\r\n");
+			REQUIRE(events.size() == 1);
+			AbstractTransferHandleUnitTestHarness::write(transfer, "\r\n");
+
+			// THEN
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::OPEN);
+			REQUIRE(events.size() == 2);
+			REQUIRE(events[0] == std::make_tuple(std::string("message"), std::string("first"), std::string()));
+			REQUIRE(events[1] == std::make_tuple(std::string("update"), std::string("line 1\nline 2"), std::string("42")));
+			REQUIRE(transfer.lastEventId() == "42");
+		}
+
+		SUBCASE("Event without data is not emitted")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.eventReceived.connect(collectEvents);
+			transfer.open();
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(transfer, "event: empty\nid: 7\n\ndata\n\n");
+
+			// THEN (the type does not carry over, an empty data field counts as data)
+			REQUIRE(events.size() == 1);
+			REQUIRE(events[0] == std::make_tuple(std::string("message"), std::string(), std::string("7")));
+		}
+
+		SUBCASE("Server sets the reconnection time")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.open();
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::write(transfer, "retry: 1500\nretry: soon\n\n");
+
+			// THEN
+			REQUIRE(transfer.reconnectionTime() == std::chrono::milliseconds(1500));
+		}
+
+		SUBCASE("Response which is no event stream aborts transfer without reconnect")
+		{
+			// GIVEN
+			contentType = "text/html";
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.open();
+
+			// WHEN
+			const auto written = AbstractTransferHandleUnitTestHarness::write(transfer, "<html>");
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_WRITE_ERROR);
+
+			// THEN
+			REQUIRE(written == 0);
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::CLOSED);
+		}
+
+		SUBCASE("Ended stream is reconnected with Last-Event-ID")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.open();
+			AbstractTransferHandleUnitTestHarness::write(transfer, "retry: 1\nid: 42\ndata: x\n\n");
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+
+			// THEN
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::WAITING_FOR_RECONNECT);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+
+			// WHEN
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(curl_multi_add_handle_fake.call_count == 2);
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::CONNECTING);
+			REQUIRE(requestHeaders.back() == "Last-Event-ID: 42");
+		}
+
+		SUBCASE("No reconnect after server responded with 204")
+		{
+			// GIVEN
+			responseCode = 204;
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.open();
+
+			// WHEN
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_OK);
+
+			// THEN
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::CLOSED);
+		}
+
+		SUBCASE("Close unregisters transfer and stops reconnecting")
+		{
+			// GIVEN
+			SseTransferHandle transfer(networkAccessManager, url);
+			transfer.open();
+			AbstractTransferHandleUnitTestHarness::write(transfer, "retry: 1\n\n");
+			AbstractTransferHandleUnitTestHarness::transferDone(transfer, CURLE_RECV_ERROR);
+
+			// WHEN
+			transfer.close();
+			app.processEvents(10);
+
+			// THEN
+			REQUIRE(curl_multi_remove_handle_fake.call_count == 1);
+			REQUIRE(curl_multi_add_handle_fake.call_count == 1);
+			REQUIRE(transfer.connectionState.get() == SseTransferHandle::ConnectionState::CLOSED);
+		}
 	}
 }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "network_access_manager.h"
+
+/*
+ * NetworkAccessManagerUnitTestHarness allows for
+ * - invoking callbacks, that would otherwise be invoked by libcurl
+ * - accessing a few private members of NetworkAccessManager to do
+ *   white box testing
+ */
+class NetworkAccessManagerUnitTestHarness
+{
+  public:
+	static int socketCallback(CURL *handle, curl_socket_t socket, int eventType) {
+		return NetworkAccessManager::socketCallback(handle, socket, eventType, &NetworkAccessManager::instance(), nullptr);
+	}
+	static int timerCallback(CURLM *handle, long timeoutMs) {
+		return NetworkAccessManager::timerCallback(handle, timeoutMs, &NetworkAccessManager::instance().m_timeoutTimer);
+	}
+
+	const Timer &timeoutTimer() { return NetworkAccessManager::instance().m_timeoutTimer; }
+	const Timer &deadlineTimer() { return NetworkAccessManager::instance().m_deadlineTimer; }
+	const TimerWheel &deadlineWheel() { return NetworkAccessManager::instance().m_deadlineWheel; }
+	NetworkAccessManager::FileDescriptorNotifierRegistry &fileDescriptorNotifierRegistry() { return NetworkAccessManager::instance().m_fdnRegistry; }
+	// the singleton outlives test cases
+	void disablePersistentState() { NetworkAccessManager::instance().m_persistentState.reset(); }
+};
@@ -0,0 +1,376 @@
+/*
+ * This implements simulation tests for class NetworkAccessManager.
+ *
+ * In contrast to tst_network_access_manager.cpp, which checks single libcurl calls,
+ * these tests run large numbers of transfers through NetworkAccessManager's
+ * FileDescriptorNotifier registry, timeout timer and message processing.
+ * libcurl and the network are substituted by SimulatedNetwork
+ * (see tst_simulated_network.h), a deterministic discrete event simulation
+ * on a virtual clock. Thus tens of thousands of transfers over a slow and lossy
+ * network take milliseconds of wall time and every run yields the same result.
+ *
+ */
+
+#include <KDFoundation/core_application.h>
+#include "http_transfer_handle.h"
+#include "network_access_manager.h"
+#include "transfer_batch.h"
+#include "transfer_handle_pool.h"
+#include "tst_simulated_network.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <doctest/doctest.h>
+
+struct CurlDummyHandle {
+	// we use this as 'non-nullptr' return value for curl_multi_init()
+};
+
+CurlDummyHandle curlDummyMultiHandle;
+void *dummyMultiHandlePtr = &curlDummyMultiHandle;
+
+auto app = CoreApplication();
+
+namespace {
+
+struct SimulationResult
+{
+	std::size_t numberOfSucceededTransfers { 0 };
+	std::size_t numberOfBytesRead { 0 };
+	SimulatedNetwork::Microseconds duration { 0 };
+	std::size_t numberOfLostSegments { 0 };
+	bool isIdle { false };
+};
+
+// registers all transfers at once and runs the simulation until all of them finished
+SimulationResult runTransfers(SimulatedNetwork &network, std::size_t numberOfTransfers)
+{
+	auto &networkAccessManager = NetworkAccessManager::instance();
+	const auto url = Url("www.example.com");
+
+	SimulationResult result;
+	std::vector<std::unique_ptr<HttpTransferHandle>> transfers;
+	transfers.reserve(numberOfTransfers);
+	for (std::size_t i = 0; i < numberOfTransfers; ++i) {
+		auto &transfer = transfers.emplace_back(std::make_unique<HttpTransferHandle>(url));
+		transfer->finished.connect([&result, transfer = transfer.get()](int curlResult) {
+			if (curlResult == CURLE_OK) {
+				++result.numberOfSucceededTransfers;
+				result.numberOfBytesRead += transfer->dataRead().size();
+			}
+		});
+		networkAccessManager.registerTransfer(*transfer);
+	}
+
+	result.isIdle = network.run();
+	result.duration = network.now();
+	result.numberOfLostSegments = network.statistics().numberOfLostSegments;
+	return result;
+}
+
+} // namespace
+
+TEST_SUITE("NetworkAccessManager on a simulated network")
+{
+	TEST_CASE("Tens of thousands of concurrent transfers finish")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		NetworkAccessManagerUnitTestHarness unitTestHarness;
+
+		constexpr std::size_t numberOfTransfers = 20000;
+		constexpr std::size_t responseSize = 4 * 1024;
+
+		SimulatedNetwork network({ .segmentSize = 1024 });
+		network.setDefaultScript({ .responseSize = responseSize });
+
+		// WHEN
+		const auto result = runTransfers(network, numberOfTransfers);
+
+		// THEN
+		REQUIRE(result.isIdle);
+		REQUIRE(result.numberOfSucceededTransfers == numberOfTransfers);
+		REQUIRE(result.numberOfBytesRead == numberOfTransfers * responseSize);
+		REQUIRE(network.statistics().maxNumberOfOpenSockets == numberOfTransfers);
+		REQUIRE(network.statistics().numberOfMissedSocketEvents == 0);
+
+		// THEN (all sockets got unregistered and curl does not wait for a timeout anymore)
+		REQUIRE(unitTestHarness.fileDescriptorNotifierRegistry().readMap.empty());
+		REQUIRE(unitTestHarness.fileDescriptorNotifierRegistry().writeMap.empty());
+		REQUIRE_FALSE(unitTestHarness.timeoutTimer().running.get());
+	}
+
+	TEST_CASE("Simulation of a lossy network is deterministic")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+
+		const auto config = SimulatedNetworkConfig { .latencyUs = 25000, .bandwidthBytesPerMs = 1024, .segmentSize = 4096, .lossRate = 0.05, .seed = 42 };
+		const auto script = SimulatedTransferScript { .responseSize = 64 * 1024 };
+
+		auto simulate = [&]() {
+			SimulatedNetwork network(config);
+			network.setDefaultScript(script);
+			return runTransfers(network, 1000);
+		};
+
+		// WHEN
+		const auto firstResult = simulate();
+		const auto secondResult = simulate();
+
+		// THEN
+		REQUIRE(firstResult.isIdle);
+		REQUIRE(firstResult.numberOfSucceededTransfers == 1000);
+		REQUIRE(firstResult.numberOfLostSegments > 0);
+
+		REQUIRE(secondResult.isIdle);
+		REQUIRE(secondResult.numberOfSucceededTransfers == firstResult.numberOfSucceededTransfers);
+		REQUIRE(secondResult.numberOfLostSegments == firstResult.numberOfLostSegments);
+		REQUIRE(secondResult.duration == firstResult.duration);
+	}
+
+	TEST_CASE("Transfer waiting for a libcurl timeout finishes after other transfers caused socket events")
+	{
+		// libcurl calls the timer callback only if its next deadline changes. Socket events of
+		// other transfers must therefore not stop the timeout timer, otherwise a transfer
+		// waiting for a timeout (here: "Expect: 100-continue") never proceeds.
+
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		SimulatedNetwork network;
+		HttpTransferHandle waitingTransfer(url);
+		HttpTransferHandle transfer(url);
+		network.setScript(waitingTransfer, { .expect100TimeoutMs = 1000 });
+
+		auto numberOfFinishedTransfers = 0;
+		waitingTransfer.finished.connect([&](int) { ++numberOfFinishedTransfers; });
+		transfer.finished.connect([&](int) { ++numberOfFinishedTransfers; });
+
+		// WHEN
+		networkAccessManager.registerTransfer(waitingTransfer);
+		networkAccessManager.registerTransfer(transfer);
+
+		// THEN
+		REQUIRE(network.run());
+		REQUIRE(numberOfFinishedTransfers == 2);
+		REQUIRE(network.now() >= 1000 * 1000);
+	}
+
+	TEST_CASE("Timeout timer restarts when libcurl requests the same timeout again")
+	{
+		// The timeout requested by libcurl counts from the call of the timer callback, even
+		// if the timeout timer is already running with the same interval. Otherwise the timer
+		// expires too early and libcurl does not call the timer callback again.
+
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		SimulatedNetwork network;
+		HttpTransferHandle cancelledTransfer(url);
+		HttpTransferHandle transfer(url);
+		network.setScript(cancelledTransfer, { .expect100TimeoutMs = 1000 });
+		network.setScript(transfer, { .expect100TimeoutMs = 1000 });
+
+		auto numberOfFinishedTransfers = 0;
+		transfer.finished.connect([&](int) { ++numberOfFinishedTransfers; });
+
+		// GIVEN (both transfers connected and wait for "100 Continue", their timeouts are 0.5 ms apart)
+		networkAccessManager.registerTransfer(cancelledTransfer);
+		REQUIRE_FALSE(network.run(500));
+		networkAccessManager.registerTransfer(transfer);
+		while (network.statistics().numberOfSocketEvents < 2) {
+			REQUIRE_FALSE(network.run(100));
+		}
+
+		// WHEN (libcurl requests a timeout of 1000 ms again)
+		networkAccessManager.unregisterTransfer(cancelledTransfer);
+
+		// THEN
+		REQUIRE(network.run());
+		REQUIRE(numberOfFinishedTransfers == 1);
+		REQUIRE(network.now() >= 1020500);
+	}
+
+	TEST_CASE("Scripted errors are reported by finished")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		SimulatedNetwork network;
+		HttpTransferHandle failingTransfer(url);
+		HttpTransferHandle transfer(url);
+		network.setScript(failingTransfer, { .result = CURLE_RECV_ERROR });
+
+		std::vector<int> results;
+		failingTransfer.finished.connect([&](int result) { results.push_back(result); });
+		transfer.finished.connect([&](int result) { results.push_back(result); });
+
+		// WHEN
+		networkAccessManager.registerTransfer(failingTransfer);
+		networkAccessManager.registerTransfer(transfer);
+
+		// THEN
+		REQUIRE(network.run());
+		REQUIRE(results.size() == 2);
+		REQUIRE(std::count(results.begin(), results.end(), CURLE_RECV_ERROR) == 1);
+		REQUIRE(std::count(results.begin(), results.end(), CURLE_OK) == 1);
+	}
+
+	TEST_CASE("Flow control bounds the data buffered for a slow consumer")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		constexpr std::size_t responseSize = 4 * 1024 * 1024;
+		constexpr std::size_t segmentSize = 16 * 1024;
+		constexpr std::size_t lowWatermark = 64 * 1024;
+		constexpr std::size_t highWatermark = 256 * 1024;
+
+		SimulatedNetwork network({ .segmentSize = segmentSize });
+		HttpTransferHandle transfer(url);
+		network.setScript(transfer, { .responseSize = responseSize });
+		transfer.setWatermarks(lowWatermark, highWatermark);
+
+		std::size_t maxNumberOfBytesBuffered = 0;
+		transfer.numberOfBytesBuffered.valueChanged().connect([&](std::size_t numberOfBytes) {
+			maxNumberOfBytesBuffered = std::max(maxNumberOfBytesBuffered, numberOfBytes);
+		});
+		auto result = -1;
+		transfer.finished.connect([&](int curlResult) { result = curlResult; });
+
+		// WHEN (the consumer takes 32 KiB every 10 ms, i.e. much slower than the network delivers)
+		networkAccessManager.registerTransfer(transfer);
+		std::size_t numberOfBytesConsumed = 0;
+		for (auto i = 0; (i < 1000) && !network.run(10000); ++i) {
+			numberOfBytesConsumed += transfer.takeDataRead(32 * 1024).size();
+		}
+		numberOfBytesConsumed += transfer.takeDataRead().size();
+
+		// THEN
+		REQUIRE(result == CURLE_OK);
+		REQUIRE(numberOfBytesConsumed == responseSize);
+		REQUIRE(network.statistics().numberOfPauses > 0);
+		REQUIRE(maxNumberOfBytesBuffered <= highWatermark + segmentSize);
+		REQUIRE_FALSE(transfer.isPaused());
+	}
+
+	TEST_CASE("Cancelled transfers free their connections immediately")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		auto &networkAccessManager = NetworkAccessManager::instance();
+		const auto url = Url("www.example.com");
+
+		constexpr std::size_t numberOfTransfers = 1000;
+
+		SimulatedNetwork network({ .segmentSize = 1024 });
+		network.setDefaultScript({ .responseSize = 1024 * 1024 });
+
+		// GIVEN (e.g. all requests of a view, which the user leaves while they are running)
+		CancellationToken token;
+		std::vector<std::unique_ptr<HttpTransferHandle>> transfers;
+		std::size_t numberOfCancelledTransfers = 0;
+		for (std::size_t i = 0; i < numberOfTransfers; ++i) {
+			auto &transfer = *transfers.emplace_back(std::make_unique<HttpTransferHandle>(url));
+			transfer.finished.connect([&](int result) { numberOfCancelledTransfers += (result == CURLE_ABORTED_BY_CALLBACK) ? 1 : 0; });
+			networkAccessManager.registerTransfer(transfer, { .deadline = std::chrono::hours(1), .cancellationToken = token });
+		}
+		REQUIRE_FALSE(network.run(10000));
+		REQUIRE(network.numberOfOpenSockets() == numberOfTransfers);
+
+		// WHEN
+		token.cancel();
+
+		// THEN
+		REQUIRE(numberOfCancelledTransfers == numberOfTransfers);
+		REQUIRE(network.numberOfRunningTransfers() == 0);
+		REQUIRE(network.numberOfOpenSockets() == 0);
+		REQUIRE(NetworkAccessManagerUnitTestHarness().deadlineWheel().size() == 0);
+	}
+
+	TEST_CASE("TransferHandlePool reuses transfer handles of consecutive transfers")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		const auto url = Url("www.example.com");
+
+		constexpr std::size_t numberOfTransfers = 10000;
+		constexpr std::size_t numberOfConcurrentTransfers = 50;
+
+		SimulatedNetwork network({ .latencyUs = 2000 });
+		TransferHandlePool<HttpTransferHandle> pool(NetworkAccessManager::instance(), numberOfConcurrentTransfers);
+
+		// like polling, every finished transfer immediately starts the next one
+		std::size_t numberOfStartedTransfers = 0;
+		std::size_t numberOfSucceededTransfers = 0;
+		std::function<void()> startNextTransfer = [&]() {
+			++numberOfStartedTransfers;
+			auto transfer = pool.start(url);
+			REQUIRE(transfer != nullptr);
+			transfer->finished.connect([&](int result) {
+				numberOfSucceededTransfers += (result == CURLE_OK) ? 1 : 0;
+				if (numberOfStartedTransfers < numberOfTransfers) {
+					startNextTransfer();
+				}
+			});
+		};
+
+		// WHEN
+		for (std::size_t i = 0; i < numberOfConcurrentTransfers; ++i) {
+			startNextTransfer();
+		}
+
+		// THEN
+		REQUIRE(network.run());
+		REQUIRE(numberOfSucceededTransfers == numberOfTransfers);
+		// a transfer starting its successor from within finished is still active, so its successor gets
+		// another handle -> at most two handles per concurrent transfer, instead of one per transfer
+		REQUIRE(curl_easy_init_fake.call_count <= 2 * numberOfConcurrentTransfers);
+		REQUIRE(pool.numberOfActiveHandles() == 0);
+		REQUIRE(pool.numberOfIdleHandles() <= numberOfConcurrentTransfers);
+	}
+
+	TEST_CASE("TransferBatch keeps its concurrency limit on a simulated network")
+	{
+		fff_setup();
+		curl_multi_init_fake.return_val = dummyMultiHandlePtr;
+		const auto url = Url("www.example.com");
+
+		constexpr std::size_t numberOfTransfers = 10000;
+		constexpr std::size_t maxConcurrentTransfers = 100;
+
+		SimulatedNetwork network({ .latencyUs = 5000, .lossRate = 0.01 });
+		TransferBatch batch(NetworkAccessManager::instance(), { .maxConcurrentTransfers = maxConcurrentTransfers });
+
+		std::vector<std::unique_ptr<AbstractTransferHandle>> transfers;
+		for (std::size_t i = 0; i < numberOfTransfers; ++i) {
+			transfers.push_back(std::make_unique<HttpTransferHandle>(url));
+		}
+
+		auto numberOfFinishedSignals = 0;
+		batch.finished.connect([&](const std::vector<CURLcode>&) { ++numberOfFinishedSignals; });
+
+		// WHEN
+		REQUIRE_FALSE(batch.submit(std::move(transfers)));
+
+		// THEN
+		REQUIRE(network.run());
+		REQUIRE(numberOfFinishedSignals == 1);
+		REQUIRE(batch.numberOfFinishedTransfers.get() == numberOfTransfers);
+		REQUIRE(batch.numberOfFailedTransfers.get() == 0);
+		REQUIRE(network.statistics().maxNumberOfOpenSockets == maxConcurrentTransfers);
+	}
+}
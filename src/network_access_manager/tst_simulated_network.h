@@ -0,0 +1,554 @@
+#pragma once
+
+#include "tst_libcurl_stub.h"
+#include "tst_network_access_manager_harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Struct: SimulatedNetworkConfig
+ *
+ * Properties of the simulated network, shared by all simulated sockets.
+ * All times are virtual, i.e. they only elapse on the clock of SimulatedNetwork.
+ */
+struct SimulatedNetworkConfig
+{
+	std::uint64_t latencyUs { 10000 }; // one way
+	std::uint64_t bandwidthBytesPerMs { 1024 * 1024 }; // per socket
+	std::size_t segmentSize { 16 * 1024 };
+	double lossRate { 0.0 }; // probability of a segment getting lost and retransmitted
+	std::uint64_t retransmissionTimeoutUs { 200000 };
+	std::uint32_t seed { 1 };
+};
+
+/*
+ * Struct: SimulatedTransferScript
+ *
+ * Scripted libcurl behavior of a single transfer.
+ */
+struct SimulatedTransferScript
+{
+	std::size_t responseSize { 1024 };
+	CURLcode result { CURLE_OK };
+
+	// if > 0, the transfer waits for "100 Continue" after sending its request until a
+	// libcurl internal timeout expires (see CURLOPT_EXPECT_100_TIMEOUT_MS), i.e. it can
+	// only proceed if NetworkAccessManager's timeout timer fires
+	long expect100TimeoutMs { 0 };
+};
+
+/*
+ * Class: SimulatedNetwork
+ *
+ * Deterministic discrete event simulation of the libcurl multi socket interface.
+ * It replaces the fakes of tst_libcurl_stub.h with a scripted libcurl, which
+ * - opens simulated sockets and announces them via NetworkAccessManager's socket callback
+ * - calls NetworkAccessManager's timer callback only if its next deadline changed (like libcurl)
+ * - delivers the response payload via CURLOPT_WRITEFUNCTION and honors CURL_WRITEFUNC_PAUSE
+ *   until the transfer is resumed by curl_easy_pause()
+ * - delivers CURLMSG_DONE via curl_multi_info_read()
+ *
+ * Socket readiness is delivered by emitting the FileDescriptorNotifiers found in
+ * NetworkAccessManager's registry and timeouts by emitting NetworkAccessManager's
+ * timeout timer once its interval elapsed since it got (re)started,
+ * i.e. through the real code paths but on a virtual clock. No real time
+ * elapses and simulated sockets are never polled, which is why their descriptors
+ * are numbered above the range of real file descriptors.
+ *
+ * Results only depend on SimulatedNetworkConfig and the scripts, not on the machine
+ * running the simulation.
+ */
+class SimulatedNetwork
+{
+  public:
+	using Microseconds = std::uint64_t;
+	static constexpr Microseconds c_never = std::numeric_limits<Microseconds>::max();
+
+	struct Statistics
+	{
+		std::size_t numberOfSocketEvents { 0 };
+		std::size_t numberOfMissedSocketEvents { 0 }; // socket got ready, but no matching FileDescriptorNotifier was registered
+		std::size_t numberOfTimeoutEvents { 0 };
+		std::size_t numberOfLostSegments { 0 };
+		std::size_t numberOfFinishedTransfers { 0 };
+		std::size_t numberOfPauses { 0 };
+		std::size_t maxNumberOfOpenSockets { 0 };
+	};
+
+	explicit SimulatedNetwork(SimulatedNetworkConfig config = {}) : m_config{config}, m_payload(config.segmentSize, 'x'), m_random{config.seed} {
+		curl_easy_init_fake.custom_fake = [this]() { return easyInit(); };
+		curl_easy_setopt_fake.custom_fake = [this](CURL *easyHandle, CURLoption option, va_list param) { return easySetopt(easyHandle, option, param); };
+		curl_easy_getinfo_fake.custom_fake = [this](CURL *easyHandle, CURLINFO info, va_list param) { return easyGetinfo(easyHandle, info, param); };
+		curl_easy_pause_fake.custom_fake = [this](CURL *easyHandle, int bitmask) { return easyPause(easyHandle, bitmask); };
+		curl_multi_add_handle_fake.custom_fake = [this](CURLM*, CURL *easyHandle) { return multiAddHandle(easyHandle); };
+		curl_multi_remove_handle_fake.custom_fake = [this](CURLM*, CURL *easyHandle) { return multiRemoveHandle(easyHandle); };
+		curl_multi_socket_action_fake.custom_fake = [this](CURLM*, curl_socket_t socket, int eventsBitmask, int *runningHandles) { return multiSocketAction(socket, eventsBitmask, runningHandles); };
+		curl_multi_info_read_fake.custom_fake = [this](CURLM*, int *msgsInQueue) { return multiInfoRead(msgsInQueue); };
+
+		// like KDFoundation::Timer, the timeout timer expires one interval after it got (re)started
+		const auto &timeoutTimer = NetworkAccessManagerUnitTestHarness().timeoutTimer();
+		m_timerRunningConnection = timeoutTimer.running.valueChanged().connect([this](bool running) {
+			if (running) {
+				restartTimer();
+			}
+		});
+		m_timerIntervalConnection = timeoutTimer.interval.valueChanged().connect([this]() { restartTimer(); });
+	}
+
+	~SimulatedNetwork() {
+		// the custom fakes and connections refer to this instance
+		fff_setup();
+		m_timerRunningConnection.disconnect();
+		m_timerIntervalConnection.disconnect();
+	}
+
+	SimulatedNetwork(const SimulatedNetwork&) = delete;
+	SimulatedNetwork &operator=(const SimulatedNetwork&) = delete;
+
+	// script applied to transfers without a script of their own
+	void setDefaultScript(const SimulatedTransferScript &script) { m_defaultScript = script; }
+
+	// must be called before the transfer is registered
+	void setScript(const AbstractTransferHandle &transfer, const SimulatedTransferScript &script) { m_scripts[transfer.handle()] = script; }
+
+	// Advances the virtual clock from event to event until no transfer is running anymore.
+	// Returns false if the simulation stalled (transfers are running, but no event is pending)
+	// or if maxDuration elapsed before all transfers finished. In the latter case the
+	// virtual clock is advanced by maxDuration.
+	bool run(Microseconds maxDuration = c_never) {
+		const auto end = (maxDuration == c_never) ? c_never : m_now + maxDuration;
+		const auto &timeoutTimer = NetworkAccessManagerUnitTestHarness().timeoutTimer();
+
+		while (m_numberOfRunningTransfers > 0) {
+			dropStaleEvents(m_socketEvents, [](const SimulatedTransfer &transfer) { return transfer.socketGeneration; });
+			const auto nextSocketEvent = m_socketEvents.empty() ? c_never : m_socketEvents.top().time;
+			const auto nextTimeout = timeoutTimer.running.get() ? m_timerExpiry : c_never;
+			const auto next = std::min(nextSocketEvent, nextTimeout);
+			if ((next == c_never) || (next > end)) {
+				m_now = (end == c_never) ? m_now : end;
+				return false;
+			}
+			m_now = std::max(m_now, next);
+
+			if (nextTimeout <= nextSocketEvent) {
+				++m_statistics.numberOfTimeoutEvents;
+				restartTimer(); // the timer is periodic unless it gets stopped
+				timeoutTimer.timeout.emit();
+			} else {
+				const auto event = m_socketEvents.top();
+				m_socketEvents.pop();
+				deliverSocketEvent(event.easyHandle);
+			}
+		}
+		return true;
+	}
+
+	[[nodiscard]] Microseconds now() const { return m_now; }
+	[[nodiscard]] std::size_t numberOfRunningTransfers() const { return m_numberOfRunningTransfers; }
+	[[nodiscard]] std::size_t numberOfOpenSockets() const { return m_transferBySocket.size(); }
+	[[nodiscard]] const Statistics &statistics() const { return m_statistics; }
+
+  private:
+	enum class Phase {
+		ADDED,
+		CONNECTING,
+		WAITING_FOR_CONTINUE,
+		RECEIVING,
+		DONE
+	};
+
+	struct SimulatedEasyHandle
+	{
+		AbstractTransferHandle *privateData { nullptr };
+		curl_write_callback writeFunction { nullptr };
+		void *writeData { nullptr };
+	};
+
+	struct SimulatedTransfer
+	{
+		SimulatedTransferScript script;
+		Phase phase { Phase::ADDED };
+		curl_socket_t socket { CURL_SOCKET_BAD };
+		int pollEvent { CURL_POLL_NONE };
+		Microseconds readyAt { c_never };
+		std::uint64_t socketGeneration { 0 }; // invalidates queued socket events
+		std::uint64_t deadlineGeneration { 0 }; // invalidates queued deadlines
+		Microseconds nextSegmentSent { c_never };
+		Microseconds nextSegmentArrival { c_never };
+		std::size_t bytesReceived { 0 };
+		bool isPaused { false }; // the write function returned CURL_WRITEFUNC_PAUSE
+	};
+
+	struct Event
+	{
+		Microseconds time;
+		std::uint64_t sequence; // keeps the order of simultaneous events stable
+		CURL *easyHandle;
+		std::uint64_t generation;
+
+		bool operator>(const Event &other) const { return (time != other.time) ? (time > other.time) : (sequence > other.sequence); }
+	};
+	using EventQueue = std::priority_queue<Event, std::vector<Event>, std::greater<Event>>;
+
+	static constexpr curl_socket_t c_firstSocket = 1 << 24;
+
+	static SimulatedEasyHandle &simulatedEasyHandle(CURL *easyHandle) { return *reinterpret_cast<SimulatedEasyHandle*>(easyHandle); }
+
+	CURL *easyInit() {
+		m_easyHandles.push_back(std::make_unique<SimulatedEasyHandle>());
+		return reinterpret_cast<CURL*>(m_easyHandles.back().get());
+	}
+
+	CURLcode easySetopt(CURL *easyHandle, CURLoption option, va_list param) {
+		auto &simulated = simulatedEasyHandle(easyHandle);
+		switch (option) {
+		case CURLOPT_PRIVATE:
+			simulated.privateData = va_arg(param, AbstractTransferHandle*);
+			break;
+		case CURLOPT_WRITEFUNCTION:
+			simulated.writeFunction = va_arg(param, curl_write_callback);
+			break;
+		case CURLOPT_WRITEDATA:
+			simulated.writeData = va_arg(param, void*);
+			break;
+		default:
+			break;
+		}
+		return CURLE_OK;
+	}
+
+	CURLcode easyGetinfo(CURL *easyHandle, CURLINFO info, va_list param) {
+		switch (info) {
+		case CURLINFO_PRIVATE:
+			*va_arg(param, AbstractTransferHandle**) = simulatedEasyHandle(easyHandle).privateData;
+			break;
+		case CURLINFO_RESPONSE_CODE:
+			*va_arg(param, long*) = 200;
+			break;
+		default:
+			return CURLE_UNKNOWN_OPTION;
+		}
+		return CURLE_OK;
+	}
+
+	CURLcode easyPause(CURL *easyHandle, int bitmask) {
+		auto it = m_transfers.find(easyHandle);
+		if ((it == m_transfers.end()) || (bitmask != CURLPAUSE_CONT) || !it->second.isPaused) {
+			return CURLE_OK;
+		}
+
+		// like libcurl, deliver the data received meanwhile from the next timeout
+		it->second.isPaused = false;
+		setDeadline(easyHandle, it->second, m_now);
+		if (!m_isInSocketAction) {
+			updateTimer();
+		}
+		return CURLE_OK;
+	}
+
+	CURLMcode multiAddHandle(CURL *easyHandle) {
+		if (m_isInSocketAction) {
+			return CURLM_RECURSIVE_API_CALL;
+		}
+		if (m_transfers.contains(easyHandle)) {
+			return CURLM_ADDED_ALREADY;
+		}
+
+		const auto script = m_scripts.contains(easyHandle) ? m_scripts[easyHandle] : m_defaultScript;
+		auto &transfer = m_transfers[easyHandle] = SimulatedTransfer { script };
+		++m_numberOfRunningTransfers;
+
+		// like libcurl, start the transfer from the next timeout
+		setDeadline(easyHandle, transfer, m_now);
+		updateTimer();
+		return CURLM_OK;
+	}
+
+	CURLMcode multiRemoveHandle(CURL *easyHandle) {
+		if (m_isInSocketAction) {
+			return CURLM_RECURSIVE_API_CALL;
+		}
+		auto it = m_transfers.find(easyHandle);
+		if (it == m_transfers.end()) {
+			return CURLM_OK;
+		}
+
+		if (it->second.phase != Phase::DONE) {
+			closeSocket(easyHandle, it->second);
+			--m_numberOfRunningTransfers;
+		}
+		m_transfers.erase(it);
+		std::erase_if(m_messages, [easyHandle](const CURLMsg &msg) { return msg.easy_handle == easyHandle; });
+
+		updateTimer();
+		return CURLM_OK;
+	}
+
+	CURLMcode multiSocketAction(curl_socket_t socket, int eventsBitmask, int *runningHandles) {
+		m_isInSocketAction = true;
+
+		if (socket != CURL_SOCKET_TIMEOUT) {
+			auto it = m_transferBySocket.find(socket);
+			if (it != m_transferBySocket.end()) {
+				auto &transfer = m_transfers.at(it->second);
+				const auto isExpectedEvent = ((transfer.pollEvent == CURL_POLL_IN) && (eventsBitmask & CURL_CSELECT_IN))
+					|| ((transfer.pollEvent == CURL_POLL_OUT) && (eventsBitmask & CURL_CSELECT_OUT));
+				if (isExpectedEvent && (transfer.readyAt <= m_now)) {
+					onSocketReady(it->second, transfer);
+				}
+			}
+		}
+
+		// like libcurl, handle expired timeouts on every call
+		while (!m_deadlines.empty() && (m_deadlines.top().time <= m_now)) {
+			const auto event = m_deadlines.top();
+			m_deadlines.pop();
+			auto it = m_transfers.find(event.easyHandle);
+			if ((it != m_transfers.end()) && (it->second.deadlineGeneration == event.generation)) {
+				onDeadline(event.easyHandle, it->second);
+			}
+		}
+
+		m_isInSocketAction = false;
+		*runningHandles = int(m_numberOfRunningTransfers);
+		updateTimer();
+		return CURLM_OK;
+	}
+
+	CURLMsg *multiInfoRead(int *msgsInQueue) {
+		if (m_messages.empty()) {
+			*msgsInQueue = 0;
+			return nullptr;
+		}
+		m_currentMessage = m_messages.front();
+		m_messages.pop_front();
+		*msgsInQueue = int(m_messages.size());
+		return &m_currentMessage;
+	}
+
+	void deliverSocketEvent(CURL *easyHandle) {
+		const auto &transfer = m_transfers.at(easyHandle);
+		auto &registry = NetworkAccessManagerUnitTestHarness().fileDescriptorNotifierRegistry();
+		auto &fdnMap = (transfer.pollEvent == CURL_POLL_OUT) ? registry.writeMap : registry.readMap;
+
+		auto it = fdnMap.find(transfer.socket);
+		if (it == fdnMap.end()) {
+			++m_statistics.numberOfMissedSocketEvents;
+			return;
+		}
+		++m_statistics.numberOfSocketEvents;
+		it->second->triggered.emit(transfer.socket);
+	}
+
+	void onDeadline(CURL *easyHandle, SimulatedTransfer &transfer) {
+		switch (transfer.phase) {
+		case Phase::ADDED:
+			// connecting takes one round trip
+			transfer.phase = Phase::CONNECTING;
+			transfer.socket = m_nextSocket++;
+			m_transferBySocket[transfer.socket] = easyHandle;
+			m_statistics.maxNumberOfOpenSockets = std::max(m_statistics.maxNumberOfOpenSockets, m_transferBySocket.size());
+			setPollEvent(easyHandle, transfer, CURL_POLL_OUT, m_now + 2 * m_config.latencyUs);
+			break;
+		case Phase::WAITING_FOR_CONTINUE:
+			// no "100 Continue" received, send the request body anyway
+			startReceiving(easyHandle, transfer);
+			break;
+		case Phase::RECEIVING:
+			// resumed after a pause
+			receiveSegments(easyHandle, transfer);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void onSocketReady(CURL *easyHandle, SimulatedTransfer &transfer) {
+		switch (transfer.phase) {
+		case Phase::CONNECTING:
+			if (transfer.script.expect100TimeoutMs > 0) {
+				transfer.phase = Phase::WAITING_FOR_CONTINUE;
+				setPollEvent(easyHandle, transfer, CURL_POLL_IN, c_never);
+				setDeadline(easyHandle, transfer, m_now + Microseconds(transfer.script.expect100TimeoutMs) * 1000);
+			} else {
+				startReceiving(easyHandle, transfer);
+			}
+			break;
+		case Phase::RECEIVING:
+			receiveSegments(easyHandle, transfer);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void startReceiving(CURL *easyHandle, SimulatedTransfer &transfer) {
+		// the server starts responding as soon as the request arrived
+		transfer.phase = Phase::RECEIVING;
+		transfer.nextSegmentSent = m_now + m_config.latencyUs;
+		transfer.nextSegmentArrival = segmentArrival(transfer.nextSegmentSent, m_now);
+		setPollEvent(easyHandle, transfer, CURL_POLL_IN, transfer.nextSegmentArrival);
+	}
+
+	void receiveSegments(CURL *easyHandle, SimulatedTransfer &transfer) {
+		if (transfer.script.result != CURLE_OK) {
+			finish(easyHandle, transfer, transfer.script.result);
+			return;
+		}
+
+		auto &simulated = simulatedEasyHandle(easyHandle);
+
+		while ((transfer.nextSegmentArrival <= m_now) && (transfer.bytesReceived < transfer.script.responseSize)) {
+			const auto size = std::min(m_config.segmentSize, transfer.script.responseSize - transfer.bytesReceived);
+			const auto written = simulated.writeFunction ? simulated.writeFunction(m_payload.data(), 1, size, simulated.writeData) : size;
+			if (written == CURL_WRITEFUNC_PAUSE) {
+				// like libcurl, keep the segment and stop polling the socket until the transfer is resumed
+				transfer.isPaused = true;
+				++m_statistics.numberOfPauses;
+				setPollEvent(easyHandle, transfer, CURL_POLL_REMOVE, c_never);
+				return;
+			}
+			if (written != size) {
+				finish(easyHandle, transfer, CURLE_WRITE_ERROR);
+				return;
+			}
+			transfer.bytesReceived += size;
+			transfer.nextSegmentSent += transmissionTime(size);
+			transfer.nextSegmentArrival = segmentArrival(transfer.nextSegmentSent, transfer.nextSegmentArrival);
+		}
+
+		if (transfer.bytesReceived >= transfer.script.responseSize) {
+			finish(easyHandle, transfer, CURLE_OK);
+			return;
+		}
+		setPollEvent(easyHandle, transfer, CURL_POLL_IN, transfer.nextSegmentArrival);
+	}
+
+	void finish(CURL *easyHandle, SimulatedTransfer &transfer, CURLcode result) {
+		closeSocket(easyHandle, transfer);
+		transfer.phase = Phase::DONE;
+		transfer.deadlineGeneration = ++m_generation;
+		--m_numberOfRunningTransfers;
+		++m_statistics.numberOfFinishedTransfers;
+
+		CURLMsg msg {};
+		msg.msg = CURLMSG_DONE;
+		msg.easy_handle = easyHandle;
+		msg.data.result = result;
+		m_messages.push_back(msg);
+	}
+
+	void closeSocket(CURL *easyHandle, SimulatedTransfer &transfer) {
+		if (transfer.socket == CURL_SOCKET_BAD) {
+			return;
+		}
+		setPollEvent(easyHandle, transfer, CURL_POLL_REMOVE, c_never);
+		m_transferBySocket.erase(transfer.socket);
+		transfer.socket = CURL_SOCKET_BAD;
+	}
+
+	void setPollEvent(CURL *easyHandle, SimulatedTransfer &transfer, int pollEvent, Microseconds readyAt) {
+		if (transfer.pollEvent != pollEvent) {
+			transfer.pollEvent = pollEvent;
+			NetworkAccessManagerUnitTestHarness::socketCallback(easyHandle, transfer.socket, pollEvent);
+		}
+		transfer.readyAt = readyAt;
+		transfer.socketGeneration = ++m_generation;
+		if (readyAt != c_never) {
+			m_socketEvents.push(Event { readyAt, m_sequence++, easyHandle, transfer.socketGeneration });
+		}
+	}
+
+	void setDeadline(CURL *easyHandle, SimulatedTransfer &transfer, Microseconds deadline) {
+		transfer.deadlineGeneration = ++m_generation;
+		m_deadlines.push(Event { deadline, m_sequence++, easyHandle, transfer.deadlineGeneration });
+	}
+
+	// like libcurl, only call the timer callback if the next deadline changed
+	void updateTimer() {
+		dropStaleEvents(m_deadlines, [](const SimulatedTransfer &transfer) { return transfer.deadlineGeneration; });
+		const auto deadline = m_deadlines.empty() ? c_never : m_deadlines.top().time;
+		if (deadline == m_reportedDeadline) {
+			return;
+		}
+		m_reportedDeadline = deadline;
+
+		long timeoutMs = -1;
+		if (deadline != c_never) {
+			timeoutMs = (deadline <= m_now) ? 0 : long((deadline - m_now + 999) / 1000);
+		}
+		NetworkAccessManagerUnitTestHarness::timerCallback(nullptr, timeoutMs);
+	}
+
+	void restartTimer() {
+		const auto interval = std::chrono::duration_cast<std::chrono::microseconds>(NetworkAccessManagerUnitTestHarness().timeoutTimer().interval.get());
+		m_timerExpiry = m_now + Microseconds(interval.count());
+	}
+
+	template<typename GenerationOf>
+	void dropStaleEvents(EventQueue &queue, GenerationOf generationOf) {
+		while (!queue.empty()) {
+			auto it = m_transfers.find(queue.top().easyHandle);
+			if ((it != m_transfers.end()) && (generationOf(it->second) == queue.top().generation)) {
+				return;
+			}
+			queue.pop();
+		}
+	}
+
+	Microseconds transmissionTime(std::size_t size) const {
+		return (Microseconds(size) * 1000 + m_config.bandwidthBytesPerMs - 1) / m_config.bandwidthBytesPerMs;
+	}
+
+	// segments are delivered in order, so a lost segment delays all following ones
+	Microseconds segmentArrival(Microseconds sent, Microseconds previousArrival) {
+		auto arrival = sent + transmissionTime(m_config.segmentSize) + m_config.latencyUs;
+		while ((m_config.lossRate > 0.0) && (m_lossDistribution(m_random) < m_config.lossRate)) {
+			++m_statistics.numberOfLostSegments;
+			arrival += m_config.retransmissionTimeoutUs;
+		}
+		return std::max(arrival, previousArrival);
+	}
+
+	const SimulatedNetworkConfig m_config;
+	std::vector<char> m_payload;
+	SimulatedTransferScript m_defaultScript;
+	std::unordered_map<CURL*, SimulatedTransferScript> m_scripts;
+
+	std::mt19937 m_random;
+	std::uniform_real_distribution<double> m_lossDistribution { 0.0, 1.0 };
+
+	Microseconds m_now { 0 };
+	Microseconds m_reportedDeadline { c_never };
+	Microseconds m_timerExpiry { c_never };
+	KDBindings::ConnectionHandle m_timerRunningConnection;
+	KDBindings::ConnectionHandle m_timerIntervalConnection;
+	std::uint64_t m_generation { 0 };
+	std::uint64_t m_sequence { 0 };
+
+	std::deque<std::unique_ptr<SimulatedEasyHandle>> m_easyHandles;
+	std::unordered_map<CURL*, SimulatedTransfer> m_transfers;
+	std::unordered_map<curl_socket_t, CURL*> m_transferBySocket;
+	curl_socket_t m_nextSocket { c_firstSocket };
+	std::size_t m_numberOfRunningTransfers { 0 };
+	bool m_isInSocketAction { false };
+
+	EventQueue m_socketEvents;
+	EventQueue m_deadlines;
+
+	std::deque<CURLMsg> m_messages;
+	CURLMsg m_currentMessage {};
+
+	Statistics m_statistics;
+};
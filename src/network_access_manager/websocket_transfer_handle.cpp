@@ -0,0 +1,238 @@
+#include "websocket_transfer_handle.h"
+#include <algorithm>
+#include <cstdio>
+#include <spdlog/spdlog.h>
+
+namespace {
+constexpr auto c_messageTypeFlags = CURLWS_TEXT | CURLWS_BINARY;
+// the payload of a close frame starts with the status code
+constexpr std::size_t c_closeStatusCodeSize = 2;
+} // namespace
+
+WebSocketTransferHandle::WebSocketTransferHandle(const INetworkAccessManager &networkAccessManager, const Url &url, bool verbose)
+	: AbstractTransferHandle(url, verbose)
+	, m_networkAccessManager{networkAccessManager}
+{
+	// switch off progress meter, the transfer lasts as long as the connection
+	curl_easy_setopt(m_handle, CURLOPT_NOPROGRESS, 1L);
+
+	// the response headers tell whether the connection got upgraded to a WebSocket
+	curl_easy_setopt(m_handle, CURLOPT_HEADERFUNCTION, headerCallback);
+	curl_easy_setopt(m_handle, CURLOPT_HEADERDATA, this);
+
+	m_flushTimer.timeout.connect([this]() {
+		m_flushTimer.running.set(false);
+		flush();
+	});
+	m_finishTimer.timeout.connect([this]() {
+		m_finishTimer.running.set(false);
+		finish(CURLE_OK);
+	});
+}
+
+bool WebSocketTransferHandle::send(std::string_view payload, int flags)
+{
+	const auto state = connectionState.get();
+	if ((state == ConnectionState::CLOSING) || (state == ConnectionState::CLOSED)) {
+		spdlog::warn("WebSocketTransferHandle::send() - connection is closing or closed");
+		return true;
+	}
+
+	m_sendQueue.push_back({ std::string(payload), flags });
+	numberOfQueuedMessages = m_sendQueue.size();
+	scheduleFlush();
+	return false;
+}
+
+bool WebSocketTransferHandle::close(std::uint16_t statusCode, std::string_view reason)
+{
+	// payload of a close frame -> status code in network byte order followed by the reason
+	std::string payload;
+	payload.reserve(2 + reason.size());
+	payload.push_back(static_cast<char>(statusCode >> 8));
+	payload.push_back(static_cast<char>(statusCode & 0xff));
+	payload.append(reason);
+
+	const auto hasError = send(payload, CURLWS_CLOSE);
+	if (!hasError) {
+		connectionState = ConnectionState::CLOSING;
+	}
+	return hasError;
+}
+
+size_t WebSocketTransferHandle::writeCallbackImpl(const char *data, size_t size, size_t nmemb)
+{
+	const size_t realSize = size * nmemb;
+
+	const auto meta = curl_ws_meta(m_handle);
+	if (!meta) {
+		// response body of a failed upgrade
+		return realSize;
+	}
+
+	if (meta->flags & CURLWS_CLOSE) {
+		// the status code is part of the first chunk of the frame
+		if (meta->offset == 0) {
+			onCloseFrameReceived(std::string_view(data, realSize));
+		}
+		return realSize;
+	}
+
+	// libcurl answers PING frames itself
+	if (meta->flags & (CURLWS_PING | CURLWS_PONG)) {
+		return realSize;
+	}
+
+	// CURLWS_CONT -> further frames of this message follow
+	const auto isLastChunkOfMessage = (meta->bytesleft == 0) && !(meta->flags & CURLWS_CONT);
+
+	if (!m_isReceivingFragmentedMessage && isLastChunkOfMessage) {
+		// the whole message arrived in one piece, no need to copy it
+		messageReceived.emit(std::string_view(data, realSize), meta->flags & c_messageTypeFlags);
+		return realSize;
+	}
+
+	if (!m_isReceivingFragmentedMessage) {
+		m_isReceivingFragmentedMessage = true;
+		m_receiveFlags = meta->flags & c_messageTypeFlags;
+	}
+	m_receiveBuffer.append(data, realSize);
+
+	if (isLastChunkOfMessage) {
+		messageReceived.emit(std::string_view(m_receiveBuffer), m_receiveFlags);
+		// keeps the capacity of the buffer for the next message
+		m_receiveBuffer.clear();
+		m_isReceivingFragmentedMessage = false;
+	}
+	return realSize;
+}
+
+void WebSocketTransferHandle::transferDoneCallbackImpl(CURLcode result)
+{
+	m_flushTimer.running = false;
+	m_finishTimer.running = false;
+	m_writeNotifier.reset();
+	m_isWaitingUntilWritable = false;
+	m_isCloseFrameSent = false;
+	m_sendQueue.clear();
+	numberOfQueuedMessages = 0;
+	m_receiveBuffer.clear();
+	m_isReceivingFragmentedMessage = false;
+	connectionState = ConnectionState::CLOSED;
+}
+
+size_t WebSocketTransferHandle::headerCallback(const char *data, size_t size, size_t nmemb, WebSocketTransferHandle *self)
+{
+	const size_t realSize = size * nmemb;
+	const auto header = std::string_view(data, realSize);
+
+	// an empty line terminates the response headers
+	if ((header == "\r\n") || (header == "\n")) {
+		long responseCode = 0;
+		curl_easy_getinfo(self->m_handle, CURLINFO_RESPONSE_CODE, &responseCode);
+		if (responseCode == 101) {
+			self->onConnectionOpened();
+		}
+	}
+	return realSize;
+}
+
+void WebSocketTransferHandle::onConnectionOpened()
+{
+	spdlog::debug("WebSocketTransferHandle::onConnectionOpened() - url:{}", m_url.url());
+	if (connectionState.get() == ConnectionState::CONNECTING) {
+		connectionState = ConnectionState::OPEN;
+	}
+	// messages sent while connecting, including a close frame
+	scheduleFlush();
+}
+
+void WebSocketTransferHandle::onCloseFrameReceived(std::string_view payload)
+{
+	spdlog::debug("WebSocketTransferHandle::onCloseFrameReceived() - url:{}", m_url.url());
+	connectionState = ConnectionState::CLOSING;
+
+	// the peer answered our close frame or closes the connection itself -> answer with its status code
+	if (!m_isCloseFrameSent) {
+		m_flushTimer.running = false;
+		m_sendQueue.clear();
+		numberOfQueuedMessages = 0;
+		const auto statusCode = payload.substr(0, std::min(payload.size(), c_closeStatusCodeSize));
+		size_t sent = 0;
+		const auto rc = curl_ws_send(m_handle, statusCode.data(), statusCode.size(), &sent, 0, CURLWS_CLOSE);
+		if (rc != CURLE_OK) {
+			spdlog::warn("WebSocketTransferHandle::onCloseFrameReceived() - cannot answer close frame: {}", curl_easy_strerror(rc));
+		}
+		m_isCloseFrameSent = true;
+	}
+	m_finishTimer.interval.set(std::chrono::microseconds(1));
+	m_finishTimer.running = true;
+}
+
+void WebSocketTransferHandle::scheduleFlush()
+{
+	if ((connectionState.get() == ConnectionState::CONNECTING) || m_sendQueue.empty() || m_flushTimer.running.get() || m_isWaitingUntilWritable) {
+		return;
+	}
+	m_flushTimer.interval.set(std::chrono::microseconds(1));
+	m_flushTimer.running = true;
+}
+
+void WebSocketTransferHandle::flush()
+{
+	spdlog::debug("WebSocketTransferHandle::flush() - sending {} message(s)", m_sendQueue.size());
+	m_writeNotifier.reset();
+
+	while (!m_sendQueue.empty()) {
+		auto &message = m_sendQueue.front();
+		const auto payload = std::string_view(message.payload).substr(message.numberOfBytesSent);
+		size_t sent = 0;
+		auto rc = curl_ws_send(m_handle, payload.data(), payload.size(), &sent, 0, message.flags);
+		// libcurl keeps track of the frame, the rest of the payload is passed on later
+		message.numberOfBytesSent += sent;
+		const auto isSocketFull = (rc == CURLE_AGAIN) || ((rc == CURLE_OK) && (sent == 0) && !payload.empty());
+		if (isSocketFull) {
+			const auto hasError = waitUntilWritable();
+			if (!hasError) {
+				break;
+			}
+			rc = CURLE_SEND_ERROR;
+		}
+		if (rc != CURLE_OK) {
+			spdlog::error("WebSocketTransferHandle::flush() - sending failed: {}", curl_easy_strerror(rc));
+			std::snprintf(m_errorBuffer, CURL_ERROR_SIZE, "Sending WebSocket message failed: %s", curl_easy_strerror(rc));
+			// finished may destroy this handle -> return right away
+			finish(rc);
+			return;
+		}
+		if (message.numberOfBytesSent < message.payload.size()) {
+			continue;
+		}
+		m_isCloseFrameSent = m_isCloseFrameSent || (message.flags & CURLWS_CLOSE);
+		m_sendQueue.pop_front();
+	}
+	numberOfQueuedMessages = m_sendQueue.size();
+}
+
+bool WebSocketTransferHandle::waitUntilWritable()
+{
+	const auto socket = activeSocket();
+	if (socket == CURL_SOCKET_BAD) {
+		spdlog::error("WebSocketTransferHandle::waitUntilWritable() - no socket to wait for");
+		return true;
+	}
+	m_isWaitingUntilWritable = true;
+	m_writeNotifier = std::make_unique<FileDescriptorNotifier>(socket, FileDescriptorNotifier::NotificationType::Write);
+	m_writeNotifier->triggered.connect([this](int) {
+		// triggers again until flush() deleted the notifier
+		m_isWaitingUntilWritable = false;
+		scheduleFlush();
+	});
+	return false;
+}
+
+void WebSocketTransferHandle::finish(CURLcode result)
+{
+	m_networkAccessManager.unregisterTransfer(*this);
+	transferDoneCallback(result);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "network_access_manager.h"
+#include <KDFoundation/file_descriptor_notifier.h>
+#include <KDFoundation/timer.h>
+#include <cstdint>
+#include <deque>
+#include <kdbindings/property.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+using namespace KDBindings;
+
+/*
+ * Class: WebSocketTransferHandle
+ *
+ * WebSocket connection (ws:// or wss:// url), driven by the NetworkAccessManager
+ * like any other transfer, i.e. through its socket callbacks and event loop integration.
+ * The connection is opened by registering the handle and ends with finished. The handle
+ * unregisters itself when sending fails and once the peer closed the connection
+ * (its close frame is answered with the same status code).
+ *
+ * Incoming messages are delivered by messageReceived as soon as their last frame arrived.
+ * A message received in one piece is passed on without copying it, i.e. the view
+ * refers to libcurl's receive buffer and is valid during the emission only.
+ * Fragmented messages are reassembled in a buffer, which is reused for later messages.
+ * libcurl answers PING frames itself.
+ *
+ * Outgoing messages are queued and sent batched from the event loop,
+ * so sending many messages in a row costs one flush only.
+ * Messages sent before the connection is open are sent once it is.
+ * If the socket cannot take more data, the rest is sent once it is writable again.
+ *
+ * Requires libcurl built with WebSocket support.
+ */
+class WebSocketTransferHandle : public AbstractTransferHandle
+{
+	friend class WebSocketTransferHandleUnitTestHarness;
+
+  public:
+	enum class ConnectionState {
+		CONNECTING,
+		OPEN,
+		CLOSING,
+		CLOSED
+	};
+
+	WebSocketTransferHandle(const INetworkAccessManager &networkAccessManager, const Url &url, bool verbose = false);
+
+	// returns true in case of error, i.e. if the connection is closing or closed
+	bool send(std::string_view payload, int flags = CURLWS_TEXT);
+	bool close(std::uint16_t statusCode = 1000, std::string_view reason = {});
+
+	Property<ConnectionState> connectionState { ConnectionState::CONNECTING };
+	Property<std::size_t> numberOfQueuedMessages { 0 };
+
+	// flags are CURLWS_TEXT or CURLWS_BINARY
+	KDBindings::Signal<std::string_view /*payload*/, int /*flags*/> messageReceived;
+
+  protected:
+	virtual size_t writeCallbackImpl(const char *data, size_t size, size_t nmemb) override;
+	virtual void transferDoneCallbackImpl(CURLcode result) override;
+
+  private:
+	struct OutgoingMessage
+	{
+		std::string payload;
+		int flags;
+		// bytes of the payload libcurl took already
+		std::size_t numberOfBytesSent { 0 };
+	};
+
+	static size_t headerCallback(const char *data, size_t size, size_t nmemb, WebSocketTransferHandle *self);
+
+	void onConnectionOpened();
+	void onCloseFrameReceived(std::string_view payload);
+	void scheduleFlush();
+	void flush();
+	// returns true in case of error (consistent with INetworkAccessManager::registerTransfer())
+	bool waitUntilWritable();
+	// unregisters the transfer, which then finishes with result
+	void finish(CURLcode result);
+
+	std::string m_receiveBuffer;
+	int m_receiveFlags { 0 };
+	bool m_isReceivingFragmentedMessage { false };
+
+	const INetworkAccessManager &m_networkAccessManager;
+
+	std::deque<OutgoingMessage> m_sendQueue;
+	bool m_isCloseFrameSent { false };
+	Timer m_flushTimer;
+	// exists while waiting for the socket to become writable, deleted by flush()
+	// rather than from within its own slot
+	std::unique_ptr<FileDescriptorNotifier> m_writeNotifier;
+	bool m_isWaitingUntilWritable { false };
+	// ends the transfer after the peer closed the connection (not possible from within a libcurl callback)
+	Timer m_finishTimer;
+};